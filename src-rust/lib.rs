@@ -4,20 +4,56 @@ use std::ffi::CStr;
 use std::os::raw::{c_char, c_void};
 use std::ptr;
 use std::slice;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Fonction de comptabilité mémoire fournie par le C : appelée à chaque variation de capacité
+/// des tampons (octets, positive ou négative) ; une hausse refusée (retour non nul) fait
+/// échouer la croissance
+pub type ChargeHook = unsafe extern "C" fn(delta: isize) -> i32;
+
+static CHARGE_HOOK: AtomicUsize = AtomicUsize::new(0);
+
+/// Imputer une hausse de capacité (toujours acceptée sans fonction enregistrée)
+#[inline]
+fn charge(bytes: usize) -> bool {
+    let hook = CHARGE_HOOK.load(Ordering::Relaxed);
+    if hook == 0 || bytes == 0 {
+        return true;
+    }
+    let f: ChargeHook = unsafe { std::mem::transmute(hook) };
+    unsafe { f(bytes as isize) == 0 }
+}
+
+/// Rendre une capacité libérée
+#[inline]
+fn uncharge(bytes: usize) {
+    let hook = CHARGE_HOOK.load(Ordering::Relaxed);
+    if hook == 0 || bytes == 0 {
+        return;
+    }
+    let f: ChargeHook = unsafe { std::mem::transmute(hook) };
+    unsafe { f(-(bytes as isize)) };
+}
 
 /// Structure pour gérer un buffer de manière sécurisée (optimisée)
 #[repr(C)]
 pub struct SafeBuffer {
     data: Vec<u8>,
+    charged: usize, // Capacité imputée au budget mémoire
 }
 
 impl SafeBuffer {
-    /// Créer un nouveau buffer avec une capacité initiale
+    /// Créer un nouveau buffer avec une capacité initiale (None si le budget est dépassé)
     #[inline]
-    pub fn new(initial_capacity: usize) -> Self {
-        Self {
-            data: Vec::with_capacity(initial_capacity.max(64)), // Minimum 64 bytes
+    pub fn new(initial_capacity: usize) -> Option<Self> {
+        let capacity = initial_capacity.max(64); // Minimum 64 bytes
+        if !charge(capacity) {
+            return None;
         }
+        Some(Self {
+            data: Vec::with_capacity(capacity),
+            charged: capacity,
+        })
     }
 
     /// Ajouter des données au buffer (optimisé avec pré-allocation)
@@ -28,7 +64,11 @@ impl SafeBuffer {
         if needed > self.data.capacity() {
             // Croissance exponentielle : 1.5x au lieu de 2x pour économiser la mémoire
             let new_capacity = (self.data.capacity() * 3 / 2).max(needed);
+            if !charge(new_capacity - self.charged) {
+                return Err(());
+            }
             self.data.reserve_exact(new_capacity - self.data.len());
+            self.charged = new_capacity;
         }
         self.data.extend_from_slice(data);
         Ok(())
@@ -53,12 +93,14 @@ impl SafeBuffer {
 
 impl Drop for SafeBuffer {
     #[inline]
-    fn drop(&mut self) {}
+    fn drop(&mut self) {
+        uncharge(self.charged);
+    }
 }
 
 
 fn allocate(size: usize) -> *mut c_void {
-    if size == 0 {
+    if size == 0 || !charge(size) {
         return ptr::null_mut();
     }
     let mut vec = Vec::<u8>::with_capacity(size);
@@ -70,6 +112,7 @@ fn allocate(size: usize) -> *mut c_void {
 unsafe fn deallocate(ptr: *mut c_void, size: usize) {
     if !ptr.is_null() && size > 0 {
         let _ = Vec::from_raw_parts(ptr as *mut u8, 0, size);
+        uncharge(size);
     }
 }
 
@@ -81,6 +124,12 @@ unsafe fn reallocate(ptr: *mut c_void, old_size: usize, new_size: usize) -> *mut
         deallocate(ptr, old_size);
         return ptr::null_mut();
     }
+    if new_size > old_size && !charge(new_size - old_size) {
+        return ptr::null_mut(); // Ancien bloc inchangé
+    }
+    if new_size < old_size {
+        uncharge(old_size - new_size);
+    }
     let mut old_vec = Vec::from_raw_parts(ptr as *mut u8, 0, old_size);
     if new_size > old_size {
         old_vec.reserve_exact(new_size - old_size);
@@ -91,7 +140,7 @@ unsafe fn reallocate(ptr: *mut c_void, old_size: usize, new_size: usize) -> *mut
     let new_cap = old_vec.capacity();
     std::mem::forget(old_vec);
     if new_cap < new_size {
-        let new_vec = Vec::<u8>::with_capacity(new_size);
+        let mut new_vec = Vec::<u8>::with_capacity(new_size);
         let new_ptr2 = new_vec.as_mut_ptr();
         std::mem::forget(new_vec);
         new_ptr2 as *mut c_void
@@ -130,7 +179,320 @@ pub fn escape_json_string(input: &str) -> String {
     output
 }
 
+// ============================================================================
+// Rédacteur JSON (échappement à l'ingestion)
+// ============================================================================
+
+/// Conteneur ouvert dans un JsonWriter
+struct JsonScope {
+    object: bool,
+    first: bool,
+}
+
+/// Construit un document JSON dans un tampon alloué par malloc : les chaînes sont échappées
+/// au fil des morceaux reçus et le C récupère le document sans copie (rust_json_finish),
+/// puis le libère avec free()
+pub struct JsonWriter {
+    buf: *mut u8,
+    len: usize,
+    cap: usize,
+    scopes: Vec<JsonScope>,
+    after_key: bool,
+    in_string: bool,
+    pending: [u8; 4], // Séquence UTF-8 coupée entre deux morceaux
+    pending_len: usize,
+    failed: bool,
+}
+
+/// Longueur d'une séquence UTF-8 d'après son premier octet
+#[inline]
+fn utf8_sequence_len(lead: u8) -> usize {
+    match lead {
+        0xC2..=0xDF => 2,
+        0xE0..=0xEF => 3,
+        0xF0..=0xF4 => 4,
+        _ => 1,
+    }
+}
+
+impl JsonWriter {
+    pub fn new(initial_capacity: usize) -> Option<Self> {
+        let cap = initial_capacity.max(64);
+        if !charge(cap) {
+            return None;
+        }
+        let buf = unsafe { libc::malloc(cap) as *mut u8 };
+        if buf.is_null() {
+            uncharge(cap);
+            return None;
+        }
+        Some(Self {
+            buf,
+            len: 0,
+            cap,
+            scopes: Vec::new(),
+            after_key: false,
+            in_string: false,
+            pending: [0; 4],
+            pending_len: 0,
+            failed: false,
+        })
+    }
 
+    #[inline]
+    fn reserve(&mut self, extra: usize) -> bool {
+        let needed = self.len + extra + 1; // + '\0' final
+        if needed <= self.cap {
+            return true;
+        }
+        let new_cap = (self.cap * 3 / 2).max(needed);
+        if !charge(new_cap - self.cap) {
+            self.failed = true;
+            return false;
+        }
+        let grown = unsafe { libc::realloc(self.buf as *mut c_void, new_cap) as *mut u8 };
+        if grown.is_null() {
+            uncharge(new_cap - self.cap);
+            self.failed = true;
+            return false;
+        }
+        self.buf = grown;
+        self.cap = new_cap;
+        true
+    }
+
+    #[inline]
+    fn push(&mut self, data: &[u8]) -> bool {
+        if !self.reserve(data.len()) {
+            return false;
+        }
+        unsafe { ptr::copy_nonoverlapping(data.as_ptr(), self.buf.add(self.len), data.len()) };
+        self.len += data.len();
+        true
+    }
+
+    /// Virgule et contrôle de position avant une valeur
+    fn value_prefix(&mut self) -> bool {
+        if self.failed || self.in_string {
+            self.failed = true;
+            return false;
+        }
+        if self.after_key {
+            self.after_key = false;
+            return true;
+        }
+        match self.scopes.last_mut() {
+            Some(scope) if !scope.object => {
+                let first = scope.first;
+                scope.first = false;
+                first || self.push(b",")
+            }
+            None if self.len == 0 => true,
+            _ => {
+                // Valeur sans clé dans un objet, ou seconde valeur de premier niveau
+                self.failed = true;
+                false
+            }
+        }
+    }
+
+    /// Échapper une portion UTF-8 valide (les suites sans caractère spécial sont copiées d'un bloc)
+    fn escape_valid(&mut self, bytes: &[u8]) -> bool {
+        if !self.reserve(bytes.len()) {
+            return false;
+        }
+        let mut start = 0;
+        for (i, &b) in bytes.iter().enumerate() {
+            let escaped: &[u8] = match b {
+                b'"' => b"\\\"",
+                b'\\' => b"\\\\",
+                b'\n' => b"\\n",
+                b'\r' => b"\\r",
+                b'\t' => b"\\t",
+                0x08 => b"\\b",
+                0x0c => b"\\f",
+                0x00..=0x1f => b"",
+                _ => continue,
+            };
+            if !self.push(&bytes[start..i]) {
+                return false;
+            }
+            let ok = if escaped.is_empty() {
+                let hex = b"0123456789abcdef";
+                self.push(&[b'\\', b'u', b'0', b'0', hex[(b >> 4) as usize], hex[(b & 0xf) as usize]])
+            } else {
+                self.push(escaped)
+            };
+            if !ok {
+                return false;
+            }
+            start = i + 1;
+        }
+        self.push(&bytes[start..])
+    }
+
+    /// Échapper des octets bruts ; une séquence UTF-8 invalide devient U+FFFD, une séquence
+    /// coupée en fin de morceau est complétée par le morceau suivant
+    fn escape_bytes(&mut self, mut data: &[u8]) -> bool {
+        if self.pending_len > 0 {
+            let expected = utf8_sequence_len(self.pending[0]);
+            let take = (expected - self.pending_len).min(data.len());
+            let mut seq = [0u8; 4];
+            seq[..self.pending_len].copy_from_slice(&self.pending[..self.pending_len]);
+            seq[self.pending_len..self.pending_len + take].copy_from_slice(&data[..take]);
+            let have = self.pending_len + take;
+            match std::str::from_utf8(&seq[..have]) {
+                Ok(_) => {
+                    self.pending_len = 0;
+                    if !self.push(&seq[..have]) {
+                        return false;
+                    }
+                    data = &data[take..];
+                }
+                Err(e) if e.error_len().is_none() => {
+                    // Toujours incomplète : le morceau était trop court
+                    self.pending[..have].copy_from_slice(&seq[..have]);
+                    self.pending_len = have;
+                    return true;
+                }
+                Err(_) => {
+                    // Début invalide : remplacé, les octets suivants sont traités normalement
+                    self.pending_len = 0;
+                    if !self.push("\u{FFFD}".as_bytes()) {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        loop {
+            match std::str::from_utf8(data) {
+                Ok(valid) => return self.escape_valid(valid.as_bytes()),
+                Err(e) => {
+                    let (valid, rest) = data.split_at(e.valid_up_to());
+                    if !self.escape_valid(valid) {
+                        return false;
+                    }
+                    match e.error_len() {
+                        Some(n) => {
+                            if !self.push("\u{FFFD}".as_bytes()) {
+                                return false;
+                            }
+                            data = &rest[n..];
+                        }
+                        None => {
+                            self.pending[..rest.len()].copy_from_slice(rest);
+                            self.pending_len = rest.len();
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    pub fn begin(&mut self, object: bool) -> bool {
+        if !self.value_prefix() || !self.push(if object { b"{" } else { b"[" }) {
+            return false;
+        }
+        self.scopes.push(JsonScope { object, first: true });
+        true
+    }
+
+    pub fn end(&mut self, object: bool) -> bool {
+        match self.scopes.last() {
+            Some(scope) if scope.object == object && !self.after_key && !self.in_string && !self.failed => {
+                self.scopes.pop();
+                self.push(if object { b"}" } else { b"]" })
+            }
+            _ => {
+                self.failed = true;
+                false
+            }
+        }
+    }
+
+    pub fn key(&mut self, key: &[u8]) -> bool {
+        let first = match self.scopes.last_mut() {
+            Some(scope) if scope.object && !self.after_key && !self.in_string && !self.failed => {
+                let first = scope.first;
+                scope.first = false;
+                first
+            }
+            _ => {
+                self.failed = true;
+                return false;
+            }
+        };
+        if (!first && !self.push(b",")) || !self.push(b"\"") {
+            return false;
+        }
+        let ok = self.escape_bytes(key) && self.flush_pending() && self.push(b"\":");
+        self.after_key = ok;
+        ok
+    }
+
+    fn flush_pending(&mut self) -> bool {
+        if self.pending_len == 0 {
+            return true;
+        }
+        self.pending_len = 0;
+        self.push("\u{FFFD}".as_bytes())
+    }
+
+    pub fn string_begin(&mut self) -> bool {
+        if !self.value_prefix() || !self.push(b"\"") {
+            return false;
+        }
+        self.in_string = true;
+        self.pending_len = 0;
+        true
+    }
+
+    pub fn string_append(&mut self, data: &[u8]) -> bool {
+        if !self.in_string || self.failed {
+            self.failed = true;
+            return false;
+        }
+        self.escape_bytes(data)
+    }
+
+    pub fn string_end(&mut self) -> bool {
+        if !self.in_string || self.failed {
+            self.failed = true;
+            return false;
+        }
+        self.in_string = false;
+        self.flush_pending() && self.push(b"\"")
+    }
+
+    /// Valeur déjà encodée (nombre, booléen, document JSON), copiée telle quelle
+    pub fn raw(&mut self, json: &[u8]) -> bool {
+        self.value_prefix() && self.push(json)
+    }
+
+    /// Document terminé et terminé par '\0' ; le tampon appartient ensuite à l'appelant
+    /// (et sort de la comptabilité : le C impute la réponse qu'il envoie)
+    pub fn finish(mut self) -> Option<(*mut u8, usize)> {
+        if self.failed || self.in_string || !self.scopes.is_empty() || self.len == 0 || !self.reserve(0) {
+            return None;
+        }
+        unsafe { *self.buf.add(self.len) = 0 };
+        let result = (self.buf, self.len);
+        self.buf = ptr::null_mut();
+        uncharge(self.cap);
+        Some(result)
+    }
+}
+
+impl Drop for JsonWriter {
+    fn drop(&mut self) {
+        if !self.buf.is_null() {
+            unsafe { libc::free(self.buf as *mut c_void) };
+            uncharge(self.cap);
+        }
+    }
+}
 
 // ============================================================================
 // Interface FFI pour le code C
@@ -139,8 +501,10 @@ pub fn escape_json_string(input: &str) -> String {
 /// Allouer un buffer sécurisé (retourné comme pointeur opaque)
 #[no_mangle]
 pub extern "C" fn rust_buffer_new(initial_capacity: usize) -> *mut c_void {
-    let buffer = Box::new(SafeBuffer::new(initial_capacity));
-    Box::into_raw(buffer) as *mut c_void
+    match SafeBuffer::new(initial_capacity) {
+        Some(buffer) => Box::into_raw(Box::new(buffer)) as *mut c_void,
+        None => ptr::null_mut(),
+    }
 }
 
 /// Ajouter des données au buffer (optimisé)
@@ -197,6 +561,12 @@ pub unsafe extern "C" fn rust_buffer_free(buffer_ptr: *mut c_void) {
     }
 }
 
+/// Enregistrer la fonction de comptabilité mémoire (NULL pour la retirer)
+#[no_mangle]
+pub extern "C" fn rust_set_charge_hook(hook: Option<ChargeHook>) {
+    CHARGE_HOOK.store(hook.map_or(0, |f| f as usize), Ordering::Relaxed);
+}
+
 #[no_mangle]
 pub extern "C" fn rust_malloc(size: usize) -> *mut c_void {
     allocate(size)
@@ -240,7 +610,7 @@ pub unsafe extern "C" fn rust_escape_json(
         if c_str.len() >= output_size {
             return -1;
         }
-        ptr::copy_nonoverlapping(c_str.as_ptr(), output, c_str.len());
+        ptr::copy_nonoverlapping(c_str.as_ptr(), output as *mut u8, c_str.len());
         *output.add(c_str.len()) = 0;
         return c_str.len() as i32;
     }
@@ -270,3 +640,238 @@ pub unsafe extern "C" fn rust_memcpy(
     0
 }
 
+
+// ============================================================================
+// Rédacteur JSON (FFI)
+// ============================================================================
+
+#[inline]
+unsafe fn json_writer<'a>(writer: *mut c_void) -> Option<&'a mut JsonWriter> {
+    (writer as *mut JsonWriter).as_mut()
+}
+
+#[inline]
+unsafe fn bytes<'a>(data: *const u8, len: usize) -> &'a [u8] {
+    if data.is_null() || len == 0 {
+        &[]
+    } else {
+        slice::from_raw_parts(data, len)
+    }
+}
+
+#[inline]
+fn status(ok: bool) -> i32 {
+    if ok { 0 } else { -1 }
+}
+
+#[no_mangle]
+pub extern "C" fn rust_json_new(initial_capacity: usize) -> *mut c_void {
+    match JsonWriter::new(initial_capacity) {
+        Some(writer) => Box::into_raw(Box::new(writer)) as *mut c_void,
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_begin_object(writer: *mut c_void) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.begin(true)))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_end_object(writer: *mut c_void) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.end(true)))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_begin_array(writer: *mut c_void) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.begin(false)))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_end_array(writer: *mut c_void) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.end(false)))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_key(writer: *mut c_void, key: *const c_char) -> i32 {
+    if key.is_null() {
+        return -1;
+    }
+    json_writer(writer).map_or(-1, |w| status(w.key(CStr::from_ptr(key).to_bytes())))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_string(writer: *mut c_void, value: *const c_char) -> i32 {
+    let value = if value.is_null() { &[][..] } else { CStr::from_ptr(value).to_bytes() };
+    json_writer(writer).map_or(-1, |w| status(w.string_begin() && w.string_append(value) && w.string_end()))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_string_begin(writer: *mut c_void) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.string_begin()))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_string_append(writer: *mut c_void, data: *const u8, len: usize) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.string_append(bytes(data, len))))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_string_end(writer: *mut c_void) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.string_end()))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_int(writer: *mut c_void, value: i64) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.raw(value.to_string().as_bytes())))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_uint(writer: *mut c_void, value: u64) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.raw(value.to_string().as_bytes())))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_bool(writer: *mut c_void, value: bool) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.raw(if value { b"true" } else { b"false" })))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_raw(writer: *mut c_void, json: *const u8, len: usize) -> i32 {
+    json_writer(writer).map_or(-1, |w| status(w.raw(bytes(json, len))))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_len(writer: *const c_void) -> usize {
+    (writer as *const JsonWriter).as_ref().map_or(0, |w| w.len)
+}
+
+/// Terminer le document : le rédacteur est libéré, le tampon (terminé par '\0') est rendu
+/// à l'appelant qui le libère avec free() ; NULL si le document est invalide ou incomplet
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_finish(writer: *mut c_void, len: *mut usize) -> *mut c_char {
+    if writer.is_null() {
+        return ptr::null_mut();
+    }
+    let writer = Box::from_raw(writer as *mut JsonWriter);
+    match writer.finish() {
+        Some((buf, n)) => {
+            if !len.is_null() {
+                *len = n;
+            }
+            buf as *mut c_char
+        }
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_json_free(writer: *mut c_void) {
+    if !writer.is_null() {
+        let _ = Box::from_raw(writer as *mut JsonWriter);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Document rendu par finish(), tampon rendu à malloc
+    fn finish_to_string(writer: JsonWriter) -> Option<String> {
+        let (buf, len) = writer.finish()?;
+        let bytes = unsafe { std::slice::from_raw_parts(buf, len).to_vec() };
+        unsafe { libc::free(buf as *mut c_void) };
+        Some(String::from_utf8(bytes).expect("le document doit être de l'UTF-8 valide"))
+    }
+
+    /// Chaîne JSON construite à partir des morceaux donnés
+    fn string_from_chunks(chunks: &[&[u8]]) -> String {
+        let mut w = JsonWriter::new(16).unwrap();
+        assert!(w.string_begin());
+        for chunk in chunks {
+            assert!(w.string_append(chunk));
+        }
+        assert!(w.string_end());
+        finish_to_string(w).unwrap()
+    }
+
+    #[test]
+    fn multibyte_split_at_every_point() {
+        let text = "aé€😀z".as_bytes();
+        let expected = "\"aé€😀z\"";
+        for i in 0..=text.len() {
+            for j in i..=text.len() {
+                let got = string_from_chunks(&[&text[..i], &text[i..j], &text[j..]]);
+                assert_eq!(got, expected, "coupures en {} et {}", i, j);
+            }
+        }
+    }
+
+    #[test]
+    fn multibyte_one_byte_at_a_time() {
+        let text = "€😀é".as_bytes();
+        let chunks: Vec<&[u8]> = text.chunks(1).collect();
+        assert_eq!(string_from_chunks(&chunks), "\"€😀é\"");
+    }
+
+    #[test]
+    fn invalid_bytes_become_replacement() {
+        assert_eq!(string_from_chunks(&[b"a\xffb"]), "\"a\u{FFFD}b\"");
+        assert_eq!(string_from_chunks(&[b"\x80x"]), "\"\u{FFFD}x\"");
+        assert_eq!(string_from_chunks(&[b"\xc0\x80"]), "\"\u{FFFD}\u{FFFD}\"");
+    }
+
+    #[test]
+    fn invalid_continuation_across_chunks() {
+        // Début de séquence de 3 octets suivi d'un ASCII dans le morceau suivant
+        assert_eq!(string_from_chunks(&[b"x\xe2", b"A"]), "\"x\u{FFFD}A\"");
+        assert_eq!(string_from_chunks(&[b"\xe2\x82", b"\""]), "\"\u{FFFD}\\\"\"");
+    }
+
+    #[test]
+    fn trailing_truncated_sequence() {
+        assert_eq!(string_from_chunks(&[b"ok\xe2\x82"]), "\"ok\u{FFFD}\"");
+        assert_eq!(string_from_chunks(&[b"ok", b"\xf0\x9f", b"\x98"]), "\"ok\u{FFFD}\"");
+    }
+
+    #[test]
+    fn control_characters_are_escaped() {
+        assert_eq!(
+            string_from_chunks(&[b"\"\\\n\r\t\x08\x0c\x01\x1f\x7f"]),
+            "\"\\\"\\\\\\n\\r\\t\\b\\f\\u0001\\u001f\x7f\""
+        );
+        // Un caractère à échapper juste après une séquence coupée
+        assert_eq!(string_from_chunks(&[b"\xc3", b"\xa9\n"]), "\"é\\n\"");
+    }
+
+    #[test]
+    fn object_with_keys_and_values() {
+        let mut w = JsonWriter::new(0).unwrap();
+        assert!(w.begin(true));
+        assert!(w.key(b"out\"put"));
+        assert!(w.string_begin() && w.string_append(b"l1\nl2") && w.string_end());
+        assert!(w.key(b"codes"));
+        assert!(w.begin(false));
+        assert!(w.raw(b"0") && w.raw(b"-1"));
+        assert!(w.end(false));
+        assert!(w.end(true));
+        assert_eq!(
+            finish_to_string(w).unwrap(),
+            "{\"out\\\"put\":\"l1\\nl2\",\"codes\":[0,-1]}"
+        );
+    }
+
+    #[test]
+    fn misuse_invalidates_document() {
+        // Valeur sans clé dans un objet
+        let mut w = JsonWriter::new(0).unwrap();
+        assert!(w.begin(true));
+        assert!(!w.raw(b"1"));
+        assert!(finish_to_string(w).is_none());
+
+        // Chaîne non terminée
+        let mut w = JsonWriter::new(0).unwrap();
+        assert!(w.string_begin() && w.string_append(b"x"));
+        assert!(finish_to_string(w).is_none());
+    }
+}
@@ -10,6 +10,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -82,6 +83,14 @@ void rust_free(void* ptr, size_t size);
  */
 void* rust_realloc(void* ptr, size_t old_size, size_t new_size);
 
+/**
+ * Enregistrer la fonction de comptabilité mémoire
+ * Appelée à chaque variation de capacité des buffers, allocations et rédacteurs JSON
+ * (delta en bytes, négatif à la libération) ; une hausse refusée (retour non nul) fait
+ * échouer l'allocation ou l'ajout. NULL pour la retirer.
+ */
+void rust_set_charge_hook(int (*hook)(ptrdiff_t delta));
+
 // ============================================================================
 // Utilitaires
 // ============================================================================
@@ -104,6 +113,72 @@ int rust_escape_json(const char* input, char* output, size_t output_size);
  */
 int rust_memcpy(void* dest, const void* src, size_t n);
 
+// ============================================================================
+// Rédacteur JSON (échappement à l'ingestion)
+// ============================================================================
+
+/**
+ * Créer un rédacteur JSON
+ * Les chaînes sont échappées au fil des morceaux ajoutés (UTF-8 invalide remplacé par
+ * U+FFFD) ; le document final est rendu sans copie par rust_json_finish
+ * @param initial_capacity Capacité initiale en bytes
+ * @return Pointeur opaque, ou NULL en cas d'erreur
+ */
+void* rust_json_new(size_t initial_capacity);
+
+/**
+ * Ouvrir / fermer un objet ou un tableau
+ * @return 0 en cas de succès, -1 en cas d'erreur (le document devient invalide)
+ */
+int rust_json_begin_object(void* writer);
+int rust_json_end_object(void* writer);
+int rust_json_begin_array(void* writer);
+int rust_json_end_array(void* writer);
+
+/**
+ * Écrire la clé du prochain membre d'objet (échappée)
+ */
+int rust_json_key(void* writer, const char* key);
+
+/**
+ * Écrire une chaîne complète (null-terminated, NULL = chaîne vide)
+ */
+int rust_json_string(void* writer, const char* value);
+
+/**
+ * Écrire une chaîne par morceaux : begin, append (octets bruts, échappés à l'ajout), end
+ * Une séquence UTF-8 coupée entre deux morceaux est reconstituée
+ */
+int rust_json_string_begin(void* writer);
+int rust_json_string_append(void* writer, const void* data, size_t len);
+int rust_json_string_end(void* writer);
+
+/**
+ * Écrire un nombre, un booléen, ou une valeur déjà encodée en JSON (copiée telle quelle)
+ */
+int rust_json_int(void* writer, int64_t value);
+int rust_json_uint(void* writer, uint64_t value);
+int rust_json_bool(void* writer, bool value);
+int rust_json_raw(void* writer, const char* json, size_t len);
+
+/**
+ * Taille actuelle du document en bytes
+ */
+size_t rust_json_len(const void* writer);
+
+/**
+ * Terminer le document et libérer le rédacteur
+ * @param len Longueur du document (peut être NULL)
+ * @return Document terminé par '\0', à libérer avec free(), ou NULL si invalide ou incomplet
+ *         (le document sort alors de la comptabilité mémoire)
+ */
+char* rust_json_finish(void* writer, size_t* len);
+
+/**
+ * Libérer un rédacteur sans produire de document
+ */
+void rust_json_free(void* writer);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,437 @@
+/**
+ * Contrôle d'admission - Rejet rapide (RESP_BUSY) plutôt que dégradation sous charge
+ *
+ * Deux niveaux :
+ * - requêtes en cours : limite globale et par processus client (pid du pair Unix),
+ *   dépassement = rejet immédiat
+ * - opérations SSH : nombre borné en parallèle, les suivantes attendent jusqu'à
+ *   queue_timeout_ms puis sont rejetées
+ * Le délai de nouvelle tentative est estimé à partir de la durée moyenne des opérations.
+ *
+ * Les opérations SSH en attente sont ordonnancées (deficit round robin) : un flux par
+ * client et par poids, chaque flux servant ses files de sessions à tour de rôle. À chaque
+ * passage, un flux reçoit un crédit égal à son poids et une place libérée coûte 1 : un
+ * client qui lance un fan-out de 500 hôtes n'obtient que sa part, et une requête
+ * interactive passe dès la prochaine place libre. Une opération dont l'hôte a déjà
+ * max_per_host opérations en cours reste en file sans bloquer les autres ; un relais
+ * entre sessions compte sur ses deux hôtes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "admission.h"
+#include "agent.h"
+
+#define MAX_TRACKED_CLIENTS 256
+#define MAX_FLOWS 256
+#define MIN_RETRY_AFTER_MS 50
+#define MAX_RETRY_AFTER_MS 30000
+
+typedef struct {
+    pid_t pid;
+    int inflight;
+} client_slot_t;
+
+// Opération en attente (sur la pile du thread de la requête)
+typedef struct ticket {
+    const admission_work_t *work;
+    pthread_cond_t cond;
+    bool granted;
+    struct session_queue *queue;
+    struct ticket *next;
+} ticket_t;
+
+// File FIFO des opérations d'une session, dans un flux
+typedef struct session_queue {
+    char key[64];
+    ticket_t *head;
+    ticket_t *tail;
+    struct session_queue *next;
+} session_queue_t;
+
+// Flux (client, poids) : ses files de sessions sont servies à tour de rôle
+typedef struct {
+    pid_t pid;
+    int weight;
+    int deficit;
+    int queued;                 // 0 = emplacement libre
+    session_queue_t *queues;    // La première file est la prochaine servie
+} flow_t;
+
+typedef struct host_count {
+    char host[256];
+    int running;
+    struct host_count *next;
+} host_count_t;
+
+static admission_config_t config = {
+    ADMISSION_DEFAULT_MAX_INFLIGHT,
+    ADMISSION_DEFAULT_MAX_PER_CLIENT,
+    ADMISSION_DEFAULT_MAX_SSH_WORK,
+    ADMISSION_DEFAULT_QUEUE_TIMEOUT_MS,
+    ADMISSION_DEFAULT_MAX_PER_HOST
+};
+
+static pthread_mutex_t admission_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_condattr_t ticket_cond_attr;
+static client_slot_t clients[MAX_TRACKED_CLIENTS];
+static flow_t flows[MAX_FLOWS];
+static int flow_cursor = 0;
+static int active_flows = 0;
+static host_count_t *hosts = NULL;     // Hôtes ayant des opérations en cours
+static int inflight = 0;
+static int ssh_running = 0;
+static int ssh_queued = 0;
+static double avg_ssh_ms = 100.0;      // Moyenne glissante de la durée des opérations SSH
+
+static uint64_t stat_rejected = 0;
+static uint64_t stat_expired = 0;
+static uint64_t stat_host_deferred = 0;    // Passages où un hôte saturé a retenu une opération
+static uint64_t stat_granted[3];           // Par classe de poids : batch, normal, interactive
+
+static int env_int(const char *name, int def) {
+    const char *value = getenv(name);
+    if (!value) return def;
+    int v = atoi(value);
+    return v > 0 ? v : def;
+}
+
+/**
+ * Lire les limites depuis l'environnement
+ */
+void admission_config_from_env(admission_config_t *cfg) {
+    cfg->max_inflight = env_int("KROWN_MAX_INFLIGHT", ADMISSION_DEFAULT_MAX_INFLIGHT);
+    cfg->max_per_client = env_int("KROWN_MAX_INFLIGHT_PER_CLIENT", ADMISSION_DEFAULT_MAX_PER_CLIENT);
+    cfg->max_ssh_work = env_int("KROWN_MAX_SSH_WORK", ADMISSION_DEFAULT_MAX_SSH_WORK);
+    cfg->queue_timeout_ms = env_int("KROWN_QUEUE_TIMEOUT_MS", ADMISSION_DEFAULT_QUEUE_TIMEOUT_MS);
+    cfg->max_per_host = env_int("KROWN_MAX_SSH_PER_HOST", ADMISSION_DEFAULT_MAX_PER_HOST);
+}
+
+void admission_init(const admission_config_t *cfg) {
+    // L'attente de la file utilise l'horloge monotone (insensible aux changements d'heure)
+    pthread_condattr_init(&ticket_cond_attr);
+    pthread_condattr_setclock(&ticket_cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&admission_mutex);
+    if (cfg) config = *cfg;
+    memset(clients, 0, sizeof(clients));
+    pthread_mutex_unlock(&admission_mutex);
+    DEBUG_PRINT("[Admission] Limites: %d en cours, %d par client, %d opérations SSH (%d par hôte), file %d ms\n",
+                config.max_inflight, config.max_per_client, config.max_ssh_work, config.max_per_host,
+                config.queue_timeout_ms);
+}
+
+/**
+ * Identifier le client (pid du processus pair, 0 si inconnu)
+ */
+pid_t admission_client_id(int client_fd) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) return 0;
+    return cred.pid;
+}
+
+static client_slot_t* find_client_locked(pid_t pid, bool create) {
+    client_slot_t *free_slot = NULL;
+    for (int i = 0; i < MAX_TRACKED_CLIENTS; i++) {
+        if (clients[i].inflight > 0 && clients[i].pid == pid) return &clients[i];
+        if (!free_slot && clients[i].inflight == 0) free_slot = &clients[i];
+    }
+    if (create && free_slot) free_slot->pid = pid;
+    return create ? free_slot : NULL;
+}
+
+/**
+ * Délai conseillé avant de réessayer : temps estimé pour écouler la file actuelle
+ */
+static uint32_t retry_after_locked(void) {
+    double estimate = avg_ssh_ms * (ssh_queued + 1) / (config.max_ssh_work > 0 ? config.max_ssh_work : 1);
+    if (estimate < MIN_RETRY_AFTER_MS) estimate = MIN_RETRY_AFTER_MS;
+    if (estimate > MAX_RETRY_AFTER_MS) estimate = MAX_RETRY_AFTER_MS;
+    return (uint32_t)estimate;
+}
+
+/**
+ * Admettre une requête (rejet immédiat si les limites sont atteintes)
+ */
+bool admission_enter(pid_t client, uint32_t *retry_after_ms) {
+    pthread_mutex_lock(&admission_mutex);
+    client_slot_t *slot = find_client_locked(client, true);
+    if (inflight >= config.max_inflight || !slot || slot->inflight >= config.max_per_client) {
+        stat_rejected++;
+        *retry_after_ms = retry_after_locked();
+        pthread_mutex_unlock(&admission_mutex);
+        return false;
+    }
+    inflight++;
+    slot->inflight++;
+    pthread_mutex_unlock(&admission_mutex);
+    return true;
+}
+
+void admission_leave(pid_t client) {
+    pthread_mutex_lock(&admission_mutex);
+    client_slot_t *slot = find_client_locked(client, false);
+    if (slot) slot->inflight--;
+    inflight--;
+    pthread_mutex_unlock(&admission_mutex);
+}
+
+/**
+ * Poids d'une opération : "weight" explicite (borné), sinon la priorité nommée
+ * (interactive, normal, batch), sinon normal
+ */
+int admission_parse_weight(const char *priority, int weight) {
+    if (weight > 0) return weight > ADMISSION_MAX_WEIGHT ? ADMISSION_MAX_WEIGHT : weight;
+    if (priority && strcmp(priority, "interactive") == 0) return ADMISSION_WEIGHT_INTERACTIVE;
+    if (priority && strcmp(priority, "batch") == 0) return ADMISSION_WEIGHT_BATCH;
+    return ADMISSION_WEIGHT_NORMAL;
+}
+
+static host_count_t* find_host_locked(const char *host, bool create) {
+    for (host_count_t *h = hosts; h; h = h->next) {
+        if (strcmp(h->host, host) == 0) return h;
+    }
+    if (!create) return NULL;
+    host_count_t *h = calloc(1, sizeof(host_count_t));
+    if (!h) return NULL;
+    snprintf(h->host, sizeof(h->host), "%s", host);
+    h->next = hosts;
+    hosts = h;
+    return h;
+}
+
+static bool host_available_locked(const char *host) {
+    if (!host[0]) return true;
+    host_count_t *h = find_host_locked(host, false);
+    return !h || h->running < config.max_per_host;
+}
+
+static void host_take_locked(const char *host) {
+    if (!host[0]) return;
+    host_count_t *h = find_host_locked(host, true);
+    if (h) h->running++;
+}
+
+static void host_release_locked(const char *host) {
+    if (!host[0]) return;
+    host_count_t **link = &hosts;
+    while (*link && strcmp((*link)->host, host) != 0) link = &(*link)->next;
+    host_count_t *h = *link;
+    if (h && --h->running <= 0) {
+        *link = h->next;
+        free(h);
+    }
+}
+
+static flow_t* find_flow_locked(pid_t pid, int weight) {
+    flow_t *free_slot = NULL;
+    for (int i = 0; i < MAX_FLOWS; i++) {
+        if (flows[i].queued > 0 && flows[i].pid == pid && flows[i].weight == weight) return &flows[i];
+        if (!free_slot && flows[i].queued == 0) free_slot = &flows[i];
+    }
+    if (free_slot) {
+        free_slot->pid = pid;
+        free_slot->weight = weight;
+        free_slot->deficit = 0;
+        free_slot->queues = NULL;
+    }
+    return free_slot;
+}
+
+/**
+ * Mettre une opération en file : file de sa session dans le flux (client, poids)
+ */
+static bool enqueue_locked(ticket_t *t) {
+    flow_t *flow = find_flow_locked(t->work->client, t->work->weight);
+    if (!flow) return false;
+
+    session_queue_t **link = &flow->queues;
+    while (*link && strcmp((*link)->key, t->work->session_key) != 0) link = &(*link)->next;
+    session_queue_t *q = *link;
+    if (!q) {
+        q = calloc(1, sizeof(session_queue_t));
+        if (!q) return false;
+        snprintf(q->key, sizeof(q->key), "%s", t->work->session_key);
+        *link = q;
+    }
+    if (q->tail) q->tail->next = t;
+    else q->head = t;
+    q->tail = t;
+    t->queue = q;
+    if (flow->queued++ == 0) active_flows++;
+    ssh_queued++;
+    return true;
+}
+
+/**
+ * Retirer une opération de sa file (servie ou abandonnée) ; une file vide disparaît,
+ * un flux vide libère son emplacement
+ */
+static void dequeue_locked(flow_t *flow, ticket_t *t) {
+    session_queue_t *q = t->queue;
+    ticket_t **tl = &q->head;
+    ticket_t *prev = NULL;
+    while (*tl && *tl != t) {
+        prev = *tl;
+        tl = &(*tl)->next;
+    }
+    if (!*tl) return;
+    *tl = t->next;
+    if (q->tail == t) q->tail = prev;
+    t->next = NULL;
+
+    if (!q->head) {
+        session_queue_t **link = &flow->queues;
+        while (*link != q) link = &(*link)->next;
+        *link = q->next;
+        free(q);
+    }
+    ssh_queued--;
+    if (--flow->queued == 0) {
+        flow->deficit = 0;
+        active_flows--;
+    }
+}
+
+/**
+ * Première opération servable du flux, en tournant sur ses files de sessions : la file
+ * servie passe en dernière position
+ */
+static ticket_t* flow_take_locked(flow_t *flow) {
+    session_queue_t **link = &flow->queues;
+    for (session_queue_t *q = flow->queues; q; link = &q->next, q = q->next) {
+        const admission_work_t *work = q->head->work;
+        if (!host_available_locked(work->host) || !host_available_locked(work->peer_host)) {
+            stat_host_deferred++;
+            continue;
+        }
+        ticket_t *t = q->head;
+        if (q->next) {
+            *link = q->next;
+            session_queue_t *last = q->next;
+            while (last->next) last = last->next;
+            last->next = q;
+            q->next = NULL;
+        }
+        dequeue_locked(flow, t);
+        return t;
+    }
+    return NULL;
+}
+
+static int weight_class(int weight) {
+    if (weight >= ADMISSION_WEIGHT_INTERACTIVE) return 2;
+    return weight > ADMISSION_WEIGHT_BATCH ? 1 : 0;
+}
+
+/**
+ * Attribuer les places libres (deficit round robin sur les flux actifs)
+ */
+static void dispatch_locked(void) {
+    int idle_visits = 0;
+    while (ssh_running < config.max_ssh_work && ssh_queued > 0 && idle_visits <= MAX_FLOWS) {
+        flow_t *flow = &flows[flow_cursor];
+        ticket_t *t = NULL;
+        if (flow->queued > 0 && flow->deficit > 0) t = flow_take_locked(flow);
+        if (!t) {
+            // Flux épuisé (crédit ou opérations servables) : crédit du suivant
+            flow_cursor = (flow_cursor + 1) % MAX_FLOWS;
+            if (flows[flow_cursor].queued > 0) flows[flow_cursor].deficit = flows[flow_cursor].weight;
+            idle_visits++;
+            continue;
+        }
+        flow->deficit--;
+        idle_visits = 0;
+
+        host_take_locked(t->work->host);
+        host_take_locked(t->work->peer_host);
+        ssh_running++;
+        stat_granted[weight_class(t->work->weight)]++;
+        t->granted = true;
+        pthread_cond_signal(&t->cond);
+    }
+}
+
+/**
+ * Obtenir une place pour une opération SSH, en attendant au plus queue_timeout_ms
+ * Une requête dont l'échéance est passée est abandonnée sans être exécutée
+ */
+bool admission_acquire_ssh(const admission_work_t *work, uint32_t *retry_after_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += config.queue_timeout_ms / 1000;
+    deadline.tv_nsec += (long)(config.queue_timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    ticket_t ticket = { .work = work };
+    pthread_cond_init(&ticket.cond, &ticket_cond_attr);
+
+    pthread_mutex_lock(&admission_mutex);
+    if (!enqueue_locked(&ticket)) {
+        stat_rejected++;
+        *retry_after_ms = retry_after_locked();
+        pthread_mutex_unlock(&admission_mutex);
+        pthread_cond_destroy(&ticket.cond);
+        return false;
+    }
+    dispatch_locked();
+
+    int rc = 0;
+    while (!ticket.granted && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&ticket.cond, &admission_mutex, &deadline);
+    }
+    if (!ticket.granted) {
+        for (int i = 0; i < MAX_FLOWS; i++) {
+            if (flows[i].queued > 0 && flows[i].pid == work->client && flows[i].weight == work->weight) {
+                dequeue_locked(&flows[i], &ticket);
+                break;
+            }
+        }
+        stat_expired++;
+        *retry_after_ms = retry_after_locked();
+    }
+    bool granted = ticket.granted;
+    pthread_mutex_unlock(&admission_mutex);
+    pthread_cond_destroy(&ticket.cond);
+    return granted;
+}
+
+void admission_release_ssh(const admission_work_t *work, double duration_ms) {
+    pthread_mutex_lock(&admission_mutex);
+    ssh_running--;
+    host_release_locked(work->host);
+    host_release_locked(work->peer_host);
+    avg_ssh_ms = avg_ssh_ms * 0.9 + duration_ms * 0.1;
+    dispatch_locked();
+    pthread_mutex_unlock(&admission_mutex);
+}
+
+/**
+ * Écrire l'état de l'admission en JSON
+ */
+int admission_stats_json(char *buf, size_t size) {
+    pthread_mutex_lock(&admission_mutex);
+    int n = snprintf(buf, size,
+            "{\"inflight\":%d,\"max_inflight\":%d,\"max_per_client\":%d,\"ssh_running\":%d,"
+            "\"ssh_queued\":%d,\"max_ssh_work\":%d,\"max_per_host\":%d,\"queue_timeout_ms\":%d,"
+            "\"avg_ssh_ms\":%.1f,\"rejected\":%llu,\"expired\":%llu,\"flows\":%d,\"host_deferred\":%llu,"
+            "\"granted\":{\"batch\":%llu,\"normal\":%llu,\"interactive\":%llu}}",
+            inflight, config.max_inflight, config.max_per_client, ssh_running,
+            ssh_queued, config.max_ssh_work, config.max_per_host, config.queue_timeout_ms,
+            avg_ssh_ms, (unsigned long long)stat_rejected, (unsigned long long)stat_expired,
+            active_flows, (unsigned long long)stat_host_deferred,
+            (unsigned long long)stat_granted[0], (unsigned long long)stat_granted[1],
+            (unsigned long long)stat_granted[2]);
+    pthread_mutex_unlock(&admission_mutex);
+    return n;
+}
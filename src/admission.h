@@ -0,0 +1,47 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ADMISSION_DEFAULT_MAX_INFLIGHT 256
+#define ADMISSION_DEFAULT_MAX_PER_CLIENT 64
+#define ADMISSION_DEFAULT_MAX_SSH_WORK 64
+#define ADMISSION_DEFAULT_QUEUE_TIMEOUT_MS 2000
+#define ADMISSION_DEFAULT_MAX_PER_HOST 8
+
+// Poids des opérations SSH (part des places libérées, par tour de l'ordonnanceur)
+#define ADMISSION_WEIGHT_BATCH 1
+#define ADMISSION_WEIGHT_NORMAL 4
+#define ADMISSION_WEIGHT_INTERACTIVE 16
+#define ADMISSION_MAX_WEIGHT 64
+
+typedef struct {
+    int max_inflight;           // Requêtes en cours, tous clients confondus
+    int max_per_client;         // Requêtes en cours par processus client
+    int max_ssh_work;           // Opérations SSH (exec, sftp, sync) simultanées
+    int queue_timeout_ms;       // Attente maximale d'une opération SSH avant rejet
+    int max_per_host;           // Opérations SSH simultanées vers un même hôte
+} admission_config_t;
+
+// Opération SSH à ordonnancer
+typedef struct {
+    pid_t client;
+    int weight;                 // 1..ADMISSION_MAX_WEIGHT
+    char session_key[64];       // File de la session (session_id, ou hôte pour une connexion)
+    char host[256];             // Hôte distant pour la limite par hôte (vide = sans limite)
+    char peer_host[256];        // Second hôte occupé (relais entre sessions : sink), vide = aucun
+} admission_work_t;
+
+void admission_init(const admission_config_t *config);
+void admission_config_from_env(admission_config_t *config);
+pid_t admission_client_id(int client_fd);
+bool admission_enter(pid_t client, uint32_t *retry_after_ms);
+void admission_leave(pid_t client);
+int admission_parse_weight(const char *priority, int weight);
+bool admission_acquire_ssh(const admission_work_t *work, uint32_t *retry_after_ms);
+void admission_release_ssh(const admission_work_t *work, double duration_ms);
+int admission_stats_json(char *buf, size_t size);
+
+#endif // ADMISSION_H
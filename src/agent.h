@@ -5,11 +5,13 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "logger.h"
 
+// Messages de débogage : supprimés à la compilation en NDEBUG, niveau debug sinon
 #ifdef NDEBUG
 #define DEBUG_PRINT(...) ((void)0)
 #else
-#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#define DEBUG_PRINT(...) LOG_DEBUG(__VA_ARGS__)
 #endif
 
 // Version du protocole
@@ -22,7 +24,23 @@ typedef enum {
     CMD_SSH_DISCONNECT = 3,
     CMD_SSH_EXECUTE = 4,
     CMD_SSH_STATUS = 5,
-    CMD_LIST_SESSIONS = 6
+    CMD_LIST_SESSIONS = 6,
+    CMD_SFTP_PUT = 7,
+    CMD_SFTP_GET = 8,
+    CMD_SYNC_FILE = 9,
+    CMD_SYNC_DIR = 10,
+    CMD_STATS = 11,
+    CMD_CANCEL = 12,
+    CMD_SSH_EXECUTE_ASYNC = 13,
+    CMD_JOB_STATUS = 14,
+    CMD_JOB_RESULT = 15,
+    CMD_JOB_WAIT = 16,
+    CMD_TUNNEL_OPEN = 17,
+    CMD_TUNNEL_CLOSE = 18,
+    CMD_TUNNEL_LIST = 19,
+    CMD_SHM_OPEN = 20,          // Bascule la connexion sur les anneaux en mémoire partagée
+    CMD_STDIN_DATA = 21,        // Trame stdin suivant un SSH_EXECUTE "stdin":"stream" (vide = EOF)
+    CMD_SSH_PIPE = 22           // stdout d'une commande relayé vers stdin d'une autre (deux sessions)
 } command_type_t;
 
 // Codes de réponse
@@ -30,14 +48,32 @@ typedef enum {
     RESP_OK = 0,
     RESP_ERROR = 1,
     RESP_INVALID_CMD = 2,
-    RESP_SSH_ERROR = 3
+    RESP_SSH_ERROR = 3,
+    RESP_BUSY = 4,              // Agent surchargé : réessayer après retry_after_ms
+    RESP_CANCELLED = 5          // Exécution annulée (CMD_CANCEL), sortie partielle
 } response_code_t;
 
+// Bits hauts de cmd_type : options de la requête (ignorés par les agents plus anciens)
+#define CMD_TYPE_MASK 0xFFFFu
+#define CMD_FLAG_ACCEPT_ZSTD (1u << 16)     // Le client accepte une réponse compressée zstd
+#define CMD_FLAG_ACCEPT_ZLIB (1u << 17)     // ... ou zlib
+
+// Bits hauts de code : encodage du corps de la réponse (jamais positionnés sans CMD_FLAG_ACCEPT_*)
+#define RESP_CODE_MASK 0xFFFFu
+#define RESP_FLAG_ZSTD (1u << 16)
+#define RESP_FLAG_ZLIB (1u << 17)
+
+#define COMMAND_MAX_FDS 2       // Descripteurs joints à une commande (SCM_RIGHTS)
+
 // Structure de commande
 typedef struct {
     uint32_t version;
     uint32_t cmd_type;
     uint32_t data_len;
+    uint32_t flags;     // CMD_FLAG_* extraits de cmd_type
+    int fds[COMMAND_MAX_FDS];   // Reçus avec l'en-tête, fermés avant l'envoi de la réponse
+    int fd_flags[COMMAND_MAX_FDS];  // Drapeaux F_GETFL d'origine à rétablir (-1 = inchangés)
+    int fd_count;
     char data[];  // Données JSON
 } command_t;
 
@@ -0,0 +1,201 @@
+/**
+ * Compression - Corps de réponse compressé à la demande du client
+ *
+ * Le client annonce les codecs acceptés dans les bits hauts de cmd_type
+ * (CMD_FLAG_ACCEPT_ZSTD / CMD_FLAG_ACCEPT_ZLIB). Au-delà d'un seuil, la réponse est
+ * compressée (zstd de préférence, zlib sinon) et le codec est signalé dans les bits hauts
+ * du code de réponse. Les flux acceptent la sortie morceau par morceau : un producteur
+ * peut compresser à mesure sans réunir le corps complet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "compression.h"
+#include "agent.h"
+#include "memory.h"
+
+#define COMPRESSION_CHUNK_SIZE (64 * 1024)
+
+struct compression_stream {
+    codec_t codec;
+    ZSTD_CCtx *zstd;
+    z_stream zlib;
+    void *out;                  // rust_buffer
+    char *chunk;
+    uint64_t bytes_in;
+    int64_t cpu_us;
+    bool finished;
+    bool failed;
+};
+
+typedef struct {
+    atomic_uint_fast64_t responses;
+    atomic_uint_fast64_t bytes_in;
+    atomic_uint_fast64_t bytes_out;
+    atomic_uint_fast64_t cpu_us;
+} codec_stats_t;
+
+static size_t min_bytes = COMPRESSION_DEFAULT_MIN_BYTES;
+static int level = COMPRESSION_DEFAULT_LEVEL;
+static codec_stats_t stats[3];
+static atomic_uint_fast64_t not_smaller = 0;
+
+/**
+ * Configurer le seuil (0 = défaut) et le niveau de compression
+ */
+void compression_init(size_t threshold, int compression_level) {
+    min_bytes = threshold ? threshold : COMPRESSION_DEFAULT_MIN_BYTES;
+    if (compression_level > 0) level = compression_level;
+    DEBUG_PRINT("[Compression] Seuil %zu octets, niveau %d\n", min_bytes, level);
+}
+
+/**
+ * Codec à utiliser pour une réponse de len octets (CODEC_NONE si non demandé ou trop petite)
+ */
+codec_t compression_choose(uint32_t accept_flags, size_t len) {
+    if (len < min_bytes) return CODEC_NONE;
+    if (accept_flags & CMD_FLAG_ACCEPT_ZSTD) return CODEC_ZSTD;
+    if (accept_flags & CMD_FLAG_ACCEPT_ZLIB) return CODEC_ZLIB;
+    return CODEC_NONE;
+}
+
+uint32_t compression_response_flag(codec_t codec) {
+    switch (codec) {
+        case CODEC_ZSTD: return RESP_FLAG_ZSTD;
+        case CODEC_ZLIB: return RESP_FLAG_ZLIB;
+        default: return 0;
+    }
+}
+
+static int64_t thread_cpu_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+compression_stream_t* compression_stream_new(codec_t codec) {
+    if (codec == CODEC_NONE) return NULL;
+    compression_stream_t *s = calloc(1, sizeof(compression_stream_t));
+    if (!s) return NULL;
+    s->codec = codec;
+    s->out = rust_buffer_new(COMPRESSION_CHUNK_SIZE);
+    s->chunk = malloc(COMPRESSION_CHUNK_SIZE);
+    bool ready = s->out && s->chunk;
+
+    if (ready && codec == CODEC_ZSTD) {
+        s->zstd = ZSTD_createCCtx();
+        ready = s->zstd && !ZSTD_isError(ZSTD_CCtx_setParameter(s->zstd, ZSTD_c_compressionLevel,
+                                                                 level > 19 ? 19 : level));
+    } else if (ready) {
+        ready = deflateInit(&s->zlib, level > 9 ? 9 : level) == Z_OK;
+        if (!ready) s->codec = CODEC_NONE;     // Rien à libérer côté zlib
+    }
+    if (!ready) {
+        compression_stream_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static int write_zstd(compression_stream_t *s, const void *data, size_t len, bool last) {
+    ZSTD_inBuffer in = { data, len, 0 };
+    ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+    size_t remaining;
+    do {
+        ZSTD_outBuffer out = { s->chunk, COMPRESSION_CHUNK_SIZE, 0 };
+        remaining = ZSTD_compressStream2(s->zstd, &out, &in, mode);
+        if (ZSTD_isError(remaining)) return -1;
+        if (out.pos > 0 && rust_buffer_append(s->out, s->chunk, out.pos) != 0) return -1;
+    } while (last ? remaining != 0 : in.pos < in.size);
+    return 0;
+}
+
+static int write_zlib(compression_stream_t *s, const void *data, size_t len, bool last) {
+    s->zlib.next_in = (Bytef*)data;
+    s->zlib.avail_in = (uInt)len;
+    int rc;
+    do {
+        s->zlib.next_out = (Bytef*)s->chunk;
+        s->zlib.avail_out = COMPRESSION_CHUNK_SIZE;
+        rc = deflate(&s->zlib, last ? Z_FINISH : Z_NO_FLUSH);
+        if (rc == Z_STREAM_ERROR) return -1;
+        size_t produced = COMPRESSION_CHUNK_SIZE - s->zlib.avail_out;
+        if (produced > 0 && rust_buffer_append(s->out, s->chunk, produced) != 0) return -1;
+    } while (last ? rc != Z_STREAM_END : (s->zlib.avail_in > 0 || s->zlib.avail_out == 0));
+    return 0;
+}
+
+/**
+ * Compresser un morceau ; last termine le flux (les statistiques sont alors comptées)
+ */
+int compression_stream_write(compression_stream_t *s, const void *data, size_t len, bool last) {
+    if (s->finished || s->failed) return -1;
+    int64_t start = thread_cpu_us();
+    int rc = s->codec == CODEC_ZSTD ? write_zstd(s, data, len, last) : write_zlib(s, data, len, last);
+    s->cpu_us += thread_cpu_us() - start;
+    s->bytes_in += len;
+    if (rc != 0) {
+        s->failed = true;
+        return -1;
+    }
+    if (last) {
+        s->finished = true;
+        codec_stats_t *st = &stats[s->codec];
+        atomic_fetch_add_explicit(&st->responses, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&st->bytes_in, s->bytes_in, memory_order_relaxed);
+        atomic_fetch_add_explicit(&st->bytes_out, rust_buffer_len(s->out), memory_order_relaxed);
+        atomic_fetch_add_explicit(&st->cpu_us, (uint64_t)s->cpu_us, memory_order_relaxed);
+    }
+    return 0;
+}
+
+/**
+ * Données compressées (NULL tant que le flux n'est pas terminé) ; un résultat plus gros que
+ * l'original n'a pas d'intérêt : il est compté et l'appelant envoie le corps tel quel
+ */
+const void* compression_stream_data(const compression_stream_t *s, size_t *len) {
+    if (!s->finished) return NULL;
+    *len = rust_buffer_len(s->out);
+    if (*len >= s->bytes_in) {
+        atomic_fetch_add_explicit(&not_smaller, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return rust_buffer_data(s->out);
+}
+
+void compression_stream_free(compression_stream_t *s) {
+    if (!s) return;
+    if (s->zstd) ZSTD_freeCCtx(s->zstd);
+    if (s->codec == CODEC_ZLIB) deflateEnd(&s->zlib);
+    if (s->out) rust_buffer_free(s->out);
+    free(s->chunk);
+    free(s);
+}
+
+static int codec_json(const codec_stats_t *st, char *buf, size_t size) {
+    uint64_t in = atomic_load_explicit(&st->bytes_in, memory_order_relaxed);
+    uint64_t out = atomic_load_explicit(&st->bytes_out, memory_order_relaxed);
+    return snprintf(buf, size,
+            "{\"responses\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu,\"ratio\":%.2f,\"cpu_us\":%llu}",
+            (unsigned long long)atomic_load_explicit(&st->responses, memory_order_relaxed),
+            (unsigned long long)in, (unsigned long long)out, out ? (double)in / out : 0.0,
+            (unsigned long long)atomic_load_explicit(&st->cpu_us, memory_order_relaxed));
+}
+
+/**
+ * Statistiques en JSON (CMD_STATS) : volume, ratio et temps CPU par codec
+ */
+int compression_stats_json(char *buf, size_t size) {
+    char zstd_json[192], zlib_json[192];
+    codec_json(&stats[CODEC_ZSTD], zstd_json, sizeof(zstd_json));
+    codec_json(&stats[CODEC_ZLIB], zlib_json, sizeof(zlib_json));
+    return snprintf(buf, size, "{\"min_bytes\":%zu,\"level\":%d,\"zstd\":%s,\"zlib\":%s,\"not_smaller\":%llu}",
+                    min_bytes, level, zstd_json, zlib_json,
+                    (unsigned long long)atomic_load_explicit(&not_smaller, memory_order_relaxed));
+}
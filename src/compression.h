@@ -0,0 +1,31 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define COMPRESSION_DEFAULT_MIN_BYTES (64 * 1024)
+#define COMPRESSION_DEFAULT_LEVEL 1     // Niveau rapide (zstd 1..19, zlib 1..9)
+
+typedef enum {
+    CODEC_NONE = 0,
+    CODEC_ZSTD = 1,
+    CODEC_ZLIB = 2
+} codec_t;
+
+typedef struct compression_stream compression_stream_t;
+
+void compression_init(size_t min_bytes, int level);
+codec_t compression_choose(uint32_t accept_flags, size_t len);
+uint32_t compression_response_flag(codec_t codec);
+
+// Compression par morceaux : la sortie s'accumule dans le flux
+compression_stream_t* compression_stream_new(codec_t codec);
+int compression_stream_write(compression_stream_t *s, const void *data, size_t len, bool last);
+const void* compression_stream_data(const compression_stream_t *s, size_t *len);
+void compression_stream_free(compression_stream_t *s);
+
+int compression_stats_json(char *buf, size_t size);
+
+#endif // COMPRESSION_H
@@ -0,0 +1,284 @@
+/**
+ * Delta de type rsync - signatures de blocs, somme Adler-32 glissante, encodage du flux
+ *
+ * Le fichier local est parcouru avec une fenêtre de block_size octets ; une fenêtre dont la
+ * somme faible puis le MD5 correspondent à un bloc distant devient une copie, le reste est
+ * envoyé en littéral. Les octets du delta passent par un sink (canal SSH pour la
+ * synchronisation, mémoire pour les tests).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+#include "md5.h"
+
+// ============================================================================
+// Sommes de contrôle
+// ============================================================================
+
+
+/**
+ * Adler-32 d'un bloc complet
+ * Boucle sans dépendance entre itérations : vectorisée par le compilateur (-O3 -march=native)
+ */
+uint32_t adler_block(const uint8_t *p, size_t n, uint32_t *a_out, uint32_t *b_out) {
+    uint64_t sa = 0, sb = 0;
+    for (size_t i = 0; i < n; i++) {
+        sa += p[i];
+        sb += (uint64_t)(n - i) * p[i];
+    }
+    uint32_t a = (uint32_t)((1 + sa) % ADLER_MOD);
+    uint32_t b = (uint32_t)((n + sb) % ADLER_MOD);
+    *a_out = a;
+    *b_out = b;
+    return (b << 16) | a;
+}
+
+// ============================================================================
+// Signatures distantes
+// ============================================================================
+
+void signature_free(signature_t *sig) {
+    free(sig->blocks);
+    free(sig->buckets);
+    free(sig->next);
+    memset(sig, 0, sizeof(*sig));
+}
+
+static int hex_to_bytes(const char *hex, uint8_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        unsigned int v;
+        if (sscanf(hex + i * 2, "%2x", &v) != 1) return -1;
+        out[i] = (uint8_t)v;
+    }
+    return 0;
+}
+
+/**
+ * Analyser la sortie du script de signatures et construire la table de hachage
+ */
+int signature_parse(const char *text, uint32_t block_size, signature_t *sig) {
+    memset(sig, 0, sizeof(*sig));
+    if (strncmp(text, "missing", 7) == 0) {
+        sig->missing = true;
+        return 0;
+    }
+    unsigned long long remote_size;
+    if (sscanf(text, "size %llu", &remote_size) != 1) return -1;
+    sig->remote_size = remote_size;
+
+    uint64_t count = (remote_size + block_size - 1) / block_size;
+    if (count > UINT32_MAX / 2) return -1;
+    sig->count = (uint32_t)count;
+    sig->last_len = (remote_size % block_size) ? (uint32_t)(remote_size % block_size) : block_size;
+    sig->full_count = (sig->last_len == block_size) ? sig->count : sig->count - 1;
+    if (sig->count == 0) return 0;
+
+    uint32_t buckets = 16;
+    while (buckets < sig->count * 2) buckets <<= 1;
+    sig->bucket_mask = buckets - 1;
+    sig->blocks = malloc(sig->count * sizeof(block_sig_t));
+    sig->buckets = malloc(buckets * sizeof(int32_t));
+    sig->next = malloc(sig->count * sizeof(int32_t));
+    if (!sig->blocks || !sig->buckets || !sig->next) return -1;
+    memset(sig->buckets, 0xff, buckets * sizeof(int32_t));
+
+    const char *line = strchr(text, '\n');
+    for (uint32_t i = 0; i < sig->count; i++) {
+        if (!line) return -1;
+        line++;
+        char *end;
+        sig->blocks[i].weak = (uint32_t)strtoul(line, &end, 16);
+        if (end == line || *end != ' ' || hex_to_bytes(end + 1, sig->blocks[i].strong, 16) < 0) return -1;
+        line = strchr(end, '\n');
+
+        // Seuls les blocs complets peuvent correspondre à une fenêtre glissante
+        if (i < sig->full_count) {
+            uint32_t bucket = (sig->blocks[i].weak ^ (sig->blocks[i].weak >> 16)) & sig->bucket_mask;
+            sig->next[i] = sig->buckets[bucket];
+            sig->buckets[bucket] = (int32_t)i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Chercher un bloc distant identique à la fenêtre courante
+ * Le bloc qui prolonge la copie en cours est testé en premier pour favoriser la fusion
+ */
+static int32_t find_match(const signature_t *sig, uint32_t weak, const uint8_t *window,
+                          uint32_t block_size, int64_t preferred) {
+    uint8_t digest[16];
+    bool digest_ready = false;
+
+    if (preferred >= 0 && preferred < sig->full_count && sig->blocks[preferred].weak == weak) {
+        md5_digest(window, block_size, digest);
+        digest_ready = true;
+        if (memcmp(digest, sig->blocks[preferred].strong, 16) == 0) return (int32_t)preferred;
+    }
+
+    uint32_t bucket = (weak ^ (weak >> 16)) & sig->bucket_mask;
+    for (int32_t i = sig->buckets[bucket]; i >= 0; i = sig->next[i]) {
+        if (sig->blocks[i].weak != weak) continue;
+        if (!digest_ready) {
+            md5_digest(window, block_size, digest);
+            digest_ready = true;
+        }
+        if (memcmp(digest, sig->blocks[i].strong, 16) == 0) return i;
+    }
+    return -1;
+}
+
+// ============================================================================
+// Flux de delta
+// ============================================================================
+
+/**
+ * Préparer un flux de delta vers sink
+ * @return 0, ou -1 si le tampon de regroupement ne peut être alloué
+ */
+int delta_writer_init(delta_writer_t *w, delta_sink_fn sink, void *sink_ctx) {
+    memset(w, 0, sizeof(*w));
+    w->sink = sink;
+    w->sink_ctx = sink_ctx;
+    w->stage = malloc(DELTA_STAGE_SIZE);
+    return w->stage ? 0 : -1;
+}
+
+void delta_writer_free(delta_writer_t *w) {
+    free(w->stage);
+    w->stage = NULL;
+}
+
+static void delta_write(delta_writer_t *w, const void *data, size_t len) {
+    if (w->failed || len == 0) return;
+    if (w->sink(w->sink_ctx, data, len) < 0) {
+        w->failed = true;
+        return;
+    }
+    w->bytes_sent += len;
+}
+
+static void delta_flush(delta_writer_t *w) {
+    delta_write(w, w->stage, w->stage_len);
+    w->stage_len = 0;
+}
+
+static void delta_append(delta_writer_t *w, const void *data, size_t len) {
+    if (w->stage_len + len > DELTA_STAGE_SIZE) delta_flush(w);
+    if (len > DELTA_STAGE_SIZE) {
+        delta_write(w, data, len);
+        return;
+    }
+    memcpy(w->stage + w->stage_len, data, len);
+    w->stage_len += len;
+}
+
+static void delta_header(delta_writer_t *w, char op, uint32_t x, uint32_t y) {
+    uint8_t h[9] = {
+        (uint8_t)op,
+        (uint8_t)(x >> 24), (uint8_t)(x >> 16), (uint8_t)(x >> 8), (uint8_t)x,
+        (uint8_t)(y >> 24), (uint8_t)(y >> 16), (uint8_t)(y >> 8), (uint8_t)y
+    };
+    delta_append(w, h, sizeof(h));
+}
+
+static void delta_flush_copy(delta_writer_t *w) {
+    if (w->copy_count == 0) return;
+    delta_header(w, 'C', w->copy_start, w->copy_count);
+    w->copy_count = 0;
+}
+
+static void delta_copy(delta_writer_t *w, uint32_t block) {
+    if (w->copy_count > 0 && w->copy_start + w->copy_count == block) {
+        w->copy_count++;
+        return;
+    }
+    delta_flush_copy(w);
+    w->copy_start = block;
+    w->copy_count = 1;
+}
+
+static void delta_literal(delta_writer_t *w, const uint8_t *data, uint64_t len) {
+    if (len == 0) return;
+    delta_flush_copy(w);
+    while (len > 0) {
+        uint32_t piece = len > DELTA_LITERAL_CHUNK ? DELTA_LITERAL_CHUNK : (uint32_t)len;
+        delta_header(w, 'L', piece, 0);
+        delta_append(w, data, piece);
+        data += piece;
+        len -= piece;
+    }
+}
+
+/**
+ * Terminer le delta (copie en cours, en-tête de fin) et tout passer au sink
+ * @return 0, ou -1 si le sink a refusé des octets
+ */
+int delta_end(delta_writer_t *w) {
+    delta_flush_copy(w);
+    delta_header(w, 'E', 0, 0);
+    delta_flush(w);
+    return w->failed ? -1 : 0;
+}
+
+/**
+ * Parcourir le fichier local et émettre le delta (sans l'en-tête de fin, cf. delta_end)
+ * @param blocks_matched Blocs distants réutilisés
+ * @return true si le fichier distant est déjà identique (rien n'a été passé au sink)
+ */
+bool delta_scan(const uint8_t *data, uint64_t size, uint32_t block_size, const signature_t *sig,
+                delta_writer_t *w, uint32_t *blocks_matched) {
+    uint64_t pos = 0, lit_start = 0;
+    uint32_t a = 0, b = 0, weak = 0;
+    uint32_t n_mod = block_size % ADLER_MOD;
+    bool in_order = true;
+
+    if (sig->full_count > 0 && size >= block_size) weak = adler_block(data, block_size, &a, &b);
+    while (sig->full_count > 0 && pos + block_size <= size) {
+        int64_t preferred = w->copy_count > 0 ? (int64_t)w->copy_start + w->copy_count : 0;
+        int32_t match = find_match(sig, weak, data + pos, block_size, preferred);
+        if (match >= 0) {
+            delta_literal(w, data + lit_start, pos - lit_start);
+            if ((uint32_t)match != *blocks_matched || lit_start != pos) in_order = false;
+            delta_copy(w, (uint32_t)match);
+            (*blocks_matched)++;
+            pos += block_size;
+            lit_start = pos;
+            if (pos + block_size <= size) weak = adler_block(data + pos, block_size, &a, &b);
+            continue;
+        }
+
+        if (pos + block_size < size) weak = adler_roll(&a, &b, data[pos], data[pos + block_size], n_mod);
+        pos++;
+        if (pos - lit_start >= DELTA_LITERAL_CHUNK) {
+            delta_literal(w, data + lit_start, pos - lit_start);
+            lit_start = pos;
+            in_order = false;
+        }
+    }
+
+    // Le dernier bloc distant (partiel) ne peut correspondre qu'à la fin du fichier local
+    uint64_t tail = size - pos;
+    if (sig->count > sig->full_count && tail == sig->last_len) {
+        uint32_t last = sig->count - 1;
+        uint32_t ta, tb;
+        uint8_t digest[16];
+        if (adler_block(data + pos, tail, &ta, &tb) == sig->blocks[last].weak) {
+            md5_digest(data + pos, tail, digest);
+            if (memcmp(digest, sig->blocks[last].strong, 16) == 0) {
+                delta_literal(w, data + lit_start, pos - lit_start);
+                if (last != *blocks_matched || lit_start != pos) in_order = false;
+                delta_copy(w, last);
+                (*blocks_matched)++;
+                lit_start = pos = size;
+            }
+        }
+    }
+    if (lit_start < size) in_order = false;
+    delta_literal(w, data + lit_start, size - lit_start);
+
+    return in_order && !sig->missing && sig->remote_size == size && w->bytes_sent == 0 && !w->failed;
+}
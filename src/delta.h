@@ -0,0 +1,73 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Delta de type rsync, sans E/S : signatures de blocs (Adler-32 + MD5), recherche par
+// somme glissante et encodage du flux de reconstruction lu par le script distant
+//   C start count : copier count blocs de l'ancien fichier
+//   L len 0       : len octets littéraux suivent
+//   E 0 0         : fin
+// (en-têtes de 9 octets : op + 2 x uint32 big-endian)
+
+#define ADLER_MOD 65521
+#define DELTA_STAGE_SIZE (64 * 1024)
+#define DELTA_LITERAL_CHUNK (1024 * 1024)
+
+// Signature d'un bloc distant
+typedef struct {
+    uint32_t weak;
+    uint8_t strong[16];
+} block_sig_t;
+
+typedef struct {
+    block_sig_t *blocks;
+    uint32_t count;             // Nombre de blocs (le dernier peut être partiel)
+    uint32_t full_count;        // Blocs de taille block_size (indexés dans la table)
+    uint32_t last_len;          // Taille du dernier bloc
+    uint64_t remote_size;
+    bool missing;
+    int32_t *buckets;
+    int32_t *next;
+    uint32_t bucket_mask;
+} signature_t;
+
+// Destination des octets du delta : 0, ou -1 pour abandonner (le delta est alors en échec)
+typedef int (*delta_sink_fn)(void *ctx, const void *data, size_t len);
+
+typedef struct {
+    delta_sink_fn sink;
+    void *sink_ctx;
+    char *stage;                // Regroupe les petits en-têtes (DELTA_STAGE_SIZE)
+    size_t stage_len;
+    uint64_t bytes_sent;        // Octets passés au sink
+    uint32_t copy_start;
+    uint32_t copy_count;
+    bool failed;
+} delta_writer_t;
+
+uint32_t adler_block(const uint8_t *p, size_t n, uint32_t *a_out, uint32_t *b_out);
+
+/**
+ * Faire glisser la fenêtre d'un octet : retirer x_out, ajouter x_in
+ * n_mod : taille de la fenêtre modulo ADLER_MOD
+ */
+static inline uint32_t adler_roll(uint32_t *a, uint32_t *b, uint8_t x_out, uint8_t x_in, uint32_t n_mod) {
+    *a = (*a + ADLER_MOD - x_out + x_in) % ADLER_MOD;
+    uint32_t t = (n_mod * x_out) % ADLER_MOD;
+    *b = (*b + 2 * ADLER_MOD - t + *a - 1) % ADLER_MOD;
+    return (*b << 16) | *a;
+}
+
+int signature_parse(const char *text, uint32_t block_size, signature_t *sig);
+void signature_free(signature_t *sig);
+
+int delta_writer_init(delta_writer_t *w, delta_sink_fn sink, void *sink_ctx);
+void delta_writer_free(delta_writer_t *w);
+bool delta_scan(const uint8_t *data, uint64_t size, uint32_t block_size, const signature_t *sig,
+                delta_writer_t *w, uint32_t *blocks_matched);
+int delta_end(delta_writer_t *w);
+
+#endif // DELTA_H
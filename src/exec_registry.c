@@ -0,0 +1,123 @@
+/**
+ * Registre des exécutions - Permet d'annuler une commande en cours (CMD_CANCEL)
+ *
+ * L'annulation positionne un drapeau lu par la boucle de lecture de l'exécution, qui
+ * envoie le signal, ferme le canal et termine la requête d'origine (RESP_CANCELLED).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <json-c/json.h>
+
+#include "exec_registry.h"
+#include "job_store.h"
+#include "agent.h"
+#include "json_macros.h"
+
+static exec_handle_t *running = NULL;
+static int running_count = 0;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static exec_handle_t* find_locked(const char *id) {
+    for (exec_handle_t *h = running; h; h = h->next) {
+        if (strcmp(h->id, id) == 0) return h;
+    }
+    return NULL;
+}
+
+/**
+ * Enregistrer une exécution
+ * @return Handle à passer à exec_registry_unregister(), NULL si l'identifiant est déjà utilisé
+ */
+exec_handle_t* exec_registry_register(const char *id) {
+    if (!id || !*id || strlen(id) >= EXEC_ID_MAX) return NULL;
+
+    exec_handle_t *handle = calloc(1, sizeof(exec_handle_t));
+    if (!handle) return NULL;
+    snprintf(handle->id, sizeof(handle->id), "%s", id);
+    atomic_init(&handle->cancelled, false);
+
+    pthread_mutex_lock(&registry_mutex);
+    if (find_locked(id)) {
+        pthread_mutex_unlock(&registry_mutex);
+        free(handle);
+        return NULL;
+    }
+    handle->next = running;
+    running = handle;
+    running_count++;
+    pthread_mutex_unlock(&registry_mutex);
+    return handle;
+}
+
+void exec_registry_unregister(exec_handle_t *handle) {
+    if (!handle) return;
+    pthread_mutex_lock(&registry_mutex);
+    exec_handle_t **pp = &running;
+    while (*pp && *pp != handle) pp = &(*pp)->next;
+    if (*pp) {
+        *pp = handle->next;
+        running_count--;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    free(handle);
+}
+
+/**
+ * Demander l'annulation d'une exécution
+ * @return 0 si l'exécution a été trouvée, -1 sinon (inconnue ou déjà terminée)
+ */
+int exec_registry_cancel(const char *id) {
+    pthread_mutex_lock(&registry_mutex);
+    exec_handle_t *handle = find_locked(id);
+    if (handle) atomic_store(&handle->cancelled, true);
+    pthread_mutex_unlock(&registry_mutex);
+    if (handle) DEBUG_PRINT("[Exec] Annulation demandée: %s\n", id);
+    return handle ? 0 : -1;
+}
+
+int exec_registry_count(void) {
+    pthread_mutex_lock(&registry_mutex);
+    int n = running_count;
+    pthread_mutex_unlock(&registry_mutex);
+    return n;
+}
+
+/**
+ * Gérer l'annulation d'une exécution
+ * {"request_id":"..."} ou {"job_id":"..."} ; la requête annulée se termine avec RESP_CANCELLED
+ */
+response_code_t handle_cancel(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    json_object *id_obj;
+    int rc;
+    if (json_object_object_get_ex(root, "request_id", &id_obj)) {
+        rc = exec_registry_cancel(json_object_get_string(id_obj));
+    } else if (json_object_object_get_ex(root, "job_id", &id_obj)) {
+        // Job asynchrone : retiré de la file s'il n'a pas démarré
+        rc = job_store_cancel(json_object_get_string(id_obj));
+    } else {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"request_id ou job_id requis\"}");
+        return RESP_ERROR;
+    }
+
+    if (rc != 0) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"Exécution introuvable ou déjà terminée\"}");
+        return RESP_ERROR;
+    }
+
+    json_object_put(root);
+    *response = strdup("{\"status\":\"cancelling\"}");
+    return RESP_OK;
+}
@@ -0,0 +1,28 @@
+#ifndef EXEC_REGISTRY_H
+#define EXEC_REGISTRY_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "agent.h"
+
+#define EXEC_ID_MAX 64
+
+// Exécution en cours, annulable par son identifiant (request_id ou job_id)
+typedef struct exec_handle {
+    char id[EXEC_ID_MAX];
+    atomic_bool cancelled;
+    struct exec_handle *next;
+} exec_handle_t;
+
+exec_handle_t* exec_registry_register(const char *id);
+void exec_registry_unregister(exec_handle_t *handle);
+int exec_registry_cancel(const char *id);
+int exec_registry_count(void);
+response_code_t handle_cancel(const char *json_data, char **response);
+
+static inline bool exec_handle_cancelled(exec_handle_t *handle) {
+    return handle && atomic_load_explicit(&handle->cancelled, memory_order_relaxed);
+}
+
+#endif // EXEC_REGISTRY_H
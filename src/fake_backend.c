@@ -0,0 +1,280 @@
+/**
+ * Backend fake - Transport SSH simulé en mémoire, pour mesurer le surcoût de l'agent
+ *
+ * Aucune connexion réseau : la sortie des commandes est générée (motif fixe, taille
+ * configurable), les latences sont simulées par horloge et les échecs tirés d'une suite
+ * pseudo-aléatoire dont la graine est fixée. Deux exécutions avec la même configuration
+ * produisent les mêmes réponses et les mêmes échecs. SFTP, synchronisation et tunnels
+ * exigent une vraie session et refusent les sessions de ce backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <libssh/libssh.h>
+
+#include "ssh_backend.h"
+#include "agent.h"
+
+#define FAKE_IDLE_US 50             // Attente entre deux lectures quand rien n'est prêt
+#define FAKE_PATTERN_LINE "krown fake output 0123456789 abcdefghijklmnopqrstuvwxyz ABCDEFGH\n"
+#define FAKE_LINE_LEN (sizeof(FAKE_PATTERN_LINE) - 1)
+
+typedef struct {
+    fake_backend_config_t config;
+    uint64_t rng;               // Tirages des échecs d'exécution (sous le verrou de la session)
+    atomic_int refs;            // Connexion + canaux ouverts : un canal survit à la déconnexion
+} fake_conn_t;
+
+typedef struct {
+    fake_conn_t *conn;
+    int64_t ready_at_us;        // Premier octet disponible à cette date (horloge monotone)
+    uint64_t stdout_left;
+    uint64_t stderr_left;
+    uint64_t stdout_offset;
+    uint64_t stderr_offset;
+    char *echo;                 // Anneau de la fenêtre simulée (echo_stdin), FAKE_WINDOW_BYTES
+    uint32_t echo_head;
+    uint32_t echo_len;
+    bool stdin_eof;
+    bool killed;
+} fake_channel_t;
+
+static fake_backend_config_t defaults = {
+    .output_bytes = FAKE_DEFAULT_OUTPUT_BYTES,
+    .seed = 1,
+};
+static atomic_uint_fast64_t connect_draws = 0;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_us(uint32_t us) {
+    struct timespec ts = { us / 1000000, (long)(us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * Tirage uniforme dans [0, 1) à partir d'un compteur (splitmix64)
+ */
+static double draw(uint64_t seed, uint64_t n) {
+    uint64_t z = seed + (n + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (double)(z >> 11) / (double)(1ULL << 53);
+}
+
+static uint64_t env_u64(const char *name, uint64_t fallback) {
+    const char *value = getenv(name);
+    return value ? strtoull(value, NULL, 10) : fallback;
+}
+
+void fake_backend_config_from_env(fake_backend_config_t *cfg) {
+    cfg->output_bytes = env_u64("KROWN_FAKE_OUTPUT_BYTES", FAKE_DEFAULT_OUTPUT_BYTES);
+    cfg->stderr_bytes = env_u64("KROWN_FAKE_STDERR_BYTES", 0);
+    cfg->exit_code = (int)env_u64("KROWN_FAKE_EXIT_CODE", 0);
+    cfg->connect_latency_us = (uint32_t)env_u64("KROWN_FAKE_CONNECT_LATENCY_US", 0);
+    cfg->exec_latency_us = (uint32_t)env_u64("KROWN_FAKE_EXEC_LATENCY_US", 0);
+    const char *rate = getenv("KROWN_FAKE_ERROR_RATE");
+    cfg->error_rate = rate ? atof(rate) : 0.0;
+    cfg->seed = env_u64("KROWN_FAKE_SEED", 1);
+    cfg->echo_stdin = env_u64("KROWN_FAKE_ECHO_STDIN", 0) != 0;
+}
+
+void fake_backend_init(const fake_backend_config_t *cfg) {
+    if (cfg) defaults = *cfg;
+    atomic_store(&connect_draws, 0);
+    DEBUG_PRINT("[Fake] Sortie %llu octets (stderr %llu), latences %u/%u µs, erreurs %.3f, graine %llu\n",
+                (unsigned long long)defaults.output_bytes, (unsigned long long)defaults.stderr_bytes,
+                defaults.connect_latency_us, defaults.exec_latency_us, defaults.error_rate,
+                (unsigned long long)defaults.seed);
+}
+
+/**
+ * Ouvrir une connexion simulée ; "fake" (objet optionnel de la spécification) remplace
+ * les valeurs par défaut pour cette session
+ * @return La connexion, ou NULL avec *error renseigné
+ */
+void* fake_backend_connect(json_object *spec, const char **error) {
+    fake_backend_config_t cfg = defaults;
+    json_object *fake_obj, *obj;
+    if (json_object_object_get_ex(spec, "fake", &fake_obj)) {
+        if (json_object_object_get_ex(fake_obj, "output_bytes", &obj)) cfg.output_bytes = json_object_get_int64(obj);
+        if (json_object_object_get_ex(fake_obj, "stderr_bytes", &obj)) cfg.stderr_bytes = json_object_get_int64(obj);
+        if (json_object_object_get_ex(fake_obj, "exit_code", &obj)) cfg.exit_code = json_object_get_int(obj);
+        if (json_object_object_get_ex(fake_obj, "connect_latency_us", &obj)) {
+            cfg.connect_latency_us = (uint32_t)json_object_get_int64(obj);
+        }
+        if (json_object_object_get_ex(fake_obj, "exec_latency_us", &obj)) {
+            cfg.exec_latency_us = (uint32_t)json_object_get_int64(obj);
+        }
+        if (json_object_object_get_ex(fake_obj, "error_rate", &obj)) cfg.error_rate = json_object_get_double(obj);
+        if (json_object_object_get_ex(fake_obj, "seed", &obj)) cfg.seed = (uint64_t)json_object_get_int64(obj);
+        if (json_object_object_get_ex(fake_obj, "echo_stdin", &obj)) cfg.echo_stdin = json_object_get_boolean(obj);
+    }
+
+    if (cfg.connect_latency_us) sleep_us(cfg.connect_latency_us);
+    uint64_t n = atomic_fetch_add_explicit(&connect_draws, 1, memory_order_relaxed);
+    if (cfg.error_rate > 0 && draw(cfg.seed, n) < cfg.error_rate) {
+        *error = "Échec connexion simulé (backend fake)";
+        return NULL;
+    }
+
+    fake_conn_t *conn = calloc(1, sizeof(fake_conn_t));
+    if (!conn) {
+        *error = "Erreur d'allocation mémoire";
+        return NULL;
+    }
+    conn->config = cfg;
+    conn->rng = n << 32;
+    atomic_init(&conn->refs, 1);
+    return conn;
+}
+
+static void conn_release(fake_conn_t *conn) {
+    if (atomic_fetch_sub(&conn->refs, 1) == 1) free(conn);
+}
+
+static void* fake_open(void *conn) {
+    fake_channel_t *ch = calloc(1, sizeof(fake_channel_t));
+    if (!ch) return NULL;
+    ch->conn = conn;
+    atomic_fetch_add(&ch->conn->refs, 1);
+    return ch;
+}
+
+static int fake_exec(void *channel, const char *command) {
+    (void)command;
+    fake_channel_t *ch = channel;
+    const fake_backend_config_t *cfg = &ch->conn->config;
+    if (cfg->error_rate > 0 && draw(cfg->seed, ch->conn->rng++) < cfg->error_rate) return -1;
+    ch->ready_at_us = now_us() + cfg->exec_latency_us;
+    ch->stdout_left = cfg->output_bytes;
+    ch->stderr_left = cfg->stderr_bytes;
+    if (cfg->echo_stdin) {
+        ch->echo = malloc(FAKE_WINDOW_BYTES);
+        if (!ch->echo) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Copier le motif à partir de la position offset du flux
+ */
+static void fill_pattern(char *buf, uint32_t len, uint64_t offset) {
+    uint32_t done = 0;
+    while (done < len) {
+        size_t at = (size_t)((offset + done) % FAKE_LINE_LEN);
+        uint32_t n = (uint32_t)(FAKE_LINE_LEN - at);
+        if (n > len - done) n = len - done;
+        memcpy(buf + done, FAKE_PATTERN_LINE + at, n);
+        done += n;
+    }
+}
+
+/**
+ * stdout en mode echo_stdin : ce que la fenêtre contient, fin de flux après l'EOF de stdin
+ */
+static int echo_read(fake_channel_t *ch, void *buf, uint32_t len) {
+    if (ch->echo_len == 0) return ch->stdin_eof ? 0 : SSH_AGAIN;
+    uint32_t n = ch->echo_len < len ? ch->echo_len : len;
+    uint32_t first = FAKE_WINDOW_BYTES - ch->echo_head;
+    if (first > n) first = n;
+    memcpy(buf, ch->echo + ch->echo_head, first);
+    memcpy((char *)buf + first, ch->echo, n - first);
+    ch->echo_head = (ch->echo_head + n) % FAKE_WINDOW_BYTES;
+    ch->echo_len -= n;
+    return (int)n;
+}
+
+static int fake_read(void *channel, void *buf, uint32_t len, int is_stderr) {
+    fake_channel_t *ch = channel;
+    if (ch->killed) return 0;
+    if (now_us() < ch->ready_at_us) return SSH_AGAIN;
+    if (ch->echo && !is_stderr) return echo_read(ch, buf, len);
+
+    uint64_t *left = is_stderr ? &ch->stderr_left : &ch->stdout_left;
+    uint64_t *offset = is_stderr ? &ch->stderr_offset : &ch->stdout_offset;
+    if (*left == 0) return 0;
+    uint32_t n = *left < len ? (uint32_t)*left : len;
+    fill_pattern(buf, n, *offset);
+    *left -= n;
+    *offset += n;
+    return (int)n;
+}
+
+/**
+ * stdin : la fenêtre simulée se libère à mesure que stdout est lu (echo_stdin),
+ * sinon les octets sont consommés par paquets de FAKE_WINDOW_BYTES
+ */
+static int fake_write(void *channel, const void *data, uint32_t len) {
+    fake_channel_t *ch = channel;
+    if (ch->killed || ch->stdin_eof) return SSH_ERROR;
+    if (!ch->echo) return (int)(len < FAKE_WINDOW_BYTES ? len : FAKE_WINDOW_BYTES);
+
+    uint32_t n = FAKE_WINDOW_BYTES - ch->echo_len;
+    if (n > len) n = len;
+    uint32_t tail = (ch->echo_head + ch->echo_len) % FAKE_WINDOW_BYTES;
+    uint32_t first = FAKE_WINDOW_BYTES - tail;
+    if (first > n) first = n;
+    memcpy(ch->echo + tail, data, first);
+    memcpy(ch->echo, (const char *)data + first, n - first);
+    ch->echo_len += n;
+    return (int)n;
+}
+
+static int fake_exit_status(void *channel) {
+    fake_channel_t *ch = channel;
+    return ch->killed ? -1 : ch->conn->config.exit_code;
+}
+
+static void fake_kill(void *channel) {
+    ((fake_channel_t*)channel)->killed = true;
+}
+
+static void fake_send_eof(void *channel) {
+    ((fake_channel_t*)channel)->stdin_eof = true;
+}
+
+static void fake_close(void *channel) {
+    fake_channel_t *ch = channel;
+    conn_release(ch->conn);
+    free(ch->echo);
+    free(ch);
+}
+
+static void fake_disconnect(void *conn) {
+    conn_release(conn);
+}
+
+static int fake_fd(void *conn) {
+    (void)conn;
+    return -1;
+}
+
+static void fake_idle(int timeout_ms) {
+    int64_t timeout_us = (int64_t)timeout_ms * 1000;
+    sleep_us(timeout_us < FAKE_IDLE_US ? (uint32_t)timeout_us : FAKE_IDLE_US);
+}
+
+const ssh_backend_t fake_backend = {
+    .name = "fake",
+    .open = fake_open,
+    .exec = fake_exec,
+    .read = fake_read,
+    .write = fake_write,
+    .exit_status = fake_exit_status,
+    .kill = fake_kill,
+    .send_eof = fake_send_eof,
+    .close = fake_close,
+    .disconnect = fake_disconnect,
+    .disconnect_closes_channels = false,
+    .fd = fake_fd,
+    .idle = fake_idle,
+};
@@ -0,0 +1,671 @@
+/**
+ * Jobs asynchrones - Exécution différée de CMD_SSH_EXECUTE
+ *
+ * CMD_SSH_EXECUTE_ASYNC place la commande dans une file et rend un job_id tout de suite ;
+ * un pool de threads l'exécute comme un CMD_SSH_EXECUTE du client d'origine (admission,
+ * ordonnanceur, limite par hôte, budget mémoire). Les résultats sont conservés
+ * dans un magasin borné (nombre de jobs et mémoire) jusqu'à leur expiration, puis
+ * récupérés avec CMD_JOB_STATUS / CMD_JOB_RESULT / CMD_JOB_WAIT. Tout ce que le magasin
+ * garde (spécifications et résultats) est aussi imputé au budget mémoire global.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <json-c/json.h>
+
+#include "job_store.h"
+#include "ssh_handler.h"
+#include "request_handler.h"
+#include "exec_registry.h"
+#include "mem_budget.h"
+#include "agent.h"
+#include "json_macros.h"
+
+#define JOB_BUCKETS 1024
+#define JOB_SWEEP_INTERVAL_MS 1000
+#define JOB_DEFAULT_WAIT_MS 30000
+#define JOB_RETRY_MIN_MS 50         // Attente d'un job refusé par l'admission (agent saturé)
+#define JOB_RETRY_MAX_MS 1000
+
+typedef enum {
+    JOB_QUEUED = 0,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_CANCELLED
+} job_state_t;
+
+static const char *job_state_names[] = { "queued", "running", "done", "cancelled" };
+
+typedef struct job {
+    char id[48];
+    job_state_t state;
+    char *request;              // JSON de CMD_SSH_EXECUTE (request_id = id du job), libéré après exécution
+    char *response;
+    response_code_t code;
+    size_t size;                // Octets comptés dans max_bytes et dans le budget global
+    int64_t created_ms;
+    int64_t started_ms;
+    int64_t finished_ms;
+    int64_t expires_ms;
+    int refs;                   // Worker en cours + clients en attente (CMD_JOB_WAIT)
+    pid_t client;               // Client d'origine (admission et ordonnancement)
+    bool cancel_requested;      // CMD_CANCEL reçu pendant l'attente d'une place
+    bool linked;                // Présent dans le magasin
+    struct job *hash_next;
+    struct job *prev;           // Ordre de création (éviction des plus anciens)
+    struct job *next;
+    struct job *queue_next;     // File d'attente des workers
+} job_t;
+
+static job_store_config_t config;
+static job_t *buckets[JOB_BUCKETS];
+static job_t *oldest = NULL, *newest = NULL;
+static job_t *queue_head = NULL, *queue_tail = NULL;
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond;
+static pthread_t workers[JOB_MAX_WORKERS];
+static int worker_count = 0;
+static bool stopping = false;
+
+static int job_count = 0;
+static size_t used_bytes = 0;
+static int64_t last_sweep_ms = 0;
+static atomic_ullong job_seq = 0;
+
+static uint64_t stat_submitted = 0;
+static uint64_t stat_completed = 0;
+static uint64_t stat_evicted = 0;
+static uint64_t stat_expired = 0;
+static uint64_t stat_rejected = 0;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Échéance absolue pour done_cond (horloge monotone)
+static struct timespec deadline_in(int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+static int env_int(const char *name, int def) {
+    const char *value = getenv(name);
+    if (!value) return def;
+    int v = atoi(value);
+    return v > 0 ? v : def;
+}
+
+static unsigned bucket_of(const char *id) {
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)id; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h % JOB_BUCKETS;
+}
+
+static bool job_finished(const job_t *job) {
+    return job->state == JOB_DONE || job->state == JOB_CANCELLED;
+}
+
+static void job_free(job_t *job) {
+    free(job->request);
+    free(job->response);
+    free(job);
+}
+
+static job_t* find_locked(const char *id) {
+    for (job_t *job = buckets[bucket_of(id)]; job; job = job->hash_next) {
+        if (strcmp(job->id, id) == 0) return job;
+    }
+    return NULL;
+}
+
+/**
+ * Retirer un job du magasin (libéré tout de suite si personne ne l'utilise)
+ * Doit être appelé avec store_mutex, jamais pour un job en file d'attente
+ */
+static void remove_locked(job_t *job) {
+    job_t **pp = &buckets[bucket_of(job->id)];
+    while (*pp && *pp != job) pp = &(*pp)->hash_next;
+    if (*pp) *pp = job->hash_next;
+
+    if (job->prev) job->prev->next = job->next;
+    else oldest = job->next;
+    if (job->next) job->next->prev = job->prev;
+    else newest = job->prev;
+
+    used_bytes -= job->size;
+    mem_budget_hold(-(ptrdiff_t)job->size);
+    job_count--;
+    job->linked = false;
+    if (job->refs == 0) job_free(job);
+}
+
+static void release_locked(job_t *job) {
+    job->refs--;
+    if (job->refs == 0 && !job->linked) job_free(job);
+}
+
+/**
+ * Supprimer les résultats expirés (au plus une fois par seconde)
+ */
+static void sweep_expired_locked(int64_t now) {
+    if (now - last_sweep_ms < JOB_SWEEP_INTERVAL_MS) return;
+    last_sweep_ms = now;
+    job_t *job = oldest;
+    while (job) {
+        job_t *next = job->next;
+        if (job_finished(job) && job->expires_ms <= now) {
+            stat_expired++;
+            remove_locked(job);
+        }
+        job = next;
+    }
+}
+
+/**
+ * Libérer de la place en évinçant les jobs terminés les plus anciens
+ * @param slots Jobs à ajouter (0 pour le résultat d'un job déjà compté)
+ * @param keep  Job à ne pas évincer (peut être NULL)
+ */
+static bool make_room_locked(size_t size, int slots, const job_t *keep) {
+    job_t *job = oldest;
+    while (job && (job_count + slots > config.max_jobs || used_bytes + size > config.max_bytes)) {
+        job_t *next = job->next;
+        if (job != keep && job_finished(job)) {
+            stat_evicted++;
+            remove_locked(job);
+        }
+        job = next;
+    }
+    return job_count + slots <= config.max_jobs && used_bytes + size <= config.max_bytes;
+}
+
+/**
+ * Enregistrer le résultat d'un job ; s'il ne tient pas dans le budget même après éviction
+ * des jobs terminés, il est remplacé par une erreur
+ */
+static void finish_locked(job_t *job, job_state_t state, char *response, response_code_t code) {
+    int64_t now = now_ms();
+    if (job->request) {
+        size_t request_size = strlen(job->request) + 1;
+        free(job->request);
+        job->request = NULL;
+        job->size -= request_size;
+        used_bytes -= request_size;
+        mem_budget_hold(-(ptrdiff_t)request_size);
+    }
+    size_t response_size = response ? strlen(response) + 1 : 0;
+    const char *rejected = NULL;
+    // Un résultat plus grand que le budget entier n'évince personne
+    if (response && (job->size + response_size > config.max_bytes ||
+                     !make_room_locked(response_size, 0, job))) {
+        rejected = "Résultat trop volumineux pour le magasin de jobs";
+    } else if (response && mem_budget_charge((ptrdiff_t)response_size) < 0) {
+        rejected = "Budget mémoire dépassé : résultat du job non conservé";
+    }
+    if (rejected) {
+        char error_msg[160];
+        snprintf(error_msg, sizeof(error_msg), "{\"error\":\"%s\",\"bytes\":%zu}", rejected, response_size - 1);
+        free(response);
+        response = strdup(error_msg);
+        response_size = response ? strlen(response) + 1 : 0;
+        // Message court, remplace un résultat plus grand : imputé sans refus
+        mem_budget_hold((ptrdiff_t)response_size);
+        code = RESP_ERROR;
+        stat_rejected++;
+    }
+    job->state = state;
+    job->response = response;
+    job->code = code;
+    job->finished_ms = now;
+    job->expires_ms = now + config.ttl_ms;
+    job->size += response_size;
+    used_bytes += response_size;
+    stat_completed++;
+    pthread_cond_broadcast(&done_cond);
+}
+
+// Délai conseillé par une réponse RESP_BUSY, borné
+static int busy_retry_ms(const char *response) {
+    int retry_ms = JOB_RETRY_MIN_MS;
+    json_object *root = response ? json_tokener_parse(response) : NULL;
+    json_object *obj;
+    if (root && json_object_object_get_ex(root, "retry_after_ms", &obj)) retry_ms = json_object_get_int(obj);
+    json_object_put(root);
+    if (retry_ms < JOB_RETRY_MIN_MS) retry_ms = JOB_RETRY_MIN_MS;
+    if (retry_ms > JOB_RETRY_MAX_MS) retry_ms = JOB_RETRY_MAX_MS;
+    return retry_ms;
+}
+
+/**
+ * Exécuter un job par le même chemin qu'un CMD_SSH_EXECUTE synchrone de son client ;
+ * tant que l'agent est saturé (RESP_BUSY), le job attend le délai conseillé puis réessaie
+ */
+static response_code_t run_job(job_t *job, char **response) {
+    while (true) {
+        pthread_mutex_lock(&store_mutex);
+        bool abandon = stopping || job->cancel_requested;
+        pthread_mutex_unlock(&store_mutex);
+        if (abandon) {
+            *response = strdup("{\"error\":\"Job annulé avant exécution\",\"cancelled\":true}");
+            return RESP_CANCELLED;
+        }
+
+        response_code_t code = request_handler_run(CMD_SSH_EXECUTE, job->request, job->client, response);
+        if (code != RESP_BUSY) return code;
+
+        struct timespec deadline = deadline_in(busy_retry_ms(*response));
+        free(*response);
+        *response = NULL;
+        pthread_mutex_lock(&store_mutex);
+        int rc = 0;
+        while (!stopping && !job->cancel_requested && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&done_cond, &store_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&store_mutex);
+    }
+}
+
+static void* job_worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&store_mutex);
+    while (true) {
+        while (!stopping && !queue_head) pthread_cond_wait(&work_cond, &store_mutex);
+        if (stopping) break;
+
+        job_t *job = queue_head;
+        queue_head = job->queue_next;
+        if (!queue_head) queue_tail = NULL;
+        job->queue_next = NULL;
+        job->state = JOB_RUNNING;
+        job->started_ms = now_ms();
+        job->refs++;
+        pthread_mutex_unlock(&store_mutex);
+
+        char *response = NULL;
+        response_code_t code = run_job(job, &response);
+        DEBUG_PRINT("[Job] %s terminé (code %d)\n", job->id, code);
+
+        pthread_mutex_lock(&store_mutex);
+        finish_locked(job, code == RESP_CANCELLED ? JOB_CANCELLED : JOB_DONE, response, code);
+        release_locked(job);
+    }
+    pthread_mutex_unlock(&store_mutex);
+    return NULL;
+}
+
+/**
+ * Lire la configuration depuis l'environnement
+ */
+void job_store_config_from_env(job_store_config_t *cfg) {
+    cfg->workers = env_int("KROWN_JOB_WORKERS", JOB_DEFAULT_WORKERS);
+    cfg->max_jobs = env_int("KROWN_JOB_MAX", JOB_DEFAULT_MAX_JOBS);
+    cfg->max_bytes = (size_t)env_int("KROWN_JOB_MAX_BYTES", JOB_DEFAULT_MAX_BYTES);
+    cfg->ttl_ms = env_int("KROWN_JOB_TTL_MS", JOB_DEFAULT_TTL_MS);
+}
+
+int job_store_init(const job_store_config_t *cfg) {
+    config = *cfg;
+    if (config.workers < 1) config.workers = 1;
+    if (config.workers > JOB_MAX_WORKERS) config.workers = JOB_MAX_WORKERS;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&done_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    stopping = false;
+    for (int i = 0; i < config.workers; i++) {
+        if (pthread_create(&workers[worker_count], NULL, job_worker, NULL) != 0) {
+            perror("[Job] Erreur création worker");
+            break;
+        }
+        worker_count++;
+    }
+    if (worker_count == 0) return -1;
+    DEBUG_PRINT("[Job] %d workers, max %d jobs / %zu octets, TTL %d ms\n",
+                worker_count, config.max_jobs, config.max_bytes, config.ttl_ms);
+    return 0;
+}
+
+/**
+ * Arrêter les workers : les jobs en cours sont annulés, ceux en attente abandonnés
+ */
+void job_store_shutdown(void) {
+    pthread_mutex_lock(&store_mutex);
+    stopping = true;
+    for (job_t *job = oldest; job; job = job->next) {
+        if (job->state == JOB_RUNNING) exec_registry_cancel(job->id);
+    }
+    pthread_cond_broadcast(&work_cond);
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&store_mutex);
+
+    for (int i = 0; i < worker_count; i++) pthread_join(workers[i], NULL);
+    worker_count = 0;
+
+    pthread_mutex_lock(&store_mutex);
+    queue_head = queue_tail = NULL;
+    while (oldest) remove_locked(oldest);
+    pthread_mutex_unlock(&store_mutex);
+}
+
+/**
+ * Annuler un job : retiré de la file s'il attend, signalé à l'exécution s'il tourne
+ * (ou abandonné s'il attend encore une place de l'admission)
+ * @return 0 si le job a été trouvé et n'était pas terminé, -1 sinon
+ */
+int job_store_cancel(const char *job_id) {
+    pthread_mutex_lock(&store_mutex);
+    job_t *job = find_locked(job_id);
+    if (!job || job_finished(job)) {
+        pthread_mutex_unlock(&store_mutex);
+        return -1;
+    }
+    if (job->state == JOB_RUNNING) {
+        job->cancel_requested = true;
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&store_mutex);
+        exec_registry_cancel(job_id);
+        return 0;
+    }
+
+    job_t **pp = &queue_head;
+    job_t *prev = NULL;
+    while (*pp && *pp != job) {
+        prev = *pp;
+        pp = &(*pp)->queue_next;
+    }
+    if (*pp) *pp = job->queue_next;
+    if (queue_tail == job) queue_tail = prev;
+    job->queue_next = NULL;
+    finish_locked(job, JOB_CANCELLED, strdup("{\"error\":\"Job annulé avant exécution\",\"cancelled\":true}"),
+                  RESP_CANCELLED);
+    pthread_mutex_unlock(&store_mutex);
+    return 0;
+}
+
+/**
+ * Écrire l'état du magasin de jobs en JSON
+ */
+int job_store_stats_json(char *buf, size_t size) {
+    pthread_mutex_lock(&store_mutex);
+    int queued = 0, running = 0;
+    for (job_t *job = oldest; job; job = job->next) {
+        if (job->state == JOB_QUEUED) queued++;
+        else if (job->state == JOB_RUNNING) running++;
+    }
+    int n = snprintf(buf, size,
+            "{\"jobs\":%d,\"queued\":%d,\"running\":%d,\"bytes\":%zu,\"max_jobs\":%d,\"max_bytes\":%zu,"
+            "\"workers\":%d,\"submitted\":%llu,\"completed\":%llu,\"evicted\":%llu,\"expired\":%llu,"
+            "\"rejected\":%llu}",
+            job_count, queued, running, used_bytes, config.max_jobs, config.max_bytes, worker_count,
+            (unsigned long long)stat_submitted, (unsigned long long)stat_completed,
+            (unsigned long long)stat_evicted, (unsigned long long)stat_expired,
+            (unsigned long long)stat_rejected);
+    pthread_mutex_unlock(&store_mutex);
+    return n;
+}
+
+/**
+ * Gérer CMD_SSH_EXECUTE_ASYNC : mêmes champs que CMD_SSH_EXECUTE, réponse immédiate
+ * Le job_id sert aussi d'identifiant d'annulation (CMD_CANCEL)
+ */
+response_code_t handle_ssh_execute_async(const char *json_data, pid_t client, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    const char *command;
+    JSON_GET_STRING_OR_RETURN(root, "command", command, "command requis");
+    (void)command;
+
+    // Pas de connexion pour relayer stdin au worker : même refus que handle_ssh_execute_fds
+    if (json_object_object_get_ex(root, "stdin", NULL)) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"stdin en flux indisponible sur ce transport (socket uniquement)\"}");
+        return RESP_ERROR;
+    }
+
+    if (!ssh_handler_find(session_id)) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"Session introuvable ou déconnectée\"}");
+        return RESP_ERROR;
+    }
+
+    job_t *job = calloc(1, sizeof(job_t));
+    if (!job) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    snprintf(job->id, sizeof(job->id), "job_%llu_%lx",
+             (unsigned long long)atomic_fetch_add(&job_seq, 1) + 1, (unsigned long)time(NULL));
+    json_object_object_add(root, "request_id", json_object_new_string(job->id));
+    job->request = strdup(json_object_to_json_string_ext(root, JSON_C_TO_STRING_PLAIN));
+    json_object_put(root);
+    if (!job->request) {
+        free(job);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    job->size = sizeof(job_t) + strlen(job->request) + 1;
+    job->client = client;
+
+    pthread_mutex_lock(&store_mutex);
+    int64_t now = now_ms();
+    sweep_expired_locked(now);
+    if (stopping || !make_room_locked(job->size, 1, NULL)) {
+        stat_rejected++;
+        pthread_mutex_unlock(&store_mutex);
+        job_free(job);
+        *response = strdup("{\"error\":\"Magasin de jobs plein, réessayer plus tard\",\"retry_after_ms\":1000}");
+        return RESP_BUSY;
+    }
+    if (mem_budget_charge((ptrdiff_t)job->size) < 0) {
+        stat_rejected++;
+        pthread_mutex_unlock(&store_mutex);
+        job_free(job);
+        char busy[128];
+        snprintf(busy, sizeof(busy), "{\"error\":\"Budget mémoire dépassé\",\"retry_after_ms\":%d}",
+                 MEM_BUDGET_RETRY_AFTER_MS);
+        *response = strdup(busy);
+        return RESP_BUSY;
+    }
+
+    job->state = JOB_QUEUED;
+    job->created_ms = now;
+    job->linked = true;
+    unsigned b = bucket_of(job->id);
+    job->hash_next = buckets[b];
+    buckets[b] = job;
+    job->prev = newest;
+    if (newest) newest->next = job;
+    else oldest = job;
+    newest = job;
+    if (queue_tail) queue_tail->queue_next = job;
+    else queue_head = job;
+    queue_tail = job;
+    job_count++;
+    used_bytes += job->size;
+    stat_submitted++;
+
+    char response_json[128];
+    snprintf(response_json, sizeof(response_json), "{\"job_id\":\"%s\",\"status\":\"queued\"}", job->id);
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&store_mutex);
+
+    *response = strdup(response_json);
+    return RESP_OK;
+}
+
+/**
+ * Construire l'état d'un job en JSON (avec store_mutex)
+ */
+static char* status_json_locked(const job_t *job, bool timed_out) {
+    int64_t now = now_ms();
+    int64_t queued_ms = (job->state == JOB_QUEUED ? now : (job->started_ms ? job->started_ms : job->finished_ms)) - job->created_ms;
+    int64_t run_ms = job->started_ms ? (job_finished(job) ? job->finished_ms : now) - job->started_ms : 0;
+
+    char response_json[256];
+    int n = snprintf(response_json, sizeof(response_json),
+            "{\"job_id\":\"%s\",\"status\":\"%s\",\"queued_ms\":%lld,\"run_ms\":%lld",
+            job->id, job_state_names[job->state], (long long)queued_ms, (long long)run_ms);
+    if (job_finished(job)) {
+        n += snprintf(response_json + n, sizeof(response_json) - n, ",\"code\":%d", job->code);
+    }
+    if (timed_out) {
+        n += snprintf(response_json + n, sizeof(response_json) - n, ",\"timed_out\":true");
+    }
+    snprintf(response_json + n, sizeof(response_json) - n, "}");
+    return strdup(response_json);
+}
+
+/**
+ * Copier le résultat d'un job terminé (avec store_mutex), puis le retirer si demandé
+ */
+static response_code_t take_result_locked(job_t *job, bool remove, char **response) {
+    response_code_t code = job->code;
+    *response = strdup(job->response ? job->response : "{\"error\":\"Erreur interne\"}");
+    if (remove && job->linked) remove_locked(job);
+    return code;
+}
+
+static job_t* lookup_job(json_object *root, char **response) {
+    json_object *id_obj;
+    if (!json_object_object_get_ex(root, "job_id", &id_obj)) {
+        *response = strdup("{\"error\":\"job_id requis\"}");
+        return NULL;
+    }
+    job_t *job = find_locked(json_object_get_string(id_obj));
+    if (job && job_finished(job) && job->expires_ms <= now_ms()) {
+        stat_expired++;
+        remove_locked(job);
+        job = NULL;
+    }
+    if (!job) *response = strdup("{\"error\":\"Job introuvable ou expiré\"}");
+    return job;
+}
+
+/**
+ * Gérer CMD_JOB_STATUS : état d'un job sans son résultat
+ */
+response_code_t handle_job_status(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    pthread_mutex_lock(&store_mutex);
+    job_t *job = lookup_job(root, response);
+    if (job) *response = status_json_locked(job, false);
+    pthread_mutex_unlock(&store_mutex);
+
+    json_object_put(root);
+    return job ? RESP_OK : RESP_ERROR;
+}
+
+/**
+ * Gérer CMD_JOB_RESULT : réponse de l'exécution (code d'origine), "remove":true pour libérer
+ */
+response_code_t handle_job_result(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    json_object *remove_obj;
+    bool remove = json_object_object_get_ex(root, "remove", &remove_obj) && json_object_get_boolean(remove_obj);
+
+    response_code_t code = RESP_ERROR;
+    pthread_mutex_lock(&store_mutex);
+    job_t *job = lookup_job(root, response);
+    if (job && job_finished(job)) {
+        code = take_result_locked(job, remove, response);
+    } else if (job) {
+        char response_json[160];
+        snprintf(response_json, sizeof(response_json),
+                "{\"error\":\"Job non terminé\",\"job_id\":\"%s\",\"status\":\"%s\"}",
+                job->id, job_state_names[job->state]);
+        *response = strdup(response_json);
+    }
+    pthread_mutex_unlock(&store_mutex);
+
+    json_object_put(root);
+    return code;
+}
+
+/**
+ * Gérer CMD_JOB_WAIT : attendre la fin d'un job (timeout_ms, défaut 30 s, max 5 min)
+ * Renvoie le résultat comme CMD_JOB_RESULT, ou l'état avec "timed_out":true
+ */
+response_code_t handle_job_wait(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    int timeout_ms = JOB_DEFAULT_WAIT_MS;
+    json_object *obj;
+    if (json_object_object_get_ex(root, "timeout_ms", &obj)) {
+        timeout_ms = json_object_get_int(obj);
+        if (timeout_ms < 0) timeout_ms = 0;
+        if (timeout_ms > JOB_WAIT_MAX_MS) timeout_ms = JOB_WAIT_MAX_MS;
+    }
+    bool remove = json_object_object_get_ex(root, "remove", &obj) && json_object_get_boolean(obj);
+
+    struct timespec deadline = deadline_in(timeout_ms);
+
+    response_code_t code = RESP_ERROR;
+    pthread_mutex_lock(&store_mutex);
+    job_t *job = lookup_job(root, response);
+    if (job) {
+        job->refs++;
+        int rc = 0;
+        while (!job_finished(job) && !stopping && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&done_cond, &store_mutex, &deadline);
+        }
+        if (job_finished(job)) {
+            code = take_result_locked(job, remove, response);
+        } else {
+            code = RESP_OK;
+            *response = status_json_locked(job, true);
+        }
+        release_locked(job);
+    }
+    pthread_mutex_unlock(&store_mutex);
+
+    json_object_put(root);
+    return code;
+}
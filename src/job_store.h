@@ -0,0 +1,33 @@
+#ifndef JOB_STORE_H
+#define JOB_STORE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "agent.h"
+
+#define JOB_DEFAULT_WORKERS 8
+#define JOB_MAX_WORKERS 64
+#define JOB_DEFAULT_MAX_JOBS 10000
+#define JOB_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+#define JOB_DEFAULT_TTL_MS (10 * 60 * 1000)
+#define JOB_WAIT_MAX_MS (5 * 60 * 1000)
+
+typedef struct {
+    int workers;                // Threads d'exécution
+    int max_jobs;               // Jobs conservés (en attente + terminés)
+    size_t max_bytes;           // Budget mémoire des jobs (spécifications + résultats)
+    int ttl_ms;                 // Conservation d'un résultat après la fin du job
+} job_store_config_t;
+
+void job_store_config_from_env(job_store_config_t *config);
+int job_store_init(const job_store_config_t *config);
+void job_store_shutdown(void);
+int job_store_cancel(const char *job_id);
+int job_store_stats_json(char *buf, size_t size);
+
+response_code_t handle_ssh_execute_async(const char *json_data, pid_t client, char **response);
+response_code_t handle_job_status(const char *json_data, char **response);
+response_code_t handle_job_result(const char *json_data, char **response);
+response_code_t handle_job_wait(const char *json_data, char **response);
+
+#endif // JOB_STORE_H
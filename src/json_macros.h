@@ -0,0 +1,43 @@
+// Macros JSON partagées par les gestionnaires de commandes
+// Les fonctions qui les utilisent doivent avoir un paramètre `char **response`
+
+#ifndef JSON_MACROS_H
+#define JSON_MACROS_H
+
+#include <string.h>
+#include <json-c/json.h>
+
+#define JSON_PARSE_OR_RETURN(json_str, root_var, error_msg) \
+    do { \
+        root_var = json_tokener_parse(json_str); \
+        if (!root_var) { \
+            *response = strdup("{\"error\":\"" error_msg "\"}"); \
+            return RESP_ERROR; \
+        } \
+    } while(0)
+
+// Champ d'un objet imbriqué (parent_var, appartenant à root_var) ; root_var est libéré en cas d'erreur
+#define JSON_GET_MEMBER_STRING_OR_RETURN(root_var, parent_var, key, var, error_msg) \
+    do { \
+        json_object *obj; \
+        if (!json_object_object_get_ex(parent_var, key, &obj) || !obj) { \
+            json_object_put(root_var); \
+            *response = strdup("{\"error\":\"" error_msg "\"}"); \
+            return RESP_ERROR; \
+        } \
+        var = json_object_get_string(obj); \
+    } while(0)
+
+#define JSON_GET_STRING_OR_RETURN(root_var, key, var, error_msg) \
+    JSON_GET_MEMBER_STRING_OR_RETURN(root_var, root_var, key, var, error_msg)
+
+#define JSON_GET_OBJECT_OR_RETURN(root_var, key, var, error_msg) \
+    do { \
+        if (!json_object_object_get_ex(root_var, key, &var) || !json_object_is_type(var, json_type_object)) { \
+            json_object_put(root_var); \
+            *response = strdup("{\"error\":\"" error_msg "\"}"); \
+            return RESP_ERROR; \
+        } \
+    } while(0)
+
+#endif // JSON_MACROS_H
@@ -0,0 +1,300 @@
+/**
+ * Journalisation asynchrone - Anneaux par thread vidés par un thread d'écriture
+ *
+ * Chaque thread qui journalise obtient un anneau SPSC (un producteur, le thread ; un
+ * consommateur, le writer). Écrire un message revient à le formater dans l'anneau puis
+ * publier l'index : aucun verrou, aucun appel système sur le thread de la requête. Si
+ * l'anneau est plein, le message est perdu et compté plutôt que de bloquer.
+ * Les anneaux sont recyclés à la fin des threads (threads de requête éphémères).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "logger.h"
+
+#define LOG_OUT_BUFFER (64 * 1024)
+
+typedef struct {
+    uint8_t level;
+    uint16_t len;
+    char msg[LOG_MSG_SIZE];
+} log_record_t;
+
+enum {
+    RING_FREE = 0,              // Disponible pour un nouveau thread
+    RING_OWNED,                 // Utilisé par un thread vivant
+    RING_RELEASED               // Thread terminé, à vider avant réutilisation
+};
+
+typedef struct {
+    _Alignas(64) atomic_size_t head;    // Écrit par le producteur
+    _Alignas(64) atomic_size_t tail;    // Écrit par le writer
+    _Alignas(64) atomic_int state;
+    atomic_ullong dropped;
+    unsigned long long dropped_reported;
+    log_record_t records[LOG_RING_RECORDS];
+} log_ring_t;
+
+typedef struct {
+    int fd;
+    size_t len;
+    char data[LOG_OUT_BUFFER];
+} log_output_t;
+
+#ifdef NDEBUG
+atomic_int log_threshold = LOG_LEVEL_INFO;
+#else
+atomic_int log_threshold = LOG_LEVEL_DEBUG;
+#endif
+
+static _Atomic(log_ring_t *) rings[LOG_MAX_RINGS];
+static atomic_int ring_count = 0;
+static _Thread_local log_ring_t *local_ring = NULL;
+static pthread_key_t ring_key;
+
+static pthread_t writer_thread;
+static atomic_bool writer_running = false;
+static atomic_bool writer_stopping = false;
+
+static log_output_t out_stdout = { .fd = STDOUT_FILENO };
+static log_output_t out_stderr = { .fd = STDERR_FILENO };
+
+static atomic_ullong stat_written = 0;
+static atomic_ullong stat_dropped = 0;
+static atomic_ullong stat_direct = 0;
+
+static const char *level_names[] = { "error", "warn", "info", "debug" };
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return;
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+/**
+ * Écriture synchrone (avant le démarrage du writer, ou si aucun anneau n'est disponible)
+ * Un seul write() par message : les lignes de threads différents ne s'entremêlent pas
+ */
+static void write_direct(log_level_t level, const char *fmt, va_list ap) {
+    char buf[LOG_MSG_SIZE + 1];
+    int n = vsnprintf(buf, LOG_MSG_SIZE, fmt, ap);
+    if (n < 0) return;
+    size_t len = (size_t)n < LOG_MSG_SIZE ? (size_t)n : LOG_MSG_SIZE - 1;
+    if (len == 0 || buf[len - 1] != '\n') buf[len++] = '\n';
+    write_all(level <= LOG_LEVEL_WARN ? STDERR_FILENO : STDOUT_FILENO, buf, len);
+    atomic_fetch_add_explicit(&stat_direct, 1, memory_order_relaxed);
+}
+
+static void release_ring(void *arg) {
+    log_ring_t *ring = arg;
+    atomic_store_explicit(&ring->state, RING_RELEASED, memory_order_release);
+}
+
+/**
+ * Attribuer un anneau au thread courant (réutilise un anneau libéré si possible)
+ */
+static log_ring_t* claim_ring(void) {
+    int count = atomic_load_explicit(&ring_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        log_ring_t *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        int expected = RING_FREE;
+        if (ring && atomic_compare_exchange_strong(&ring->state, &expected, RING_OWNED)) {
+            local_ring = ring;
+            pthread_setspecific(ring_key, ring);
+            return ring;
+        }
+    }
+
+    int index = atomic_fetch_add(&ring_count, 1);
+    if (index >= LOG_MAX_RINGS) {
+        atomic_fetch_sub(&ring_count, 1);
+        return NULL;
+    }
+    log_ring_t *ring = calloc(1, sizeof(log_ring_t));
+    if (!ring) {
+        // Emplacement réservé mais vide : ignoré par le writer
+        return NULL;
+    }
+    atomic_store(&ring->state, RING_OWNED);
+    atomic_store_explicit(&rings[index], ring, memory_order_release);
+    local_ring = ring;
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+void logger_write(log_level_t level, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+
+    log_ring_t *ring = NULL;
+    if (atomic_load_explicit(&writer_running, memory_order_acquire)) {
+        ring = local_ring ? local_ring : claim_ring();
+    }
+    if (!ring) {
+        write_direct(level, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= LOG_RING_RECORDS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        va_end(ap);
+        return;
+    }
+
+    log_record_t *rec = &ring->records[head & (LOG_RING_RECORDS - 1)];
+    int n = vsnprintf(rec->msg, LOG_MSG_SIZE, fmt, ap);
+    va_end(ap);
+    rec->len = n < 0 ? 0 : ((size_t)n < LOG_MSG_SIZE ? (uint16_t)n : LOG_MSG_SIZE - 1);
+    rec->level = (uint8_t)level;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void output_flush(log_output_t *out) {
+    write_all(out->fd, out->data, out->len);
+    out->len = 0;
+}
+
+static void output_append(log_output_t *out, const char *data, size_t len) {
+    if (out->len + len + 1 > LOG_OUT_BUFFER) output_flush(out);
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    if (len == 0 || data[len - 1] != '\n') out->data[out->len++] = '\n';
+}
+
+/**
+ * Vider tous les anneaux (thread d'écriture uniquement)
+ * @return Nombre de messages écrits
+ */
+static size_t drain_rings(void) {
+    size_t total = 0;
+    int count = atomic_load_explicit(&ring_count, memory_order_acquire);
+    if (count > LOG_MAX_RINGS) count = LOG_MAX_RINGS;
+
+    for (int i = 0; i < count; i++) {
+        log_ring_t *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (!ring) continue;
+
+        int state = atomic_load_explicit(&ring->state, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            log_record_t *rec = &ring->records[tail & (LOG_RING_RECORDS - 1)];
+            output_append(rec->level <= LOG_LEVEL_WARN ? &out_stderr : &out_stdout, rec->msg, rec->len);
+            total++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        unsigned long long dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->dropped_reported) {
+            char msg[96];
+            int n = snprintf(msg, sizeof(msg), "[Log] %llu messages perdus (anneau plein)\n",
+                             dropped - ring->dropped_reported);
+            output_append(&out_stderr, msg, (size_t)n);
+            atomic_fetch_add_explicit(&stat_dropped, dropped - ring->dropped_reported, memory_order_relaxed);
+            ring->dropped_reported = dropped;
+        }
+
+        // Le thread propriétaire est terminé et l'anneau est vide : il peut resservir
+        if (state == RING_RELEASED) {
+            atomic_store_explicit(&ring->state, RING_FREE, memory_order_release);
+        }
+    }
+
+    if (total > 0) atomic_fetch_add_explicit(&stat_written, total, memory_order_relaxed);
+    output_flush(&out_stderr);
+    output_flush(&out_stdout);
+    return total;
+}
+
+static void* writer_loop(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, LOG_FLUSH_INTERVAL_MS * 1000000L };
+    while (true) {
+        size_t written = drain_rings();
+        if (written == 0) {
+            if (atomic_load(&writer_stopping)) break;
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Démarrer le thread d'écriture
+ * Les messages émis avant sont écrits directement
+ */
+int logger_init(log_level_t level) {
+    logger_set_level(level);
+    if (pthread_key_create(&ring_key, release_ring) != 0) return -1;
+    atomic_store(&writer_stopping, false);
+    if (pthread_create(&writer_thread, NULL, writer_loop, NULL) != 0) {
+        perror("[Log] Erreur création du thread d'écriture");
+        return -1;
+    }
+    atomic_store_explicit(&writer_running, true, memory_order_release);
+    return 0;
+}
+
+/**
+ * Arrêter le writer après avoir vidé les anneaux ; la suite est écrite directement
+ */
+void logger_shutdown(void) {
+    if (!atomic_load(&writer_running)) return;
+    atomic_store_explicit(&writer_running, false, memory_order_release);
+    atomic_store(&writer_stopping, true);
+    pthread_join(writer_thread, NULL);
+    drain_rings();
+}
+
+void logger_set_level(log_level_t level) {
+    if (level < LOG_LEVEL_ERROR) level = LOG_LEVEL_ERROR;
+    if (level > LOG_LEVEL_DEBUG) level = LOG_LEVEL_DEBUG;
+    atomic_store_explicit(&log_threshold, (int)level, memory_order_relaxed);
+}
+
+/**
+ * Convertir un nom de niveau (error, warn, info, debug ou 0-3)
+ */
+log_level_t logger_parse_level(const char *name, log_level_t def) {
+    if (!name || !*name) return def;
+    if (name[0] >= '0' && name[0] <= '3' && name[1] == '\0') return (log_level_t)(name[0] - '0');
+    if (strcasecmp(name, "warning") == 0) return LOG_LEVEL_WARN;
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) return (log_level_t)i;
+    }
+    return def;
+}
+
+const char* logger_level_name(log_level_t level) {
+    if (level < LOG_LEVEL_ERROR || level > LOG_LEVEL_DEBUG) return "unknown";
+    return level_names[level];
+}
+
+/**
+ * Écrire les compteurs du journal en JSON
+ */
+int logger_stats_json(char *buf, size_t size) {
+    int count = atomic_load(&ring_count);
+    return snprintf(buf, size,
+            "{\"level\":\"%s\",\"rings\":%d,\"written\":%llu,\"direct\":%llu,\"dropped\":%llu}",
+            logger_level_name((log_level_t)atomic_load(&log_threshold)),
+            count > LOG_MAX_RINGS ? LOG_MAX_RINGS : count,
+            (unsigned long long)atomic_load(&stat_written),
+            (unsigned long long)atomic_load(&stat_direct),
+            (unsigned long long)atomic_load(&stat_dropped));
+}
@@ -0,0 +1,41 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define LOG_MSG_SIZE 240            // Taille maximale d'un message (tronqué au-delà)
+#define LOG_RING_RECORDS 256        // Enregistrements par thread (puissance de 2)
+#define LOG_MAX_RINGS 512           // Anneaux simultanés (threads qui journalisent)
+#define LOG_FLUSH_INTERVAL_MS 5     // Attente du writer quand les anneaux sont vides
+
+typedef enum {
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+} log_level_t;
+
+extern atomic_int log_threshold;
+
+int logger_init(log_level_t level);
+void logger_shutdown(void);
+void logger_set_level(log_level_t level);
+log_level_t logger_parse_level(const char *name, log_level_t def);
+const char* logger_level_name(log_level_t level);
+void logger_write(log_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int logger_stats_json(char *buf, size_t size);
+
+// Le seuil est testé avant tout formatage : un message filtré ne coûte qu'une lecture atomique
+#define LOG_AT(level, ...) \
+    do { \
+        if ((int)(level) <= atomic_load_explicit(&log_threshold, memory_order_relaxed)) \
+            logger_write(level, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif // LOGGER_H
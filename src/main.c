@@ -15,48 +15,45 @@
 #include <sys/stat.h>
 
 #include "agent.h"
+#include "logger.h"
+#include "trace.h"
+#include "tunnel.h"
 #include "ssh_handler.h"
 #include "socket_server.h"
 #include "request_handler.h"
+#include "profile.h"
+#include "result_cache.h"
+#include "session_state.h"
+#include "admission.h"
+#include "job_store.h"
+#include "compression.h"
+#include "mem_budget.h"
+
+#define DEFAULT_PROFILES_PATH "/etc/krown/profiles.json"
+#define DEFAULT_BACKLOG 1024
+#define MAX_ACCEPTORS 16
 
 static volatile bool running = true;
 static int server_fd = -1;
 
 void signal_handler(int sig) {
     if (sig == SIGINT || sig == SIGTERM) {
-        DEBUG_PRINT("\n[Agent] Signal de terminaison reçu\n");
         running = false;
         if (server_fd >= 0) close(server_fd);
+    } else if (sig == SIGUSR1 || sig == SIGUSR2) {
+        // Verbosité ajustable à chaud : SIGUSR1 augmente, SIGUSR2 diminue
+        int level = atomic_load(&log_threshold) + (sig == SIGUSR1 ? 1 : -1);
+        logger_set_level((log_level_t)level);
     }
 }
 
-int main(int argc, char *argv[]) {
-    DEBUG_PRINT("=== Krown Agent v1.0 ===\n");
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
-
-    if (ssh_handler_init() != 0) {
-        fprintf(stderr, "[Agent] Erreur: Échec de l'initialisation SSH\n");
-        return 1;
-    }
-
-    const char *socket_path = getenv("SOCKET_PATH");
-    if (!socket_path) socket_path = "/tmp/krown-agent.sock";
-    if (argc > 1) socket_path = argv[1];
-
-    DEBUG_PRINT("[Agent] Écoute sur socket: %s\n", socket_path);
-    
-    server_fd = socket_server_start(socket_path);
-    if (server_fd < 0) {
-        fprintf(stderr, "[Agent] Erreur: Impossible de démarrer le serveur socket\n");
-        ssh_handler_cleanup();
-        return 1;
-    }
-
-    DEBUG_PRINT("[Agent] Daemon prêt\n");
-
-    // Boucle principale avec select() pour éviter les appels accept() inutiles
-    // Accepter plusieurs connexions par itération pour améliorer le débit
+/**
+ * Boucle d'acceptation (exécutée par un ou plusieurs threads sur le même socket)
+ * select() évite les appels accept() inutiles ; plusieurs connexions sont acceptées
+ * par itération pour améliorer le débit
+ */
+static void* acceptor_loop(void *arg) {
+    (void)arg;
     while (running) {
         fd_set read_fds;
         struct timeval timeout;
@@ -132,10 +129,148 @@ int main(int argc, char *argv[]) {
             }
         }
     }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    // Journal asynchrone (niveau KROWN_LOG_LEVEL : error, warn, info, debug)
+    logger_init(logger_parse_level(getenv("KROWN_LOG_LEVEL"), (log_level_t)atomic_load(&log_threshold)));
+    DEBUG_PRINT("=== Krown Agent v1.0 ===\n");
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, signal_handler);
+    signal(SIGUSR2, signal_handler);
+    // Client parti (socket, tube de sortie) : erreur EPIPE plutôt qu'arrêt de l'agent
+    signal(SIGPIPE, SIG_IGN);
+
+    // Budget mémoire global : installé avant la première allocation de tampon
+    const char *memory_budget = getenv("KROWN_MEMORY_BUDGET_BYTES");
+    mem_budget_init(memory_budget ? strtoull(memory_budget, NULL, 10) : 0);
+
+    if (ssh_handler_init() != 0) {
+        LOG_ERROR("[Agent] Erreur: Échec de l'initialisation SSH\n");
+        logger_shutdown();
+        return 1;
+    }
+
+    // Profils de connexion (optionnels)
+    const char *profiles_path = getenv("KROWN_PROFILES");
+    if (profiles_path) {
+        profile_load(profiles_path);
+    } else if (access(DEFAULT_PROFILES_PATH, R_OK) == 0) {
+        profile_load(DEFAULT_PROFILES_PATH);
+    }
+
+    // Backend SSH par défaut (KROWN_SSH_BACKEND=fake : transport simulé, sans réseau)
+    const char *backend = getenv("KROWN_SSH_BACKEND");
+    if (backend && ssh_handler_set_backend(backend) != 0) {
+        LOG_ERROR("[Agent] Backend SSH inconnu: %s (libssh conservé)\n", backend);
+    }
+    fake_backend_config_t fake;
+    fake_backend_config_from_env(&fake);
+    fake_backend_init(&fake);
+
+    // Cache de résultats (budget mémoire configurable)
+    const char *cache_max = getenv("KROWN_CACHE_MAX_BYTES");
+    result_cache_init(cache_max ? strtoull(cache_max, NULL, 10) : 0);
+
+    // Délais (exécution, connexion SSH, socket client)
+    const char *exec_timeout = getenv("KROWN_EXEC_TIMEOUT_MS");
+    const char *connect_timeout = getenv("KROWN_CONNECT_TIMEOUT_MS");
+    const char *client_timeout = getenv("KROWN_CLIENT_TIMEOUT_MS");
+    ssh_handler_set_timeouts(exec_timeout ? atoi(exec_timeout) : -1,
+                             connect_timeout ? atoi(connect_timeout) : -1);
+    if (client_timeout) request_handler_set_client_timeout(atoi(client_timeout));
+
+    // Compression des réponses volumineuses (si le client l'accepte)
+    const char *compress_min = getenv("KROWN_COMPRESS_MIN_BYTES");
+    const char *compress_level = getenv("KROWN_COMPRESS_LEVEL");
+    compression_init(compress_min ? strtoull(compress_min, NULL, 10) : 0,
+                     compress_level ? atoi(compress_level) : 0);
+
+    // Spans des requêtes (format Chrome Trace Event), désactivés si KROWN_TRACE_FILE est absent
+    const char *trace_max = getenv("KROWN_TRACE_MAX_BYTES");
+    trace_init(getenv("KROWN_TRACE_FILE"), trace_max ? strtoull(trace_max, NULL, 10) : 0);
+
+    // Limites d'admission (rejet rapide sous charge)
+    admission_config_t admission;
+    admission_config_from_env(&admission);
+    admission_init(&admission);
+
+    // Pool d'exécution des jobs asynchrones (CMD_SSH_EXECUTE_ASYNC)
+    job_store_config_t jobs;
+    job_store_config_from_env(&jobs);
+    if (job_store_init(&jobs) != 0) {
+        LOG_ERROR("[Agent] Erreur: Impossible de démarrer les workers de jobs\n");
+    }
+
+    // Relais des tunnels (CMD_TUNNEL_OPEN) : sockets Unix confinés à KROWN_TUNNEL_DIR,
+    // écoute TCP sur loopback seulement sauf KROWN_TUNNEL_ALLOW_REMOTE_BIND=1
+    const char *tunnel_dir = getenv("KROWN_TUNNEL_DIR");
+    const char *remote_bind = getenv("KROWN_TUNNEL_ALLOW_REMOTE_BIND");
+    if (tunnel_init(tunnel_dir ? tunnel_dir : TUNNEL_DEFAULT_DIR, remote_bind && atoi(remote_bind) != 0) != 0) {
+        LOG_ERROR("[Agent] Erreur: Impossible de démarrer le relais des tunnels\n");
+    }
+
+    bool persist_sessions = session_state_init(getenv("KROWN_STATE_FILE")) == 0;
+
+    const char *socket_path = getenv("SOCKET_PATH");
+    if (!socket_path) socket_path = "/tmp/krown-agent.sock";
+    if (argc > 1) socket_path = argv[1];
+
+    const char *backlog_env = getenv("KROWN_BACKLOG");
+    int backlog = backlog_env ? atoi(backlog_env) : DEFAULT_BACKLOG;
+
+    // Socket pré-ouvert par systemd (LISTEN_FDS), sinon bind sur socket_path
+    server_fd = socket_server_from_systemd();
+    if (server_fd < 0) {
+        DEBUG_PRINT("[Agent] Écoute sur socket: %s\n", socket_path);
+        server_fd = socket_server_start(socket_path, backlog);
+    }
+    if (server_fd < 0) {
+        LOG_ERROR("[Agent] Erreur: Impossible de démarrer le serveur socket\n");
+        job_store_shutdown();
+        tunnel_shutdown();
+        result_cache_cleanup();
+        ssh_handler_cleanup();
+        trace_shutdown();
+        logger_shutdown();
+        return 1;
+    }
+
+    // Reprise à chaud des sessions persistées, en arrière-plan une fois le socket en écoute :
+    // les requêtes visant une session pas encore rétablie reçoivent RESP_BUSY
+    if (persist_sessions) {
+        const char *concurrency = getenv("KROWN_RESTORE_CONCURRENCY");
+        session_state_restore_start(concurrency ? atoi(concurrency) : SESSION_STATE_DEFAULT_CONCURRENCY);
+    }
+
+    DEBUG_PRINT("[Agent] Daemon prêt\n");
+
+    // Threads d'acceptation supplémentaires (absorber les rafales de connexions)
+    const char *acceptors_env = getenv("KROWN_ACCEPTORS");
+    int acceptors = acceptors_env ? atoi(acceptors_env) : 1;
+    if (acceptors < 1) acceptors = 1;
+    if (acceptors > MAX_ACCEPTORS) acceptors = MAX_ACCEPTORS;
+
+    pthread_t acceptor_threads[MAX_ACCEPTORS];
+    int extra = 0;
+    for (int i = 1; i < acceptors; i++) {
+        if (pthread_create(&acceptor_threads[extra], NULL, acceptor_loop, NULL) == 0) extra++;
+    }
+
+    acceptor_loop(NULL);
+    for (int i = 0; i < extra; i++) pthread_join(acceptor_threads[i], NULL);
 
     DEBUG_PRINT("[Agent] Arrêt du daemon...\n");
     socket_server_stop(server_fd, socket_path);
+    job_store_shutdown();
+    session_state_shutdown();
+    tunnel_shutdown();
+    result_cache_cleanup();
     ssh_handler_cleanup();
+    trace_shutdown();
+    logger_shutdown();
     return 0;
 }
 
@@ -0,0 +1,20 @@
+#ifndef MD5_H
+#define MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MD5 (RFC 1321) - empreinte forte des blocs pour la synchronisation différentielle
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t block[64];
+    size_t block_len;
+} md5_ctx_t;
+
+void md5_init(md5_ctx_t *ctx);
+void md5_update(md5_ctx_t *ctx, const void *data, size_t len);
+void md5_final(md5_ctx_t *ctx, uint8_t digest[16]);
+void md5_digest(const void *data, size_t len, uint8_t digest[16]);
+
+#endif // MD5_H
@@ -0,0 +1,169 @@
+/**
+ * Budget mémoire - Comptabilité des tampons de l'agent sous une limite globale
+ *
+ * Les buffers, allocations et rédacteurs JSON de la bibliothèque Rust signalent chaque
+ * variation de capacité (rust_set_charge_hook) ; le chemin des réponses C impute ce qu'il
+ * garde pendant l'envoi (mem_budget_hold). Une hausse qui dépasserait le budget est
+ * refusée : la croissance du tampon échoue et la requête se termine avec une erreur
+ * explicite au lieu de pousser l'agent vers MemoryMax.
+ *
+ * Chaque hausse est aussi attribuée à la requête en cours sur le thread et, si elle est
+ * connue, à sa session ; pics et refus sont exposés dans CMD_STATS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem_budget.h"
+#include "memory.h"
+#include "agent.h"
+
+static uint64_t budget = MEM_BUDGET_DEFAULT_BYTES;
+static atomic_llong used = 0;
+static atomic_llong peak = 0;
+static atomic_ullong stat_refused = 0;
+static atomic_llong request_peak_max = 0;
+
+static __thread mem_request_t *current = NULL;
+
+static void raise_peak(atomic_llong *p, long long value) {
+    long long seen = atomic_load_explicit(p, memory_order_relaxed);
+    while (value > seen && !atomic_compare_exchange_weak_explicit(p, &seen, value,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Imputer delta octets à la requête et à la session courantes
+ */
+static void attribute(ptrdiff_t delta) {
+    mem_request_t *req = current;
+    if (!req) return;
+    req->used += delta;
+    if (req->used > req->peak) req->peak = req->used;
+    mem_counter_t *session = req->sessions[req->active];
+    if (session) {
+        req->session_used[req->active] += delta;
+        long long now = atomic_fetch_add_explicit(&session->used, delta, memory_order_relaxed) + delta;
+        raise_peak(&session->peak, now);
+    }
+}
+
+static int charge(ptrdiff_t delta, bool report_refusal) {
+    long long now = atomic_fetch_add_explicit(&used, delta, memory_order_relaxed) + delta;
+    if (delta > 0 && (uint64_t)now > budget) {
+        atomic_fetch_sub_explicit(&used, delta, memory_order_relaxed);
+        if (report_refusal) {
+            atomic_fetch_add_explicit(&stat_refused, 1, memory_order_relaxed);
+            if (current) current->refused = true;
+        }
+        return -1;
+    }
+    if (delta > 0) raise_peak(&peak, now);
+    attribute(delta);
+    return 0;
+}
+
+/**
+ * Fonction de comptabilité des tampons Rust
+ * @return 0, ou -1 si la hausse dépasserait le budget (rien n'est imputé)
+ */
+int mem_budget_charge(ptrdiff_t delta) {
+    return charge(delta, true);
+}
+
+/**
+ * Comme mem_budget_charge, pour une mémoire facultative (entrée de cache) : un refus
+ * n'est ni compté ni signalé à la requête en cours
+ */
+int mem_budget_try_charge(ptrdiff_t delta) {
+    return charge(delta, false);
+}
+
+/**
+ * Imputer sans refus (mémoire déjà allouée : réponse en cours d'envoi, anneaux partagés)
+ */
+void mem_budget_hold(ptrdiff_t delta) {
+    long long now = atomic_fetch_add_explicit(&used, delta, memory_order_relaxed) + delta;
+    if (delta > 0) raise_peak(&peak, now);
+    attribute(delta);
+}
+
+static int charge_hook(ptrdiff_t delta) {
+    return mem_budget_charge(delta);
+}
+
+/**
+ * @param budget_bytes Limite globale (0 = MEM_BUDGET_DEFAULT_BYTES)
+ */
+void mem_budget_init(uint64_t budget_bytes) {
+    budget = budget_bytes ? budget_bytes : MEM_BUDGET_DEFAULT_BYTES;
+    rust_set_charge_hook(charge_hook);
+    DEBUG_PRINT("[Mémoire] Budget %llu octets\n", (unsigned long long)budget);
+}
+
+uint64_t mem_budget_limit(void) {
+    return budget;
+}
+
+/**
+ * Budget presque atteint : les nouvelles opérations SSH sont refusées (RESP_BUSY)
+ */
+bool mem_budget_exhausted(void) {
+    long long now = atomic_load_explicit(&used, memory_order_relaxed);
+    return now > 0 && (uint64_t)now >= budget / 100 * MEM_BUDGET_ADMIT_PERCENT;
+}
+
+void mem_request_begin(mem_request_t *req) {
+    memset(req, 0, sizeof(*req));
+    current = req;
+}
+
+/**
+ * Fin de la requête : ce qu'elle détient encore n'est plus attribué à ses sessions
+ */
+void mem_request_end(mem_request_t *req) {
+    for (int i = 0; i < MEM_REQUEST_SESSIONS; i++) {
+        if (req->sessions[i] && req->session_used[i] != 0) {
+            atomic_fetch_sub_explicit(&req->sessions[i]->used, req->session_used[i], memory_order_relaxed);
+        }
+    }
+    raise_peak(&request_peak_max, req->peak);
+    if (current == req) current = NULL;
+}
+
+/**
+ * Attribuer la suite de la requête courante à une session
+ */
+void mem_request_set_session(mem_counter_t *session) {
+    if (!current || current->sessions[0]) return;
+    current->sessions[0] = session;
+}
+
+/**
+ * Attribuer les hausses suivantes à l'une des sessions de la requête (ajoutée au besoin,
+ * dans la limite de MEM_REQUEST_SESSIONS) : un relais impute à chaque côté ses tampons
+ */
+void mem_request_select_session(mem_counter_t *session) {
+    if (!current) return;
+    for (int i = 0; i < MEM_REQUEST_SESSIONS; i++) {
+        if (!current->sessions[i]) current->sessions[i] = session;
+        if (current->sessions[i] == session) {
+            current->active = i;
+            return;
+        }
+    }
+}
+
+bool mem_request_refused(void) {
+    return current && current->refused;
+}
+
+int mem_budget_stats_json(char *buf, size_t size) {
+    return snprintf(buf, size,
+                    "{\"budget\":%llu,\"used\":%lld,\"peak\":%lld,\"refused\":%llu,\"request_peak_max\":%lld}",
+                    (unsigned long long)budget, atomic_load(&used), atomic_load(&peak),
+                    (unsigned long long)atomic_load(&stat_refused), atomic_load(&request_peak_max));
+}
@@ -0,0 +1,47 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Sous MemoryMax=512M (krown-agent.service) : marge pour les piles, libssh et json-c
+#define MEM_BUDGET_DEFAULT_BYTES (384ULL * 1024 * 1024)
+#define MEM_BUDGET_ADMIT_PERCENT 90     // Au-delà, les nouvelles opérations SSH sont refusées
+#define MEM_BUDGET_RETRY_AFTER_MS 1000  // retry_after_ms de ces refus
+
+// Consommation d'une session (somme des requêtes en cours sur la session)
+typedef struct {
+    atomic_llong used;
+    atomic_llong peak;
+} mem_counter_t;
+
+#define MEM_REQUEST_SESSIONS 2     // Sessions d'une requête (relais : source et sink)
+
+// Compte de la requête en cours sur ce thread
+typedef struct {
+    int64_t used;
+    int64_t peak;
+    bool refused;               // Une allocation a été refusée (budget dépassé)
+    mem_counter_t *sessions[MEM_REQUEST_SESSIONS];
+    int64_t session_used[MEM_REQUEST_SESSIONS];    // Parts imputées, rendues à la fin de la requête
+    int active;                 // Session à laquelle les hausses sont attribuées
+} mem_request_t;
+
+void mem_budget_init(uint64_t budget_bytes);
+uint64_t mem_budget_limit(void);
+int mem_budget_charge(ptrdiff_t delta);
+int mem_budget_try_charge(ptrdiff_t delta);
+void mem_budget_hold(ptrdiff_t delta);
+bool mem_budget_exhausted(void);
+
+void mem_request_begin(mem_request_t *req);
+void mem_request_end(mem_request_t *req);
+void mem_request_set_session(mem_counter_t *session);
+void mem_request_select_session(mem_counter_t *session);
+bool mem_request_refused(void);
+
+int mem_budget_stats_json(char *buf, size_t size);
+
+#endif // MEM_BUDGET_H
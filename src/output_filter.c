@@ -0,0 +1,375 @@
+/**
+ * Filtre de sortie - head / tail / max_bytes / grep appliqués pendant la lecture
+ *
+ * Les octets reçus du canal passent par le filtre avant d'être mis en tampon : seule la
+ * partie retenue est copiée, échappée et envoyée au client. Ordre d'application, comme
+ * `grep | head | tail` : sélection des lignes, N premières, N dernières, puis max_bytes.
+ * Les coupes respectent les frontières UTF-8. L'anneau de tail et les lignes en cours
+ * sont imputés au budget mémoire : une croissance refusée arrête le filtrage.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <regex.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "output_filter.h"
+#include "memory.h"
+#include "mem_budget.h"
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} filter_line_t;
+
+struct output_filter {
+    size_t head;                // 0 = désactivé (idem pour tail et max_bytes)
+    size_t tail;
+    size_t max_bytes;
+    char *grep;                 // NULL = toutes les lignes
+    size_t grep_len;
+    bool use_regex;
+    regex_t regex;
+    bool lines;                 // Découpage en lignes nécessaire (head, tail ou grep)
+    filter_line_t partial;      // Ligne en cours (reçue en plusieurs morceaux)
+    filter_line_t *ring;        // tail : N dernières lignes retenues
+    size_t ring_start;
+    size_t ring_count;
+    size_t selected;            // Lignes retenues par grep et head
+    size_t out_bytes;
+    bool truncated;
+    bool complete;
+    int out_fd;                 // >= 0 : sortie brute vers ce descripteur plutôt que le rédacteur
+    int64_t out_deadline_ms;    // Échéance des écritures sur out_fd (0 = aucune)
+    exec_handle_t *out_handle;  // Annulation des écritures sur out_fd
+    size_t charged;             // Octets imputés au budget mémoire (anneau et lignes)
+};
+
+/**
+ * Écrire data à la position at (la ligne reste terminée par '\0' pour regexec)
+ */
+static int line_set(output_filter_t *f, filter_line_t *line, size_t at, const char *data, size_t len) {
+    if (at + len + 1 > line->cap) {
+        size_t cap = line->cap ? line->cap : 256;
+        while (cap < at + len + 1) cap *= 2;
+        if (mem_budget_charge((ptrdiff_t)(cap - line->cap)) < 0) return -1;
+        char *grown = realloc(line->data, cap);
+        if (!grown) {
+            mem_budget_charge(-(ptrdiff_t)(cap - line->cap));
+            return -1;
+        }
+        f->charged += cap - line->cap;
+        line->data = grown;
+        line->cap = cap;
+    }
+    memcpy(line->data + at, data, len);
+    line->len = at + len;
+    line->data[line->len] = '\0';
+    return 0;
+}
+
+/**
+ * Longueur d'un préfixe de data de n octets au plus, sans couper de caractère UTF-8
+ */
+static size_t utf8_prefix(const char *data, size_t len, size_t n) {
+    if (n >= len) return len;
+    while (n > 0 && ((unsigned char)data[n] & 0xC0) == 0x80) n--;
+    return n;
+}
+
+static bool line_matches(output_filter_t *f, const char *data, size_t len) {
+    if (!f->grep) return true;
+    if (!f->use_regex) return f->grep_len == 0 || memmem(data, len, f->grep, f->grep_len) != NULL;
+    // REG_STARTEND : le '\n' final et d'éventuels octets nuls ne comptent pas
+    regmatch_t match = { .rm_so = 0, .rm_eo = (regoff_t)len };
+    return regexec(&f->regex, data, 1, &match, REG_STARTEND) == 0;
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Écrire tout le bloc sur un descripteur (attente si le descripteur est non bloquant ;
+ * les descripteurs reçus par SCM_RIGHTS le sont toujours, cf. read_header)
+ * L'attente est bornée par deadline_ms (horloge monotone, 0 = aucune) et s'interrompt
+ * dès que handle est annulé : le lecteur qui ne consomme plus ne retient pas la commande
+ * @return 0, ou -1 (lecteur parti, disque plein... ; errno ETIMEDOUT ou ECANCELED)
+ */
+int output_write_fd(int fd, const char *data, size_t len, int64_t deadline_ms, exec_handle_t *handle) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (exec_handle_cancelled(handle)) {
+                    errno = ECANCELED;
+                    return -1;
+                }
+                int wait_ms = OUTPUT_WRITE_POLL_MS;
+                if (deadline_ms) {
+                    int64_t remaining = deadline_ms - monotonic_ms();
+                    if (remaining <= 0) {
+                        errno = ETIMEDOUT;
+                        return -1;
+                    }
+                    if (remaining < wait_ms) wait_ms = (int)remaining;
+                }
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) return -1;
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+static int append(output_filter_t *f, void *out, const char *data, size_t len) {
+    if (f->out_fd >= 0) return output_write_fd(f->out_fd, data, len, f->out_deadline_ms, f->out_handle);
+    return rust_json_string_append(out, data, len);
+}
+
+static int emit(output_filter_t *f, const char *data, size_t len, void *out) {
+    if (f->max_bytes && f->out_bytes + len > f->max_bytes) {
+        len = utf8_prefix(data, len, f->max_bytes - f->out_bytes);
+        f->truncated = true;
+        f->complete = true;
+    }
+    if (len > 0 && append(f, out, data, len) != 0) return FILTER_ERROR;
+    f->out_bytes += len;
+    return f->complete ? FILTER_COMPLETE : FILTER_CONTINUE;
+}
+
+/**
+ * Traiter une ligne complète (avec son '\n' final s'il existe)
+ */
+static int process_line(output_filter_t *f, const char *data, size_t len, void *out) {
+    size_t text_len = (len > 0 && data[len - 1] == '\n') ? len - 1 : len;
+    if (!line_matches(f, data, text_len)) return FILTER_CONTINUE;
+    f->selected++;
+
+    int rc;
+    if (f->tail) {
+        filter_line_t *slot;
+        if (f->ring_count < f->tail) {
+            slot = &f->ring[(f->ring_start + f->ring_count++) % f->tail];
+        } else {
+            slot = &f->ring[f->ring_start];
+            f->ring_start = (f->ring_start + 1) % f->tail;
+            f->truncated = true;
+        }
+        rc = line_set(f, slot, 0, data, len) == 0 ? FILTER_CONTINUE : FILTER_ERROR;
+    } else {
+        rc = emit(f, data, len, out);
+    }
+
+    // head atteint : la suite ne sera pas retenue (comme `| head`, la lecture peut s'arrêter)
+    if (rc == FILTER_CONTINUE && f->head && f->selected >= f->head) {
+        f->complete = true;
+        rc = FILTER_COMPLETE;
+    }
+    return rc;
+}
+
+/**
+ * Créer un filtre à partir des options de la requête
+ * @param filter NULL si aucune option de filtrage n'est présente
+ * @return 0, ou -1 avec *error renseigné (options invalides)
+ */
+int output_filter_create(json_object *root, output_filter_t **filter, const char **error) {
+    *filter = NULL;
+    json_object *head_obj, *tail_obj, *max_obj, *grep_obj, *regex_obj;
+    bool has_head = json_object_object_get_ex(root, "head", &head_obj);
+    bool has_tail = json_object_object_get_ex(root, "tail", &tail_obj);
+    bool has_max = json_object_object_get_ex(root, "max_bytes", &max_obj);
+    bool has_grep = json_object_object_get_ex(root, "grep", &grep_obj);
+    if (!has_head && !has_tail && !has_max && !has_grep) return 0;
+
+    int64_t head = has_head ? json_object_get_int64(head_obj) : 0;
+    int64_t tail = has_tail ? json_object_get_int64(tail_obj) : 0;
+    int64_t max_bytes = has_max ? json_object_get_int64(max_obj) : 0;
+    if (head < 0 || tail < 0 || max_bytes < 0) {
+        *error = "head, tail et max_bytes doivent être positifs";
+        return -1;
+    }
+    if (tail > OUTPUT_FILTER_MAX_TAIL) {
+        *error = "tail trop grand";
+        return -1;
+    }
+
+    output_filter_t *f = calloc(1, sizeof(output_filter_t));
+    if (!f) {
+        *error = "Erreur d'allocation mémoire";
+        return -1;
+    }
+    f->head = (size_t)head;
+    f->tail = (size_t)tail;
+    f->max_bytes = (size_t)max_bytes;
+    f->out_fd = -1;
+
+    if (has_grep) {
+        f->grep = strdup(json_object_get_string(grep_obj));
+        f->grep_len = f->grep ? strlen(f->grep) : 0;
+        f->use_regex = json_object_object_get_ex(root, "grep_regex", &regex_obj) &&
+                       json_object_get_boolean(regex_obj);
+        if (!f->grep || (f->use_regex && regcomp(&f->regex, f->grep, REG_EXTENDED | REG_NOSUB) != 0)) {
+            *error = f->grep ? "Expression grep invalide" : "Erreur d'allocation mémoire";
+            f->use_regex = false;
+            output_filter_free(f);
+            return -1;
+        }
+    }
+    if (f->tail) {
+        size_t ring_size = f->tail * sizeof(filter_line_t);
+        if (mem_budget_charge((ptrdiff_t)ring_size) < 0) {
+            *error = "Budget mémoire dépassé : tail trop grand";
+            output_filter_free(f);
+            return -1;
+        }
+        f->charged = ring_size;
+        f->ring = calloc(f->tail, sizeof(filter_line_t));
+        if (!f->ring) {
+            *error = "Erreur d'allocation mémoire";
+            output_filter_free(f);
+            return -1;
+        }
+    }
+    f->lines = f->head || f->tail || f->grep;
+    *filter = f;
+    return 0;
+}
+
+/**
+ * Passer un morceau de sortie au filtre ; la partie retenue est ajoutée à out (rédacteur
+ * JSON dont la chaîne est ouverte : elle est échappée au passage), ou écrite telle quelle
+ * sur le descripteur de output_filter_set_fd()
+ * @return FILTER_CONTINUE, FILTER_COMPLETE (rien d'autre ne sera retenu) ou FILTER_ERROR
+ */
+int output_filter_feed(output_filter_t *f, const char *data, size_t len, void *out) {
+    if (f->complete) {
+        if (len > 0) f->truncated = true;
+        return FILTER_COMPLETE;
+    }
+    if (!f->lines) return emit(f, data, len, out);
+
+    const char *p = data, *end = data + len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t n = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+        int rc = FILTER_CONTINUE;
+
+        if (f->partial.len == 0 && nl && n <= OUTPUT_FILTER_MAX_LINE && !f->use_regex) {
+            // Ligne entière dans le morceau : aucune copie (regexec exige une chaîne terminée)
+            rc = process_line(f, p, n, out);
+        } else {
+            size_t text = nl ? n - 1 : n;
+            size_t room = f->partial.len < OUTPUT_FILTER_MAX_LINE ? OUTPUT_FILTER_MAX_LINE - f->partial.len : 0;
+            size_t take = text < room ? text : room;
+            if (take < text) f->truncated = true;
+            if (take > 0 && line_set(f, &f->partial, f->partial.len, p, take) != 0) return FILTER_ERROR;
+            if (nl) {
+                if (line_set(f, &f->partial, f->partial.len, "\n", 1) != 0) return FILTER_ERROR;
+                rc = process_line(f, f->partial.data, f->partial.len, out);
+                f->partial.len = 0;
+            }
+        }
+
+        p += n;
+        if (rc != FILTER_CONTINUE) {
+            if (rc == FILTER_COMPLETE && p < end) f->truncated = true;
+            return rc;
+        }
+    }
+    return FILTER_CONTINUE;
+}
+
+/**
+ * Fin de la sortie : dernière ligne sans '\n' et lignes conservées par tail
+ */
+int output_filter_finish(output_filter_t *f, void *out) {
+    if (f->partial.len > 0 && !f->complete) {
+        if (process_line(f, f->partial.data, f->partial.len, out) == FILTER_ERROR) return -1;
+    }
+    f->partial.len = 0;
+    if (!f->tail) return 0;
+
+    // max_bytes avec tail : on garde la fin
+    size_t total = 0;
+    for (size_t i = 0; i < f->ring_count; i++) total += f->ring[(f->ring_start + i) % f->tail].len;
+    size_t skip = (f->max_bytes && total > f->max_bytes) ? total - f->max_bytes : 0;
+    if (skip) f->truncated = true;
+
+    for (size_t i = 0; i < f->ring_count; i++) {
+        filter_line_t *line = &f->ring[(f->ring_start + i) % f->tail];
+        if (skip >= line->len) {
+            skip -= line->len;
+            continue;
+        }
+        const char *d = line->data + skip;
+        size_t l = line->len - skip;
+        if (skip) {
+            while (l > 0 && ((unsigned char)*d & 0xC0) == 0x80) {
+                d++;
+                l--;
+            }
+            skip = 0;
+        }
+        if (l > 0 && append(f, out, d, l) != 0) return -1;
+        f->out_bytes += l;
+    }
+    f->ring_count = 0;
+    return 0;
+}
+
+/**
+ * Envoyer la partie retenue sur un descripteur (octets bruts) au lieu du rédacteur JSON,
+ * avec l'échéance et l'annulation de la requête (voir output_write_fd)
+ */
+void output_filter_set_fd(output_filter_t *f, int fd, int64_t deadline_ms, exec_handle_t *handle) {
+    f->out_fd = fd;
+    f->out_deadline_ms = deadline_ms;
+    f->out_handle = handle;
+}
+
+/**
+ * Octets retenus jusqu'ici
+ */
+size_t output_filter_bytes(const output_filter_t *f) {
+    return f->out_bytes;
+}
+
+bool output_filter_truncated(const output_filter_t *f) {
+    return f->truncated;
+}
+
+/**
+ * Représentation du filtre pour la clé du cache de résultats
+ */
+int output_filter_key(const output_filter_t *f, char *buf, size_t size) {
+    return snprintf(buf, size, "head=%zu;tail=%zu;max=%zu;%s=%s", f->head, f->tail, f->max_bytes,
+                    f->use_regex ? "regex" : "grep", f->grep ? f->grep : "");
+}
+
+void output_filter_free(output_filter_t *f) {
+    if (!f) return;
+    if (f->use_regex) regfree(&f->regex);
+    free(f->grep);
+    free(f->partial.data);
+    if (f->ring) {
+        for (size_t i = 0; i < f->tail; i++) free(f->ring[i].data);
+        free(f->ring);
+    }
+    mem_budget_charge(-(ptrdiff_t)f->charged);
+    free(f);
+}
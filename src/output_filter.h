@@ -0,0 +1,32 @@
+#ifndef OUTPUT_FILTER_H
+#define OUTPUT_FILTER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+#include "exec_registry.h"
+
+#define OUTPUT_FILTER_MAX_LINE (64 * 1024)  // Au-delà, la fin de la ligne est ignorée
+#define OUTPUT_FILTER_MAX_TAIL 100000       // Lignes conservées au plus par "tail"
+#define OUTPUT_WRITE_POLL_MS 100            // Attente max. entre deux vérifications d'annulation
+
+typedef struct output_filter output_filter_t;
+
+// Code de retour de output_filter_feed()
+#define FILTER_CONTINUE 0
+#define FILTER_COMPLETE 1           // Plus rien ne sera retenu : la lecture peut s'arrêter
+#define FILTER_ERROR -1
+
+int output_filter_create(json_object *root, output_filter_t **filter, const char **error);
+int output_filter_feed(output_filter_t *f, const char *data, size_t len, void *out);
+int output_filter_finish(output_filter_t *f, void *out);
+void output_filter_set_fd(output_filter_t *f, int fd, int64_t deadline_ms, exec_handle_t *handle);
+size_t output_filter_bytes(const output_filter_t *f);
+bool output_filter_truncated(const output_filter_t *f);
+int output_filter_key(const output_filter_t *f, char *buf, size_t size);
+void output_filter_free(output_filter_t *f);
+int output_write_fd(int fd, const char *data, size_t len, int64_t deadline_ms, exec_handle_t *handle);
+
+#endif // OUTPUT_FILTER_H
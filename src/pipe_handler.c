@@ -0,0 +1,326 @@
+/**
+ * Relais entre sessions - stdout d'une commande sur une session vers stdin d'une commande
+ * sur une autre (pg_dump | psql, tar c | tar x d'un hôte à l'autre)
+ *
+ * Les octets passent d'un canal à l'autre par un tampon fixe (PIPE_RELAY_BYTES), sans être
+ * conservés ni mis en JSON. Le tampon n'est rempli à nouveau qu'une fois vidé dans la
+ * fenêtre SSH du consommateur : tant qu'elle est pleine, le producteur n'est plus lu et sa
+ * propre fenêtre se referme, ce qui le freine. stderr des deux commandes et stdout du
+ * consommateur sont lus en parallèle et conservés dans la limite de PIPE_CAPTURE_BYTES.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <json-c/json.h>
+#include <libssh/libssh.h>
+
+#include "pipe_handler.h"
+#include "ssh_handler.h"
+#include "exec_registry.h"
+#include "mem_budget.h"
+#include "json_macros.h"
+#include "logger.h"
+#include "memory.h"
+
+#define PIPE_SCRATCH_BYTES (16 * 1024)      // Lecture des flux annexes
+
+// Extrémité du tube : une commande sur une session
+typedef struct {
+    const char *session_id;
+    const char *command;
+    ssh_session_t *sess;
+    ssh_channel channel;
+    void *out;                  // stdout conservé (consommateur seulement)
+    void *err;                  // stderr conservé
+    bool out_done;
+    bool err_done;
+    int exit_code;
+} pipe_end_t;
+
+// Déroulement du relais
+typedef struct {
+    uint64_t bytes;             // Octets transmis au consommateur
+    bool sink_closed;           // Le consommateur a cessé de lire : producteur arrêté
+    bool timed_out;
+    bool cancelled;
+    bool truncated;             // Une sortie conservée a été tronquée
+} pipe_result_t;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void end_signal(pipe_end_t *end, bool kill) {
+    if (!ssh_handler_lock(end->sess)) return;
+    if (kill) {
+        end->sess->backend->kill(end->channel);
+    } else {
+        end->sess->backend->send_eof(end->channel);
+    }
+    ssh_handler_unlock(end->sess);
+}
+
+/**
+ * Lire un flux annexe sans attendre ; au-delà de PIPE_CAPTURE_BYTES il est lu et jeté
+ * @return true si des octets ont été lus
+ */
+static bool drain(pipe_end_t *end, int is_stderr, char *scratch, pipe_result_t *result) {
+    bool *done = is_stderr ? &end->err_done : &end->out_done;
+    void *capture = is_stderr ? end->err : end->out;
+    int n = ssh_handler_channel_read(end->sess, end->channel, scratch, PIPE_SCRATCH_BYTES, is_stderr, 0);
+    if (n == 0 || n == SSH_ERROR) {
+        *done = true;
+        return false;
+    }
+    if (n < 0) return false;
+
+    size_t kept = rust_buffer_len(capture);
+    size_t room = kept < PIPE_CAPTURE_BYTES ? PIPE_CAPTURE_BYTES - kept : 0;
+    size_t keep = (size_t)n < room ? (size_t)n : room;
+    mem_request_select_session(&end->sess->mem);
+    if (keep < (size_t)n || (keep > 0 && rust_buffer_append(capture, scratch, keep) != 0)) {
+        result->truncated = true;
+    }
+    return true;
+}
+
+/**
+ * Relayer stdout du producteur vers stdin du consommateur jusqu'à la fin des deux commandes
+ */
+static void relay(pipe_end_t *src, pipe_end_t *dst, int timeout_ms, exec_handle_t *handle,
+                  char *buf, char *scratch, pipe_result_t *result) {
+    int64_t deadline = timeout_ms > 0 ? now_ms() + timeout_ms : 0;
+    uint32_t len = 0, off = 0;
+    bool eof_sent = false, src_out_done = false;
+
+    while (!src_out_done || off < len || !src->err_done || !dst->out_done || !dst->err_done) {
+        bool progress = false;
+
+        if (off == len && !src_out_done) {
+            int n = ssh_handler_channel_read(src->sess, src->channel, buf, PIPE_RELAY_BYTES, 0, 0);
+            if (n > 0) {
+                len = (uint32_t)n;
+                off = 0;
+                progress = true;
+            } else if (n == 0 || n == SSH_ERROR) {
+                src_out_done = true;
+            }
+        }
+        if (off < len) {
+            int n = result->sink_closed ? SSH_ERROR
+                                        : ssh_handler_channel_write_some(dst->sess, dst->channel, buf + off, len - off);
+            if (n == SSH_ERROR) {
+                // Consommateur parti : le producteur est arrêté (comme SIGPIPE dans un tube)
+                if (!result->sink_closed) end_signal(src, true);
+                result->sink_closed = true;
+                off = len;
+            } else {
+                off += (uint32_t)n;
+                result->bytes += (uint64_t)n;
+                progress |= n > 0;
+            }
+        }
+        if (src_out_done && off == len && !eof_sent) {
+            if (!result->sink_closed) end_signal(dst, false);
+            eof_sent = true;
+        }
+
+        if (!src->err_done) progress |= drain(src, 1, scratch, result);
+        if (!dst->out_done) progress |= drain(dst, 0, scratch, result);
+        if (!dst->err_done) progress |= drain(dst, 1, scratch, result);
+
+        // Consommateur terminé alors que le producteur tourne encore
+        if (dst->out_done && dst->err_done && !src_out_done && !result->sink_closed) {
+            end_signal(src, true);
+            result->sink_closed = true;
+        }
+
+        if (exec_handle_cancelled(handle)) {
+            result->cancelled = true;
+            break;
+        }
+        if (deadline && now_ms() >= deadline) {
+            result->timed_out = true;
+            break;
+        }
+        if (!progress) ssh_handler_wait_pair(src->sess, dst->sess, 10);
+    }
+
+    bool stopped = result->cancelled || result->timed_out;
+    pipe_end_t *ends[2] = { src, dst };
+    for (int i = 0; i < 2; i++) {
+        ends[i]->exit_code = -1;
+        if (!ssh_handler_lock(ends[i]->sess)) continue;
+        if (stopped) {
+            ends[i]->sess->backend->kill(ends[i]->channel);
+        } else {
+            ends[i]->exit_code = ends[i]->sess->backend->exit_status(ends[i]->channel);
+        }
+        ssh_handler_unlock(ends[i]->sess);
+    }
+}
+
+static int write_capture(void *writer, const char *key, void *capture) {
+    size_t len = rust_buffer_len(capture);
+    if (len == 0) return 0;
+    int rc = rust_json_key(writer, key);
+    rc |= rust_json_string_begin(writer);
+    rc |= rust_json_string_append(writer, rust_buffer_data(capture), len);
+    rc |= rust_json_string_end(writer);
+    return rc;
+}
+
+static char* build_response(const pipe_end_t *src, const pipe_end_t *dst, const pipe_result_t *result,
+                            int64_t duration_ms) {
+    void *writer = rust_json_new(1024 + rust_buffer_len(src->err) + rust_buffer_len(dst->out) +
+                                 rust_buffer_len(dst->err));
+    if (!writer) return NULL;
+    int rc = rust_json_begin_object(writer);
+    rc |= rust_json_key(writer, "bytes_transferred");
+    rc |= rust_json_uint(writer, result->bytes);
+    rc |= rust_json_key(writer, "duration_ms");
+    rc |= rust_json_int(writer, duration_ms);
+    rc |= rust_json_key(writer, "source");
+    rc |= rust_json_begin_object(writer);
+    rc |= rust_json_key(writer, "exit_code");
+    rc |= rust_json_int(writer, src->exit_code);
+    rc |= write_capture(writer, "stderr", src->err);
+    rc |= rust_json_end_object(writer);
+    rc |= rust_json_key(writer, "sink");
+    rc |= rust_json_begin_object(writer);
+    rc |= rust_json_key(writer, "exit_code");
+    rc |= rust_json_int(writer, dst->exit_code);
+    rc |= write_capture(writer, "output", dst->out);
+    rc |= write_capture(writer, "stderr", dst->err);
+    rc |= rust_json_end_object(writer);
+    if (result->sink_closed) {
+        rc |= rust_json_key(writer, "sink_closed");
+        rc |= rust_json_bool(writer, true);
+    }
+    if (result->truncated) {
+        rc |= rust_json_key(writer, "truncated");
+        rc |= rust_json_bool(writer, true);
+    }
+    if (result->cancelled || result->timed_out) {
+        rc |= rust_json_key(writer, result->cancelled ? "cancelled" : "timed_out");
+        rc |= rust_json_bool(writer, true);
+    }
+    rc |= rust_json_end_object(writer);
+
+    char *json = rust_json_finish(writer, NULL);
+    if (rc != 0) {
+        free(json);
+        return NULL;
+    }
+    return json;
+}
+
+/**
+ * Gérer CMD_SSH_PIPE
+ * {"source":{"session_id","command"},"sink":{"session_id","command"},"timeout_ms","request_id"}
+ * Les deux sessions peuvent être identiques (deux canaux sur la même connexion).
+ */
+response_code_t handle_ssh_pipe(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root, *source, *sink;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+    JSON_GET_OBJECT_OR_RETURN(root, "source", source, "source requis (objet session_id, command)");
+    JSON_GET_OBJECT_OR_RETURN(root, "sink", sink, "sink requis (objet session_id, command)");
+
+    pipe_end_t src = {0}, dst = {0};
+    JSON_GET_MEMBER_STRING_OR_RETURN(root, source, "session_id", src.session_id, "source.session_id requis");
+    JSON_GET_MEMBER_STRING_OR_RETURN(root, source, "command", src.command, "source.command requis");
+    JSON_GET_MEMBER_STRING_OR_RETURN(root, sink, "session_id", dst.session_id, "sink.session_id requis");
+    JSON_GET_MEMBER_STRING_OR_RETURN(root, sink, "command", dst.command, "sink.command requis");
+
+    int timeout_ms = ssh_handler_exec_timeout_ms();
+    json_object *timeout_obj;
+    if (json_object_object_get_ex(root, "timeout_ms", &timeout_obj) && json_object_get_int(timeout_obj) >= 0) {
+        timeout_ms = json_object_get_int(timeout_obj);
+    }
+
+    src.sess = ssh_handler_find(src.session_id);
+    dst.sess = ssh_handler_find(dst.session_id);
+    if (!src.sess || !dst.sess) {
+        json_object_put(root);
+        *response = strdup(src.sess ? "{\"error\":\"Session sink introuvable ou déconnectée\"}"
+                                    : "{\"error\":\"Session source introuvable ou déconnectée\"}");
+        return RESP_ERROR;
+    }
+
+    exec_handle_t *handle = NULL;
+    json_object *request_id_obj;
+    if (json_object_object_get_ex(root, "request_id", &request_id_obj)) {
+        handle = exec_registry_register(json_object_get_string(request_id_obj));
+        if (!handle) {
+            json_object_put(root);
+            *response = strdup("{\"error\":\"request_id invalide ou déjà en cours\"}");
+            return RESP_ERROR;
+        }
+    }
+
+    // Tampon du relais imputé au budget mémoire (et à la source) ; les sorties conservées
+    // passent par Rust et sont attribuées à la session qui les produit
+    mem_request_set_session(&src.sess->mem);
+    bool charged = mem_budget_charge(PIPE_RELAY_BYTES) == 0;
+    char *buf = charged ? malloc(PIPE_RELAY_BYTES) : NULL;
+    char *scratch = malloc(PIPE_SCRATCH_BYTES);
+    src.err = rust_buffer_new(1024);
+    mem_request_select_session(&dst.sess->mem);
+    dst.out = rust_buffer_new(1024);
+    dst.err = rust_buffer_new(1024);
+    mem_request_select_session(&src.sess->mem);
+
+    response_code_t code;
+    if (!buf || !scratch || !src.err || !dst.out || !dst.err) {
+        *response = strdup(charged ? "{\"error\":\"Erreur d'allocation mémoire\"}"
+                                   : "{\"error\":\"Budget mémoire dépassé\"}");
+        code = RESP_ERROR;
+    } else if (!(dst.channel = ssh_handler_open_exec(dst.sess, dst.command))) {
+        *response = strdup("{\"error\":\"Impossible de lancer la commande sink\"}");
+        code = RESP_SSH_ERROR;
+    } else if (!(src.channel = ssh_handler_open_exec(src.sess, src.command))) {
+        end_signal(&dst, true);
+        ssh_handler_close_channel(dst.sess, dst.channel);
+        *response = strdup("{\"error\":\"Impossible de lancer la commande source\"}");
+        code = RESP_SSH_ERROR;
+    } else {
+        // Le producteur n'a pas d'entrée (comme `< /dev/null`)
+        end_signal(&src, false);
+        DEBUG_PRINT("[Pipe] %s -> %s\n", src.session_id, dst.session_id);
+        pipe_result_t result = {0};
+        int64_t start = now_ms();
+        relay(&src, &dst, timeout_ms, handle, buf, scratch, &result);
+        ssh_handler_close_channel(src.sess, src.channel);
+        ssh_handler_close_channel(dst.sess, dst.channel);
+
+        mem_request_select_session(&src.sess->mem);
+        *response = build_response(&src, &dst, &result, now_ms() - start);
+        if (!*response) {
+            *response = strdup(mem_request_refused() ? "{\"error\":\"Budget mémoire dépassé\"}"
+                                                     : "{\"error\":\"Erreur d'allocation mémoire\"}");
+            code = RESP_ERROR;
+        } else {
+            code = result.cancelled ? RESP_CANCELLED : RESP_OK;
+        }
+    }
+
+    free(buf);
+    if (charged) mem_budget_charge(-PIPE_RELAY_BYTES);
+    free(scratch);
+    if (src.err) rust_buffer_free(src.err);
+    mem_request_select_session(&dst.sess->mem);
+    if (dst.out) rust_buffer_free(dst.out);
+    if (dst.err) rust_buffer_free(dst.err);
+    exec_registry_unregister(handle);
+    json_object_put(root);
+    return code;
+}
@@ -0,0 +1,11 @@
+#ifndef PIPE_HANDLER_H
+#define PIPE_HANDLER_H
+
+#include "agent.h"
+
+#define PIPE_RELAY_BYTES (256 * 1024)       // Tampon du relais stdout -> stdin (fixe)
+#define PIPE_CAPTURE_BYTES (64 * 1024)      // Sortie conservée par flux annexe (stderr, stdout du consommateur)
+
+response_code_t handle_ssh_pipe(const char *json_data, char **response);
+
+#endif // PIPE_HANDLER_H
@@ -0,0 +1,126 @@
+/**
+ * Profils de connexion - Réglages de transport nommés, chargés depuis un fichier JSON
+ *
+ * {"profiles":{"lan":{"ciphers":"aes128-gcm@openssh.com","compression":false,"read_chunk":262144},
+ *              "wan":{"ciphers":"chacha20-poly1305@openssh.com","compression":true,"compression_level":6}}}
+ *
+ * libssh n'expose pas la taille de fenêtre des canaux : les tailles réglables ici sont
+ * celles que l'agent contrôle (lectures de canal, requêtes SFTP et nombre en vol).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json-c/json.h>
+#include <libssh/libssh.h>
+
+#include "profile.h"
+#include "agent.h"
+#include "logger.h"
+
+static connection_profile_t profiles[MAX_PROFILES];
+static int profile_count = 0;
+
+static void copy_string_field(json_object *obj, const char *key, char *dest, size_t dest_size) {
+    json_object *value;
+    if (json_object_object_get_ex(obj, key, &value)) {
+        snprintf(dest, dest_size, "%s", json_object_get_string(value));
+    }
+}
+
+static int64_t get_int_field(json_object *obj, const char *key, int64_t def, int64_t min, int64_t max) {
+    json_object *value;
+    if (!json_object_object_get_ex(obj, key, &value)) return def;
+    int64_t v = json_object_get_int64(value);
+    if (v < min) v = min;
+    if (v > max) v = max;
+    return v;
+}
+
+static bool get_bool_field(json_object *obj, const char *key, bool def) {
+    json_object *value;
+    if (!json_object_object_get_ex(obj, key, &value)) return def;
+    return json_object_get_boolean(value);
+}
+
+/**
+ * Charger les profils depuis un fichier JSON
+ * Appelé une fois au démarrage : les pointeurs retournés par profile_find() restent valides
+ * @return Nombre de profils chargés, ou -1 en cas d'erreur
+ */
+int profile_load(const char *path) {
+    json_object *root = json_object_from_file(path);
+    if (!root) {
+        LOG_ERROR("[Profile] Impossible de lire %s\n", path);
+        return -1;
+    }
+
+    json_object *list;
+    if (!json_object_object_get_ex(root, "profiles", &list) || !json_object_is_type(list, json_type_object)) {
+        LOG_ERROR("[Profile] %s: objet \"profiles\" manquant\n", path);
+        json_object_put(root);
+        return -1;
+    }
+
+    profile_count = 0;
+    json_object_object_foreach(list, name, obj) {
+        if (profile_count >= MAX_PROFILES) {
+            LOG_ERROR("[Profile] Trop de profils, limite: %d\n", MAX_PROFILES);
+            break;
+        }
+        connection_profile_t *p = &profiles[profile_count];
+        memset(p, 0, sizeof(*p));
+        snprintf(p->name, sizeof(p->name), "%s", name);
+        copy_string_field(obj, "ciphers", p->ciphers, sizeof(p->ciphers));
+        copy_string_field(obj, "hmac", p->hmac, sizeof(p->hmac));
+        copy_string_field(obj, "kex", p->kex, sizeof(p->kex));
+        copy_string_field(obj, "hostkeys", p->hostkeys, sizeof(p->hostkeys));
+        p->compression = get_bool_field(obj, "compression", false);
+        p->compression_level = (int)get_int_field(obj, "compression_level", 0, 0, 9);
+        p->nodelay = get_bool_field(obj, "nodelay", false);
+        p->read_chunk = (uint32_t)get_int_field(obj, "read_chunk", PROFILE_DEFAULT_READ_CHUNK, 4096, 1024 * 1024);
+        p->sftp_chunk = (uint32_t)get_int_field(obj, "sftp_chunk", 0, 0, 1024 * 1024);
+        p->sftp_inflight = (int)get_int_field(obj, "sftp_inflight", 0, 0, 64);
+        profile_count++;
+        DEBUG_PRINT("[Profile] Profil chargé: %s\n", p->name);
+    }
+
+    json_object_put(root);
+    return profile_count;
+}
+
+const connection_profile_t* profile_find(const char *name) {
+    if (!name) return NULL;
+    for (int i = 0; i < profile_count; i++) {
+        if (strcmp(profiles[i].name, name) == 0) return &profiles[i];
+    }
+    return NULL;
+}
+
+/**
+ * Appliquer un profil à une session libssh (avant ssh_connect)
+ * @return 0 en cas de succès, -1 si libssh refuse une option (ssh_get_error donne le détail)
+ */
+int profile_apply(const connection_profile_t *profile, ssh_session session) {
+    int rc = 0;
+    if (profile->ciphers[0]) {
+        rc |= ssh_options_set(session, SSH_OPTIONS_CIPHERS_C_S, profile->ciphers);
+        rc |= ssh_options_set(session, SSH_OPTIONS_CIPHERS_S_C, profile->ciphers);
+    }
+    if (profile->hmac[0]) {
+        rc |= ssh_options_set(session, SSH_OPTIONS_HMAC_C_S, profile->hmac);
+        rc |= ssh_options_set(session, SSH_OPTIONS_HMAC_S_C, profile->hmac);
+    }
+    if (profile->kex[0]) rc |= ssh_options_set(session, SSH_OPTIONS_KEY_EXCHANGE, profile->kex);
+    if (profile->hostkeys[0]) rc |= ssh_options_set(session, SSH_OPTIONS_HOSTKEYS, profile->hostkeys);
+
+    rc |= ssh_options_set(session, SSH_OPTIONS_COMPRESSION, profile->compression ? "yes" : "no");
+    if (profile->compression && profile->compression_level > 0) {
+        rc |= ssh_options_set(session, SSH_OPTIONS_COMPRESSION_LEVEL, &profile->compression_level);
+    }
+    if (profile->nodelay) {
+        int nodelay = 1;
+        rc |= ssh_options_set(session, SSH_OPTIONS_NODELAY, &nodelay);
+    }
+    return rc == 0 ? 0 : -1;
+}
@@ -0,0 +1,30 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libssh/libssh.h>
+
+#define MAX_PROFILES 32
+#define PROFILE_DEFAULT_READ_CHUNK (16 * 1024)
+
+// Profil de transport : préférences d'algorithmes et tailles de blocs par segment réseau
+typedef struct {
+    char name[32];
+    char ciphers[256];
+    char hmac[256];
+    char kex[256];
+    char hostkeys[256];
+    bool compression;
+    int compression_level;      // 1-9, 0 = défaut libssh
+    bool nodelay;
+    uint32_t read_chunk;        // Taille des lectures de canal (exec, sync)
+    uint32_t sftp_chunk;        // Taille des requêtes SFTP par défaut (0 = défaut sftp_handler)
+    int sftp_inflight;          // Requêtes SFTP en vol par défaut (0 = défaut sftp_handler)
+} connection_profile_t;
+
+int profile_load(const char *path);
+const connection_profile_t* profile_find(const char *name);
+int profile_apply(const connection_profile_t *profile, ssh_session session);
+
+#endif // PROFILE_H
@@ -9,68 +9,403 @@
 #include <time.h>
 
 #include "agent.h"
+#include "logger.h"
 #include "socket_server.h"
 #include "ssh_handler.h"
+#include "sftp_handler.h"
+#include "sync_handler.h"
 #include "request_handler.h"
+#include "result_cache.h"
+#include "admission.h"
+#include "exec_registry.h"
+#include "job_store.h"
+#include "tunnel.h"
+#include "compression.h"
+#include "shm_transport.h"
+#include "mem_budget.h"
+#include "pipe_handler.h"
+#include "session_state.h"
 
-void* handle_client_request(void *arg) {
-    int client_fd = *(int *)arg;
-    free(arg);
+// Délai de lecture/écriture sur le socket client (ms, 0 = aucun)
+static int client_timeout_ms = REQUEST_DEFAULT_CLIENT_TIMEOUT_MS;
 
-    DEBUG_PRINT("[Handler] Traitement de la requête (fd=%d)\n", client_fd);
+void request_handler_set_client_timeout(int timeout_ms) {
+    if (timeout_ms >= 0) client_timeout_ms = timeout_ms;
+}
 
-    // Lire la commande
-    command_t *cmd = NULL;
-    if (socket_read_command(client_fd, &cmd) < 0) {
-        fprintf(stderr, "[Handler] Erreur lecture commande\n");
-        close(client_fd);
-        return NULL;
+/**
+ * Gérer la demande de statistiques de l'agent
+ */
+static response_code_t handle_stats(char **response) {
+    char cache_json[512];
+    result_cache_stats_json(cache_json, sizeof(cache_json));
+    char admission_json[768];
+    admission_stats_json(admission_json, sizeof(admission_json));
+
+    char jobs_json[512];
+    job_store_stats_json(jobs_json, sizeof(jobs_json));
+
+    char log_json[256];
+    logger_stats_json(log_json, sizeof(log_json));
+
+    char tunnels_json[192];
+    tunnel_stats_json(tunnels_json, sizeof(tunnels_json));
+
+    char compression_json[512];
+    compression_stats_json(compression_json, sizeof(compression_json));
+
+    char shm_json[192];
+    shm_transport_stats_json(shm_json, sizeof(shm_json));
+
+    char memory_json[192];
+    mem_budget_stats_json(memory_json, sizeof(memory_json));
+
+    char response_json[3456];
+    snprintf(response_json, sizeof(response_json),
+             "{\"cache\":%s,\"admission\":%s,\"executions\":%d,\"jobs\":%s,\"log\":%s,\"tunnels\":%s,"
+             "\"compression\":%s,\"shm\":%s,\"memory\":%s}",
+             cache_json, admission_json, exec_registry_count(), jobs_json, log_json, tunnels_json,
+             compression_json, shm_json, memory_json);
+    *response = strdup(response_json);
+    return *response ? RESP_OK : RESP_ERROR;
+}
+
+/**
+ * Commandes qui occupent une session SSH (soumises à la file d'admission)
+ */
+static bool is_ssh_work(uint32_t cmd_type) {
+    switch (cmd_type) {
+        case CMD_SSH_CONNECT:
+        case CMD_SSH_EXECUTE:
+        case CMD_SFTP_PUT:
+        case CMD_SFTP_GET:
+        case CMD_SYNC_FILE:
+        case CMD_SYNC_DIR:
+        case CMD_SSH_PIPE:
+            return true;
+        default:
+            return false;
     }
+}
+
+/**
+ * Décrire une opération SSH pour l'ordonnanceur : poids ("weight" ou "priority"), file de
+ * session (session_id, ou hôte pour une connexion) et hôte distant (limite par hôte)
+ */
+static void describe_work(const command_t *cmd, pid_t client, admission_work_t *work) {
+    memset(work, 0, sizeof(*work));
+    work->client = client;
+    work->weight = ADMISSION_WEIGHT_NORMAL;
+
+    json_object *root = cmd->data_len > 0 ? json_tokener_parse(cmd->data) : NULL;
+    if (!root) return;
+    json_object *obj;
+    const char *priority = NULL;
+    int weight = 0;
+    if (json_object_object_get_ex(root, "priority", &obj)) priority = json_object_get_string(obj);
+    if (json_object_object_get_ex(root, "weight", &obj)) weight = json_object_get_int(obj);
+    work->weight = admission_parse_weight(priority, weight);
 
-    // Traiter selon le type de commande
+    // Relais entre sessions : mis en file sur la session source, l'hôte du sink compte aussi
+    json_object *scope = root;
+    if (cmd->cmd_type == CMD_SSH_PIPE && json_object_object_get_ex(root, "source", &obj) &&
+        json_object_is_type(obj, json_type_object)) {
+        scope = obj;
+    }
+    json_object *sink, *sink_id;
+    if (cmd->cmd_type == CMD_SSH_PIPE && json_object_object_get_ex(root, "sink", &sink) &&
+        json_object_is_type(sink, json_type_object) && json_object_object_get_ex(sink, "session_id", &sink_id)) {
+        ssh_handler_session_host(json_object_get_string(sink_id), work->peer_host, sizeof(work->peer_host));
+    }
+
+    if (json_object_object_get_ex(scope, "session_id", &obj)) {
+        const char *session_id = json_object_get_string(obj);
+        snprintf(work->session_key, sizeof(work->session_key), "%s", session_id);
+        ssh_handler_session_host(session_id, work->host, sizeof(work->host));
+    } else if (json_object_object_get_ex(root, "host", &obj)) {
+        const char *host = json_object_get_string(obj);
+        snprintf(work->host, sizeof(work->host), "%s", host);
+        snprintf(work->session_key, sizeof(work->session_key), "%s", host);
+    }
+    // Sink sur le même hôte que la source : compté une seule fois
+    if (strcmp(work->peer_host, work->host) == 0) work->peer_host[0] = '\0';
+    json_object_put(root);
+}
+
+static char* busy_response(uint32_t retry_after_ms) {
+    char response_json[128];
+    snprintf(response_json, sizeof(response_json),
+            "{\"error\":\"Agent surchargé, réessayer plus tard\",\"retry_after_ms\":%u}", retry_after_ms);
+    return strdup(response_json);
+}
+
+/**
+ * La requête vise-t-elle une session encore en cours de reprise au démarrage ?
+ * (session_id, bastion d'une connexion, source / sink d'un relais)
+ */
+static bool targets_restoring_session(const command_t *cmd) {
+    if (!session_state_restoring() || cmd->data_len == 0) return false;
+    json_object *root = json_tokener_parse(cmd->data);
+    if (!root) return false;
+
+    json_object *scopes[3] = { root, NULL, NULL };
+    json_object_object_get_ex(root, "source", &scopes[1]);
+    json_object_object_get_ex(root, "sink", &scopes[2]);
+    static const char *keys[] = { "session_id", "via_session_id" };
+    bool pending = false;
+    for (int i = 0; i < 3 && !pending; i++) {
+        if (!scopes[i] || !json_object_is_type(scopes[i], json_type_object)) continue;
+        for (int k = 0; k < 2 && !pending; k++) {
+            json_object *id;
+            if (json_object_object_get_ex(scopes[i], keys[k], &id)) {
+                pending = session_state_restore_pending(json_object_get_string(id));
+            }
+        }
+    }
+    json_object_put(root);
+    return pending;
+}
+
+/**
+ * Exécuter une commande et produire sa réponse
+ * @param client    Processus client (imputé aux jobs asynchrones qu'il soumet)
+ * @param client_fd Connexion d'origine (-1 pour les anneaux partagés) : stdin en flux
+ */
+static response_code_t dispatch_command(command_t *cmd, pid_t client, int client_fd, char **response_data) {
     response_code_t code = RESP_OK;
-    char *response_data = NULL;
 
     switch (cmd->cmd_type) {
         case CMD_PING:
             DEBUG_PRINT("[Handler] Commande: PING\n");
-            response_data = strdup("{\"status\":\"pong\",\"agent\":\"krown-agent v1.0\"}");
-            if (!response_data) code = RESP_ERROR;
+            *response_data = strdup("{\"status\":\"pong\",\"agent\":\"krown-agent v1.0\"}");
+            if (!*response_data) code = RESP_ERROR;
             break;
         case CMD_SSH_CONNECT:
             DEBUG_PRINT("[Handler] Commande: SSH_CONNECT\n");
-            code = handle_ssh_connect(cmd->data, &response_data);
+            code = handle_ssh_connect(cmd->data, response_data);
             break;
         case CMD_SSH_DISCONNECT:
             DEBUG_PRINT("[Handler] Commande: SSH_DISCONNECT\n");
-            code = handle_ssh_disconnect(cmd->data, &response_data);
+            code = handle_ssh_disconnect(cmd->data, response_data);
             break;
         case CMD_SSH_EXECUTE:
             DEBUG_PRINT("[Handler] Commande: SSH_EXECUTE\n");
-            code = handle_ssh_execute(cmd->data, &response_data);
+            code = handle_ssh_execute_fds(cmd->data, cmd->fds, cmd->fd_count, client_fd, response_data);
             break;
         case CMD_SSH_STATUS:
             DEBUG_PRINT("[Handler] Commande: SSH_STATUS\n");
-            code = handle_ssh_status(cmd->data, &response_data);
+            code = handle_ssh_status(cmd->data, response_data);
             break;
         case CMD_LIST_SESSIONS:
             DEBUG_PRINT("[Handler] Commande: LIST_SESSIONS\n");
-            code = handle_list_sessions(&response_data);
+            code = handle_list_sessions(cmd->data, response_data);
+            break;
+        case CMD_SFTP_PUT:
+            DEBUG_PRINT("[Handler] Commande: SFTP_PUT\n");
+            code = handle_sftp_put(cmd->data, response_data);
+            break;
+        case CMD_SFTP_GET:
+            DEBUG_PRINT("[Handler] Commande: SFTP_GET\n");
+            code = handle_sftp_get(cmd->data, response_data);
+            break;
+        case CMD_SYNC_FILE:
+            DEBUG_PRINT("[Handler] Commande: SYNC_FILE\n");
+            code = handle_sync_file(cmd->data, response_data);
+            break;
+        case CMD_SYNC_DIR:
+            DEBUG_PRINT("[Handler] Commande: SYNC_DIR\n");
+            code = handle_sync_dir(cmd->data, response_data);
+            break;
+        case CMD_STATS:
+            DEBUG_PRINT("[Handler] Commande: STATS\n");
+            code = handle_stats(response_data);
+            break;
+        case CMD_CANCEL:
+            DEBUG_PRINT("[Handler] Commande: CANCEL\n");
+            code = handle_cancel(cmd->data, response_data);
+            break;
+        case CMD_SSH_EXECUTE_ASYNC:
+            DEBUG_PRINT("[Handler] Commande: SSH_EXECUTE_ASYNC\n");
+            code = handle_ssh_execute_async(cmd->data, client, response_data);
+            break;
+        case CMD_JOB_STATUS:
+            DEBUG_PRINT("[Handler] Commande: JOB_STATUS\n");
+            code = handle_job_status(cmd->data, response_data);
+            break;
+        case CMD_JOB_RESULT:
+            DEBUG_PRINT("[Handler] Commande: JOB_RESULT\n");
+            code = handle_job_result(cmd->data, response_data);
+            break;
+        case CMD_JOB_WAIT:
+            DEBUG_PRINT("[Handler] Commande: JOB_WAIT\n");
+            code = handle_job_wait(cmd->data, response_data);
+            break;
+        case CMD_TUNNEL_OPEN:
+            DEBUG_PRINT("[Handler] Commande: TUNNEL_OPEN\n");
+            code = handle_tunnel_open(cmd->data, response_data);
+            break;
+        case CMD_TUNNEL_CLOSE:
+            DEBUG_PRINT("[Handler] Commande: TUNNEL_CLOSE\n");
+            code = handle_tunnel_close(cmd->data, response_data);
+            break;
+        case CMD_TUNNEL_LIST:
+            DEBUG_PRINT("[Handler] Commande: TUNNEL_LIST\n");
+            code = handle_tunnel_list(response_data);
+            break;
+        case CMD_SHM_OPEN:
+            // Seulement comme première commande d'une connexion socket
+            code = RESP_INVALID_CMD;
+            *response_data = strdup("{\"error\":\"Transport partagé déjà ouvert\"}");
+            if (!*response_data) code = RESP_ERROR;
+            break;
+        case CMD_SSH_PIPE:
+            DEBUG_PRINT("[Handler] Commande: SSH_PIPE\n");
+            code = handle_ssh_pipe(cmd->data, response_data);
+            break;
+        case CMD_STDIN_DATA:
+            code = RESP_INVALID_CMD;
+            *response_data = strdup("{\"error\":\"Trame stdin hors d'une exécution en flux\"}");
+            if (!*response_data) code = RESP_ERROR;
             break;
         default:
             DEBUG_PRINT("[Handler] Commande inconnue: %u\n", cmd->cmd_type);
             code = RESP_INVALID_CMD;
-            response_data = strdup("{\"error\":\"Commande inconnue\"}");
-            if (!response_data) code = RESP_ERROR;
+            *response_data = strdup("{\"error\":\"Commande inconnue\"}");
+            if (!*response_data) code = RESP_ERROR;
             break;
     }
 
+    return code;
+}
+
+/**
+ * Contrôle d'admission puis exécution (PING, STATS et CANCEL restent toujours disponibles)
+ */
+static response_code_t process_command(command_t *cmd, pid_t client, int client_fd, char **response_data) {
+    response_code_t code = RESP_OK;
+    bool control = cmd->cmd_type == CMD_PING || cmd->cmd_type == CMD_STATS ||
+                   cmd->cmd_type == CMD_CANCEL;
+    bool admitted = false, ssh_slot = false;
+    uint32_t retry_after_ms = 0;
+    struct timespec ssh_start;
+    admission_work_t work;
+    mem_request_t mem;
+
+    // Session pas encore rétablie (reprise en arrière-plan au démarrage) : réessayer plus tard
+    bool restoring = !control && targets_restoring_session(cmd);
+
+    mem_request_begin(&mem);
+    if (!control && !restoring) {
+        admitted = admission_enter(client, &retry_after_ms);
+        // Budget mémoire presque atteint : pas de nouvelle sortie SSH à tamponner
+        if (admitted && is_ssh_work(cmd->cmd_type) && mem_budget_exhausted()) {
+            retry_after_ms = MEM_BUDGET_RETRY_AFTER_MS;
+        } else if (admitted && is_ssh_work(cmd->cmd_type)) {
+            describe_work(cmd, client, &work);
+            ssh_slot = admission_acquire_ssh(&work, &retry_after_ms);
+            clock_gettime(CLOCK_MONOTONIC, &ssh_start);
+        }
+    }
+
+    if (restoring) {
+        char response_json[128];
+        snprintf(response_json, sizeof(response_json),
+                "{\"error\":\"Session en cours de reprise, réessayer plus tard\",\"retry_after_ms\":%d}",
+                SESSION_STATE_RETRY_AFTER_MS);
+        code = RESP_BUSY;
+        *response_data = strdup(response_json);
+    } else if (!control && (!admitted || (is_ssh_work(cmd->cmd_type) && !ssh_slot))) {
+        code = RESP_BUSY;
+        *response_data = busy_response(retry_after_ms);
+    } else {
+        code = dispatch_command(cmd, client, client_fd, response_data);
+    }
+
+    if (ssh_slot) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        admission_release_ssh(&work, (end.tv_sec - ssh_start.tv_sec) * 1000.0 +
+                              (end.tv_nsec - ssh_start.tv_nsec) / 1e6);
+    }
+    if (admitted) admission_leave(client);
+    mem_request_end(&mem);
+    return code;
+}
+
+/**
+ * Exécuter une commande interne (jobs asynchrones) avec le même contrôle d'admission,
+ * ordonnancement et budget mémoire qu'une requête reçue sur le socket
+ * @param client Processus client imputé (file de l'ordonnanceur, limite par client)
+ * @return Code de la commande, ou RESP_BUSY avec retry_after_ms si l'agent est saturé
+ */
+response_code_t request_handler_run(uint32_t cmd_type, const char *json_data, pid_t client,
+                                    char **response_data) {
+    size_t data_len = json_data ? strlen(json_data) : 0;
+    command_t *cmd = calloc(1, sizeof(command_t) + data_len + 1);
+    if (!cmd) {
+        *response_data = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    cmd->version = PROTOCOL_VERSION;
+    cmd->cmd_type = cmd_type;
+    cmd->data_len = (uint32_t)data_len;
+    if (data_len > 0) memcpy(cmd->data, json_data, data_len);
+
+    response_code_t code = process_command(cmd, client, -1, response_data);
+    free(cmd);
+    return code;
+}
+
+/**
+ * Requête reçue par l'anneau partagé : même traitement que sur le socket
+ */
+static response_code_t shm_dispatch(command_t *cmd, void *ctx, char **response_data) {
+    return process_command(cmd, *(pid_t *)ctx, -1, response_data);
+}
+
+void* handle_client_request(void *arg) {
+    int client_fd = *(int *)arg;
+    free(arg);
+
+    DEBUG_PRINT("[Handler] Traitement de la requête (fd=%d)\n", client_fd);
+
+    socket_set_timeouts(client_fd, client_timeout_ms);
+
+    // Lire la commande
+    command_t *cmd = NULL;
+    if (socket_read_command(client_fd, &cmd) < 0) {
+        LOG_ERROR("[Handler] Erreur lecture commande\n");
+        close(client_fd);
+        return NULL;
+    }
+
+    pid_t client = admission_client_id(client_fd);
+
+    // Transport partagé : la connexion sert ensuite les anneaux jusqu'au départ du client
+    if (cmd->cmd_type == CMD_SHM_OPEN) {
+        DEBUG_PRINT("[Handler] Commande: SHM_OPEN\n");
+        shm_transport_serve(client_fd, cmd->data, client_timeout_ms, shm_dispatch, &client);
+        socket_close_fds(cmd);
+        free(cmd);
+        close(client_fd);
+        return NULL;
+    }
+
+    char *response_data = NULL;
+    response_code_t code = process_command(cmd, client, client_fd, &response_data);
+    // Descripteurs joints rendus (drapeaux d'origine) avant que le client ne lise la réponse
+    socket_close_fds(cmd);
+
     // Envoyer la réponse
     if (response_data) {
-        socket_send_response(client_fd, code, response_data);
+        // La réponse reste imputée au budget jusqu'à la fin de l'envoi
+        ptrdiff_t held = (ptrdiff_t)strlen(response_data) + 1;
+        mem_budget_hold(held);
+        socket_send_response(client_fd, code, response_data, cmd->flags);
         free(response_data);
+        mem_budget_hold(-held);
     } else {
-        socket_send_response(client_fd, RESP_ERROR, "{\"error\":\"Erreur interne\"}");
+        socket_send_response(client_fd, RESP_ERROR, "{\"error\":\"Erreur interne\"}", 0);
     }
 
     free(cmd);
@@ -1,7 +1,16 @@
 #ifndef REQUEST_HANDLER_H
 #define REQUEST_HANDLER_H
 
+#include <stdint.h>
+#include <sys/types.h>
+#include "agent.h"
+
+#define REQUEST_DEFAULT_CLIENT_TIMEOUT_MS (30 * 1000)
+
 void* handle_client_request(void *arg);
+void request_handler_set_client_timeout(int timeout_ms);
+response_code_t request_handler_run(uint32_t cmd_type, const char *json_data, pid_t client,
+                                    char **response_data);
 
 #endif // REQUEST_HANDLER_H
 
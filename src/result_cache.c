@@ -0,0 +1,324 @@
+/**
+ * Cache de résultats - Réponses de commandes idempotentes avec durée de vie (TTL)
+ *
+ * Les entrées sont indexées par (identité de l'hôte, commande). Une requête identique
+ * arrivant pendant l'exécution attend le résultat de la première au lieu de relancer
+ * la commande (dans la limite de sa propre échéance, et seulement si ce résultat est
+ * complet). La mémoire est bornée : les entrées les moins récemment utilisées sont
+ * évincées au-delà de max_bytes. Les entrées conservées sont imputées au budget mémoire
+ * global ; s'il ne couvre pas une nouvelle entrée, les plus anciennes lui cèdent la place
+ * et, à défaut, le résultat n'est pas gardé.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "result_cache.h"
+#include "mem_budget.h"
+#include "agent.h"
+
+#define CACHE_BUCKETS 1024
+#define CACHE_WAIT_SLICE_MS 50     // Attente maximale entre deux vérifications d'annulation
+
+struct cache_entry {
+    cache_entry_t *hash_next;
+    cache_entry_t *lru_prev;
+    cache_entry_t *lru_next;
+    uint64_t hash;
+    char *key;
+    char *response;
+    response_code_t code;
+    size_t size;                // Octets comptés dans max_bytes et dans le budget global
+    uint64_t expires_at;        // ms, horloge monotone
+    bool pending;               // Exécution en cours
+    bool shared;                // Résultat complet (RESP_OK) transmis aux requêtes en attente
+    bool cached;                // Résultat conservé (LRU, budget mémoire)
+    bool linked;                // Présente dans la table
+    int refs;                   // Propriétaire + requêtes en attente
+};
+
+static cache_entry_t *buckets[CACHE_BUCKETS];
+static cache_entry_t *lru_head = NULL;     // Plus récemment utilisée
+static cache_entry_t *lru_tail = NULL;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_cond = PTHREAD_COND_INITIALIZER;
+
+static size_t max_bytes = RESULT_CACHE_DEFAULT_MAX_BYTES;
+static size_t used_bytes = 0;
+static size_t entry_count = 0;
+
+static uint64_t stat_hits = 0;
+static uint64_t stat_misses = 0;
+static uint64_t stat_coalesced = 0;
+static uint64_t stat_evictions = 0;
+static uint64_t stat_expirations = 0;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a 64 bits
+static uint64_t hash_key(const char *key) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void entry_free(cache_entry_t *e) {
+    free(e->key);
+    free(e->response);
+    free(e);
+}
+
+static void lru_unlink(cache_entry_t *e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else if (lru_head == e) lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else if (lru_tail == e) lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_front(cache_entry_t *e) {
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = e;
+    lru_head = e;
+    if (!lru_tail) lru_tail = e;
+}
+
+static cache_entry_t* find_locked(const char *key, uint64_t hash) {
+    for (cache_entry_t *e = buckets[hash % CACHE_BUCKETS]; e; e = e->hash_next) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) return e;
+    }
+    return NULL;
+}
+
+/**
+ * Retirer une entrée de la table (libérée tout de suite si personne ne l'attend)
+ * Doit être appelé avec cache_mutex
+ */
+static void remove_locked(cache_entry_t *e) {
+    cache_entry_t **pp = &buckets[e->hash % CACHE_BUCKETS];
+    while (*pp && *pp != e) pp = &(*pp)->hash_next;
+    if (*pp) *pp = e->hash_next;
+    e->hash_next = NULL;
+
+    if (e->cached) {
+        lru_unlink(e);
+        used_bytes -= e->size;
+        mem_budget_hold(-(ptrdiff_t)e->size);
+        entry_count--;
+    }
+    e->linked = false;
+    if (e->refs == 0) entry_free(e);
+}
+
+/**
+ * Attendre la fin de l'exécution d'une entrée, par tranches pour surveiller l'annulation
+ * Doit être appelé avec cache_mutex
+ * @param deadline_ms Échéance (horloge monotone, 0 = aucune)
+ * @return CACHE_HIT quand l'entrée est terminée, sinon CACHE_TIMED_OUT ou CACHE_CANCELLED
+ */
+static cache_lookup_t wait_pending_locked(cache_entry_t *e, int64_t deadline_ms, exec_handle_t *handle) {
+    while (e->pending) {
+        if (exec_handle_cancelled(handle)) return CACHE_CANCELLED;
+        uint64_t wait_ms = CACHE_WAIT_SLICE_MS;
+        if (deadline_ms > 0) {
+            uint64_t now = now_ms();
+            if (now >= (uint64_t)deadline_ms) return CACHE_TIMED_OUT;
+            if ((uint64_t)deadline_ms - now < wait_ms) wait_ms = (uint64_t)deadline_ms - now;
+        }
+        // cache_cond utilise CLOCK_REALTIME : l'échéance est recalculée à chaque tranche
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)(wait_ms * 1000000);
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&cache_cond, &cache_mutex, &ts);
+    }
+    return CACHE_HIT;
+}
+
+static void release_locked(cache_entry_t *e) {
+    e->refs--;
+    if (e->refs == 0 && !e->linked) entry_free(e);
+}
+
+/**
+ * Initialiser le cache
+ * @param limit Budget mémoire en octets (0 = défaut)
+ */
+int result_cache_init(size_t limit) {
+    pthread_mutex_lock(&cache_mutex);
+    memset(buckets, 0, sizeof(buckets));
+    max_bytes = limit ? limit : RESULT_CACHE_DEFAULT_MAX_BYTES;
+    used_bytes = 0;
+    entry_count = 0;
+    pthread_mutex_unlock(&cache_mutex);
+    DEBUG_PRINT("[Cache] Initialisé (max %zu octets)\n", max_bytes);
+    return 0;
+}
+
+void result_cache_cleanup(void) {
+    pthread_mutex_lock(&cache_mutex);
+    while (lru_head) remove_locked(lru_head);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * Chercher une réponse en cache
+ * - entrée valide : copie de la réponse, CACHE_HIT
+ * - exécution identique en cours : attente de son résultat, CACHE_HIT s'il est complet ;
+ *   sinon (erreur, sortie partielle, annulation) nouvelle recherche, l'appelant exécutant
+ *   lui-même la commande
+ * - échéance ou annulation de l'appelant pendant l'attente : CACHE_TIMED_OUT ou
+ *   CACHE_CANCELLED, sans réponse
+ * - sinon : CACHE_MISS, l'appelant devient propriétaire de *ticket et doit appeler
+ *   result_cache_finish() (même en cas d'erreur, pour réveiller les requêtes en attente)
+ * @param deadline_ms Échéance de l'appelant (horloge monotone en ms, 0 = aucune)
+ * @param handle      Annulation de l'appelant (peut être NULL)
+ */
+cache_lookup_t result_cache_begin(const char *key, int64_t deadline_ms, exec_handle_t *handle,
+                                  char **response, response_code_t *code, cache_entry_t **ticket) {
+    uint64_t hash = hash_key(key);
+    *ticket = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    cache_entry_t *e = find_locked(key, hash);
+
+    while (e && e->pending) {
+        e->refs++;
+        cache_lookup_t waited = wait_pending_locked(e, deadline_ms, handle);
+        if (waited == CACHE_HIT && e->shared) {
+            stat_coalesced++;
+            *code = e->code;
+            *response = strdup(e->response);
+            if (!*response) {
+                *code = RESP_ERROR;
+                *response = strdup("{\"error\":\"Erreur interne\"}");
+            }
+            release_locked(e);
+            pthread_mutex_unlock(&cache_mutex);
+            return CACHE_HIT;
+        }
+        release_locked(e);
+        if (waited != CACHE_HIT) {
+            pthread_mutex_unlock(&cache_mutex);
+            return waited;
+        }
+        // Résultat non partageable : l'entrée a été retirée, chercher à nouveau
+        e = find_locked(key, hash);
+    }
+
+    if (e && now_ms() < e->expires_at) {
+        char *copy = strdup(e->response);
+        if (copy) {
+            stat_hits++;
+            lru_unlink(e);
+            lru_push_front(e);
+            *code = e->code;
+            *response = copy;
+            pthread_mutex_unlock(&cache_mutex);
+            return CACHE_HIT;
+        }
+    } else if (e) {
+        stat_expirations++;
+        remove_locked(e);
+    }
+
+    stat_misses++;
+    e = calloc(1, sizeof(cache_entry_t));
+    if (e) e->key = strdup(key);
+    if (e && e->key) {
+        e->hash = hash;
+        e->pending = true;
+        e->linked = true;
+        e->refs = 1;
+        e->hash_next = buckets[hash % CACHE_BUCKETS];
+        buckets[hash % CACHE_BUCKETS] = e;
+        *ticket = e;
+    } else if (e) {
+        free(e);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return CACHE_MISS;
+}
+
+/**
+ * Publier le résultat d'une exécution et réveiller les requêtes en attente
+ * Seules les réponses RESP_OK avec un TTL > 0 restent en cache ou sont transmises aux
+ * requêtes en attente (ttl_ms = 0 pour une sortie partielle)
+ */
+void result_cache_finish(cache_entry_t *ticket, const char *response, response_code_t code,
+                         uint32_t ttl_ms) {
+    if (!ticket) return;
+
+    // Une entrée ne peut pas occuper plus d'un huitième du budget
+    size_t size = sizeof(cache_entry_t) + strlen(ticket->key) + 1 + (response ? strlen(response) + 1 : 0);
+    bool keep = response && code == RESP_OK && ttl_ms > 0 && size <= max_bytes / 8;
+
+    char *copy = response ? strdup(response) : NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    ticket->response = copy;
+    ticket->code = code;
+    ticket->shared = copy && code == RESP_OK && ttl_ms > 0;
+    ticket->pending = false;
+    pthread_cond_broadcast(&cache_cond);
+
+    // Budget global insuffisant : les entrées les moins récemment utilisées cèdent la place
+    bool charged = false;
+    if (keep && ticket->response && ticket->linked) {
+        while (!(charged = mem_budget_try_charge((ptrdiff_t)size) == 0) && lru_tail) {
+            stat_evictions++;
+            remove_locked(lru_tail);
+        }
+    }
+
+    if (charged) {
+        uint64_t now = now_ms();
+        ticket->size = size;
+        ticket->expires_at = now + (ttl_ms > RESULT_CACHE_MAX_TTL_MS ? RESULT_CACHE_MAX_TTL_MS : ttl_ms);
+        ticket->cached = true;
+        lru_push_front(ticket);
+        used_bytes += size;
+        entry_count++;
+
+        // Éviction LRU (les entrées expirées en queue partent en premier)
+        while (used_bytes > max_bytes && lru_tail && lru_tail != ticket) {
+            if (now >= lru_tail->expires_at) stat_expirations++;
+            else stat_evictions++;
+            remove_locked(lru_tail);
+        }
+    } else if (ticket->linked) {
+        remove_locked(ticket);
+    }
+
+    release_locked(ticket);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+/**
+ * Écrire les compteurs du cache en JSON
+ */
+int result_cache_stats_json(char *buf, size_t size) {
+    pthread_mutex_lock(&cache_mutex);
+    int n = snprintf(buf, size,
+            "{\"entries\":%zu,\"bytes\":%zu,\"max_bytes\":%zu,\"hits\":%llu,\"misses\":%llu,"
+            "\"coalesced\":%llu,\"evictions\":%llu,\"expirations\":%llu}",
+            entry_count, used_bytes, max_bytes,
+            (unsigned long long)stat_hits, (unsigned long long)stat_misses,
+            (unsigned long long)stat_coalesced, (unsigned long long)stat_evictions,
+            (unsigned long long)stat_expirations);
+    pthread_mutex_unlock(&cache_mutex);
+    return n;
+}
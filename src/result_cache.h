@@ -0,0 +1,29 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "agent.h"
+#include "exec_registry.h"
+
+#define RESULT_CACHE_DEFAULT_MAX_BYTES (16 * 1024 * 1024)
+#define RESULT_CACHE_MAX_TTL_MS (60 * 60 * 1000)
+
+typedef enum {
+    CACHE_HIT = 0,      // Réponse disponible (en cache ou partagée avec une exécution en cours)
+    CACHE_MISS,         // L'appelant exécute puis appelle result_cache_finish()
+    CACHE_TIMED_OUT,    // Échéance de l'appelant atteinte en attendant une exécution identique
+    CACHE_CANCELLED     // Appelant annulé (CMD_CANCEL) pendant l'attente
+} cache_lookup_t;
+
+typedef struct cache_entry cache_entry_t;
+
+int result_cache_init(size_t max_bytes);
+void result_cache_cleanup(void);
+cache_lookup_t result_cache_begin(const char *key, int64_t deadline_ms, exec_handle_t *handle,
+                                  char **response, response_code_t *code, cache_entry_t **ticket);
+void result_cache_finish(cache_entry_t *ticket, const char *response, response_code_t code,
+                         uint32_t ttl_ms);
+int result_cache_stats_json(char *buf, size_t size);
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,122 @@
+/**
+ * Vue des sessions - Instantanés immuables et versionnés, lus sans verrou
+ *
+ * Chaque connexion ou déconnexion publie une nouvelle vue complète (remplacement atomique
+ * du pointeur). Les lecteurs (LIST_SESSIONS, SSH_STATUS) parcourent la vue courante sans
+ * prendre sessions_mutex : l'ancienne vue n'est libérée qu'après un délai de grâce, quand
+ * plus aucun lecteur ne peut la tenir (deux compteurs de lecteurs alternés, comme SRCU).
+ *
+ * Chaque entrée garde la version de sa dernière modification, ce qui permet de ne renvoyer
+ * que les changements depuis une version donnée. Les versions partent de l'heure de
+ * démarrage (ms) : un numéro reçu d'une instance précédente reste inférieur à la base.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "session_snapshot.h"
+#include "logger.h"
+
+static _Atomic(session_snapshot_t*) current = NULL;
+static atomic_uint epoch = 0;
+static atomic_uint readers[2];
+static uint64_t base_version = 0;
+
+static session_snapshot_t* snapshot_alloc(int count) {
+    return calloc(1, sizeof(session_snapshot_t) + (size_t)count * sizeof(session_entry_t));
+}
+
+/**
+ * Publier une vue vide ; la base des versions est l'heure de démarrage
+ */
+void session_snapshot_init(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    base_version = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+
+    session_snapshot_t *empty = snapshot_alloc(0);
+    if (empty) empty->version = base_version;
+    atomic_store(&current, empty);
+}
+
+/**
+ * Libérer la vue courante (arrêt : plus aucun lecteur)
+ */
+void session_snapshot_shutdown(void) {
+    free(atomic_exchange(&current, NULL));
+}
+
+uint64_t session_snapshot_base_version(void) {
+    return base_version;
+}
+
+/**
+ * Entrer en lecture et obtenir la vue courante (NULL si indisponible)
+ * @param token À rendre à session_snapshot_release()
+ */
+const session_snapshot_t* session_snapshot_acquire(unsigned *token) {
+    for (;;) {
+        unsigned e = atomic_load(&epoch);
+        atomic_fetch_add(&readers[e & 1], 1);
+        // L'époque a basculé entre-temps : ce compteur n'est peut-être plus attendu
+        if (atomic_load(&epoch) == e) {
+            *token = e & 1;
+            return atomic_load(&current);
+        }
+        atomic_fetch_sub(&readers[e & 1], 1);
+    }
+}
+
+void session_snapshot_release(unsigned token) {
+    atomic_fetch_sub(&readers[token], 1);
+}
+
+/**
+ * Attendre que les lecteurs entrés avant la publication soient sortis
+ */
+static void wait_for_readers(void) {
+    unsigned e = atomic_fetch_add(&epoch, 1);
+    while (atomic_load(&readers[e & 1]) != 0) sched_yield();
+}
+
+/**
+ * Publier l'état des sessions ; les entrées inchangées gardent leur version
+ * Sans changement, la vue courante est conservée (même version). Les publications doivent
+ * être sérialisées par l'appelant, avec un état construit sous le même verrou
+ */
+void session_snapshot_publish(const session_entry_t *entries, int count) {
+    // Seul l'écrivain libère une vue : la courante reste lisible ici
+    session_snapshot_t *prev = atomic_load(&current);
+    uint64_t version = (prev ? prev->version : base_version) + 1;
+
+    session_snapshot_t *next = snapshot_alloc(count);
+    if (!next) {
+        LOG_ERROR("[Sessions] Allocation de la vue impossible, vue précédente conservée\n");
+        return;
+    }
+
+    bool changed = !prev || prev->count != count;
+    for (int i = 0; i < count; i++) {
+        next->entries[i] = entries[i];
+        const session_entry_t *old = (prev && i < prev->count) ? &prev->entries[i] : NULL;
+        if (old && old->sess == entries[i].sess && old->connected == entries[i].connected) {
+            next->entries[i].version = old->version;
+        } else {
+            next->entries[i].version = version;
+            changed = true;
+        }
+    }
+    if (!changed) {
+        free(next);
+        return;
+    }
+    next->version = version;
+    next->count = count;
+
+    atomic_store(&current, next);
+    wait_for_readers();
+    free(prev);
+}
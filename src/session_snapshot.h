@@ -0,0 +1,43 @@
+#ifndef SESSION_SNAPSHOT_H
+#define SESSION_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "ssh_handler.h"
+
+// Métadonnées d'une session, figées au moment de la publication
+typedef struct {
+    ssh_session_t *sess;        // Emplacement (jamais réutilisé) : compteurs de débit lus en direct
+    char session_id[64];
+    const char *backend;        // Nom du backend (chaîne statique)
+    char host[256];
+    int port;
+    char username[64];
+    const connection_profile_t *profile;
+    char via_session_id[64];
+    time_t created_at;
+    bool connected;
+    uint64_t version;           // Version de la dernière modification de l'entrée
+} session_entry_t;
+
+// Vue immuable de toutes les sessions (un emplacement par entrée, dans l'ordre)
+typedef struct {
+    uint64_t version;
+    int count;
+    session_entry_t entries[];
+} session_snapshot_t;
+
+void session_snapshot_init(void);
+void session_snapshot_shutdown(void);
+uint64_t session_snapshot_base_version(void);
+
+// Lecture sans verrou : la vue reste valide jusqu'à session_snapshot_release()
+const session_snapshot_t* session_snapshot_acquire(unsigned *token);
+void session_snapshot_release(unsigned token);
+
+// Écriture (appels sérialisés par l'appelant)
+void session_snapshot_publish(const session_entry_t *entries, int count);
+
+#endif // SESSION_SNAPSHOT_H
@@ -0,0 +1,314 @@
+/**
+ * État persistant - Reprise à chaud des sessions après un redémarrage
+ *
+ * Les spécifications des sessions ouvertes avec "persist":true (hôte, port, utilisateur,
+ * profil, chemin de la clé, identifiant) sont écrites dans un fichier d'état. Au démarrage,
+ * elles sont rétablies en arrière-plan, en parallèle (concurrence bornée), avec les mêmes
+ * identifiants : l'agent écoute déjà, et une requête visant une session pas encore rétablie
+ * reçoit RESP_BUSY. Une session ouverte via un bastion (via_session_id) attend la vague où
+ * son bastion est rétabli. Une session qui échoue reste dans le fichier (panne passagère au
+ * démarrage) jusqu'à SESSION_STATE_MAX_RESTORE_FAILURES reprises manquées d'affilée.
+ * Aucun mot de passe ni clé privée n'est écrit sur le disque.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <json-c/json.h>
+
+#include "session_state.h"
+#include "ssh_handler.h"
+#include "agent.h"
+#include "logger.h"
+
+static char state_path[512];
+static bool enabled = false;
+static bool restoring = false;
+static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Reprise en arrière-plan (sous state_mutex, sauf restore_active)
+static atomic_bool restore_active = false;
+static json_object *restore_pending = NULL;     // session_id -> null : pas encore rétablies
+static json_object *retained = NULL;            // Spécifications en échec gardées dans le fichier
+static json_object *restore_root = NULL;        // Fichier d'état lu au démarrage
+static int restore_concurrency = SESSION_STATE_DEFAULT_CONCURRENCY;
+static pthread_t restore_thread;
+static bool restore_thread_started = false;
+
+// Travail partagé par les threads de reprise
+typedef struct {
+    json_object *specs;         // Vague en cours
+    size_t count;
+    atomic_size_t next;
+    atomic_int restored;
+    json_object *failed;        // Spécifications en échec (sous state_mutex)
+} restore_work_t;
+
+/**
+ * Activer la persistance
+ * @param path Fichier d'état (NULL ou vide = désactivée)
+ */
+int session_state_init(const char *path) {
+    if (!path || !*path) return 0;
+    if (strlen(path) >= sizeof(state_path) - 8) {
+        LOG_ERROR("[State] Chemin trop long: %s\n", path);
+        return -1;
+    }
+    snprintf(state_path, sizeof(state_path), "%s", path);
+    enabled = true;
+    DEBUG_PRINT("[State] Fichier d'état: %s\n", state_path);
+    return 0;
+}
+
+/**
+ * Réécrire le fichier d'état (fichier temporaire puis rename, jamais de fichier partiel)
+ */
+void session_state_save(void) {
+    if (!enabled) return;
+
+    pthread_mutex_lock(&state_mutex);
+    if (restoring) {
+        // Sauvegardé une seule fois à la fin de la reprise
+        pthread_mutex_unlock(&state_mutex);
+        return;
+    }
+
+    json_object *root = json_object_new_object();
+    json_object *specs = json_object_new_array();
+    ssh_handler_export_specs(specs);
+    for (size_t i = 0; retained && i < json_object_array_length(retained); i++) {
+        json_object_array_add(specs, json_object_get(json_object_array_get_idx(retained, i)));
+    }
+    json_object_object_add(root, "version", json_object_new_int(1));
+    json_object_object_add(root, "sessions", specs);
+
+    char tmp_path[sizeof(state_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", state_path);
+    if (json_object_to_file_ext(tmp_path, root, JSON_C_TO_STRING_PLAIN) != 0 ||
+        rename(tmp_path, state_path) != 0) {
+        LOG_ERROR("[State] Impossible d'écrire %s\n", state_path);
+        unlink(tmp_path);
+    }
+    json_object_put(root);
+    pthread_mutex_unlock(&state_mutex);
+}
+
+static const char* spec_id(json_object *spec) {
+    json_object *id_obj;
+    return json_object_object_get_ex(spec, "session_id", &id_obj) ? json_object_get_string(id_obj) : "?";
+}
+
+/**
+ * Fin de la reprise d'une session (rétablie ou non) : ses requêtes ne sont plus retenues
+ */
+static void restore_done(json_object *spec, json_object *failed) {
+    pthread_mutex_lock(&state_mutex);
+    if (restore_pending) json_object_object_del(restore_pending, spec_id(spec));
+    if (failed) json_object_array_add(failed, json_object_get(spec));
+    pthread_mutex_unlock(&state_mutex);
+}
+
+static void* restore_worker(void *arg) {
+    restore_work_t *work = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        json_object *spec = json_object_array_get_idx(work->specs, i);
+        char *response = NULL;
+        if (ssh_handler_restore(spec, &response) == RESP_OK) {
+            atomic_fetch_add(&work->restored, 1);
+            restore_done(spec, NULL);
+        } else {
+            LOG_ERROR("[State] Reprise échouée (%s): %s\n", spec_id(spec), response ? response : "");
+            restore_done(spec, work->failed);
+        }
+        free(response);
+    }
+    return NULL;
+}
+
+/**
+ * Garder les spécifications en échec dans le fichier, avec le nombre de reprises manquées
+ * d'affilée ; au-delà de SESSION_STATE_MAX_RESTORE_FAILURES, la session est abandonnée
+ */
+static void retain_failed(json_object *failed) {
+    json_object *keep = json_object_new_array();
+    for (size_t i = 0; i < json_object_array_length(failed); i++) {
+        json_object *spec = json_object_array_get_idx(failed, i);
+        json_object *count_obj;
+        int failures = (json_object_object_get_ex(spec, "restore_failures", &count_obj)
+                        ? json_object_get_int(count_obj) : 0) + 1;
+        if (failures >= SESSION_STATE_MAX_RESTORE_FAILURES) {
+            LOG_ERROR("[State] Session %s abandonnée après %d reprises échouées\n", spec_id(spec), failures);
+            continue;
+        }
+        json_object_object_add(spec, "restore_failures", json_object_new_int(failures));
+        json_object_array_add(keep, json_object_get(spec));
+    }
+    pthread_mutex_lock(&state_mutex);
+    if (retained) json_object_put(retained);
+    retained = keep;
+    pthread_mutex_unlock(&state_mutex);
+}
+
+/**
+ * Rétablir les sessions du fichier d'état lu par session_state_restore_start()
+ * @return Nombre de sessions rétablies
+ */
+static int restore_all(json_object *specs, int concurrency) {
+    size_t total = json_object_array_length(specs);
+    if (concurrency < 1) concurrency = 1;
+    if (concurrency > SESSION_STATE_MAX_CONCURRENCY) concurrency = SESSION_STATE_MAX_CONCURRENCY;
+    if ((size_t)concurrency > total) concurrency = (int)total;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Vagues successives : une spécification est prête quand elle n'a pas de bastion ou que
+    // celui-ci est connecté ; les autres attendent la vague suivante (chaînes de rebonds)
+    restore_work_t work;
+    atomic_init(&work.restored, 0);
+    work.failed = json_object_new_array();
+    json_object *pending = json_object_get(specs);
+    while (json_object_array_length(pending) > 0) {
+        json_object *ready = json_object_new_array();
+        json_object *later = json_object_new_array();
+        for (size_t i = 0; i < json_object_array_length(pending); i++) {
+            json_object *spec = json_object_array_get_idx(pending, i);
+            json_object *via_obj;
+            bool waits = json_object_object_get_ex(spec, "via_session_id", &via_obj) &&
+                         !ssh_handler_find(json_object_get_string(via_obj));
+            json_object_array_add(waits ? later : ready, json_object_get(spec));
+        }
+        json_object_put(pending);
+        pending = later;
+
+        work.specs = ready;
+        work.count = json_object_array_length(ready);
+        atomic_init(&work.next, 0);
+        if (work.count == 0) {
+            // Bastions absents : ces sessions ne peuvent pas être rétablies
+            for (size_t i = 0; i < json_object_array_length(pending); i++) {
+                json_object *spec = json_object_array_get_idx(pending, i);
+                LOG_ERROR("[State] Reprise échouée (%s): session de rebond absente\n", spec_id(spec));
+                restore_done(spec, work.failed);
+            }
+            json_object_put(ready);
+            break;
+        }
+
+        pthread_t threads[SESSION_STATE_MAX_CONCURRENCY];
+        int workers = (size_t)concurrency > work.count ? (int)work.count : concurrency;
+        int started = 0;
+        for (int t = 0; t < workers; t++) {
+            if (pthread_create(&threads[started], NULL, restore_worker, &work) == 0) started++;
+        }
+        if (started == 0) restore_worker(&work);
+        for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+        json_object_put(ready);
+    }
+    json_object_put(pending);
+    retain_failed(work.failed);
+    json_object_put(work.failed);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double duration_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    int restored = atomic_load(&work.restored);
+    LOG_INFO("[State] %d/%zu sessions rétablies en %.0f ms (%d en parallèle)\n",
+             restored, total, duration_ms, concurrency);
+    return restored;
+}
+
+static void* restore_main(void *arg) {
+    (void)arg;
+    json_object *specs;
+    json_object_object_get_ex(restore_root, "sessions", &specs);
+    restore_all(specs, restore_concurrency);
+
+    pthread_mutex_lock(&state_mutex);
+    restoring = false;
+    json_object_put(restore_pending);
+    restore_pending = NULL;
+    atomic_store(&restore_active, false);
+    pthread_mutex_unlock(&state_mutex);
+    session_state_save();
+
+    json_object_put(restore_root);
+    restore_root = NULL;
+    return NULL;
+}
+
+/**
+ * Lancer la reprise des sessions du fichier d'état en arrière-plan
+ * Le fichier est lu ici : au retour, les identifiants à rétablir sont connus et
+ * session_state_restore_pending() retient leurs requêtes
+ * @return 0, ou -1 si la reprise n'a pas pu démarrer
+ */
+int session_state_restore_start(int concurrency) {
+    if (!enabled || access(state_path, R_OK) != 0) return 0;
+
+    json_object *root = json_object_from_file(state_path);
+    json_object *specs;
+    if (!root || !json_object_object_get_ex(root, "sessions", &specs) ||
+        !json_object_is_type(specs, json_type_array)) {
+        LOG_ERROR("[State] Fichier d'état invalide: %s\n", state_path);
+        if (root) json_object_put(root);
+        return 0;
+    }
+    if (json_object_array_length(specs) == 0) {
+        json_object_put(root);
+        return 0;
+    }
+
+    pthread_mutex_lock(&state_mutex);
+    restoring = true;
+    restore_pending = json_object_new_object();
+    for (size_t i = 0; i < json_object_array_length(specs); i++) {
+        json_object_object_add(restore_pending, spec_id(json_object_array_get_idx(specs, i)), NULL);
+    }
+    restore_root = root;
+    restore_concurrency = concurrency;
+    atomic_store(&restore_active, true);
+    pthread_mutex_unlock(&state_mutex);
+
+    if (pthread_create(&restore_thread, NULL, restore_main, NULL) != 0) {
+        LOG_ERROR("[State] Impossible de lancer la reprise en arrière-plan\n");
+        restore_main(NULL);
+        return -1;
+    }
+    restore_thread_started = true;
+    return 0;
+}
+
+/**
+ * Session encore en cours de reprise (ses requêtes reçoivent RESP_BUSY)
+ */
+bool session_state_restore_pending(const char *session_id) {
+    if (!atomic_load(&restore_active) || !session_id) return false;
+    pthread_mutex_lock(&state_mutex);
+    bool pending = restore_pending && json_object_object_get_ex(restore_pending, session_id, NULL);
+    pthread_mutex_unlock(&state_mutex);
+    return pending;
+}
+
+bool session_state_restoring(void) {
+    return atomic_load(&restore_active);
+}
+
+/**
+ * Attendre la fin de la reprise (arrêt de l'agent) et libérer l'état
+ */
+void session_state_shutdown(void) {
+    if (restore_thread_started) {
+        pthread_join(restore_thread, NULL);
+        restore_thread_started = false;
+    }
+    pthread_mutex_lock(&state_mutex);
+    if (retained) json_object_put(retained);
+    retained = NULL;
+    pthread_mutex_unlock(&state_mutex);
+}
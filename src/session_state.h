@@ -0,0 +1,18 @@
+#ifndef SESSION_STATE_H
+#define SESSION_STATE_H
+
+#include <stdbool.h>
+
+#define SESSION_STATE_DEFAULT_CONCURRENCY 16
+#define SESSION_STATE_MAX_CONCURRENCY 64
+#define SESSION_STATE_MAX_RESTORE_FAILURES 5    // Reprises manquées d'affilée avant abandon
+#define SESSION_STATE_RETRY_AFTER_MS 1000       // retry_after_ms d'une session en cours de reprise
+
+int session_state_init(const char *path);
+int session_state_restore_start(int concurrency);
+bool session_state_restoring(void);
+bool session_state_restore_pending(const char *session_id);
+void session_state_shutdown(void);
+void session_state_save(void);
+
+#endif // SESSION_STATE_H
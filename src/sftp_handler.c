@@ -0,0 +1,669 @@
+/**
+ * Gestionnaire SFTP - Transferts de fichiers sur une session existante
+ *
+ * Les transferts gardent plusieurs requêtes SFTP en vol (fenêtre de max_inflight
+ * blocs de chunk_size octets) pour ne pas être limités par la latence d'un
+ * aller-retour. La mémoire utilisée est fixe : max_inflight * chunk_size.
+ *
+ * Les fichiers distants sont non bloquants : chaque réponse attendue est relevée par un
+ * essai sous verrou, l'attente des paquets se fait hors verrou. Les autres canaux de la
+ * session (exec, tunnels, rebonds) avancent pendant le transfert.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <json-c/json.h>
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+
+#include "sftp_handler.h"
+#include "ssh_handler.h"
+#include "agent.h"
+#include "json_macros.h"
+
+// libssh >= 0.11 fournit l'API sftp_aio (lecture et écriture asynchrones)
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+#define KROWN_SFTP_AIO 1
+#endif
+
+#define SFTP_DEFAULT_CHUNK (64 * 1024)
+#define SFTP_MIN_CHUNK (4 * 1024)
+#define SFTP_MAX_CHUNK (1024 * 1024)
+#define SFTP_DEFAULT_INFLIGHT 16
+#define SFTP_MAX_INFLIGHT 64
+#define SFTP_POLL_MS 10             // Attente hors verrou entre deux essais d'une réponse
+
+// Requête SFTP en vol
+typedef struct {
+    char *buf;
+    size_t len;             // Octets demandés (lecture) ou envoyés (écriture)
+    uint64_t offset;
+#ifdef KROWN_SFTP_AIO
+    sftp_aio aio;
+#else
+    sftp_file file;
+    uint32_t id;
+    ssize_t result;
+#endif
+} sftp_slot_t;
+
+typedef enum {
+    XFER_OK = 0,
+    XFER_ERR_LOCAL,
+    XFER_ERR_SFTP,
+    XFER_ERR_SESSION
+} xfer_error_t;
+
+#ifdef KROWN_SFTP_AIO
+static ssize_t slot_begin_write(sftp_file file, sftp_slot_t *slot) {
+    return sftp_aio_begin_write(file, slot->buf, slot->len, &slot->aio);
+}
+
+static ssize_t slot_wait_write(sftp_slot_t *slot) {
+    return sftp_aio_wait_write(&slot->aio);
+}
+
+static ssize_t slot_begin_read(sftp_file file, sftp_slot_t *slot) {
+    return sftp_aio_begin_read(file, slot->len, &slot->aio);
+}
+
+static ssize_t slot_wait_read(sftp_slot_t *slot) {
+    return sftp_aio_wait_read(&slot->aio, slot->buf, slot->len);
+}
+#else
+// libssh < 0.11 n'a pas d'écriture asynchrone : écriture synchrone, fenêtre réduite à 1
+static ssize_t slot_begin_write(sftp_file file, sftp_slot_t *slot) {
+    slot->result = sftp_write(file, slot->buf, slot->len);
+    return slot->result < 0 ? SSH_ERROR : slot->result;
+}
+
+static ssize_t slot_wait_write(sftp_slot_t *slot) {
+    return slot->result;
+}
+
+static ssize_t slot_begin_read(sftp_file file, sftp_slot_t *slot) {
+    int id = sftp_async_read_begin(file, slot->len);
+    if (id < 0) return SSH_ERROR;
+    slot->file = file;
+    slot->id = (uint32_t)id;
+    return slot->len;
+}
+
+static ssize_t slot_wait_read(sftp_slot_t *slot) {
+    return sftp_async_read(slot->file, slot->buf, slot->len, slot->id);
+}
+#endif
+
+/**
+ * Attendre la réponse d'une requête en vol sans garder la session
+ * @param session_lost Positionné si la session a été perdue pendant l'attente
+ * @return Résultat de slot_wait_write / slot_wait_read, ou SSH_ERROR
+ */
+static ssize_t slot_finish(ssh_session_t *sess, sftp_slot_t *slot, bool for_write, bool *session_lost) {
+    for (;;) {
+        if (!ssh_handler_lock(sess)) {
+            *session_lost = true;
+            return SSH_ERROR;
+        }
+        ssize_t n = for_write ? slot_wait_write(slot) : slot_wait_read(slot);
+        ssh_handler_unlock(sess);
+        if (n != SSH_AGAIN) return n;
+        ssh_handler_wait(sess, SFTP_POLL_MS);
+    }
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static ssize_t read_full(int fd, char *buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = read(fd, buf + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += n;
+    }
+    return total;
+}
+
+static int write_full(int fd, const char *buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = write(fd, buf + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+    }
+    return 0;
+}
+
+/**
+ * Ouvrir le sous-système SFTP de la session (une seule fois, réutilisé ensuite)
+ * Doit être appelé avec le verrou de la session
+ */
+static sftp_session get_sftp_locked(ssh_session_t *sess) {
+    if (sess->sftp) return sess->sftp;
+
+    sftp_session sftp = sftp_new(sess->session);
+    if (!sftp) return NULL;
+    if (sftp_init(sftp) != SSH_OK) {
+        sftp_free(sftp);
+        return NULL;
+    }
+    sess->sftp = sftp;
+    return sftp;
+}
+
+/**
+ * Lire les options de transfert (chunk_size, max_inflight) avec bornes
+ * Valeurs par défaut : celles du profil de la session, sinon celles du module
+ */
+static void read_transfer_options(json_object *root, const ssh_session_t *sess,
+                                  size_t *chunk_size, int *max_inflight) {
+    json_object *obj;
+    const connection_profile_t *profile = sess->profile;
+    *chunk_size = (profile && profile->sftp_chunk) ? profile->sftp_chunk : SFTP_DEFAULT_CHUNK;
+    *max_inflight = (profile && profile->sftp_inflight) ? profile->sftp_inflight : SFTP_DEFAULT_INFLIGHT;
+    if (*chunk_size < SFTP_MIN_CHUNK) *chunk_size = SFTP_MIN_CHUNK;
+
+    if (json_object_object_get_ex(root, "chunk_size", &obj)) {
+        int64_t v = json_object_get_int64(obj);
+        if (v < SFTP_MIN_CHUNK) v = SFTP_MIN_CHUNK;
+        if (v > SFTP_MAX_CHUNK) v = SFTP_MAX_CHUNK;
+        *chunk_size = (size_t)v;
+    }
+    if (json_object_object_get_ex(root, "max_inflight", &obj)) {
+        int v = json_object_get_int(obj);
+        if (v < 1) v = 1;
+        if (v > SFTP_MAX_INFLIGHT) v = SFTP_MAX_INFLIGHT;
+        *max_inflight = v;
+    }
+}
+
+/**
+ * Allouer la fenêtre de requêtes (un seul bloc pour tous les buffers)
+ */
+static sftp_slot_t* alloc_slots(int count, size_t chunk_size, char **pool) {
+    sftp_slot_t *slots = calloc(count, sizeof(sftp_slot_t));
+    *pool = malloc((size_t)count * chunk_size);
+    if (!slots || !*pool) {
+        free(slots);
+        free(*pool);
+        *pool = NULL;
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        slots[i].buf = *pool + (size_t)i * chunk_size;
+    }
+    return slots;
+}
+
+/**
+ * Ajuster la taille des blocs aux limites annoncées par le serveur
+ */
+static void clamp_chunk_to_limits(sftp_session sftp, size_t *chunk_size, bool for_write) {
+#ifdef KROWN_SFTP_AIO
+    sftp_limits_t limits = sftp_limits(sftp);
+    if (limits) {
+        uint64_t max = for_write ? limits->max_write_length : limits->max_read_length;
+        if (max > 0 && *chunk_size > max) *chunk_size = (size_t)max;
+        sftp_limits_free(limits);
+    }
+#else
+    (void)sftp;
+    (void)chunk_size;
+    (void)for_write;
+#endif
+}
+
+/**
+ * Construire la réponse d'erreur d'un transfert
+ * @param local_errno errno sauvegardé au moment de l'erreur locale (XFER_ERR_LOCAL)
+ */
+static response_code_t transfer_error(ssh_session_t *sess, xfer_error_t err, int local_errno,
+                                      char **response) {
+    char error_msg[512];
+    switch (err) {
+        case XFER_ERR_LOCAL:
+            snprintf(error_msg, sizeof(error_msg),
+                    "{\"error\":\"Erreur fichier local: %s\"}", strerror(local_errno));
+            *response = strdup(error_msg);
+            return RESP_ERROR;
+        case XFER_ERR_SESSION:
+            *response = strdup("{\"error\":\"Session déconnectée pendant le transfert\"}");
+            return RESP_SSH_ERROR;
+        default: {
+            int sftp_code = -1;
+            const char *ssh_error = "inconnue";
+            if (ssh_handler_lock(sess)) {
+                if (sess->sftp) sftp_code = sftp_get_error(sess->sftp);
+                ssh_error = ssh_get_error(sess->session);
+                snprintf(error_msg, sizeof(error_msg),
+                        "{\"error\":\"Échec SFTP: %s\",\"sftp_code\":%d}", ssh_error, sftp_code);
+                ssh_handler_unlock(sess);
+            } else {
+                snprintf(error_msg, sizeof(error_msg), "{\"error\":\"Échec SFTP\",\"sftp_code\":%d}", sftp_code);
+            }
+            *response = strdup(error_msg);
+            return RESP_SSH_ERROR;
+        }
+    }
+}
+
+static char* transfer_result(const char *direction, uint64_t bytes, double duration_ms,
+                             size_t chunk_size, int max_inflight) {
+    char response_json[256];
+    double bytes_per_sec = duration_ms > 0 ? bytes * 1000.0 / duration_ms : 0;
+    snprintf(response_json, sizeof(response_json),
+            "{\"status\":\"ok\",\"direction\":\"%s\",\"bytes\":%llu,\"duration_ms\":%.1f,"
+            "\"bytes_per_sec\":%.0f,\"chunk_size\":%zu,\"max_inflight\":%d}",
+            direction, (unsigned long long)bytes, duration_ms, bytes_per_sec, chunk_size, max_inflight);
+    return strdup(response_json);
+}
+
+/**
+ * Ouvrir un fichier distant (ouvre le sous-système SFTP si nécessaire)
+ */
+static sftp_file open_remote(ssh_session_t *sess, const char *path, int flags, mode_t mode,
+                             size_t *chunk_size, bool for_write, xfer_error_t *err) {
+    if (!ssh_handler_lock(sess)) {
+        *err = XFER_ERR_SESSION;
+        return NULL;
+    }
+    sftp_file file = NULL;
+    sftp_session sftp = get_sftp_locked(sess);
+    if (sftp) {
+        file = sftp_open(sftp, path, flags, mode);
+        if (file) {
+            clamp_chunk_to_limits(sftp, chunk_size, for_write);
+            sftp_file_set_nonblocking(file);
+        }
+    }
+    ssh_handler_unlock(sess);
+    if (!file) *err = XFER_ERR_SFTP;
+    return file;
+}
+
+static void close_remote(ssh_session_t *sess, sftp_file file) {
+    if (ssh_handler_lock(sess)) {
+        sftp_close(file);
+        ssh_handler_unlock(sess);
+    }
+}
+
+/**
+ * Envoyer un fichier local vers la session (CMD_SFTP_PUT)
+ */
+response_code_t handle_sftp_put(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id, *local_path, *remote_path;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    JSON_GET_STRING_OR_RETURN(root, "local_path", local_path, "local_path requis");
+    JSON_GET_STRING_OR_RETURN(root, "remote_path", remote_path, "remote_path requis");
+
+    ssh_session_t *sess = ssh_handler_find_native(session_id, response);
+    if (!sess) {
+        json_object_put(root);
+        return RESP_ERROR;
+    }
+
+    size_t chunk_size;
+    int max_inflight;
+    read_transfer_options(root, sess, &chunk_size, &max_inflight);
+#ifndef KROWN_SFTP_AIO
+    max_inflight = 1;
+#endif
+
+    int fd = open(local_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        int saved_errno = errno;
+        if (fd >= 0) close(fd);
+        json_object_put(root);
+        return transfer_error(sess, XFER_ERR_LOCAL, saved_errno, response);
+    }
+
+    mode_t mode = st.st_mode & 0777;
+    json_object *mode_obj;
+    if (json_object_object_get_ex(root, "mode", &mode_obj)) {
+        mode = (mode_t)json_object_get_int(mode_obj) & 0777;
+    }
+
+    // remote_path appartient à root : libérer seulement après l'ouverture distante
+    xfer_error_t err = XFER_OK;
+    sftp_file file = open_remote(sess, remote_path, O_WRONLY | O_CREAT | O_TRUNC, mode,
+                                 &chunk_size, true, &err);
+    json_object_put(root);
+    if (!file) {
+        close(fd);
+        return transfer_error(sess, err, 0, response);
+    }
+
+    char *pool;
+    sftp_slot_t *slots = alloc_slots(max_inflight, chunk_size, &pool);
+    if (!slots) {
+        close_remote(sess, file);
+        close(fd);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Fenêtre glissante : remplir jusqu'à max_inflight requêtes, puis attendre la plus ancienne.
+    // En cas d'erreur, on n'émet plus rien mais on draine les requêtes encore en vol.
+    uint64_t sent = 0, offset = 0;
+    int head = 0, count = 0, local_errno = 0;
+    bool local_eof = false, session_lost = false;
+    while (!session_lost && (count > 0 || (err == XFER_OK && !local_eof))) {
+        while (err == XFER_OK && !local_eof && count < max_inflight) {
+            sftp_slot_t *slot = &slots[(head + count) % max_inflight];
+            ssize_t n = read_full(fd, slot->buf, chunk_size);
+            if (n < 0) {
+                local_errno = errno;
+                err = XFER_ERR_LOCAL;
+                break;
+            }
+            if ((size_t)n < chunk_size) local_eof = true;
+            if (n == 0) break;
+
+            slot->len = n;
+            slot->offset = offset;
+            offset += n;
+            if (!ssh_handler_lock(sess)) {
+                err = XFER_ERR_SESSION;
+                session_lost = true;
+                break;
+            }
+            ssize_t rc = slot_begin_write(file, slot);
+            ssh_handler_unlock(sess);
+            if (rc < 0) {
+                err = XFER_ERR_SFTP;
+                break;
+            }
+            count++;
+        }
+        if (count == 0 || session_lost) break;
+
+        sftp_slot_t *slot = &slots[head];
+        ssize_t written = slot_finish(sess, slot, true, &session_lost);
+        if (session_lost) {
+            err = XFER_ERR_SESSION;
+            break;
+        }
+        if (written < 0 || (size_t)written != slot->len) {
+            if (err == XFER_OK) err = XFER_ERR_SFTP;
+        } else {
+            sent += written;
+        }
+        head = (head + 1) % max_inflight;
+        count--;
+    }
+
+    double duration = elapsed_ms(&start);
+    if (!session_lost) close_remote(sess, file);
+    close(fd);
+    free(slots);
+    free(pool);
+
+    atomic_fetch_add_explicit(&sess->bytes_out, sent, memory_order_relaxed);
+    if (err != XFER_OK) return transfer_error(sess, err, local_errno, response);
+
+    ssh_handler_record_transfer(sess, sent, duration);
+    *response = transfer_result("put", sent, duration, chunk_size, max_inflight);
+    return *response ? RESP_OK : RESP_ERROR;
+}
+
+/**
+ * Compléter une lecture courte de façon synchrone, puis replacer l'offset
+ * du fichier distant là où la fenêtre de lecture s'est arrêtée
+ * @return Nombre d'octets complétés, ou -1 en cas d'erreur
+ */
+static ssize_t fill_short_read(ssh_session_t *sess, sftp_file file, sftp_slot_t *slot,
+                               size_t got, uint64_t resume_offset) {
+    size_t filled = got;
+    if (!ssh_handler_lock(sess)) return -1;
+    // Cas rare (fin de fichier, serveur qui tronque) : lecture bloquante le temps du complément
+    sftp_file_set_blocking(file);
+    if (sftp_seek64(file, slot->offset + got) == 0) {
+        while (filled < slot->len) {
+            ssize_t n = sftp_read(file, slot->buf + filled, slot->len - filled);
+            if (n <= 0) break;
+            filled += n;
+        }
+    }
+    int rc = sftp_seek64(file, resume_offset);
+    sftp_file_set_nonblocking(file);
+    ssh_handler_unlock(sess);
+    return rc == 0 ? (ssize_t)(filled - got) : -1;
+}
+
+/**
+ * Créer le fichier temporaire de réception à côté de la destination
+ * (même répertoire, donc rename() atomique en fin de transfert). Un fichier
+ * existant garde ses permissions, sinon 0644.
+ * @return Descripteur ouvert, ou -1 (errno positionné)
+ */
+static int open_local_temp(const char *dest, char **tmp_path) {
+    size_t len = strlen(dest);
+    char *path = malloc(len + sizeof(".krown-XXXXXX"));
+    if (!path) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(path, dest, len);
+    memcpy(path + len, ".krown-XXXXXX", sizeof(".krown-XXXXXX"));
+
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd < 0) {
+        int saved_errno = errno;
+        free(path);
+        errno = saved_errno;
+        return -1;
+    }
+
+    struct stat st;
+    mode_t mode = (stat(dest, &st) == 0 && S_ISREG(st.st_mode)) ? (st.st_mode & 0777) : 0644;
+    if (fchmod(fd, mode) < 0) {
+        int saved_errno = errno;
+        close(fd);
+        unlink(path);
+        free(path);
+        errno = saved_errno;
+        return -1;
+    }
+    *tmp_path = path;
+    return fd;
+}
+
+/**
+ * Récupérer un fichier distant vers un fichier local (CMD_SFTP_GET)
+ *
+ * Les données sont écrites dans un fichier temporaire renommé sur local_path
+ * seulement si le transfert réussit : un échec ne touche pas au fichier existant.
+ */
+response_code_t handle_sftp_get(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id, *local_path, *remote_path;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    JSON_GET_STRING_OR_RETURN(root, "local_path", local_path, "local_path requis");
+    JSON_GET_STRING_OR_RETURN(root, "remote_path", remote_path, "remote_path requis");
+
+    ssh_session_t *sess = ssh_handler_find_native(session_id, response);
+    if (!sess) {
+        json_object_put(root);
+        return RESP_ERROR;
+    }
+
+    size_t chunk_size;
+    int max_inflight;
+    read_transfer_options(root, sess, &chunk_size, &max_inflight);
+
+    xfer_error_t err = XFER_OK;
+    sftp_file file = open_remote(sess, remote_path, O_RDONLY, 0, &chunk_size, false, &err);
+    if (!file) {
+        json_object_put(root);
+        return transfer_error(sess, err, 0, response);
+    }
+
+    uint64_t remote_size = 0;
+    if (ssh_handler_lock(sess)) {
+        sftp_attributes attrs = sftp_fstat(file);
+        if (attrs) {
+            remote_size = attrs->size;
+            sftp_attributes_free(attrs);
+        } else {
+            err = XFER_ERR_SFTP;
+        }
+        ssh_handler_unlock(sess);
+    } else {
+        err = XFER_ERR_SESSION;
+    }
+
+    int fd = -1, local_errno = 0;
+    char *dest_path = NULL, *tmp_path = NULL;
+    if (err == XFER_OK) {
+        dest_path = strdup(local_path);
+        fd = dest_path ? open_local_temp(dest_path, &tmp_path) : -1;
+        if (fd < 0) {
+            local_errno = dest_path ? errno : ENOMEM;
+            err = XFER_ERR_LOCAL;
+        }
+    }
+    json_object_put(root);
+    if (err != XFER_OK) {
+        if (err != XFER_ERR_SESSION) close_remote(sess, file);
+        free(dest_path);
+        return transfer_error(sess, err, local_errno, response);
+    }
+
+    char *pool;
+    sftp_slot_t *slots = alloc_slots(max_inflight, chunk_size, &pool);
+    if (!slots) {
+        close_remote(sess, file);
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        free(dest_path);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Les réponses sont attendues dans l'ordre d'émission : l'écriture locale reste séquentielle
+    uint64_t received = 0, next_offset = 0;
+    int head = 0, count = 0;
+    bool remote_eof = false, session_lost = false;
+    while (!session_lost && (count > 0 || (err == XFER_OK && !remote_eof && next_offset < remote_size))) {
+        while (err == XFER_OK && !remote_eof && next_offset < remote_size && count < max_inflight) {
+            sftp_slot_t *slot = &slots[(head + count) % max_inflight];
+            uint64_t remaining = remote_size - next_offset;
+            slot->len = remaining < chunk_size ? (size_t)remaining : chunk_size;
+            slot->offset = next_offset;
+            if (!ssh_handler_lock(sess)) {
+                err = XFER_ERR_SESSION;
+                session_lost = true;
+                break;
+            }
+            ssize_t rc = slot_begin_read(file, slot);
+            ssh_handler_unlock(sess);
+            if (rc < 0) {
+                err = XFER_ERR_SFTP;
+                break;
+            }
+            next_offset += slot->len;
+            count++;
+        }
+        if (count == 0 || session_lost) break;
+
+        sftp_slot_t *slot = &slots[head];
+        ssize_t n = slot_finish(sess, slot, false, &session_lost);
+        if (session_lost) {
+            err = XFER_ERR_SESSION;
+            break;
+        }
+
+        if (err == XFER_OK) {
+            if (n < 0) {
+                err = XFER_ERR_SFTP;
+            } else if (n == 0) {
+                remote_eof = true;  // Le fichier distant a rétréci pendant le transfert
+            } else if (!remote_eof) {
+                size_t got = (size_t)n;
+                if (got < slot->len) {
+                    ssize_t extra = fill_short_read(sess, file, slot, got, next_offset);
+                    if (extra < 0) {
+                        err = XFER_ERR_SFTP;
+                    } else {
+                        got += extra;
+                        if (got < slot->len) remote_eof = true;
+                    }
+                }
+                if (err == XFER_OK) {
+                    if (write_full(fd, slot->buf, got) < 0) {
+                        local_errno = errno;
+                        err = XFER_ERR_LOCAL;
+                    } else {
+                        received += got;
+                    }
+                }
+            }
+        }
+        head = (head + 1) % max_inflight;
+        count--;
+    }
+
+    double duration = elapsed_ms(&start);
+    if (!session_lost) close_remote(sess, file);
+    if (close(fd) < 0 && err == XFER_OK) {
+        local_errno = errno;
+        err = XFER_ERR_LOCAL;
+    }
+    if (err == XFER_OK && rename(tmp_path, dest_path) < 0) {
+        local_errno = errno;
+        err = XFER_ERR_LOCAL;
+    }
+    if (err != XFER_OK) unlink(tmp_path);
+    free(tmp_path);
+    free(dest_path);
+    free(slots);
+    free(pool);
+
+    atomic_fetch_add_explicit(&sess->bytes_in, received, memory_order_relaxed);
+    if (err != XFER_OK) return transfer_error(sess, err, local_errno, response);
+
+    ssh_handler_record_transfer(sess, received, duration);
+    *response = transfer_result("get", received, duration, chunk_size, max_inflight);
+    return *response ? RESP_OK : RESP_ERROR;
+}
@@ -0,0 +1,9 @@
+#ifndef SFTP_HANDLER_H
+#define SFTP_HANDLER_H
+
+#include "agent.h"
+
+response_code_t handle_sftp_put(const char *json_data, char **response);
+response_code_t handle_sftp_get(const char *json_data, char **response);
+
+#endif // SFTP_HANDLER_H
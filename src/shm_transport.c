@@ -0,0 +1,374 @@
+/**
+ * Transport par mémoire partagée - Anneaux SPSC entre l'agent et un client local
+ *
+ * Négocié sur le socket par CMD_SHM_OPEN : l'agent crée un memfd (en-tête + anneau des
+ * requêtes + anneau des réponses), le projette et le transmet au client (SCM_RIGHTS) avec
+ * la réponse. Les anneaux portent les mêmes trames que le socket (en-tête de 3 uint32 +
+ * données) ; une réponse plus grande que l'anneau passe par morceaux au fil de la lecture
+ * du client. Les réveils passent par futex sur des compteurs de l'en-tête partagé.
+ *
+ * Le thread du socket sert ensuite les requêtes de l'anneau, une à la fois, jusqu'à la
+ * fermeture du socket (qui reste le témoin de vie du client) ou du drapeau closed.
+ *
+ * Le client peut écrire tout l'en-tête : la taille des anneaux et les positions propres
+ * à l'agent (head des requêtes, tail des réponses) sont gardées en privé et seulement
+ * publiées ; les positions du client sont validées avant chaque copie.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <json-c/json.h>
+
+#include "shm_transport.h"
+#include "socket_server.h"
+#include "logger.h"
+#include "mem_budget.h"
+
+_Static_assert(sizeof(shm_ring_t) == 192, "disposition shm_ring_t");
+_Static_assert(sizeof(shm_header_t) <= SHM_HEADER_BYTES, "disposition shm_header_t");
+
+typedef struct {
+    shm_header_t *hdr;
+    size_t map_bytes;
+    uint64_t ring_bytes;        // Copies privées : l'en-tête partagé n'est jamais relu
+    uint64_t mask;
+    uint64_t request_head;      // Position de l'agent dans l'anneau des requêtes
+    uint64_t response_tail;     // Position de l'agent dans l'anneau des réponses
+    uint8_t *request_data;
+    uint8_t *response_data;
+    int client_fd;
+    int timeout_ms;             // Réponse non consommée par le client (0 = aucune limite)
+} shm_conn_t;
+
+static atomic_uint_fast64_t stat_opened = 0;
+static atomic_int stat_active = 0;
+static atomic_uint_fast64_t stat_requests = 0;
+static atomic_uint_fast64_t stat_bytes_in = 0;
+static atomic_uint_fast64_t stat_bytes_out = 0;
+
+static void futex_wait(_Atomic uint32_t *word, uint32_t expected, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000 };
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * Signaler l'autre côté : compteur incrémenté, réveil seulement s'il attend
+ */
+static void notify(_Atomic uint32_t *seq, _Atomic uint32_t *waiting) {
+    atomic_fetch_add(seq, 1);
+    if (atomic_load(waiting)) futex_wake(seq);
+}
+
+/**
+ * Le client est-il toujours là ? (socket fermé ou drapeau closed)
+ */
+static bool client_alive(shm_conn_t *c) {
+    if (atomic_load(&c->hdr->closed)) return false;
+    struct pollfd pfd = { .fd = c->client_fd, .events = POLLRDHUP };
+    if (poll(&pfd, 1, 0) <= 0) return true;
+    return !(pfd.revents & (POLLHUP | POLLERR | POLLRDHUP));
+}
+
+/**
+ * Attendre une tranche sur un futex, le prédicat étant relu après la levée du drapeau
+ * d'attente (l'autre côté avance sa position avant de lire le drapeau)
+ * @return 0 pour réessayer, -1 si le client est parti
+ */
+static int wait_slice(shm_conn_t *c, _Atomic uint32_t *seq, _Atomic uint32_t *waiting,
+                      _Atomic uint64_t *watched, uint64_t seen) {
+    atomic_store(waiting, 1);
+    uint32_t s = atomic_load(seq);
+    if (atomic_load(watched) == seen) futex_wait(seq, s, SHM_WAIT_SLICE_MS);
+    atomic_store(waiting, 0);
+    return client_alive(c) ? 0 : -1;
+}
+
+/**
+ * Lire exactement len octets de l'anneau des requêtes (attente sans limite : la
+ * connexion reste ouverte entre deux requêtes)
+ */
+static int ring_read(shm_conn_t *c, void *dst, size_t len) {
+    shm_ring_t *r = &c->hdr->request;
+    uint64_t size = c->ring_bytes;
+    size_t done = 0;
+
+    while (done < len) {
+        uint64_t head = c->request_head;
+        uint64_t tail = atomic_load(&r->tail);
+        if (tail - head > size) return -1;      // Positions incohérentes : client fautif
+        if (tail == head) {
+            if (wait_slice(c, &r->data_seq, &r->consumer_waiting, &r->tail, tail) < 0) return -1;
+            continue;
+        }
+        size_t n = (size_t)(tail - head);
+        if (n > len - done) n = len - done;
+        size_t at = (size_t)(head & c->mask);
+        size_t first = n < size - at ? n : (size_t)(size - at);
+        memcpy((uint8_t *)dst + done, c->request_data + at, first);
+        memcpy((uint8_t *)dst + done + first, c->request_data, n - first);
+        c->request_head = head + n;
+        atomic_store(&r->head, head + n);
+        notify(&r->space_seq, &r->producer_waiting);
+        done += n;
+    }
+    return 0;
+}
+
+/**
+ * Écrire len octets dans l'anneau des réponses, au rythme de la lecture du client
+ */
+static int ring_write(shm_conn_t *c, const void *src, size_t len) {
+    shm_ring_t *r = &c->hdr->response;
+    uint64_t size = c->ring_bytes;
+    size_t done = 0;
+    int stalled_ms = 0;
+
+    while (done < len) {
+        uint64_t tail = c->response_tail;
+        uint64_t head = atomic_load(&r->head);
+        if (tail - head > size) return -1;
+        uint64_t space = size - (tail - head);
+        if (space == 0) {
+            if (c->timeout_ms > 0 && stalled_ms >= c->timeout_ms) {
+                LOG_WARN("[Shm] Réponse non consommée depuis %d ms, transport fermé\n", stalled_ms);
+                return -1;
+            }
+            if (wait_slice(c, &r->space_seq, &r->producer_waiting, &r->head, head) < 0) return -1;
+            stalled_ms += SHM_WAIT_SLICE_MS;
+            continue;
+        }
+        stalled_ms = 0;
+        size_t n = space < len - done ? (size_t)space : len - done;
+        size_t at = (size_t)(tail & c->mask);
+        size_t first = n < size - at ? n : (size_t)(size - at);
+        memcpy(c->response_data + at, (const uint8_t *)src + done, first);
+        memcpy(c->response_data, (const uint8_t *)src + done + first, n - first);
+        c->response_tail = tail + n;
+        atomic_store(&r->tail, tail + n);
+        notify(&r->data_seq, &r->consumer_waiting);
+        done += n;
+    }
+    return 0;
+}
+
+/**
+ * Lire une trame de requête (mêmes contrôles que socket_read_command)
+ */
+static int read_command(shm_conn_t *c, command_t **cmd_out) {
+    uint32_t header[3];
+    if (ring_read(c, header, sizeof(header)) < 0) return -1;
+
+    if (header[0] != PROTOCOL_VERSION) {
+        LOG_ERROR("[Shm] Version de protocole invalide: %u\n", header[0]);
+        return -1;
+    }
+    uint32_t data_len = header[2];
+    if (data_len > 1024 * 1024) {
+        LOG_ERROR("[Shm] Taille de données trop grande: %u\n", data_len);
+        return -1;
+    }
+
+    command_t *cmd = malloc(sizeof(command_t) + data_len + 1);
+    if (!cmd) return -1;
+    cmd->version = header[0];
+    cmd->cmd_type = header[1] & CMD_TYPE_MASK;
+    cmd->flags = header[1] & ~CMD_TYPE_MASK;
+    cmd->data_len = data_len;
+    cmd->fd_count = 0;          // Pas de descripteurs par l'anneau
+    if (data_len > 0 && ring_read(c, cmd->data, data_len) < 0) {
+        free(cmd);
+        return -1;
+    }
+    cmd->data[data_len] = '\0';
+
+    atomic_fetch_add_explicit(&stat_bytes_in, sizeof(header) + data_len, memory_order_relaxed);
+    *cmd_out = cmd;
+    return 0;
+}
+
+/**
+ * Écrire une trame de réponse (non compressée : rien à gagner sans copie noyau)
+ */
+static int send_response(shm_conn_t *c, response_code_t code, const char *data) {
+    size_t len = data ? strlen(data) : 0;
+    uint32_t header[3] = { PROTOCOL_VERSION, (uint32_t)code, (uint32_t)len };
+    if (ring_write(c, header, sizeof(header)) < 0) return -1;
+    if (len > 0 && ring_write(c, data, len) < 0) return -1;
+    atomic_fetch_add_explicit(&stat_bytes_out, sizeof(header) + len, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * Taille d'anneau demandée, arrondie à la puissance de 2 supérieure et bornée
+ */
+static uint64_t ring_size_from(const char *json_data) {
+    uint64_t wanted = SHM_DEFAULT_RING_BYTES;
+    json_object *root = json_data && *json_data ? json_tokener_parse(json_data) : NULL;
+    json_object *obj;
+    if (root && json_object_object_get_ex(root, "ring_bytes", &obj)) {
+        int64_t v = json_object_get_int64(obj);
+        if (v > 0) wanted = (uint64_t)v;
+    }
+    if (root) json_object_put(root);
+
+    if (wanted < SHM_MIN_RING_BYTES) wanted = SHM_MIN_RING_BYTES;
+    if (wanted > SHM_MAX_RING_BYTES) wanted = SHM_MAX_RING_BYTES;
+    uint64_t size = SHM_MIN_RING_BYTES;
+    while (size < wanted) size <<= 1;
+    return size;
+}
+
+/**
+ * Créer et projeter le memfd ; *memfd reste ouvert pour la transmission au client
+ * La taille est scellée avant l'envoi : un client qui tronquerait le memfd ferait
+ * tomber l'agent sur SIGBUS à la prochaine copie dans l'anneau.
+ */
+static int map_rings(shm_conn_t *c, uint64_t ring_bytes, int *memfd) {
+    c->map_bytes = SHM_HEADER_BYTES + 2 * ring_bytes;
+    int fd = memfd_create("krown-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)c->map_bytes) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        perror("fcntl(F_ADD_SEALS)");
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, c->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return -1;
+    }
+
+    c->hdr = base;      // memfd neuf : tout est à zéro
+    c->hdr->magic = SHM_MAGIC;
+    c->hdr->layout_version = SHM_LAYOUT_VERSION;
+    c->hdr->ring_bytes = ring_bytes;
+    c->hdr->request_offset = SHM_HEADER_BYTES;
+    c->hdr->response_offset = SHM_HEADER_BYTES + ring_bytes;
+    c->ring_bytes = ring_bytes;
+    c->mask = ring_bytes - 1;
+    c->request_data = (uint8_t *)base + c->hdr->request_offset;
+    c->response_data = (uint8_t *)base + c->hdr->response_offset;
+    *memfd = fd;
+    return 0;
+}
+
+/**
+ * Réserver une place parmi les SHM_MAX_CONNECTIONS transports ouverts
+ */
+static bool reserve_slot(void) {
+    int active = atomic_load(&stat_active);
+    do {
+        if (active >= SHM_MAX_CONNECTIONS) return false;
+    } while (!atomic_compare_exchange_weak(&stat_active, &active, active + 1));
+    return true;
+}
+
+/**
+ * Ouvrir le transport partagé pour ce client et le servir jusqu'à son départ
+ * @param json_data {"ring_bytes": N} optionnel
+ * @return 0 à la fermeture normale, -1 si le transport n'a pas pu être ouvert
+ */
+int shm_transport_serve(int client_fd, const char *json_data, int timeout_ms,
+                        shm_dispatch_fn dispatch, void *ctx) {
+    shm_conn_t c = { .client_fd = client_fd, .timeout_ms = timeout_ms };
+    uint64_t ring_bytes = ring_size_from(json_data);
+    int memfd = -1;
+
+    if (!reserve_slot()) {
+        socket_send_response(client_fd, RESP_BUSY,
+                             "{\"error\":\"Trop de transports partagés ouverts\",\"retry_after_ms\":1000}", 0);
+        return -1;
+    }
+    // Pages du memfd imputées à l'agent avant leur création : refus si le budget ne les couvre pas
+    ptrdiff_t map_bytes = (ptrdiff_t)(SHM_HEADER_BYTES + 2 * ring_bytes);
+    if (mem_budget_charge(map_bytes) < 0) {
+        atomic_fetch_sub(&stat_active, 1);
+        char busy[128];
+        snprintf(busy, sizeof(busy),
+                 "{\"error\":\"Budget mémoire insuffisant pour les anneaux partagés\",\"retry_after_ms\":%d}",
+                 MEM_BUDGET_RETRY_AFTER_MS);
+        socket_send_response(client_fd, RESP_BUSY, busy, 0);
+        return -1;
+    }
+    if (map_rings(&c, ring_bytes, &memfd) < 0) {
+        mem_budget_hold(-map_bytes);
+        atomic_fetch_sub(&stat_active, 1);
+        socket_send_response(client_fd, RESP_ERROR, "{\"error\":\"Impossible de créer la mémoire partagée\"}", 0);
+        return -1;
+    }
+
+    char response_json[256];
+    snprintf(response_json, sizeof(response_json),
+             "{\"status\":\"mapped\",\"layout_version\":%d,\"map_bytes\":%llu,\"ring_bytes\":%llu,"
+             "\"request_offset\":%llu,\"response_offset\":%llu}",
+             SHM_LAYOUT_VERSION, (unsigned long long)c.map_bytes, (unsigned long long)ring_bytes,
+             (unsigned long long)c.hdr->request_offset, (unsigned long long)c.hdr->response_offset);
+    int sent = socket_send_response_fd(client_fd, RESP_OK, response_json, memfd);
+    close(memfd);
+    if (sent < 0) {
+        munmap(c.hdr, c.map_bytes);
+        mem_budget_hold(-map_bytes);
+        atomic_fetch_sub(&stat_active, 1);
+        return -1;
+    }
+
+    atomic_fetch_add_explicit(&stat_opened, 1, memory_order_relaxed);
+    DEBUG_PRINT("[Shm] Transport ouvert (fd=%d, anneaux %llu octets)\n",
+                client_fd, (unsigned long long)ring_bytes);
+
+    command_t *cmd = NULL;
+    while (read_command(&c, &cmd) == 0) {
+        char *response_data = NULL;
+        response_code_t code = dispatch(cmd, ctx, &response_data);
+        atomic_fetch_add_explicit(&stat_requests, 1, memory_order_relaxed);
+
+        int rc = response_data ? send_response(&c, code, response_data)
+                               : send_response(&c, RESP_ERROR, "{\"error\":\"Erreur interne\"}");
+        free(response_data);
+        free(cmd);
+        cmd = NULL;
+        if (rc < 0) break;
+    }
+
+    // Le client qui attendrait encore est réveillé et voit closed
+    atomic_store(&c.hdr->closed, 1);
+    futex_wake(&c.hdr->response.data_seq);
+    futex_wake(&c.hdr->request.space_seq);
+    munmap(c.hdr, c.map_bytes);
+    mem_budget_hold(-map_bytes);
+    atomic_fetch_sub(&stat_active, 1);
+    DEBUG_PRINT("[Shm] Transport fermé (fd=%d)\n", client_fd);
+    return 0;
+}
+
+int shm_transport_stats_json(char *buf, size_t size) {
+    return snprintf(buf, size,
+                    "{\"opened\":%llu,\"active\":%d,\"requests\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu}",
+                    (unsigned long long)atomic_load(&stat_opened), atomic_load(&stat_active),
+                    (unsigned long long)atomic_load(&stat_requests),
+                    (unsigned long long)atomic_load(&stat_bytes_in),
+                    (unsigned long long)atomic_load(&stat_bytes_out));
+}
@@ -0,0 +1,57 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "agent.h"
+
+#define SHM_LAYOUT_VERSION 1
+#define SHM_MAGIC 0x4B534852u                   // "KSHR"
+#define SHM_HEADER_BYTES 4096                   // Zones de données alignées sur une page
+#define SHM_DEFAULT_RING_BYTES (4 * 1024 * 1024)
+#define SHM_MIN_RING_BYTES (64 * 1024)
+#define SHM_MAX_RING_BYTES (256 * 1024 * 1024)
+#define SHM_WAIT_SLICE_MS 100                   // Attente futex entre deux contrôles du client
+#define SHM_MAX_CONNECTIONS 32                  // Transports partagés ouverts simultanément
+
+/*
+ * Anneau SPSC d'octets (disposition partagée avec le client, offsets fixes)
+ * head : position du consommateur, tail : position du producteur (compteurs 64 bits,
+ * index = position & (ring_bytes - 1)). Chaque côté incrémente la séquence de l'autre
+ * après avoir avancé sa position et réveille par futex (FUTEX_WAKE, non privé) si
+ * le drapeau d'attente est levé.
+ */
+typedef struct {
+    _Atomic uint64_t head;                      // +0
+    char pad0[56];
+    _Atomic uint64_t tail;                      // +64
+    char pad1[56];
+    _Atomic uint32_t data_seq;                  // +128 : futex du consommateur (données publiées)
+    _Atomic uint32_t space_seq;                 // +132 : futex du producteur (place libérée)
+    _Atomic uint32_t consumer_waiting;          // +136
+    _Atomic uint32_t producer_waiting;          // +140
+    char pad2[48];
+} shm_ring_t;
+
+typedef struct {
+    uint32_t magic;                             // +0
+    uint32_t layout_version;                    // +4
+    uint64_t ring_bytes;                        // +8 : taille de chaque anneau (puissance de 2)
+    uint64_t request_offset;                    // +16 : données de l'anneau des requêtes
+    uint64_t response_offset;                   // +24 : données de l'anneau des réponses
+    _Atomic uint32_t closed;                    // +32 : positionné par le côté qui s'en va
+    char pad[28];
+    shm_ring_t request;                         // +64 : client -> agent
+    shm_ring_t response;                        // +256 : agent -> client
+} shm_header_t;
+
+// Traitement d'une commande reçue par l'anneau (même chemin que le socket)
+typedef response_code_t (*shm_dispatch_fn)(command_t *cmd, void *ctx, char **response);
+
+int shm_transport_serve(int client_fd, const char *json_data, int timeout_ms,
+                        shm_dispatch_fn dispatch, void *ctx);
+int shm_transport_stats_json(char *buf, size_t size);
+
+#endif // SHM_TRANSPORT_H
@@ -9,13 +9,60 @@
 #include <errno.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "socket_server.h"
 #include "agent.h"
+#include "logger.h"
+#include "compression.h"
 
-#define MAX_CLIENTS 10
+#define SD_LISTEN_FDS_START 3   // Premier fd transmis par systemd (sd_listen_fds)
 
-int socket_server_start(const char *socket_path) {
+// Socket reçu de systemd : il appartient à l'unité .socket, ne pas le supprimer à l'arrêt
+static bool socket_activated = false;
+
+/**
+ * Récupérer le socket d'écoute transmis par systemd (activation par socket)
+ * Protocole sd_listen_fds : LISTEN_PID = notre pid, LISTEN_FDS = nombre de fds à partir de 3
+ * @return fd d'écoute, ou -1 si l'agent n'a pas été activé par systemd
+ */
+int socket_server_from_systemd(void) {
+    const char *pid_env = getenv("LISTEN_PID");
+    const char *fds_env = getenv("LISTEN_FDS");
+    if (!pid_env || !fds_env) return -1;
+    if ((pid_t)strtol(pid_env, NULL, 10) != getpid()) return -1;
+
+    int n_fds = atoi(fds_env);
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    if (n_fds < 1) return -1;
+    if (n_fds > 1) {
+        LOG_WARN("[Socket] %d sockets transmis par systemd, seul le premier est utilisé\n", n_fds);
+    }
+
+    int fd = SD_LISTEN_FDS_START;
+    int type = 0, listening = 0;
+    socklen_t len = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) {
+        LOG_ERROR("[Socket] Le fd systemd n'est pas un socket stream\n");
+        return -1;
+    }
+    len = sizeof(listening);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening) {
+        LOG_ERROR("[Socket] Le fd systemd n'est pas en écoute\n");
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    socket_activated = true;
+    DEBUG_PRINT("[Socket] Socket reçu de systemd (fd=%d)\n", fd);
+    return fd;
+}
+
+int socket_server_start(const char *socket_path, int backlog) {
     int server_fd;
     struct sockaddr_un addr;
 
@@ -45,15 +92,16 @@ int socket_server_start(const char *socket_path) {
         return -1;
     }
 
-    // Listen
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
+    // Listen (le noyau plafonne à net.core.somaxconn)
+    if (backlog < 1) backlog = SOMAXCONN;
+    if (listen(server_fd, backlog) < 0) {
         perror("listen");
         close(server_fd);
         return -1;
     }
 
     chmod(socket_path, 0666);
-    DEBUG_PRINT("[Socket] Serveur démarré sur %s\n", socket_path);
+    DEBUG_PRINT("[Socket] Serveur démarré sur %s (backlog %d)\n", socket_path, backlog);
     return server_fd;
 }
 
@@ -75,13 +123,97 @@ int socket_server_accept(int server_fd) {
     return client_fd;
 }
 
+/**
+ * Borner les lectures/écritures sur un client (un client bloqué ne retient pas un thread)
+ */
+int socket_set_timeouts(int client_fd, int timeout_ms) {
+    if (timeout_ms <= 0) return 0;
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+        perror("setsockopt timeout");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Fermer des descripteurs reçus en rétablissant leurs drapeaux d'origine : O_NONBLOCK
+ * porte sur la description de fichier ouverte, partagée avec le client
+ */
+static void close_received(const int *fds, const int *fd_flags, int count) {
+    for (int i = 0; i < count; i++) {
+        if (fd_flags[i] >= 0) fcntl(fds[i], F_SETFL, fd_flags[i]);
+        close(fds[i]);
+    }
+}
+
+/**
+ * Lire l'en-tête avec recvmsg : les descripteurs joints (SCM_RIGHTS, au plus
+ * COMMAND_MAX_FDS) accompagnent ses premiers octets. Ils sont passés en O_NONBLOCK le
+ * temps de la requête : une écriture sur un tube que le client ne vide plus rend la main
+ * à l'agent, qui peut alors appliquer le délai et CMD_CANCEL au lieu de rester bloqué
+ * dans write(). fd_flags reçoit les drapeaux à rétablir avant la fermeture
+ * @return Octets lus, ou -1 (erreur, ou trop de descripteurs : ceux reçus sont fermés)
+ */
+static ssize_t read_header(int client_fd, uint32_t header[3], int *fds, int *fd_flags, int *fd_count) {
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * COMMAND_MAX_FDS)];
+    } control;
+    struct iovec iov = { .iov_base = header, .iov_len = 3 * sizeof(uint32_t) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    ssize_t n;
+    do {
+        n = recvmsg(client_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    *fd_count = 0;
+    if (n < 0) {
+        perror("read header");
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*fd_count < COMMAND_MAX_FDS) {
+                int flags = fcntl(fd, F_GETFL);
+                bool set = flags >= 0 && !(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+                fd_flags[*fd_count] = set ? flags : -1;
+                fds[(*fd_count)++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        LOG_ERROR("[Socket] Trop de descripteurs joints (max %d)\n", COMMAND_MAX_FDS);
+        close_received(fds, fd_flags, *fd_count);
+        *fd_count = 0;
+        return -1;
+    }
+    return n;
+}
+
 int socket_read_command(int client_fd, command_t **cmd_out) {
-    // Lire l'en-tête (version + type + longueur)
+    // Lire l'en-tête (version + type + longueur) et les descripteurs joints
     uint32_t header[3];
-    ssize_t n = read(client_fd, header, sizeof(header));
+    int fds[COMMAND_MAX_FDS];
+    int fd_flags[COMMAND_MAX_FDS];
+    int fd_count = 0;
+    ssize_t n = read_header(client_fd, header, fds, fd_flags, &fd_count);
     
     if (n < (ssize_t)sizeof(header)) {
-        if (n < 0) perror("read header");
+        close_received(fds, fd_flags, fd_count);
         return -1;
     }
 
@@ -91,7 +223,8 @@ int socket_read_command(int client_fd, command_t **cmd_out) {
 
     // Vérifier la version
     if (version != PROTOCOL_VERSION) {
-        fprintf(stderr, "[Socket] Version de protocole invalide: %u\n", version);
+        LOG_ERROR("[Socket] Version de protocole invalide: %u\n", version);
+        close_received(fds, fd_flags, fd_count);
         return -1;
     }
 
@@ -99,16 +232,22 @@ int socket_read_command(int client_fd, command_t **cmd_out) {
     command_t *cmd = malloc(sizeof(command_t) + data_len + 1);
     if (!cmd) {
         perror("malloc");
+        close_received(fds, fd_flags, fd_count);
         return -1;
     }
+    memcpy(cmd->fds, fds, sizeof(int) * fd_count);
+    memcpy(cmd->fd_flags, fd_flags, sizeof(int) * fd_count);
+    cmd->fd_count = fd_count;
 
     cmd->version = version;
-    cmd->cmd_type = cmd_type;
+    cmd->cmd_type = cmd_type & CMD_TYPE_MASK;
+    cmd->flags = cmd_type & ~CMD_TYPE_MASK;
     cmd->data_len = data_len;
 
     // Vérifier la taille maximale pour éviter les débordements
     if (data_len > 1024 * 1024) { // Limite à 1MB
-        fprintf(stderr, "[Socket] Taille de données trop grande: %u\n", data_len);
+        LOG_ERROR("[Socket] Taille de données trop grande: %u\n", data_len);
+        socket_close_fds(cmd);
         free(cmd);
         return -1;
     }
@@ -121,11 +260,13 @@ int socket_read_command(int client_fd, command_t **cmd_out) {
             if (n < 0) {
                 if (errno == EINTR) continue;
                 perror("read data");
+                socket_close_fds(cmd);
                 free(cmd);
                 return -1;
             }
             if (n == 0) {
-                fprintf(stderr, "[Socket] Connexion fermée pendant la lecture\n");
+                LOG_ERROR("[Socket] Connexion fermée pendant la lecture\n");
+                socket_close_fds(cmd);
                 free(cmd);
                 return -1;
             }
@@ -140,13 +281,104 @@ int socket_read_command(int client_fd, command_t **cmd_out) {
     return 0;
 }
 
-int socket_send_response(int client_fd, response_code_t code, const char *data) {
-    uint32_t data_len = data ? strlen(data) : 0;
+/**
+ * Fermer les descripteurs joints à une commande (drapeaux d'origine rétablis)
+ */
+void socket_close_fds(command_t *cmd) {
+    close_received(cmd->fds, cmd->fd_flags, cmd->fd_count);
+    cmd->fd_count = 0;
+}
+
+void socket_stream_init(socket_stream_t *stream, int client_fd) {
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = client_fd;
+}
+
+/**
+ * Réception non bloquante
+ * @return Octets reçus, SOCKET_STREAM_AGAIN, ou -1 (erreur, client parti)
+ */
+static ssize_t recv_some(int fd, void *buf, size_t len) {
+    ssize_t n;
+    do {
+        n = recv(fd, buf, len, MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? SOCKET_STREAM_AGAIN : -1;
+    if (n == 0) {
+        LOG_ERROR("[Socket] Connexion fermée pendant le flux stdin\n");
+        return -1;
+    }
+    return n;
+}
+
+/**
+ * Lire la suite du flux : en-têtes de trame consommés au passage, jamais plus que len
+ * octets de données (la mémoire ne dépend pas de la taille des trames)
+ * @return Octets de données, 0 à la fin du flux, SOCKET_STREAM_AGAIN, ou -1
+ *         (connexion fermée, trame invalide)
+ */
+ssize_t socket_stream_read(socket_stream_t *stream, void *buf, size_t len) {
+    while (!stream->eof) {
+        if (stream->in_frame) {
+            size_t want = stream->frame_left < len ? stream->frame_left : len;
+            ssize_t n = recv_some(stream->fd, buf, want);
+            if (n > 0) {
+                stream->frame_left -= (uint32_t)n;
+                if (stream->frame_left == 0) stream->in_frame = false;
+            }
+            return n;
+        }
+
+        ssize_t n = recv_some(stream->fd, (char *)stream->header + stream->header_got,
+                              sizeof(stream->header) - stream->header_got);
+        if (n < 0) return n;
+        stream->header_got += (size_t)n;
+        if (stream->header_got < sizeof(stream->header)) continue;
+
+        stream->header_got = 0;
+        if (stream->header[0] != PROTOCOL_VERSION ||
+            (stream->header[1] & CMD_TYPE_MASK) != CMD_STDIN_DATA) {
+            LOG_ERROR("[Socket] Trame stdin invalide (version %u, type %u)\n",
+                      stream->header[0], stream->header[1] & CMD_TYPE_MASK);
+            return -1;
+        }
+        stream->frame_left = stream->header[2];
+        stream->in_frame = stream->frame_left > 0;
+        if (!stream->in_frame) stream->eof = true;
+    }
+    return 0;
+}
+
+/**
+ * Envoyer une réponse ; le corps est compressé si le client l'accepte (CMD_FLAG_ACCEPT_*)
+ * et qu'il dépasse le seuil, le codec étant alors indiqué dans les bits hauts du code
+ */
+int socket_send_response(int client_fd, response_code_t code, const char *data, uint32_t accept_flags) {
+    size_t raw_len = data ? strlen(data) : 0;
+    uint32_t code_field = (uint32_t)code;
+
+    compression_stream_t *cs = NULL;
+    codec_t codec = compression_choose(accept_flags, raw_len);
+    if (codec != CODEC_NONE && (cs = compression_stream_new(codec)) != NULL) {
+        size_t off = 0, compressed_len = 0;
+        while (off < raw_len) {
+            size_t n = raw_len - off < SOCKET_COMPRESS_CHUNK ? raw_len - off : SOCKET_COMPRESS_CHUNK;
+            if (compression_stream_write(cs, data + off, n, off + n == raw_len) != 0) break;
+            off += n;
+        }
+        const void *compressed = compression_stream_data(cs, &compressed_len);
+        if (compressed) {
+            data = compressed;
+            raw_len = compressed_len;
+            code_field |= compression_response_flag(codec);
+        }
+    }
+    uint32_t data_len = (uint32_t)raw_len;
     
     // En-tête
     uint32_t header[3] = {
         PROTOCOL_VERSION,
-        (uint32_t)code,
+        code_field,
         data_len
     };
 
@@ -156,6 +388,7 @@ int socket_send_response(int client_fd, response_code_t code, const char *data)
         if (n < 0) {
             if (errno == EINTR) continue;
             perror("write header");
+            compression_stream_free(cs);
             return -1;
         }
         written += n;
@@ -169,18 +402,79 @@ int socket_send_response(int client_fd, response_code_t code, const char *data)
             if (n < 0) {
                 if (errno == EINTR) continue;
                 perror("write data");
+                compression_stream_free(cs);
                 return -1;
             }
             written += n;
         }
     }
 
+    compression_stream_free(cs);
+    return 0;
+}
+
+/**
+ * Envoyer une réponse (non compressée) accompagnée d'un descripteur (SCM_RIGHTS),
+ * attaché à l'en-tête : le client le reçoit avec recvmsg() sur les 12 premiers octets
+ */
+int socket_send_response_fd(int client_fd, response_code_t code, const char *data, int pass_fd) {
+    uint32_t data_len = data ? (uint32_t)strlen(data) : 0;
+    uint32_t header[3] = { PROTOCOL_VERSION, (uint32_t)code, data_len };
+
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = header, .iov_len = sizeof(header) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+
+    ssize_t written;
+    do {
+        written = sendmsg(client_fd, &msg, MSG_NOSIGNAL);
+    } while (written < 0 && errno == EINTR);
+    if (written < 0) {
+        perror("sendmsg");
+        return -1;
+    }
+
+    // Reste de l'en-tête (écriture partielle) puis données, sans descripteur
+    while (written < (ssize_t)sizeof(header)) {
+        ssize_t n = write(client_fd, (char*)header + written, sizeof(header) - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write header");
+            return -1;
+        }
+        written += n;
+    }
+    written = 0;
+    while (written < (ssize_t)data_len) {
+        ssize_t n = write(client_fd, data + written, data_len - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write data");
+            return -1;
+        }
+        written += n;
+    }
     return 0;
 }
 
 void socket_server_stop(int server_fd, const char *socket_path) {
     if (server_fd >= 0) close(server_fd);
-    unlink(socket_path);
+    // Avec l'activation systemd, le socket reste ouvert et les connexions attendent le redémarrage
+    if (!socket_activated) unlink(socket_path);
     DEBUG_PRINT("[Socket] Serveur arrêté\n");
 }
 
@@ -1,12 +1,33 @@
 #ifndef SOCKET_SERVER_H
 #define SOCKET_SERVER_H
 
+#include <sys/types.h>
+
 #include "agent.h"
 
-int socket_server_start(const char *socket_path);
+#define SOCKET_COMPRESS_CHUNK (256 * 1024)  // Morceau passé au compresseur
+#define SOCKET_STREAM_AGAIN (-2)            // Aucune donnée disponible pour l'instant
+
+// Trames CMD_STDIN_DATA lues sur la connexion après la commande (lecture non bloquante)
+typedef struct {
+    int fd;
+    uint32_t header[3];
+    size_t header_got;          // Octets de l'en-tête en cours déjà reçus
+    uint32_t frame_left;        // Octets restants de la trame en cours
+    bool in_frame;
+    bool eof;                   // Trame vide reçue
+} socket_stream_t;
+
+int socket_server_from_systemd(void);
+int socket_server_start(const char *socket_path, int backlog);
 int socket_server_accept(int server_fd);
+int socket_set_timeouts(int client_fd, int timeout_ms);
 int socket_read_command(int client_fd, command_t **cmd_out);
-int socket_send_response(int client_fd, response_code_t code, const char *data);
+void socket_close_fds(command_t *cmd);
+void socket_stream_init(socket_stream_t *stream, int client_fd);
+ssize_t socket_stream_read(socket_stream_t *stream, void *buf, size_t len);
+int socket_send_response(int client_fd, response_code_t code, const char *data, uint32_t accept_flags);
+int socket_send_response_fd(int client_fd, response_code_t code, const char *data, int pass_fd);
 void socket_server_stop(int server_fd, const char *socket_path);
 
 #endif // SOCKET_SERVER_H
@@ -0,0 +1,101 @@
+/**
+ * Backend libssh - Opérations de canal de ssh_handler.c sur une vraie session SSH
+ *
+ * La connexion et l'authentification restent dans ssh_handler.c (profils, rebond, clés) ;
+ * ce module couvre ce que l'exécution d'une commande demande au transport.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <libssh/libssh.h>
+
+#include "ssh_backend.h"
+
+static void* libssh_open(void *conn) {
+    ssh_channel channel = ssh_channel_new((ssh_session)conn);
+    if (channel && ssh_channel_open_session(channel) != SSH_OK) {
+        ssh_channel_free(channel);
+        channel = NULL;
+    }
+    return channel;
+}
+
+static int libssh_exec(void *channel, const char *command) {
+    return ssh_channel_request_exec((ssh_channel)channel, command) == SSH_OK ? 0 : -1;
+}
+
+static int libssh_read(void *channel, void *buf, uint32_t len, int is_stderr) {
+    int n = ssh_channel_read_nonblocking((ssh_channel)channel, buf, len, is_stderr);
+    if (n != 0) return n;
+    if (ssh_channel_is_eof((ssh_channel)channel) || ssh_channel_is_closed((ssh_channel)channel)) return 0;
+    return SSH_AGAIN;
+}
+
+static int libssh_write(void *channel, const void *data, uint32_t len) {
+    uint32_t window = ssh_channel_window_size((ssh_channel)channel);
+    if (window == 0) {
+        // Traiter les paquets entrants : un WINDOW_ADJUST peut être en attente
+        ssh_channel_poll((ssh_channel)channel, 0);
+        window = ssh_channel_window_size((ssh_channel)channel);
+    }
+    if (window == 0) return 0;
+    return ssh_channel_write((ssh_channel)channel, data, len < window ? len : window);
+}
+
+static int libssh_exit_status(void *channel) {
+    return ssh_channel_get_exit_status((ssh_channel)channel);
+}
+
+static void libssh_kill(void *channel) {
+    // Signal transmis si le serveur le permet ; EOF + fermeture du canal sinon
+    ssh_channel_request_send_signal((ssh_channel)channel, "KILL");
+    ssh_channel_send_eof((ssh_channel)channel);
+}
+
+static void libssh_send_eof(void *channel) {
+    ssh_channel_send_eof((ssh_channel)channel);
+}
+
+static void libssh_close(void *channel) {
+    ssh_channel_close((ssh_channel)channel);
+    ssh_channel_free((ssh_channel)channel);
+}
+
+static void libssh_disconnect(void *conn) {
+    ssh_disconnect((ssh_session)conn);
+    ssh_free((ssh_session)conn);
+}
+
+static int libssh_fd(void *conn) {
+    socket_t fd = ssh_get_fd((ssh_session)conn);
+    return fd == SSH_INVALID_SOCKET ? -1 : fd;
+}
+
+static void libssh_idle(int timeout_ms) {
+    usleep(timeout_ms * 1000);
+}
+
+const ssh_backend_t libssh_backend = {
+    .name = "libssh",
+    .open = libssh_open,
+    .exec = libssh_exec,
+    .read = libssh_read,
+    .write = libssh_write,
+    .exit_status = libssh_exit_status,
+    .kill = libssh_kill,
+    .send_eof = libssh_send_eof,
+    .close = libssh_close,
+    .disconnect = libssh_disconnect,
+    .disconnect_closes_channels = true,
+    .fd = libssh_fd,
+    .idle = libssh_idle,
+};
+
+/**
+ * Trouver un backend par nom (NULL ou vide = libssh)
+ */
+const ssh_backend_t* ssh_backend_find(const char *name) {
+    if (!name || !*name || strcmp(name, libssh_backend.name) == 0) return &libssh_backend;
+    if (strcmp(name, fake_backend.name) == 0) return &fake_backend;
+    return NULL;
+}
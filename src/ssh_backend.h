@@ -0,0 +1,54 @@
+#ifndef SSH_BACKEND_H
+#define SSH_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <json-c/json.h>
+
+// Transport d'une session : libssh, ou fake en mémoire (mesure du surcoût de l'agent)
+// conn : connexion du backend (ssh_session pour libssh) ; channel : canal d'exécution
+// Appels faits sous le verrou de la session, sauf idle()
+typedef struct ssh_backend {
+    const char *name;
+    void* (*open)(void *conn);                          // Nouveau canal, NULL en cas d'échec
+    int (*exec)(void *channel, const char *command);    // 0, ou -1 en cas d'échec
+    // Lecture non bloquante : >0 octets lus, 0 en fin de flux, SSH_AGAIN, SSH_ERROR
+    int (*read)(void *channel, void *buf, uint32_t len, int is_stderr);
+    // Écriture non bloquante sur stdin : octets acceptés (bornés par la fenêtre du distant,
+    // 0 si elle est pleine), SSH_ERROR
+    int (*write)(void *channel, const void *data, uint32_t len);
+    int (*exit_status)(void *channel);
+    void (*kill)(void *channel);                        // Signal KILL (si possible) puis EOF
+    void (*send_eof)(void *channel);
+    void (*close)(void *channel);                       // Ferme et libère le canal
+    void (*disconnect)(void *conn);                     // Ferme et libère la connexion
+    bool disconnect_closes_channels;                    // Sinon close() reste dû après disconnect()
+    int (*fd)(void *conn);                              // Descripteur à surveiller, -1 si aucun
+    void (*idle)(int timeout_ms);                       // Attente sans descripteur
+} ssh_backend_t;
+
+extern const ssh_backend_t libssh_backend;
+extern const ssh_backend_t fake_backend;
+
+const ssh_backend_t* ssh_backend_find(const char *name);
+
+#define FAKE_DEFAULT_OUTPUT_BYTES 1024
+#define FAKE_WINDOW_BYTES (64 * 1024)   // Fenêtre simulée du canal (stdin)
+
+// Backend fake : sortie générée, latences et taux d'erreur configurables, déterministe
+typedef struct {
+    uint64_t output_bytes;      // stdout de chaque commande
+    uint64_t stderr_bytes;
+    int exit_code;
+    uint32_t connect_latency_us;
+    uint32_t exec_latency_us;   // Délai avant le premier octet
+    double error_rate;          // Probabilité d'échec d'une connexion ou d'une exécution (0..1)
+    uint64_t seed;              // Même graine, même suite d'échecs
+    bool echo_stdin;            // stdout renvoie stdin (comme `cat`) au lieu du motif
+} fake_backend_config_t;
+
+void fake_backend_config_from_env(fake_backend_config_t *config);
+void fake_backend_init(const fake_backend_config_t *config);
+void* fake_backend_connect(json_object *spec, const char **error);
+
+#endif // SSH_BACKEND_H
@@ -11,60 +11,100 @@
 #include <sys/stat.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
 #include <json-c/json.h>
 #include <libssh/libssh.h>
+#include <libssh/sftp.h>
+#include <libssh/callbacks.h>
 
 #include "ssh_handler.h"
 #include "agent.h"
+#include "json_macros.h"
+#include "profile.h"
+#include "result_cache.h"
+#include "session_state.h"
+#include "exec_registry.h"
+#include "logger.h"
+#include "trace.h"
+#include "tunnel.h"
+#include "output_filter.h"
+#include "session_snapshot.h"
+#include "socket_server.h"
 
 #include "memory.h"
 
-// Macros JSON
-#define JSON_PARSE_OR_RETURN(json_str, root_var, error_msg) \
-    do { \
-        root_var = json_tokener_parse(json_str); \
-        if (!root_var) { \
-            *response = strdup("{\"error\":\"" error_msg "\"}"); \
-            return RESP_ERROR; \
-        } \
-    } while(0)
-
-#define JSON_GET_STRING_OR_RETURN(root_var, key, var, error_msg) \
-    do { \
-        json_object *obj; \
-        if (!json_object_object_get_ex(root_var, key, &obj) || !obj) { \
-            json_object_put(root_var); \
-            *response = strdup("{\"error\":\"" error_msg "\"}"); \
-            return RESP_ERROR; \
-        } \
-        var = json_object_get_string(obj); \
-    } while(0)
-
-#define MAX_SESSIONS 100
-
-// Structure de session SSH
-typedef struct {
-    char session_id[64];
-    ssh_session session;
-    bool connected;
-    time_t created_at;
-} ssh_session_t;
+#define RESTORE_CONNECT_TIMEOUT_MS 10000   // Pour ne pas bloquer le démarrage sur un hôte injoignable
 
 static ssh_session_t sessions[MAX_SESSIONS];
 static int session_count = 0;
 static pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Publication de la vue des sessions (session_snapshot.c) : construction et remplacement
+static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static session_entry_t publish_entries[MAX_SESSIONS];
+
+// Délais par défaut (ms, 0 = aucun), remplaçables par requête
+static int default_exec_timeout_ms = SSH_DEFAULT_EXEC_TIMEOUT_MS;
+static int default_connect_timeout_ms = SSH_DEFAULT_CONNECT_TIMEOUT_MS;
+
+// Backend des connexions sans champ "backend" (KROWN_SSH_BACKEND)
+static const ssh_backend_t *default_backend = &libssh_backend;
+
 /**
  * Initialiser le gestionnaire SSH
  */
 int ssh_handler_init(void) {
     ssh_init();
     memset(sessions, 0, sizeof(sessions));
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        pthread_mutex_init(&sessions[i].lock, NULL);
+    }
     session_count = 0;
+    session_snapshot_init();
     DEBUG_PRINT("[SSH] Gestionnaire initialisé\n");
     return 0;
 }
 
+/**
+ * Régler les délais par défaut (exécution de commande, connexion)
+ */
+void ssh_handler_set_timeouts(int exec_timeout_ms, int connect_timeout_ms) {
+    if (exec_timeout_ms >= 0) default_exec_timeout_ms = exec_timeout_ms;
+    if (connect_timeout_ms > 0) default_connect_timeout_ms = connect_timeout_ms;
+}
+
+int ssh_handler_exec_timeout_ms(void) {
+    return default_exec_timeout_ms;
+}
+
+/**
+ * Choisir le backend par défaut des nouvelles sessions
+ * @return 0, ou -1 si le nom est inconnu (le backend courant est conservé)
+ */
+int ssh_handler_set_backend(const char *name) {
+    const ssh_backend_t *backend = ssh_backend_find(name);
+    if (!backend) return -1;
+    default_backend = backend;
+    DEBUG_PRINT("[SSH] Backend par défaut: %s\n", backend->name);
+    return 0;
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Cause de l'échec d'une écriture sur descripteur (errno de output_write_fd)
+ */
+static void write_stopped(int err, bool *timed_out, bool *cancelled, bool *write_failed) {
+    if (err == ETIMEDOUT) *timed_out = true;
+    else if (err == ECANCELED) *cancelled = true;
+    else *write_failed = true;
+}
+
 /**
  * Nettoyer le gestionnaire SSH
  */
@@ -73,14 +113,15 @@ void ssh_handler_cleanup(void) {
     
     // Fermer toutes les sessions
     for (int i = 0; i < session_count; i++) {
-        if (sessions[i].connected && sessions[i].session) {
-            ssh_disconnect(sessions[i].session);
-            ssh_free(sessions[i].session);
+        if (sessions[i].connected && sessions[i].conn) {
+            if (sessions[i].sftp) sftp_free(sessions[i].sftp);
+            sessions[i].backend->disconnect(sessions[i].conn);
         }
     }
     
     session_count = 0;
     pthread_mutex_unlock(&sessions_mutex);
+    session_snapshot_shutdown();
     ssh_finalize();
     DEBUG_PRINT("[SSH] Gestionnaire nettoyé\n");
 }
@@ -110,19 +151,373 @@ static ssh_session_t* find_session(const char *session_id) {
 }
 
 /**
- * Gérer la connexion SSH
+ * Trouver une session connectée par ID
+ * Les emplacements ne sont jamais réutilisés : le pointeur reste valide,
+ * mais l'état doit être revérifié avec ssh_handler_lock() avant usage
  */
-response_code_t handle_ssh_connect(const char *json_data, char **response) {
-    if (!json_data || !response) {
-        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
-        return RESP_ERROR;
+ssh_session_t* ssh_handler_find(const char *session_id) {
+    ssh_session_t *sess = find_session(session_id);
+    return (sess && sess->connected) ? sess : NULL;
+}
+
+/**
+ * Trouver une session connectée portée par libssh (SFTP, synchronisation, tunnels)
+ * @return NULL avec *response renseigné si la session est absente ou d'un autre backend
+ */
+ssh_session_t* ssh_handler_find_native(const char *session_id, char **response) {
+    ssh_session_t *sess = ssh_handler_find(session_id);
+    if (!sess) {
+        *response = strdup("{\"error\":\"Session introuvable ou déconnectée\"}");
+    } else if (sess->backend != &libssh_backend) {
+        *response = strdup("{\"error\":\"Opération indisponible pour une session du backend fake\"}");
+        sess = NULL;
     }
-    
-    json_object *root;
-    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+    return sess;
+}
+
+/**
+ * Publier l'état courant des sessions pour les lecteurs sans verrou (LIST_SESSIONS, SSH_STATUS)
+ * À appeler après chaque connexion ou déconnexion, hors sessions_mutex
+ */
+static void publish_sessions(void) {
+    pthread_mutex_lock(&publish_mutex);
+    pthread_mutex_lock(&sessions_mutex);
+    int count = session_count;
+    for (int i = 0; i < count; i++) {
+        ssh_session_t *sess = &sessions[i];
+        session_entry_t *e = &publish_entries[i];
+        e->sess = sess;
+        memcpy(e->session_id, sess->session_id, sizeof(e->session_id));
+        e->backend = sess->backend ? sess->backend->name : libssh_backend.name;
+        memcpy(e->host, sess->host, sizeof(e->host));
+        e->port = sess->port;
+        memcpy(e->username, sess->username, sizeof(e->username));
+        e->profile = sess->profile;
+        memcpy(e->via_session_id, sess->via_session_id, sizeof(e->via_session_id));
+        e->created_at = sess->created_at;
+        e->connected = sess->connected;
+    }
+    pthread_mutex_unlock(&sessions_mutex);
+    session_snapshot_publish(publish_entries, count);
+    pthread_mutex_unlock(&publish_mutex);
+}
+
+/**
+ * Verrouiller une session avant un appel libssh
+ * @return false (verrou relâché) si la session a été déconnectée entre-temps
+ */
+bool ssh_handler_lock(ssh_session_t *sess) {
+    pthread_mutex_lock(&sess->lock);
+    if (!sess->connected) {
+        pthread_mutex_unlock(&sess->lock);
+        return false;
+    }
+    return true;
+}
+
+void ssh_handler_unlock(ssh_session_t *sess) {
+    pthread_mutex_unlock(&sess->lock);
+}
+
+/**
+ * Attendre des données sur le socket de la session (et sur extra_fd s'il est >= 0), hors verrou
+ * Un autre thread peut consommer les paquets avant nous : le timeout borne l'attente
+ */
+static void wait_session_or(ssh_session_t *sess, int extra_fd, int timeout_ms) {
+    int fd = -1;
+    if (ssh_handler_lock(sess)) {
+        fd = sess->backend->fd(sess->conn);
+        ssh_handler_unlock(sess);
+    }
+    if (fd < 0) {
+        sess->backend->idle(timeout_ms);
+        return;
+    }
+    struct pollfd pfd[2] = { { .fd = fd, .events = POLLIN }, { .fd = extra_fd, .events = POLLIN } };
+    poll(pfd, extra_fd >= 0 ? 2 : 1, timeout_ms);
+}
+
+void ssh_handler_wait(ssh_session_t *sess, int timeout_ms) {
+    wait_session_or(sess, -1, timeout_ms);
+}
+
+/**
+ * Attendre des données sur l'une de deux sessions (relais entre sessions), hors verrou
+ */
+void ssh_handler_wait_pair(ssh_session_t *a, ssh_session_t *b, int timeout_ms) {
+    int fd = -1;
+    if (a != b && ssh_handler_lock(b)) {
+        fd = b->backend->fd(b->conn);
+        ssh_handler_unlock(b);
+    }
+    wait_session_or(a, fd, timeout_ms);
+}
+
+/**
+ * Lire un canal sans monopoliser la session
+ * Lecture non bloquante sous verrou, puis attente hors verrou si rien n'est disponible,
+ * ce qui permet à plusieurs canaux (exec, sftp) de partager la même session
+ * @return >0 octets lus, 0 en fin de flux, SSH_AGAIN si rien avant timeout_ms, SSH_ERROR en cas d'erreur
+ */
+int ssh_handler_channel_read(ssh_session_t *sess, ssh_channel channel, void *buf, uint32_t len,
+                             int is_stderr, int timeout_ms) {
+    if (!ssh_handler_lock(sess)) return SSH_ERROR;
+    int n = sess->backend->read(channel, buf, len, is_stderr);
+    ssh_handler_unlock(sess);
+    if (n > 0) atomic_fetch_add_explicit(&sess->bytes_in, (uint64_t)n, memory_order_relaxed);
+    if (n != SSH_AGAIN) return n;
+
+    if (timeout_ms > 0) ssh_handler_wait(sess, timeout_ms);
+    return SSH_AGAIN;
+}
+
+/**
+ * Écrire sur un canal ce que la fenêtre SSH du distant accepte, sans attendre
+ * @return Octets écrits (0 si la fenêtre est pleine), SSH_ERROR en cas d'erreur
+ */
+int ssh_handler_channel_write_some(ssh_session_t *sess, ssh_channel channel, const void *data, uint32_t len) {
+    if (!ssh_handler_lock(sess)) return SSH_ERROR;
+    int n = sess->backend->write(channel, data, len);
+    ssh_handler_unlock(sess);
+    if (n > 0) atomic_fetch_add_explicit(&sess->bytes_out, (uint64_t)n, memory_order_relaxed);
+    return n;
+}
+
+/**
+ * Écrire sur un canal en respectant la fenêtre SSH du distant
+ * Quand la fenêtre est pleine, le backend traite les paquets entrants (WINDOW_ADJUST)
+ * puis on attend hors verrou : la session n'est jamais bloquée par un écrivain
+ * @return len en cas de succès, SSH_ERROR sinon
+ */
+int ssh_handler_channel_write(ssh_session_t *sess, ssh_channel channel, const void *data, uint32_t len) {
+    const char *p = data;
+    uint32_t left = len;
+    while (left > 0) {
+        int n = ssh_handler_channel_write_some(sess, channel, p, left);
+        if (n == SSH_ERROR) return SSH_ERROR;
+        if (n == 0) {
+            ssh_handler_wait(sess, 10);
+            continue;
+        }
+        p += n;
+        left -= n;
+    }
+    return (int)len;
+}
+
+/**
+ * Ouvrir un canal et lancer une commande
+ * @return Le canal, ou NULL en cas d'erreur
+ */
+ssh_channel ssh_handler_open_exec(ssh_session_t *sess, const char *command) {
+    if (!ssh_handler_lock(sess)) return NULL;
+    ssh_channel channel = sess->backend->open(sess->conn);
+    if (channel && sess->backend->exec(channel, command) != 0) {
+        sess->backend->close(channel);
+        channel = NULL;
+    }
+    ssh_handler_unlock(sess);
+    return channel;
+}
+
+/**
+ * Lire stdout et stderr d'un canal jusqu'à la fin, dans des buffers Rust
+ * stderr_buffer peut être NULL (stderr est alors lu et ignoré)
+ * @return Code de sortie de la commande, ou -1 en cas d'erreur
+ */
+int ssh_handler_collect(ssh_session_t *sess, ssh_channel channel, void *stdout_buffer, void *stderr_buffer) {
+    bool stdout_done = false, stderr_done = false, failed = false;
+    uint32_t buf_size = sess->read_chunk;
+    char *buf = malloc(buf_size);
+    if (!buf) return -1;
+    while (!stdout_done || !stderr_done) {
+        int n_out = SSH_AGAIN, n_err = SSH_AGAIN;
+        if (!stdout_done) {
+            n_out = ssh_handler_channel_read(sess, channel, buf, buf_size, 0, 0);
+            if (n_out > 0 && rust_buffer_append(stdout_buffer, buf, n_out) != 0) failed = true;
+            if (n_out == 0 || n_out == SSH_ERROR) stdout_done = true;
+        }
+        if (!stderr_done) {
+            n_err = ssh_handler_channel_read(sess, channel, buf, buf_size, 1, 0);
+            if (n_err > 0 && stderr_buffer) rust_buffer_append(stderr_buffer, buf, n_err);
+            if (n_err == 0 || n_err == SSH_ERROR) stderr_done = true;
+        }
+        if (n_out == SSH_ERROR || n_err == SSH_ERROR) failed = true;
+        if (n_out == SSH_AGAIN && n_err == SSH_AGAIN) ssh_handler_wait(sess, 10);
+    }
+    free(buf);
+
+    int exit_status = -1;
+    if (!failed && ssh_handler_lock(sess)) {
+        exit_status = sess->backend->exit_status(channel);
+        ssh_handler_unlock(sess);
+    }
+    return exit_status;
+}
+
+/**
+ * Fermer et libérer un canal sous le verrou de la session
+ * Si la session a été déconnectée, ssh_free() a déjà libéré ses canaux (libssh)
+ */
+void ssh_handler_close_channel(ssh_session_t *sess, ssh_channel channel) {
+    if (ssh_handler_lock(sess)) {
+        sess->backend->close(channel);
+        ssh_handler_unlock(sess);
+    } else if (!sess->backend->disconnect_closes_channels) {
+        sess->backend->close(channel);
+    }
+}
+
+/**
+ * Enregistrer un transfert en masse pour le calcul du débit de la session
+ * Seuls les transferts (sftp) comptent : la durée d'un exec inclut le temps de calcul distant
+ */
+void ssh_handler_record_transfer(ssh_session_t *sess, uint64_t bytes, double duration_ms) {
+    uint64_t us = (uint64_t)(duration_ms * 1000.0);
+    if (bytes == 0 || us == 0) return;
+    atomic_fetch_add_explicit(&sess->xfer_bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sess->xfer_us, us, memory_order_relaxed);
+
+    uint64_t rate = bytes * 1000000 / us;
+    uint64_t peak = atomic_load_explicit(&sess->peak_bytes_per_sec, memory_order_relaxed);
+    while (rate > peak &&
+           !atomic_compare_exchange_weak_explicit(&sess->peak_bytes_per_sec, &peak, rate,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Débit moyen des transferts en masse de la session (octets/s)
+ */
+static uint64_t session_bytes_per_sec(ssh_session_t *sess) {
+    uint64_t bytes = atomic_load_explicit(&sess->xfer_bytes, memory_order_relaxed);
+    uint64_t us = atomic_load_explicit(&sess->xfer_us, memory_order_relaxed);
+    return us ? bytes * 1000000 / us : 0;
+}
+
+/**
+ * Écrire une entrée de la vue des sessions (membres de l'objet JSON en cours)
+ * Les métadonnées viennent de la vue, les compteurs de débit de la session elle-même
+ * @return 0, ou une valeur non nulle si le document est invalide
+ */
+static int write_session_entry(void *writer, const session_entry_t *e) {
+    ssh_session_t *sess = e->sess;
+    int rc = 0;
+    rc |= rust_json_key(writer, "status");
+    rc |= rust_json_string(writer, e->connected ? "connected" : "disconnected");
+    rc |= rust_json_key(writer, "created_at");
+    rc |= rust_json_int(writer, e->created_at);
+    rc |= rust_json_key(writer, "version");
+    rc |= rust_json_uint(writer, e->version);
+    rc |= rust_json_key(writer, "host");
+    rc |= rust_json_string(writer, e->host);
+    rc |= rust_json_key(writer, "port");
+    rc |= rust_json_int(writer, e->port);
+    rc |= rust_json_key(writer, "username");
+    rc |= rust_json_string(writer, e->username);
+    rc |= rust_json_key(writer, "profile");
+    rc |= rust_json_string(writer, e->profile ? e->profile->name : "");
+    rc |= rust_json_key(writer, "via_session_id");
+    rc |= rust_json_string(writer, e->via_session_id);
+    rc |= rust_json_key(writer, "backend");
+    rc |= rust_json_string(writer, e->backend);
+    rc |= rust_json_key(writer, "bytes_in");
+    rc |= rust_json_uint(writer, atomic_load_explicit(&sess->bytes_in, memory_order_relaxed));
+    rc |= rust_json_key(writer, "bytes_out");
+    rc |= rust_json_uint(writer, atomic_load_explicit(&sess->bytes_out, memory_order_relaxed));
+    rc |= rust_json_key(writer, "bytes_per_sec");
+    rc |= rust_json_uint(writer, session_bytes_per_sec(sess));
+    rc |= rust_json_key(writer, "peak_bytes_per_sec");
+    rc |= rust_json_uint(writer, atomic_load_explicit(&sess->peak_bytes_per_sec, memory_order_relaxed));
+    rc |= rust_json_key(writer, "memory_bytes");
+    rc |= rust_json_int(writer, atomic_load_explicit(&sess->mem.used, memory_order_relaxed));
+    rc |= rust_json_key(writer, "memory_peak");
+    rc |= rust_json_int(writer, atomic_load_explicit(&sess->mem.peak, memory_order_relaxed));
+    return rc;
+}
+
+/**
+ * Progression de ssh_connect() : libssh signale 0.2 une fois le socket TCP connecté et
+ * 0.4 après réception de la bannière du serveur ; le reste est l'échange de clés
+ */
+typedef struct {
+    trace_t *trace;
+    float reached;
+} connect_progress_t;
+
+static void connect_status_cb(void *userdata, float status) {
+    connect_progress_t *progress = userdata;
+    if (status >= 0.2f && progress->reached < 0.2f) trace_mark(progress->trace, "tcp");
+    if (status >= 0.4f && progress->reached < 0.4f) trace_mark(progress->trace, "banner");
+    if (status > progress->reached) progress->reached = status;
+}
+
+// Remplace les callbacks de connexion (pointant sur la pile) une fois ssh_connect() terminé
+static struct ssh_callbacks_struct no_callbacks = { .size = sizeof(struct ssh_callbacks_struct) };
 
-    json_object *host_obj, *port_obj, *user_obj, *pass_obj, *key_obj, *passphrase_obj;
-    const char *host, *username, *password = NULL, *private_key = NULL, *passphrase = NULL;
+/**
+ * Enregistrer une session établie (la connexion est libérée si la table est pleine)
+ * @param session ssh_session pour libssh, NULL pour les autres backends
+ */
+static response_code_t register_session(const ssh_backend_t *backend, void *conn, ssh_session session,
+                                        const char *restore_id, const char *host, int port,
+                                        const char *username, const connection_profile_t *profile,
+                                        bool persistent, const char *key_file, const char *via_session_id,
+                                        trace_t *trace, char **response) {
+    pthread_mutex_lock(&sessions_mutex);
+    if (session_count < MAX_SESSIONS) {
+        char session_id[64];
+        if (restore_id) {
+            snprintf(session_id, sizeof(session_id), "%s", restore_id);
+        } else {
+            snprintf(session_id, sizeof(session_id), "session_%d_%ld", session_count, time(NULL));
+        }
+        
+        strncpy(sessions[session_count].session_id, session_id, sizeof(sessions[session_count].session_id) - 1);
+        sessions[session_count].backend = backend;
+        sessions[session_count].conn = conn;
+        sessions[session_count].session = session;
+        sessions[session_count].connected = true;
+        sessions[session_count].created_at = time(NULL);
+        snprintf(sessions[session_count].host, sizeof(sessions[session_count].host), "%s", host);
+        sessions[session_count].port = port;
+        snprintf(sessions[session_count].username, sizeof(sessions[session_count].username), "%s", username);
+        sessions[session_count].profile = profile;
+        sessions[session_count].read_chunk = profile ? profile->read_chunk : PROFILE_DEFAULT_READ_CHUNK;
+        sessions[session_count].persistent = persistent;
+        snprintf(sessions[session_count].key_file, sizeof(sessions[session_count].key_file), "%s",
+                 key_file ? key_file : "");
+        snprintf(sessions[session_count].via_session_id, sizeof(sessions[session_count].via_session_id), "%s",
+                 via_session_id);
+        session_count++;
+
+        char response_json[704];
+        snprintf(response_json, sizeof(response_json), 
+                "{\"session_id\":\"%s\",\"status\":\"connected\",\"host\":\"%s\",\"port\":%d,\"profile\":\"%s\",\"persistent\":%s,\"via_session_id\":\"%s\",\"backend\":\"%s\"}",
+                session_id, host, port, profile ? profile->name : "", persistent ? "true" : "false", via_session_id,
+                backend->name);
+        *response = strdup(response_json);
+        pthread_mutex_unlock(&sessions_mutex);
+        publish_sessions();
+        if (persistent && !restore_id) session_state_save();
+        trace_mark(trace, "register");
+        return RESP_OK;
+    }
+    pthread_mutex_unlock(&sessions_mutex);
+
+    backend->disconnect(conn);
+    *response = strdup("{\"error\":\"Nombre maximum de sessions atteint\"}");
+    return RESP_ERROR;
+}
+
+/**
+ * Établir et enregistrer une session à partir de sa spécification JSON (libère root)
+ * @param restore_id Identifiant à conserver (reprise à chaud), NULL pour en générer un
+ */
+static response_code_t connect_session(json_object *root, const char *restore_id, trace_t *trace,
+                                       char **response) {
+    json_object *host_obj, *port_obj, *user_obj, *pass_obj, *key_obj, *passphrase_obj, *key_file_obj, *persist_obj;
+    const char *host, *username, *password = NULL, *private_key = NULL, *passphrase = NULL, *key_file = NULL;
     int port = 22;
 
     json_object_object_get_ex(root, "host", &host_obj);
@@ -131,6 +526,8 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
     json_object_object_get_ex(root, "password", &pass_obj);
     json_object_object_get_ex(root, "private_key", &key_obj);
     json_object_object_get_ex(root, "passphrase", &passphrase_obj);
+    if (!json_object_object_get_ex(root, "key_file", &key_file_obj)) key_file_obj = NULL;
+    if (!json_object_object_get_ex(root, "persist", &persist_obj)) persist_obj = NULL;
 
     if (!host_obj || !user_obj) {
         json_object_put(root);
@@ -143,12 +540,42 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
     if (port_obj) port = json_object_get_int(port_obj);
     if (pass_obj) {
         password = json_object_get_string(pass_obj);
-        printf("[SSH] Mot de passe reçu (longueur: %zu)\n", password ? strlen(password) : 0);
+        LOG_DEBUG("[SSH] Mot de passe reçu (longueur: %zu)\n", password ? strlen(password) : 0);
     }
     if (key_obj) private_key = json_object_get_string(key_obj);
+    if (key_file_obj) key_file = json_object_get_string(key_file_obj);
     if (passphrase_obj) {
         passphrase = json_object_get_string(passphrase_obj);
-        printf("[SSH] Passphrase reçue (longueur: %zu)\n", passphrase ? strlen(passphrase) : 0);
+        LOG_DEBUG("[SSH] Passphrase reçue (longueur: %zu)\n", passphrase ? strlen(passphrase) : 0);
+    }
+
+    // Backend : explicite ("backend"), sinon celui de l'agent (KROWN_SSH_BACKEND)
+    const ssh_backend_t *backend = default_backend;
+    json_object *backend_obj;
+    if (json_object_object_get_ex(root, "backend", &backend_obj)) {
+        backend = ssh_backend_find(json_object_get_string(backend_obj));
+        if (!backend) {
+            json_object_put(root);
+            *response = strdup("{\"error\":\"Backend SSH inconnu (libssh, fake)\"}");
+            return RESP_ERROR;
+        }
+    }
+    if (backend == &fake_backend) {
+        // Ni profil, ni rebond, ni persistance : la session n'existe que dans cette instance
+        const char *connect_error = "";
+        void *conn = fake_backend_connect(root, &connect_error);
+        trace_mark(trace, "connect");
+        if (!conn) {
+            char error_msg[256];
+            snprintf(error_msg, sizeof(error_msg), "{\"error\":\"Échec connexion: %s\"}", connect_error);
+            *response = strdup(error_msg);
+            json_object_put(root);
+            return RESP_SSH_ERROR;
+        }
+        response_code_t code = register_session(backend, conn, NULL, restore_id, host, port, username, NULL,
+                                                false, NULL, "", trace, response);
+        json_object_put(root);
+        return code;
     }
 
     // Créer la session SSH
@@ -163,8 +590,81 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
     ssh_options_set(session, SSH_OPTIONS_PORT, &port);
     ssh_options_set(session, SSH_OPTIONS_USER, username);
 
-    // Connexion
+    // Délai de connexion (et des opérations bloquantes de la session)
+    long connect_timeout_ms = default_connect_timeout_ms;
+    json_object *timeout_obj;
+    if (json_object_object_get_ex(root, "connect_timeout_ms", &timeout_obj)) {
+        connect_timeout_ms = json_object_get_int64(timeout_obj);
+        if (connect_timeout_ms <= 0) connect_timeout_ms = default_connect_timeout_ms;
+    }
+    if (restore_id && connect_timeout_ms > RESTORE_CONNECT_TIMEOUT_MS) connect_timeout_ms = RESTORE_CONNECT_TIMEOUT_MS;
+    long timeout_sec = connect_timeout_ms / 1000;
+    long timeout_usec = (connect_timeout_ms % 1000) * 1000;
+    ssh_options_set(session, SSH_OPTIONS_TIMEOUT, &timeout_sec);
+    ssh_options_set(session, SSH_OPTIONS_TIMEOUT_USEC, &timeout_usec);
+
+    // Profil de transport : explicite, sinon "default" s'il est défini
+    const connection_profile_t *profile = NULL;
+    json_object *profile_obj;
+    if (json_object_object_get_ex(root, "profile", &profile_obj)) {
+        profile = profile_find(json_object_get_string(profile_obj));
+        if (!profile) {
+            ssh_free(session);
+            json_object_put(root);
+            *response = strdup("{\"error\":\"Profil de connexion inconnu\"}");
+            return RESP_ERROR;
+        }
+    } else {
+        profile = profile_find("default");
+    }
+    if (profile && profile_apply(profile, session) != 0) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "{\"error\":\"Profil invalide: %s\"}", ssh_get_error(session));
+        *response = strdup(error_msg);
+        ssh_free(session);
+        json_object_put(root);
+        return RESP_ERROR;
+    }
+
+    trace_mark(trace, "setup");
+
+    // via_session_id (optionnel) : transport sur un canal direct-tcpip d'une session existante
+    // (bastion). Ouvert en dernier, une fois les options validées : libssh ne prend le
+    // descripteur qu'à ssh_connect() (puis le ferme avec la session), il est donc fermé
+    // ici si SSH_OPTIONS_FD échoue
+    char via_session_id[64] = "";
+    json_object *via_obj;
+    if (json_object_object_get_ex(root, "via_session_id", &via_obj)) {
+        snprintf(via_session_id, sizeof(via_session_id), "%s", json_object_get_string(via_obj));
+        const char *via_error = NULL;
+        socket_t via_fd = tunnel_open_stream(via_session_id, host, port, &via_error);
+        if (via_fd >= 0 && ssh_options_set(session, SSH_OPTIONS_FD, &via_fd) != SSH_OK) {
+            close(via_fd);
+            via_fd = -1;
+            via_error = "option SSH_OPTIONS_FD refusée";
+        }
+        if (via_fd < 0) {
+            char error_msg[256];
+            snprintf(error_msg, sizeof(error_msg),
+                     "{\"error\":\"Impossible d'ouvrir le canal via la session de rebond: %s\"}", via_error);
+            *response = strdup(error_msg);
+            ssh_free(session);
+            json_object_put(root);
+            return RESP_SSH_ERROR;
+        }
+        trace_mark(trace, "via_channel");
+    }
+
+    // Connexion (phases TCP / bannière / échange de clés via le callback de progression)
+    connect_progress_t progress = { trace, 0.0f };
+    struct ssh_callbacks_struct callbacks = { 0 };
+    callbacks.userdata = &progress;
+    callbacks.connect_status_function = connect_status_cb;
+    ssh_callbacks_init(&callbacks);
+    ssh_set_callbacks(session, &callbacks);
     int rc = ssh_connect(session);
+    ssh_set_callbacks(session, &no_callbacks);
+    trace_mark(trace, progress.reached >= 0.4f ? "kex" : "handshake");
     if (rc != SSH_OK) {
         char error_msg[256];
         snprintf(error_msg, sizeof(error_msg), "{\"error\":\"Échec connexion: %s\"}", ssh_get_error(session));
@@ -175,6 +675,7 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
     }
 
     int auth_methods = ssh_userauth_list(session, username);
+    trace_mark(trace, "auth_list");
     DEBUG_PRINT("[SSH] Authentification %s@%s:%d\n", username, host, port);
     
     if (password && strlen(password) > 0) {
@@ -191,26 +692,27 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
         }
         
         rc = ssh_userauth_password(session, NULL, password);
+        trace_mark(trace, "auth");
         
         if (rc == SSH_AUTH_SUCCESS) {
-            printf("[SSH] Authentification par mot de passe réussie\n");
+            LOG_INFO("[SSH] Authentification par mot de passe réussie\n");
         } else {
-            printf("[SSH] Échec authentification par mot de passe: %s (code: %d)\n", 
-                   ssh_get_error(session), rc);
+            LOG_WARN("[SSH] Échec authentification par mot de passe: %s (code: %d)\n", 
+                    ssh_get_error(session), rc);
             
             // Essayer d'obtenir plus d'informations sur l'erreur
             if (rc == SSH_AUTH_DENIED) {
-                printf("[SSH] Accès refusé - le mot de passe est peut-être incorrect\n");
+                LOG_WARN("[SSH] Accès refusé - le mot de passe est peut-être incorrect\n");
             } else if (rc == SSH_AUTH_PARTIAL) {
-                printf("[SSH] Authentification partielle - méthode supplémentaire requise\n");
+                LOG_WARN("[SSH] Authentification partielle - méthode supplémentaire requise\n");
             }
         }
     } else if (private_key && strlen(private_key) > 0) {
-        printf("[SSH] Méthode: clé privée (longueur: %zu)\n", strlen(private_key));
+        LOG_DEBUG("[SSH] Méthode: clé privée (longueur: %zu)\n", strlen(private_key));
         
         // Vérifier que le serveur accepte l'authentification par clé publique
         if (!(auth_methods & SSH_AUTH_METHOD_PUBLICKEY)) {
-            printf("[SSH] ERREUR: Le serveur n'accepte pas l'authentification par clé publique\n");
+            LOG_WARN("[SSH] ERREUR: Le serveur n'accepte pas l'authentification par clé publique\n");
             char error_msg[256];
             snprintf(error_msg, sizeof(error_msg), 
                     "{\"error\":\"Le serveur SSH n'accepte pas l'authentification par clé publique\"}");
@@ -261,6 +763,7 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
         
         // Supprimer le fichier temporaire immédiatement après import
         unlink(tmp_key_file);
+        trace_mark(trace, "key_import");
         
         if (import_rc != SSH_OK || privkey == NULL) {
             DEBUG_PRINT("[SSH] ERREUR: Impossible d'importer la clé privée\n");
@@ -282,8 +785,7 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
                 // Afficher les 50 premiers caractères de la clé publique pour le débogage
                 char pubkey_preview[64] = {0};
                 strncpy(pubkey_preview, pubkey_str, 50);
-                printf("[SSH] Clé publique (preview): %s...\n", pubkey_preview);
-                printf("[SSH] Vérifiez que cette clé publique est dans ~/.ssh/authorized_keys sur le serveur\n");
+                LOG_DEBUG("[SSH] Clé publique (preview): %s...\n", pubkey_preview);
                 ssh_string_free_char(pubkey_str);
             }
             ssh_key_free(pubkey);
@@ -291,48 +793,64 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
         
         // Essayer d'abord avec ssh_userauth_try_publickey pour vérifier si la clé est acceptée
         int try_rc = ssh_userauth_try_publickey(session, NULL, privkey);
+        trace_mark(trace, "key_probe");
         if (try_rc == SSH_AUTH_SUCCESS) {
-            printf("[SSH] La clé publique est acceptée par le serveur, tentative d'authentification...\n");
+            LOG_DEBUG("[SSH] La clé publique est acceptée par le serveur, tentative d'authentification...\n");
         } else if (try_rc == SSH_AUTH_DENIED) {
-            printf("[SSH] ATTENTION: La clé publique n'est PAS dans authorized_keys sur le serveur\n");
-            printf("[SSH] Vérifiez que la clé publique correspondante est dans ~/.ssh/authorized_keys\n");
+            LOG_WARN("[SSH] ATTENTION: La clé publique n'est PAS dans authorized_keys sur le serveur\n");
         } else {
-            printf("[SSH] Résultat du test de la clé: code %d\n", try_rc);
+            LOG_DEBUG("[SSH] Résultat du test de la clé: code %d\n", try_rc);
         }
         
         // Authentifier avec la clé privée
         rc = ssh_userauth_publickey(session, NULL, privkey);
+        trace_mark(trace, "auth");
         
         // Libérer la clé
         ssh_key_free(privkey);
         
         if (rc == SSH_AUTH_SUCCESS) {
-            printf("[SSH] Authentification par clé privée réussie\n");
+            LOG_INFO("[SSH] Authentification par clé privée réussie\n");
         } else {
-            printf("[SSH] Échec authentification par clé privée: %s (code: %d)\n", 
-                   ssh_get_error(session), rc);
+            LOG_WARN("[SSH] Échec authentification par clé privée: %s (code: %d)\n", 
+                    ssh_get_error(session), rc);
             
             if (rc == SSH_AUTH_DENIED) {
-                printf("[SSH] Accès refusé - causes possibles:\n");
-                printf("[SSH]   1. La clé publique n'est pas dans ~/.ssh/authorized_keys sur le serveur\n");
-                printf("[SSH]   2. Les permissions de ~/.ssh ou authorized_keys sont incorrectes (doivent être 700 et 600)\n");
-                printf("[SSH]   3. La clé privée ne correspond pas à la clé publique dans authorized_keys\n");
-                printf("[SSH]   4. Le serveur SSH a désactivé l'authentification par clé publique\n");
+                LOG_WARN("[SSH] Accès refusé - clé absente de authorized_keys, permissions de ~/.ssh incorrectes "
+                         "(700/600), clé privée ne correspondant pas, ou clé publique désactivée côté serveur\n");
             } else if (rc == SSH_AUTH_PARTIAL) {
-                printf("[SSH] Authentification partielle - méthode supplémentaire requise\n");
+                LOG_WARN("[SSH] Authentification partielle - méthode supplémentaire requise\n");
             } else if (rc == SSH_AUTH_ERROR) {
-                printf("[SSH] Erreur lors de l'authentification - vérifiez les logs du serveur SSH\n");
+                LOG_WARN("[SSH] Erreur lors de l'authentification - vérifiez les logs du serveur SSH\n");
             }
         }
+    } else if (key_file && strlen(key_file) > 0) {
+        // Clé privée lue sur le disque de l'agent (référence persistable)
+        ssh_key privkey = NULL;
+        rc = SSH_AUTH_ERROR;
+        if (ssh_pki_import_privkey_file(key_file, passphrase, NULL, NULL, &privkey) == SSH_OK) {
+            rc = ssh_userauth_publickey(session, NULL, privkey);
+            ssh_key_free(privkey);
+        } else {
+            LOG_WARN("[SSH] Impossible d'importer la clé %s\n", key_file);
+        }
+        trace_mark(trace, "auth");
+        if (rc == SSH_AUTH_SUCCESS) {
+            LOG_INFO("[SSH] Authentification par fichier de clé réussie\n");
+        } else {
+            LOG_WARN("[SSH] Échec authentification par fichier de clé: %s (code: %d)\n",
+                    ssh_get_error(session), rc);
+        }
     } else {
-        printf("[SSH] Méthode: clé publique automatique\n");
+        LOG_DEBUG("[SSH] Méthode: clé publique automatique\n");
         rc = ssh_userauth_publickey_auto(session, NULL, NULL);
+        trace_mark(trace, "auth");
         
         if (rc == SSH_AUTH_SUCCESS) {
-            printf("[SSH] Authentification par clé publique réussie\n");
+            LOG_INFO("[SSH] Authentification par clé publique réussie\n");
         } else {
-            printf("[SSH] Échec authentification par clé publique: %s (code: %d)\n", 
-                   ssh_get_error(session), rc);
+            LOG_WARN("[SSH] Échec authentification par clé publique: %s (code: %d)\n", 
+                    ssh_get_error(session), rc);
         }
     }
 
@@ -352,34 +870,91 @@ response_code_t handle_ssh_connect(const char *json_data, char **response) {
         return RESP_SSH_ERROR;
     }
 
-    // Enregistrer la session
-    pthread_mutex_lock(&sessions_mutex);
-    if (session_count < MAX_SESSIONS) {
-        char session_id[64];
-        snprintf(session_id, sizeof(session_id), "session_%d_%ld", session_count, time(NULL));
-        
-        strncpy(sessions[session_count].session_id, session_id, sizeof(sessions[session_count].session_id) - 1);
-        sessions[session_count].session = session;
-        sessions[session_count].connected = true;
-        sessions[session_count].created_at = time(NULL);
-        session_count++;
+    // Seules les sessions sans secret en mémoire (fichier de clé, clé automatique) sont persistées
+    bool persistent = persist_obj && json_object_get_boolean(persist_obj) &&
+                      !(password && *password) && !(private_key && *private_key) &&
+                      !(passphrase && *passphrase);
 
-        char response_json[512];
-        snprintf(response_json, sizeof(response_json), 
-                "{\"session_id\":\"%s\",\"status\":\"connected\",\"host\":\"%s\",\"port\":%d}",
-                session_id, host, port);
-        *response = strdup(response_json);
-        pthread_mutex_unlock(&sessions_mutex);
-        json_object_put(root);
-        return RESP_OK;
+    response_code_t code = register_session(&libssh_backend, session, session, restore_id, host, port, username,
+                                            profile, persistent, key_file, via_session_id, trace, response);
+    json_object_put(root);
+    return code;
+}
+
+/**
+ * Gérer la connexion SSH
+ */
+response_code_t handle_ssh_connect(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
     }
-    pthread_mutex_unlock(&sessions_mutex);
+    
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
 
-    ssh_disconnect(session);
-    ssh_free(session);
-    json_object_put(root);
-    *response = strdup("{\"error\":\"Nombre maximum de sessions atteint\"}");
-    return RESP_ERROR;
+    // timing (optionnel) : durée de chaque phase dans la réponse
+    json_object *obj;
+    bool timing = json_object_object_get_ex(root, "timing", &obj) && json_object_get_boolean(obj);
+    char target[320] = "";
+    json_object *host_obj;
+    if (json_object_object_get_ex(root, "host", &host_obj)) {
+        snprintf(target, sizeof(target), "%s", json_object_get_string(host_obj));
+    }
+
+    trace_t trace;
+    trace_start(&trace, "ssh_connect");
+    response_code_t code = connect_session(root, NULL, &trace, response);
+    if (timing) *response = trace_attach_timing(&trace, *response);
+    trace_finish(&trace, target, code);
+    return code;
+}
+
+/**
+ * Rétablir une session persistée en conservant son identifiant (reprise à chaud)
+ */
+response_code_t ssh_handler_restore(json_object *spec, char **response) {
+    json_object *id_obj;
+    if (!json_object_object_get_ex(spec, "session_id", &id_obj)) {
+        *response = strdup("{\"error\":\"session_id requis\"}");
+        return RESP_ERROR;
+    }
+    const char *session_id = json_object_get_string(id_obj);
+    if (find_session(session_id)) {
+        *response = strdup("{\"error\":\"Session déjà présente\"}");
+        return RESP_ERROR;
+    }
+    json_object_get(spec);
+    trace_t trace;
+    trace_start(&trace, "ssh_restore");
+    response_code_t code = connect_session(spec, session_id, &trace, response);
+    trace_finish(&trace, session_id, code);
+    return code;
+}
+
+/**
+ * Ajouter les spécifications des sessions persistantes connectées à un tableau JSON
+ * Aucun secret n'est écrit : seulement la référence de la clé (chemin) ou l'authentification automatique
+ */
+void ssh_handler_export_specs(json_object *array) {
+    pthread_mutex_lock(&sessions_mutex);
+    for (int i = 0; i < session_count; i++) {
+        ssh_session_t *sess = &sessions[i];
+        if (!sess->connected || !sess->persistent) continue;
+        json_object *spec = json_object_new_object();
+        json_object_object_add(spec, "session_id", json_object_new_string(sess->session_id));
+        json_object_object_add(spec, "host", json_object_new_string(sess->host));
+        json_object_object_add(spec, "port", json_object_new_int(sess->port));
+        json_object_object_add(spec, "username", json_object_new_string(sess->username));
+        if (sess->profile) json_object_object_add(spec, "profile", json_object_new_string(sess->profile->name));
+        if (sess->key_file[0]) json_object_object_add(spec, "key_file", json_object_new_string(sess->key_file));
+        if (sess->via_session_id[0]) {
+            json_object_object_add(spec, "via_session_id", json_object_new_string(sess->via_session_id));
+        }
+        json_object_object_add(spec, "persist", json_object_new_boolean(1));
+        json_object_array_add(array, spec);
+    }
+    pthread_mutex_unlock(&sessions_mutex);
 }
 
 /**
@@ -398,210 +973,622 @@ response_code_t handle_ssh_disconnect(const char *json_data, char **response) {
     JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
     ssh_session_t *sess = find_session(session_id);
 
-    if (!sess || !sess->connected) {
+    if (!sess || !ssh_handler_lock(sess)) {
         json_object_put(root);
         *response = strdup("{\"error\":\"Session introuvable\"}");
         return RESP_ERROR;
     }
 
-    ssh_disconnect(sess->session);
-    ssh_free(sess->session);
     sess->connected = false;
+    if (sess->sftp) {
+        sftp_free(sess->sftp);
+        sess->sftp = NULL;
+    }
+    sess->backend->disconnect(sess->conn);
+    sess->conn = NULL;
+    sess->session = NULL;
+    ssh_handler_unlock(sess);
+    publish_sessions();
+    if (sess->persistent) session_state_save();
 
     *response = strdup("{\"status\":\"disconnected\"}");
     json_object_put(root);
     return RESP_OK;
 }
 
+// stdin en flux d'une exécution : trames du client relayées au canal
+typedef struct {
+    socket_stream_t *stream;
+    char *buf;                  // SSH_STDIN_CHUNK octets
+    uint32_t len;               // Reçus du client...
+    uint32_t off;               // ... dont déjà acceptés par le canal
+    size_t bytes;               // Transmis au distant
+    bool done;                  // EOF transmis, ou distant fermé
+    bool closed;                // Le distant a cessé de lire avant la fin du flux
+    bool failed;                // Connexion fermée ou trame invalide
+} stdin_pump_t;
+
 /**
- * Gérer l'exécution de commande SSH
+ * Faire avancer stdin sans attendre : recevoir une trame quand le tampon est vide, écrire
+ * ce que la fenêtre SSH accepte, puis EOF après la trame vide. Le client n'est plus lu
+ * tant que la fenêtre est pleine : la contre-pression remonte jusqu'à son socket.
+ * @return true si des octets ont avancé
  */
-response_code_t handle_ssh_execute(const char *json_data, char **response) {
-    if (!json_data || !response) {
-        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
-        return RESP_ERROR;
+static bool stdin_pump(ssh_session_t *sess, ssh_channel channel, stdin_pump_t *in) {
+    bool progress = false;
+    if (in->off == in->len && !in->stream->eof) {
+        ssize_t n = socket_stream_read(in->stream, in->buf, SSH_STDIN_CHUNK);
+        if (n == -1) {
+            in->failed = true;
+            return false;
+        }
+        in->off = 0;
+        in->len = n > 0 ? (uint32_t)n : 0;
+        progress = n > 0;
     }
-    
-    json_object *root;
-    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+    if (in->off < in->len) {
+        int n = ssh_handler_channel_write_some(sess, channel, in->buf + in->off, in->len - in->off);
+        if (n == SSH_ERROR) {
+            // Commande terminée sans lire toute son entrée (comme `head`)
+            in->done = true;
+            in->closed = true;
+            return progress;
+        }
+        in->off += (uint32_t)n;
+        in->bytes += (size_t)n;
+        progress |= n > 0;
+    }
+    if (in->off == in->len && in->stream->eof) {
+        if (ssh_handler_lock(sess)) {
+            sess->backend->send_eof(channel);
+            ssh_handler_unlock(sess);
+        }
+        in->done = true;
+    }
+    return progress;
+}
 
-    const char *session_id;
-    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
-    
-    const char *command;
-    JSON_GET_STRING_OR_RETURN(root, "command", command, "command requis");
-    
-    ssh_session_t *sess = find_session(session_id);
-    if (!sess || !sess->connected) {
-        json_object_put(root);
+/**
+ * Réponse d'une exécution arrêtée par le budget mémoire (la sortie n'est pas déversée
+ * ailleurs : le client la réduit ou la fait écrire vers un descripteur)
+ */
+static char* budget_error(size_t bytes_read) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg),
+             "{\"error\":\"Budget mémoire dépassé : réduire la sortie (max_bytes, tail) ou l'écrire vers un descripteur\","
+             "\"memory_budget\":%llu,\"bytes_read\":%zu}",
+             (unsigned long long)mem_budget_limit(), bytes_read);
+    return strdup(error_msg);
+}
+
+/**
+ * Exécuter une commande sur la session et construire la réponse JSON
+ * @param timeout_ms Délai d'exécution (0 = aucun) ; à l'échéance la commande reçoit SIGKILL,
+ *                   le canal est fermé et la sortie partielle est renvoyée avec "timed_out":true
+ * @param handle     Entrée du registre d'annulation (peut être NULL) ; une annulation termine
+ *                   la requête avec RESP_CANCELLED et la sortie partielle
+ * @param filter     Filtre appliqué à stdout pendant la lecture (peut être NULL) ; quand il ne
+ *                   retiendra plus rien, le canal est fermé sans attendre la fin (comme `| head`)
+ * @param stdout_fd  Descripteur du client (-1 = aucun) : stdout y est écrit brut à l'arrivée et
+ *                   la réponse ne contient que les compteurs (idem stderr_fd pour stderr)
+ * @param stdin_stream Trames stdin du client (NULL = aucune) : relayées pendant la lecture de
+ *                   stdout/stderr, EOF envoyé au distant après la trame vide
+ * @param partial    Positionné si la sortie est incomplète (délai ou annulation, peut être NULL)
+ * @param trace      Phases : verrou de session, ouverture du canal, exécution distante (dont
+ *                   temps de lecture cumulé), fermeture, mise en forme (stdout est échappé
+ *                   pendant la lecture, directement dans la réponse)
+ */
+static response_code_t execute_command(ssh_session_t *sess, const char *command, int timeout_ms,
+                                       output_filter_t *filter, int stdout_fd, int stderr_fd,
+                                       socket_stream_t *stdin_stream, exec_handle_t *handle,
+                                       trace_t *trace, char **response, bool *partial) {
+    bool timed_out = false, cancelled = false, stopped = false, write_failed = false;
+    bool over_budget = false, read_failed = false;
+    stdin_pump_t stdin_state = { .stream = stdin_stream };
+    stdin_pump_t *in = stdin_stream ? &stdin_state : NULL;
+    int64_t deadline = timeout_ms > 0 ? monotonic_ms() + timeout_ms : 0;
+    if (partial) *partial = false;
+
+    if (!ssh_handler_lock(sess)) {
         *response = strdup("{\"error\":\"Session introuvable ou déconnectée\"}");
         return RESP_ERROR;
     }
+    trace_mark(trace, "session_lock");
+    mem_request_set_session(&sess->mem);
 
-    // Exécuter la commande
-    ssh_channel channel = ssh_channel_new(sess->session);
+    const ssh_backend_t *backend = sess->backend;
+    void *channel = backend->open(sess->conn);
     if (!channel) {
-        json_object_put(root);
-        *response = strdup("{\"error\":\"Impossible de créer le canal\"}");
-        return RESP_SSH_ERROR;
-    }
-
-    if (ssh_channel_open_session(channel) != SSH_OK) {
-        ssh_channel_free(channel);
-        json_object_put(root);
+        ssh_handler_unlock(sess);
         *response = strdup("{\"error\":\"Impossible d'ouvrir le canal\"}");
         return RESP_SSH_ERROR;
     }
+    trace_mark(trace, "channel_open");
 
-    if (ssh_channel_request_exec(channel, command) != SSH_OK) {
-        ssh_channel_close(channel);
-        ssh_channel_free(channel);
-        json_object_put(root);
+    if (backend->exec(channel, command) != 0) {
+        backend->close(channel);
+        ssh_handler_unlock(sess);
         *response = strdup("{\"error\":\"Impossible d'exécuter la commande\"}");
         return RESP_SSH_ERROR;
     }
+    ssh_handler_unlock(sess);
+    trace_mark(trace, "exec_request");
 
-    // Utiliser les buffers Rust pour une gestion mémoire sécurisée (optimisé)
-    void *stdout_buffer = rust_buffer_new(8192);  // Capacité initiale plus grande
-    void *stderr_buffer = rust_buffer_new(4096);
-    
-    if (!stdout_buffer || !stderr_buffer) {
-        if (stdout_buffer) rust_buffer_free(stdout_buffer);
+    // Réponse construite pendant la lecture : stdout est échappé directement dans le document
+    // (une seule copie), stderr est conservé à part puis écrit à la suite ; avec un descripteur,
+    // le flux y est écrit tel quel et n'entre pas dans la réponse
+    void *writer = rust_json_new(stdout_fd >= 0 ? 256 : 8192);
+    void *stderr_buffer = rust_buffer_new(stderr_fd >= 0 ? 16 : 4096);
+    if (!writer || !stderr_buffer || rust_json_begin_object(writer) != 0 ||
+        (stdout_fd < 0 && (rust_json_key(writer, "output") != 0 || rust_json_string_begin(writer) != 0))) {
+        rust_json_free(writer);
         if (stderr_buffer) rust_buffer_free(stderr_buffer);
-        ssh_channel_close(channel);
-        ssh_channel_free(channel);
-        json_object_put(root);
-        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        ssh_handler_close_channel(sess, channel);
+        *response = mem_request_refused() ? budget_error(0)
+                                          : strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
         return RESP_ERROR;
     }
     
-    // Lire stdout (optimisé : pas besoin de null terminator)
-    int nbytes;
-    do {
-        char buf[4096];
-        nbytes = ssh_channel_read(channel, buf, sizeof(buf), 0);
-        if (nbytes > 0) {
-            if (rust_buffer_append(stdout_buffer, buf, nbytes) != 0) {
-                rust_buffer_free(stdout_buffer);
-                rust_buffer_free(stderr_buffer);
-                ssh_channel_close(channel);
-                ssh_channel_free(channel);
-                json_object_put(root);
-                *response = strdup("{\"error\":\"Erreur lors de la lecture\"}");
-                return RESP_ERROR;
+    // Lire stdout et stderr en alternance : la session reste disponible pour les autres
+    // canaux et un stderr volumineux ne bloque plus la fenêtre de stdout
+    bool stdout_done = false, stderr_done = false;
+    int64_t read_us = 0;
+    size_t stdout_read = 0, stdout_written = 0, stderr_read = 0;
+    if (filter && stdout_fd >= 0) output_filter_set_fd(filter, stdout_fd, deadline, handle);
+    uint32_t buf_size = sess->read_chunk;
+    char *buf = malloc(buf_size);
+    if (in) in->buf = malloc(SSH_STDIN_CHUNK);
+    if (!buf || (in && !in->buf)) {
+        free(buf);
+        if (in) free(in->buf);
+        rust_json_free(writer);
+        rust_buffer_free(stderr_buffer);
+        ssh_handler_close_channel(sess, channel);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    while (!stdout_done || !stderr_done) {
+        int nbytes = SSH_AGAIN, stderr_bytes = SSH_AGAIN;
+        bool stdin_moved = false;
+        if (in && !in->done) {
+            stdin_moved = stdin_pump(sess, channel, in);
+            if (in->failed) break;
+        }
+        int64_t read_start = trace_now_us();
+        if (!stdout_done) {
+            nbytes = ssh_handler_channel_read(sess, channel, buf, buf_size, 0, 0);
+            int rc = 0;
+            if (nbytes > 0) {
+                stdout_read += (size_t)nbytes;
+                if (filter) {
+                    rc = output_filter_feed(filter, buf, (size_t)nbytes, writer);
+                } else if (stdout_fd >= 0) {
+                    rc = output_write_fd(stdout_fd, buf, (size_t)nbytes, deadline, handle);
+                    stdout_written += (size_t)nbytes;
+                } else {
+                    rc = rust_json_string_append(writer, buf, (size_t)nbytes);
+                }
             }
+            if (rc == FILTER_COMPLETE) {
+                stopped = true;
+                break;
+            }
+            if (rc != 0 && mem_request_refused()) {
+                over_budget = true;
+                break;
+            }
+            if (rc != 0 && stdout_fd >= 0) {
+                // Lecteur parti, descripteur plein jusqu'à l'échéance ou annulation : la commande est arrêtée
+                write_stopped(errno, &timed_out, &cancelled, &write_failed);
+                break;
+            }
+            if (rc != 0) {
+                read_failed = true;
+                break;
+            }
+            if (nbytes == 0 || nbytes == SSH_ERROR) stdout_done = true;
         }
-    } while (nbytes > 0);
-    
-    // Lire stderr
-    int stderr_bytes;
-    do {
-        char stderr_buf[4096];
-        stderr_bytes = ssh_channel_read(channel, stderr_buf, sizeof(stderr_buf), 1);
-        if (stderr_bytes > 0) {
-            rust_buffer_append(stderr_buffer, stderr_buf, stderr_bytes);
-        }
-    } while (stderr_bytes > 0);
+        if (!stderr_done) {
+            stderr_bytes = ssh_handler_channel_read(sess, channel, buf, buf_size, 1, 0);
+            if (stderr_bytes > 0) {
+                stderr_read += (size_t)stderr_bytes;
+                if (stderr_fd < 0) {
+                    if (rust_buffer_append(stderr_buffer, buf, stderr_bytes) != 0) {
+                        // stderr n'est jamais perdu en silence : refus du budget ou échec d'allocation
+                        if (mem_request_refused()) over_budget = true;
+                        else read_failed = true;
+                        break;
+                    }
+                } else if (output_write_fd(stderr_fd, buf, (size_t)stderr_bytes, deadline, handle) != 0) {
+                    write_stopped(errno, &timed_out, &cancelled, &write_failed);
+                    break;
+                }
+            }
+            if (stderr_bytes == 0 || stderr_bytes == SSH_ERROR) stderr_done = true;
+        }
+        read_us += trace_now_us() - read_start;
+        if (exec_handle_cancelled(handle)) {
+            cancelled = true;
+            break;
+        }
+        if (deadline && monotonic_ms() >= deadline) {
+            timed_out = true;
+            break;
+        }
+        if (nbytes == SSH_AGAIN && stderr_bytes == SSH_AGAIN && !stdin_moved) {
+            // En attente d'une trame : le socket du client réveille aussi
+            bool want_frame = in && !in->done && in->off == in->len;
+            wait_session_or(sess, want_frame ? in->stream->fd : -1, 10);
+        }
+    }
+    free(buf);
+    bool stdin_failed = in && in->failed;
+    if (in) {
+        free(in->buf);
+        if (!in->done && !stdin_failed) in->closed = true;
+    }
+    if (filter && !stopped && !timed_out && !cancelled && !write_failed && !over_budget && !read_failed &&
+        !stdin_failed && output_filter_finish(filter, writer) != 0 && stdout_fd >= 0) {
+        write_stopped(errno, &timed_out, &cancelled, &write_failed);
+    }
+    if (filter && stdout_fd >= 0) stdout_written = output_filter_bytes(filter);
+    trace_mark(trace, "remote");
+    trace_add(trace, "read", read_us);
     
-    int exit_status = ssh_channel_get_exit_status(channel);
-    ssh_channel_close(channel);
-    ssh_channel_free(channel);
+    int exit_status = -1;
+    if (ssh_handler_lock(sess)) {
+        if (timed_out || cancelled || write_failed || over_budget || read_failed || stdin_failed) {
+            backend->kill(channel);
+        } else if (stopped) {
+            // Filtre satisfait : la commande reçoit SIGPIPE à sa prochaine écriture
+            backend->send_eof(channel);
+        } else {
+            exit_status = backend->exit_status(channel);
+        }
+        ssh_handler_unlock(sess);
+    }
+    ssh_handler_close_channel(sess, channel);
+    if (partial) *partial = timed_out || cancelled || write_failed;
+    trace_mark(trace, "close");
 
-    // Obtenir les données des buffers
-    size_t stdout_len = rust_buffer_len(stdout_buffer);
-    size_t stderr_len = rust_buffer_len(stderr_buffer);
-    const char *stdout_data = (const char*)rust_buffer_data(stdout_buffer);
-    const char *stderr_data = (const char*)rust_buffer_data(stderr_buffer);
-
-    // Allouer les buffers d'échappement avec taille estimée (évite les réallocations)
-    // Estimation : la plupart des sorties n'ont pas besoin d'échappement complet
-    size_t escaped_stdout_size = stdout_len + (stdout_len / 4) + 256;  // 25% overhead au lieu de 100%
-    size_t escaped_stderr_size = stderr_len + (stderr_len / 4) + 256;
-    char *escaped_stdout = malloc(escaped_stdout_size);
-    char *escaped_stderr = NULL;
-    
-    if (!escaped_stdout) {
-        rust_buffer_free(stdout_buffer);
+    if (over_budget) {
+        rust_json_free(writer);
         rust_buffer_free(stderr_buffer);
-        json_object_put(root);
+        *response = budget_error(stdout_read);
+        return RESP_ERROR;
+    }
+    if (read_failed) {
+        rust_json_free(writer);
+        rust_buffer_free(stderr_buffer);
+        *response = strdup("{\"error\":\"Erreur lors de la lecture\"}");
+        return RESP_ERROR;
+    }
+    if (stdin_failed) {
+        rust_json_free(writer);
+        rust_buffer_free(stderr_buffer);
+        char error_msg[160];
+        snprintf(error_msg, sizeof(error_msg),
+                 "{\"error\":\"Flux stdin interrompu (connexion fermée ou trame invalide)\",\"stdin_bytes\":%zu}",
+                 in->bytes);
+        *response = strdup(error_msg);
+        return RESP_ERROR;
+    }
+
+    if (write_failed) {
+        rust_json_free(writer);
+        rust_buffer_free(stderr_buffer);
+        char error_msg[160];
+        snprintf(error_msg, sizeof(error_msg),
+                 "{\"error\":\"Écriture impossible sur le descripteur de sortie\",\"bytes_read\":%zu}",
+                 stdout_read);
+        *response = strdup(error_msg);
+        return RESP_ERROR;
+    }
+
+    // Fin du document : un appel en échec invalide le document (rust_json_finish renvoie NULL)
+    int rc = stdout_fd < 0 ? rust_json_string_end(writer) : 0;
+    size_t stderr_len = rust_buffer_len(stderr_buffer);
+    if (stderr_len > 0) {
+        rc |= rust_json_key(writer, "stderr");
+        rc |= rust_json_string_begin(writer);
+        rc |= rust_json_string_append(writer, rust_buffer_data(stderr_buffer), stderr_len);
+        rc |= rust_json_string_end(writer);
+    }
+    rust_buffer_free(stderr_buffer);
+    rc |= rust_json_key(writer, "exit_code");
+    rc |= rust_json_int(writer, exit_status);
+    rc |= rust_json_key(writer, "bytes_read");
+    rc |= rust_json_uint(writer, stdout_read);
+    if (stdout_fd >= 0) {
+        rc |= rust_json_key(writer, "bytes_written");
+        rc |= rust_json_uint(writer, stdout_written);
+    }
+    if (stderr_fd >= 0) {
+        rc |= rust_json_key(writer, "stderr_bytes");
+        rc |= rust_json_uint(writer, stderr_read);
+    }
+    if (in) {
+        rc |= rust_json_key(writer, "stdin_bytes");
+        rc |= rust_json_uint(writer, in->bytes);
+        if (in->closed) {
+            rc |= rust_json_key(writer, "stdin_closed");
+            rc |= rust_json_bool(writer, true);
+        }
+    }
+    if (filter) {
+        rc |= rust_json_key(writer, "truncated");
+        rc |= rust_json_bool(writer, stopped || output_filter_truncated(filter));
+    }
+    if (cancelled || timed_out) {
+        rc |= rust_json_key(writer, cancelled ? "cancelled" : "timed_out");
+        rc |= rust_json_bool(writer, true);
+    }
+    rc |= rust_json_end_object(writer);
+
+    char *response_json = rust_json_finish(writer, NULL);
+    if (rc != 0 || !response_json) {
+        free(response_json);
+        *response = mem_request_refused() ? budget_error(stdout_read)
+                                          : strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    *response = response_json;
+    trace_mark(trace, "format");
+
+    return cancelled ? RESP_CANCELLED : RESP_OK;
+}
+
+
+/**
+ * Ajouter "cached":true à une réponse servie depuis le cache
+ */
+static char* mark_cached(char *response) {
+    size_t len = strlen(response);
+    if (len == 0 || response[len - 1] != '}') return response;
+    char *marked = realloc(response, len + sizeof(",\"cached\":true"));
+    if (!marked) return response;
+    strcpy(marked + len - 1, ",\"cached\":true}");
+    return marked;
+}
+
+/**
+ * Exécuter une commande en passant par le cache si cache_ttl_ms > 0
+ */
+static response_code_t execute_or_cache(ssh_session_t *sess, const char *command, int timeout_ms,
+                                        uint32_t cache_ttl_ms, output_filter_t *filter,
+                                        exec_handle_t *handle, trace_t *trace, char **response) {
+    if (cache_ttl_ms == 0) {
+        return execute_command(sess, command, timeout_ms, filter, -1, -1, NULL, handle, trace, response, NULL);
+    }
+
+    // Clé : backend + identité de l'hôte + route (bastion) + commande (partagée entre sessions
+    // vers le même compte par le même chemin) + filtre ; un même host:port derrière deux
+    // bastions désigne deux machines distinctes, et une session fake ne sert jamais une vraie
+    int filter_len = filter ? output_filter_key(filter, NULL, 0) : 0;
+    size_t key_size = strlen(sess->backend->name) + strlen(sess->username) + strlen(sess->host) +
+                      strlen(sess->via_session_id) + strlen(command) + (size_t)filter_len + 24;
+    char *key = malloc(key_size);
+    if (!key) {
         *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
         return RESP_ERROR;
     }
+    int n = snprintf(key, key_size, "%s/%s@%s:%d>%s\n%s", sess->backend->name, sess->username,
+                     sess->host, sess->port, sess->via_session_id, command);
+    if (filter) {
+        key[n++] = '\n';
+        output_filter_key(filter, key + n, key_size - (size_t)n);
+    }
+
+    // L'attente d'une exécution identique compte dans le délai de la requête
+    int64_t deadline = timeout_ms > 0 ? monotonic_ms() + timeout_ms : 0;
+    response_code_t code;
+    cache_entry_t *ticket;
+    cache_lookup_t lookup = result_cache_begin(key, deadline, handle, response, &code, &ticket);
+    trace_mark(trace, "cache");
+    if (lookup == CACHE_HIT) {
+        if (code == RESP_OK) *response = mark_cached(*response);
+    } else if (lookup == CACHE_TIMED_OUT) {
+        code = RESP_OK;
+        *response = strdup("{\"output\":\"\",\"exit_code\":-1,\"bytes_read\":0,\"timed_out\":true}");
+    } else if (lookup == CACHE_CANCELLED) {
+        code = RESP_CANCELLED;
+        *response = strdup("{\"output\":\"\",\"exit_code\":-1,\"bytes_read\":0,\"cancelled\":true}");
+    } else {
+        if (deadline) {
+            int64_t remaining = deadline - monotonic_ms();
+            timeout_ms = remaining > 0 ? (int)remaining : 1;
+        }
+        bool partial;
+        code = execute_command(sess, command, timeout_ms, filter, -1, -1, NULL, handle, trace, response, &partial);
+        // Une sortie partielle n'est jamais conservée ni partagée
+        result_cache_finish(ticket, *response, code, partial ? 0 : cache_ttl_ms);
+    }
+
+    free(key);
+    return code;
+}
+
+/**
+ * Gérer l'exécution de commande SSH
+ * cache_ttl_ms (optionnel) : réutiliser le résultat d'une commande identique sur le même
+ * hôte (user@host:port, atteint par la même session de rebond) pendant ce délai ; les requêtes identiques simultanées partagent
+ * une seule exécution
+ * request_id (optionnel) : permet d'annuler l'exécution avec CMD_CANCEL
+ * timing (optionnel) : ajoute la durée de chaque phase à la réponse
+ * head, tail, max_bytes, grep, grep_regex (optionnels) : filtrage de stdout pendant la lecture
+ */
+response_code_t handle_ssh_execute(const char *json_data, char **response) {
+    return handle_ssh_execute_fds(json_data, NULL, 0, -1, response);
+}
+
+/**
+ * Exécution avec les descripteurs joints à la requête (SCM_RIGHTS) : fds[0] reçoit stdout,
+ * fds[1] (optionnel) stderr, octets bruts écrits à l'arrivée ; la réponse ne porte que le
+ * code de sortie et les compteurs. Incompatible avec cache_ttl_ms.
+ * @param client_fd Connexion du client (-1 si aucune : anneaux partagés, jobs) ; avec
+ *                  "stdin":"stream", les trames CMD_STDIN_DATA qui suivent y sont lues
+ */
+response_code_t handle_ssh_execute_fds(const char *json_data, const int *fds, int fd_count, int client_fd,
+                                       char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
     
-    int escaped_stdout_len = rust_escape_json(stdout_data, escaped_stdout, escaped_stdout_size);
-    if (escaped_stdout_len < 0) {
-        // Buffer trop petit, réessayer avec taille maximale
-        free(escaped_stdout);
-        escaped_stdout_size = stdout_len * 2 + 1;
-        escaped_stdout = malloc(escaped_stdout_size);
-        if (!escaped_stdout) {
-            rust_buffer_free(stdout_buffer);
-            rust_buffer_free(stderr_buffer);
-            json_object_put(root);
-            *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
-            return RESP_ERROR;
+    trace_t trace;
+    trace_start(&trace, "ssh_execute");
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    
+    const char *command;
+    JSON_GET_STRING_OR_RETURN(root, "command", command, "command requis");
+
+    int timeout_ms = default_exec_timeout_ms;
+    json_object *timeout_obj;
+    if (json_object_object_get_ex(root, "timeout_ms", &timeout_obj)) {
+        timeout_ms = json_object_get_int(timeout_obj);
+        if (timeout_ms < 0) timeout_ms = default_exec_timeout_ms;
+    }
+
+    int64_t cache_ttl_ms = 0;
+    json_object *ttl_obj;
+    if (json_object_object_get_ex(root, "cache_ttl_ms", &ttl_obj)) {
+        cache_ttl_ms = json_object_get_int64(ttl_obj);
+        if (cache_ttl_ms < 0) cache_ttl_ms = 0;
+        if (cache_ttl_ms > RESULT_CACHE_MAX_TTL_MS) cache_ttl_ms = RESULT_CACHE_MAX_TTL_MS;
+    }
+    if (cache_ttl_ms > 0 && fd_count > 0) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"cache_ttl_ms incompatible avec la sortie vers un descripteur\"}");
+        return RESP_ERROR;
+    }
+
+    // stdin (optionnel) : "stream" = trames CMD_STDIN_DATA sur la connexion, trame vide = EOF
+    bool stdin_stream = false;
+    json_object *stdin_obj;
+    if (json_object_object_get_ex(root, "stdin", &stdin_obj)) {
+        const char *error = NULL;
+        if (!json_object_is_type(stdin_obj, json_type_string) ||
+            strcmp(json_object_get_string(stdin_obj), "stream") != 0) {
+            error = "{\"error\":\"stdin : seule la valeur \\\"stream\\\" est acceptée\"}";
+        } else if (client_fd < 0) {
+            error = "{\"error\":\"stdin en flux indisponible sur ce transport (socket uniquement)\"}";
+        } else if (cache_ttl_ms > 0) {
+            error = "{\"error\":\"cache_ttl_ms incompatible avec stdin\"}";
         }
-        escaped_stdout_len = rust_escape_json(stdout_data, escaped_stdout, escaped_stdout_size);
-        if (escaped_stdout_len < 0) {
-            free(escaped_stdout);
-            rust_buffer_free(stdout_buffer);
-            rust_buffer_free(stderr_buffer);
+        if (error) {
             json_object_put(root);
-            *response = strdup("{\"error\":\"Erreur lors de l'échappement JSON\"}");
+            *response = strdup(error);
             return RESP_ERROR;
         }
+        stdin_stream = true;
     }
     
-    if (stderr_len > 0) {
-        escaped_stderr = malloc(escaped_stderr_size);
-        if (escaped_stderr) {
-            int escaped_stderr_len = rust_escape_json(stderr_data, escaped_stderr, escaped_stderr_size);
-            if (escaped_stderr_len < 0) {
-                // Buffer trop petit, réessayer
-                free(escaped_stderr);
-                escaped_stderr_size = stderr_len * 2 + 1;
-                escaped_stderr = malloc(escaped_stderr_size);
-                if (escaped_stderr) {
-                    rust_escape_json(stderr_data, escaped_stderr, escaped_stderr_size);
-                }
-            }
-        }
+    output_filter_t *filter;
+    const char *filter_error = NULL;
+    if (output_filter_create(root, &filter, &filter_error) != 0) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "{\"error\":\"%s\"}", filter_error);
+        json_object_put(root);
+        *response = strdup(error_msg);
+        return RESP_ERROR;
     }
 
-    size_t response_size = escaped_stdout_len + (escaped_stderr ? strlen(escaped_stderr) : 0) + 128;
-    char *response_json = malloc(response_size);
-    if (!response_json) {
-        free(escaped_stdout);
-        if (escaped_stderr) free(escaped_stderr);
-        rust_buffer_free(stdout_buffer);
-        rust_buffer_free(stderr_buffer);
+    ssh_session_t *sess = find_session(session_id);
+    if (!sess) {
+        output_filter_free(filter);
         json_object_put(root);
-        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        *response = strdup("{\"error\":\"Session introuvable ou déconnectée\"}");
         return RESP_ERROR;
     }
-    
-    if (escaped_stderr && stderr_len > 0) {
-        snprintf(response_json, response_size,
-                "{\"output\":\"%s\",\"stderr\":\"%s\",\"exit_code\":%d,\"bytes_read\":%zu}",
-                escaped_stdout, escaped_stderr, exit_status, stdout_len);
-    } else {
-        snprintf(response_json, response_size,
-                "{\"output\":\"%s\",\"exit_code\":%d,\"bytes_read\":%zu}",
-                escaped_stdout, exit_status, stdout_len);
+
+    // request_id (optionnel) : identifiant choisi par le client pour CMD_CANCEL
+    exec_handle_t *handle = NULL;
+    json_object *request_id_obj;
+    if (json_object_object_get_ex(root, "request_id", &request_id_obj)) {
+        handle = exec_registry_register(json_object_get_string(request_id_obj));
+        if (!handle) {
+            output_filter_free(filter);
+            json_object_put(root);
+            *response = strdup("{\"error\":\"request_id invalide ou déjà en cours\"}");
+            return RESP_ERROR;
+        }
     }
-    
-    free(escaped_stdout);
-    if (escaped_stderr) free(escaped_stderr);
-    rust_buffer_free(stdout_buffer);
-    rust_buffer_free(stderr_buffer);
-    *response = response_json;
 
+    // timing (optionnel) : durée de chaque phase dans la réponse
+    json_object *timing_obj;
+    bool timing = json_object_object_get_ex(root, "timing", &timing_obj) && json_object_get_boolean(timing_obj);
+
+    response_code_t code;
+    if (fd_count > 0 || stdin_stream) {
+        socket_stream_t stream;
+        socket_stream_init(&stream, client_fd);
+        code = execute_command(sess, command, timeout_ms, filter, fd_count > 0 ? fds[0] : -1,
+                               fd_count > 1 ? fds[1] : -1, stdin_stream ? &stream : NULL,
+                               handle, &trace, response, NULL);
+    } else {
+        code = execute_or_cache(sess, command, timeout_ms, (uint32_t)cache_ttl_ms,
+                                filter, handle, &trace, response);
+    }
+    exec_registry_unregister(handle);
+    output_filter_free(filter);
+    if (timing) *response = trace_attach_timing(&trace, *response);
+    trace_finish(&trace, session_id, code);
     json_object_put(root);
-    return RESP_OK;
+    return code;
+}
+
+
+static const session_entry_t* snapshot_find(const session_snapshot_t *snap, const char *session_id) {
+    for (int i = 0; i < snap->count; i++) {
+        if (strcmp(snap->entries[i].session_id, session_id) == 0) return &snap->entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * Hôte d'une session connectée, lu dans la vue publiée (sans verrou)
+ * @return true si la session existe et est connectée
+ */
+bool ssh_handler_session_host(const char *session_id, char *host, size_t size) {
+    unsigned token;
+    const session_snapshot_t *snap = session_snapshot_acquire(&token);
+    const session_entry_t *e = snap ? snapshot_find(snap, session_id) : NULL;
+    bool found = e && e->connected;
+    if (found) snprintf(host, size, "%s", e->host);
+    session_snapshot_release(token);
+    return found;
+}
+
+/**
+ * Écrire le statut d'une session (objet JSON complet)
+ * @param with_id Ajouter "session_id" (réponse groupée)
+ */
+static int write_status(void *writer, const session_snapshot_t *snap, const char *session_id, bool with_id) {
+    const session_entry_t *e = snapshot_find(snap, session_id);
+    int rc = rust_json_begin_object(writer);
+    if (with_id) {
+        rc |= rust_json_key(writer, "session_id");
+        rc |= rust_json_string(writer, session_id);
+    }
+    if (e) {
+        rc |= write_session_entry(writer, e);
+    } else {
+        rc |= rust_json_key(writer, "status");
+        rc |= rust_json_string(writer, "not_found");
+    }
+    rc |= rust_json_end_object(writer);
+    return rc;
 }
 
 /**
  * Gérer le statut SSH
+ * "session_id" : une session ; "session_ids" : plusieurs sessions en une requête, lues dans
+ * la même vue (cohérentes entre elles). Lecture sans verrou.
  */
 response_code_t handle_ssh_status(const char *json_data, char **response) {
     if (!json_data || !response) {
@@ -612,72 +1599,195 @@ response_code_t handle_ssh_status(const char *json_data, char **response) {
     json_object *root;
     JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
 
-    const char *session_id;
-    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
-    ssh_session_t *sess = find_session(session_id);
+    json_object *ids_obj = NULL;
+    const char *session_id = NULL;
+    if (!json_object_object_get_ex(root, "session_ids", &ids_obj) ||
+        !json_object_is_type(ids_obj, json_type_array)) {
+        ids_obj = NULL;
+        JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id ou session_ids requis");
+    }
 
-    if (!sess) {
-        *response = strdup("{\"status\":\"not_found\"}");
-    } else if (sess->connected) {
-        char response_json[256];
-        snprintf(response_json, sizeof(response_json),
-                "{\"status\":\"connected\",\"created_at\":%ld}",
-                sess->created_at);
-        *response = strdup(response_json);
-    } else {
-        *response = strdup("{\"status\":\"disconnected\"}");
+    unsigned token;
+    const session_snapshot_t *snap = session_snapshot_acquire(&token);
+    if (!snap) {
+        session_snapshot_release(token);
+        json_object_put(root);
+        *response = strdup("{\"error\":\"Vue des sessions indisponible\"}");
+        return RESP_ERROR;
     }
 
+    size_t n = ids_obj ? json_object_array_length(ids_obj) : 1;
+    void *writer = rust_json_new(256 + n * 384);
+    int rc = 0;
+    if (ids_obj) {
+        rc |= rust_json_begin_object(writer);
+        rc |= rust_json_key(writer, "sessions");
+        rc |= rust_json_begin_array(writer);
+        for (size_t i = 0; i < n; i++) {
+            const char *id = json_object_get_string(json_object_array_get_idx(ids_obj, i));
+            rc |= write_status(writer, snap, id ? id : "", true);
+        }
+        rc |= rust_json_end_array(writer);
+        rc |= rust_json_key(writer, "version");
+        rc |= rust_json_uint(writer, snap->version);
+        rc |= rust_json_end_object(writer);
+    } else {
+        rc |= write_status(writer, snap, session_id, false);
+    }
+    session_snapshot_release(token);
     json_object_put(root);
+
+    *response = rust_json_finish(writer, NULL);
+    if (rc != 0 || !*response) {
+        free(*response);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
     return RESP_OK;
 }
 
+// Filtre de LIST_SESSIONS sur l'état des sessions
+typedef enum {
+    LIST_CONNECTED,
+    LIST_DISCONNECTED,
+    LIST_ALL
+} list_state_t;
+
+typedef struct {
+    const char *host;           // Sous-chaîne de l'hôte, NULL = tous
+    list_state_t state;
+    int64_t min_age_s;          // -1 = pas de borne
+    int64_t max_age_s;
+    int64_t offset;
+    int64_t limit;              // 0 = pas de limite
+    bool has_since;
+    uint64_t since_version;
+} list_query_t;
+
 /**
- * Lister toutes les sessions
+ * Lire les paramètres de LIST_SESSIONS (tous optionnels)
+ * @return NULL, ou le message d'erreur
  */
-response_code_t handle_list_sessions(char **response) {
-    pthread_mutex_lock(&sessions_mutex);
-    void *json_buffer = rust_buffer_new(256);
-    if (!json_buffer) {
-        pthread_mutex_unlock(&sessions_mutex);
-        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+static const char* parse_list_query(json_object *root, list_query_t *q) {
+    json_object *obj;
+    q->host = NULL;
+    q->min_age_s = q->max_age_s = -1;
+    q->offset = q->limit = 0;
+    q->has_since = root && json_object_object_get_ex(root, "since_version", &obj);
+    q->since_version = q->has_since ? (uint64_t)json_object_get_int64(obj) : 0;
+    // En mode delta, les déconnexions font partie des changements
+    q->state = q->has_since ? LIST_ALL : LIST_CONNECTED;
+    if (!root) return NULL;
+
+    if (json_object_object_get_ex(root, "host", &obj)) q->host = json_object_get_string(obj);
+    if (json_object_object_get_ex(root, "state", &obj)) {
+        const char *state = json_object_get_string(obj);
+        if (!state) return "state invalide (connected, disconnected, all)";
+        if (strcmp(state, "connected") == 0) q->state = LIST_CONNECTED;
+        else if (strcmp(state, "disconnected") == 0) q->state = LIST_DISCONNECTED;
+        else if (strcmp(state, "all") == 0) q->state = LIST_ALL;
+        else return "state invalide (connected, disconnected, all)";
+    }
+    if (json_object_object_get_ex(root, "min_age_s", &obj)) q->min_age_s = json_object_get_int64(obj);
+    if (json_object_object_get_ex(root, "max_age_s", &obj)) q->max_age_s = json_object_get_int64(obj);
+    if (json_object_object_get_ex(root, "offset", &obj)) q->offset = json_object_get_int64(obj);
+    if (json_object_object_get_ex(root, "limit", &obj)) q->limit = json_object_get_int64(obj);
+    if (q->offset < 0 || q->limit < 0) return "offset et limit doivent être positifs";
+    return NULL;
+}
+
+static bool list_matches(const list_query_t *q, const session_entry_t *e, time_t now) {
+    if (q->state == LIST_CONNECTED && !e->connected) return false;
+    if (q->state == LIST_DISCONNECTED && e->connected) return false;
+    if (q->has_since && e->version <= q->since_version) return false;
+    if (q->host && !strstr(e->host, q->host)) return false;
+    int64_t age = (int64_t)(now - e->created_at);
+    if (q->min_age_s >= 0 && age < q->min_age_s) return false;
+    if (q->max_age_s >= 0 && age > q->max_age_s) return false;
+    return true;
+}
+
+/**
+ * Lister les sessions, sans verrou (vue immuable)
+ * Filtres : host (sous-chaîne), state, min_age_s / max_age_s ; pagination : offset, limit.
+ * since_version : seulement les sessions modifiées depuis cette version (connexions et
+ * déconnexions). Une version inconnue (instance précédente) renvoie la liste complète
+ * avec "delta":false.
+ */
+response_code_t handle_list_sessions(const char *json_data, char **response) {
+    json_object *root = NULL;
+    if (json_data && *json_data) {
+        JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+    }
+    list_query_t q;
+    const char *error = parse_list_query(root, &q);
+    if (error) {
+        char error_json[160];
+        snprintf(error_json, sizeof(error_json), "{\"error\":\"%s\"}", error);
+        json_object_put(root);
+        *response = strdup(error_json);
         return RESP_ERROR;
     }
-    
-    rust_buffer_append(json_buffer, "{\"sessions\":[", 13);
-    int count = 0;
-    for (int i = 0; i < session_count; i++) {
-        if (sessions[i].connected) {
-            if (count > 0) rust_buffer_append(json_buffer, ",", 1);
-            char session_json[128];
-            int n = snprintf(session_json, sizeof(session_json),
-                    "{\"id\":\"%s\",\"status\":\"connected\",\"created_at\":%ld}",
-                    sessions[i].session_id, sessions[i].created_at);
-            if (n > 0) rust_buffer_append(json_buffer, session_json, n);
-            count++;
-        }
+
+    unsigned token;
+    const session_snapshot_t *snap = session_snapshot_acquire(&token);
+    if (!snap) {
+        session_snapshot_release(token);
+        json_object_put(root);
+        *response = strdup("{\"error\":\"Vue des sessions indisponible\"}");
+        return RESP_ERROR;
     }
-    
-    char count_str[32];
-    int count_len = snprintf(count_str, sizeof(count_str), "],\"count\":%d}", count);
-    rust_buffer_append(json_buffer, count_str, count_len);
-    
-    size_t json_len = rust_buffer_len(json_buffer);
-    const char *json_data = (const char*)rust_buffer_data(json_buffer);
-    char *json = malloc(json_len + 1);
-    if (!json) {
-        rust_buffer_free(json_buffer);
-        pthread_mutex_unlock(&sessions_mutex);
+    bool asked_delta = q.has_since;
+    bool delta = q.has_since;
+    if (delta && (q.since_version < session_snapshot_base_version() || q.since_version > snap->version)) {
+        // Version d'une autre instance : resynchronisation complète
+        q.has_since = false;
+        if (q.state == LIST_ALL) q.state = LIST_CONNECTED;
+        delta = false;
+    }
+
+    time_t now = time(NULL);
+    void *writer = rust_json_new(256 + (size_t)snap->count * 384);
+    int rc = rust_json_begin_object(writer);
+    rc |= rust_json_key(writer, "sessions");
+    rc |= rust_json_begin_array(writer);
+    int64_t total = 0, count = 0;
+    for (int i = 0; i < snap->count; i++) {
+        const session_entry_t *e = &snap->entries[i];
+        if (!list_matches(&q, e, now)) continue;
+        total++;
+        if (total <= q.offset || (q.limit && count >= q.limit)) continue;
+        rc |= rust_json_begin_object(writer);
+        rc |= rust_json_key(writer, "id");
+        rc |= rust_json_string(writer, e->session_id);
+        rc |= write_session_entry(writer, e);
+        rc |= rust_json_end_object(writer);
+        count++;
+    }
+    rc |= rust_json_end_array(writer);
+    rc |= rust_json_key(writer, "count");
+    rc |= rust_json_int(writer, count);
+    rc |= rust_json_key(writer, "total");
+    rc |= rust_json_int(writer, total);
+    if (q.offset + count < total) {
+        rc |= rust_json_key(writer, "next_offset");
+        rc |= rust_json_int(writer, q.offset + count);
+    }
+    rc |= rust_json_key(writer, "version");
+    rc |= rust_json_uint(writer, snap->version);
+    if (asked_delta) {
+        rc |= rust_json_key(writer, "delta");
+        rc |= rust_json_bool(writer, delta);
+    }
+    rc |= rust_json_end_object(writer);
+    session_snapshot_release(token);
+    json_object_put(root);
+
+    *response = rust_json_finish(writer, NULL);
+    if (rc != 0 || !*response) {
+        free(*response);
         *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
         return RESP_ERROR;
     }
-    
-    memcpy(json, json_data, json_len);
-    json[json_len] = '\0';
-    
-    rust_buffer_free(json_buffer);
-    pthread_mutex_unlock(&sessions_mutex);
-    *response = json;
     return RESP_OK;
 }
-
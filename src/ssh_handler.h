@@ -1,16 +1,83 @@
 #ifndef SSH_HANDLER_H
 #define SSH_HANDLER_H
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+#include <json-c/json.h>
+
 #include "agent.h"
+#include "profile.h"
+#include "ssh_backend.h"
+#include "mem_budget.h"
+
+#define MAX_SESSIONS 100
+#define SSH_DEFAULT_EXEC_TIMEOUT_MS (5 * 60 * 1000)
+#define SSH_DEFAULT_CONNECT_TIMEOUT_MS (30 * 1000)
+#define SSH_STDIN_CHUNK (64 * 1024)         // Tampon de stdin en flux (mémoire fixe par exécution)
+
+// Structure de session SSH (partagée avec sftp_handler.c, sync_handler.c)
+typedef struct {
+    char session_id[64];
+    const ssh_backend_t *backend;
+    void *conn;                 // Connexion du backend (== session pour libssh)
+    ssh_session session;        // NULL hors libssh : SFTP, synchronisation et tunnels indisponibles
+    sftp_session sftp;          // Sous-système SFTP ouvert à la demande
+    bool connected;
+    time_t created_at;
+    pthread_mutex_t lock;       // libssh exige qu'une session ne soit utilisée que par un thread à la fois
+    char host[256];
+    int port;
+    char username[64];
+    const connection_profile_t *profile;    // NULL si aucun profil
+    uint32_t read_chunk;
+    bool persistent;            // Spécification sauvegardée pour la reprise à chaud
+    char key_file[256];         // Référence de la clé (chemin), vide = authentification automatique
+    char via_session_id[64];    // Session de rebond (bastion) portant le transport, vide = TCP direct
+    // Compteurs de débit (lus sans verrou)
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t xfer_bytes;            // Transferts en masse (sftp) : octets et durée cumulés
+    _Atomic uint64_t xfer_us;
+    _Atomic uint64_t peak_bytes_per_sec;
+    mem_counter_t mem;                      // Tampons détenus par les requêtes en cours
+} ssh_session_t;
 
 int ssh_handler_init(void);
 void ssh_handler_cleanup(void);
+void ssh_handler_set_timeouts(int exec_timeout_ms, int connect_timeout_ms);
+int ssh_handler_exec_timeout_ms(void);
+int ssh_handler_set_backend(const char *name);
+
+// Accès aux sessions pour les autres modules
+ssh_session_t* ssh_handler_find(const char *session_id);
+ssh_session_t* ssh_handler_find_native(const char *session_id, char **response);
+bool ssh_handler_session_host(const char *session_id, char *host, size_t size);
+bool ssh_handler_lock(ssh_session_t *sess);
+void ssh_handler_unlock(ssh_session_t *sess);
+void ssh_handler_wait(ssh_session_t *sess, int timeout_ms);
+void ssh_handler_wait_pair(ssh_session_t *a, ssh_session_t *b, int timeout_ms);
+int ssh_handler_channel_read(ssh_session_t *sess, ssh_channel channel, void *buf, uint32_t len,
+                             int is_stderr, int timeout_ms);
+int ssh_handler_channel_write_some(ssh_session_t *sess, ssh_channel channel, const void *data, uint32_t len);
+int ssh_handler_channel_write(ssh_session_t *sess, ssh_channel channel, const void *data, uint32_t len);
+ssh_channel ssh_handler_open_exec(ssh_session_t *sess, const char *command);
+int ssh_handler_collect(ssh_session_t *sess, ssh_channel channel, void *stdout_buffer, void *stderr_buffer);
+void ssh_handler_close_channel(ssh_session_t *sess, ssh_channel channel);
+void ssh_handler_record_transfer(ssh_session_t *sess, uint64_t bytes, double duration_ms);
+
+// Reprise à chaud (session_state.c)
+response_code_t ssh_handler_restore(json_object *spec, char **response);
+void ssh_handler_export_specs(json_object *array);
 
 response_code_t handle_ssh_connect(const char *json_data, char **response);
 response_code_t handle_ssh_disconnect(const char *json_data, char **response);
 response_code_t handle_ssh_execute(const char *json_data, char **response);
+response_code_t handle_ssh_execute_fds(const char *json_data, const int *fds, int fd_count, int client_fd,
+                                       char **response);
 response_code_t handle_ssh_status(const char *json_data, char **response);
-response_code_t handle_list_sessions(char **response);
+response_code_t handle_list_sessions(const char *json_data, char **response);
 
 #endif // SSH_HANDLER_H
-
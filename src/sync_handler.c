@@ -0,0 +1,474 @@
+/**
+ * Synchronisation différentielle de fichiers (algorithme de type rsync)
+ *
+ * 1. Un script perl lancé sur la session calcule les signatures des blocs du
+ *    fichier distant (Adler-32 + MD5)
+ * 2. Le fichier local est parcouru avec une somme Adler-32 glissante ; une fenêtre
+ *    dont la somme puis le MD5 correspondent à un bloc distant devient une copie
+ * 3. Le delta (copies + données littérales) est envoyé en flux sur stdin d'un second
+ *    script qui reconstruit le fichier dans un temporaire puis le renomme
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <json-c/json.h>
+#include <libssh/libssh.h>
+
+#include "sync_handler.h"
+#include "ssh_handler.h"
+#include "agent.h"
+#include "json_macros.h"
+#include "delta.h"
+#include "memory.h"
+
+#define SYNC_MIN_BLOCK 2048
+#define SYNC_MAX_BLOCK (128 * 1024)
+#define SYNC_MAX_DEPTH 32
+
+// Script distant : signatures des blocs ("missing" ou "size N" puis "adler32 md5" par bloc)
+// Compress::Zlib est utilisé s'il est présent, sinon Adler-32 est calculé en perl pur
+static const char *SIG_SCRIPT =
+    "use Digest::MD5 qw(md5_hex);my $z=eval{require Compress::Zlib;1};"
+    "sub ad{my $d=shift;return Compress::Zlib::adler32($d) if $z;my($u,$v)=(1,0);"
+    "for(unpack(\"C*\",$d)){$u=($u+$_)%65521;$v=($v+$u)%65521}return($v<<16)|$u}"
+    "my($bs,$p)=@ARGV;open(my $f,\"<\",$p) or do{print \"missing\\n\";exit 0};binmode $f;"
+    "print \"size \",-s $f,\"\\n\";while(read($f,my $d,$bs)){printf \"%08x %s\\n\",ad($d),md5_hex($d)}";
+
+// Script distant : application du delta lu sur stdin (format décrit dans delta.h)
+static const char *APPLY_SCRIPT =
+    "my($bs,$p,$m)=@ARGV;my $t=\"$p.krown-sync.$$\";open(my $o,\">\",$t) or die \"open: $!\";binmode $o;"
+    "my $i;open($i,\"<\",$p) and binmode $i;binmode STDIN;"
+    "while(read(STDIN,my $h,9)==9){my($op,$x,$y)=unpack(\"aNN\",$h);"
+    "if($op eq \"C\"){seek($i,$x*$bs,0) or die \"seek\";my $n=$y*$bs;"
+    "while($n>0){my $r=read($i,my $b,$n>1048576?1048576:$n);last unless $r;print $o $b;$n-=$r}}"
+    "elsif($op eq \"L\"){while($x>0){my $r=read(STDIN,my $b,$x>1048576?1048576:$x) or die \"short\";"
+    "print $o $b;$x-=$r}}else{last}}"
+    "close($o) or die \"close: $!\";chmod(oct($m),$t);rename($t,$p) or die \"rename: $!\";print \"ok\\n\"";
+
+typedef struct {
+    uint64_t file_size;
+    uint64_t bytes_sent;
+    uint64_t signature_bytes;
+    uint32_t blocks_matched;
+    uint32_t blocks_total;
+    uint32_t block_size;
+    bool unchanged;
+} sync_stats_t;
+
+// ============================================================================
+// Utilitaires
+// ============================================================================
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * Entourer une chaîne de quotes simples pour le shell distant
+ */
+static char* shell_quote(const char *s) {
+    size_t len = strlen(s);
+    char *out = malloc(len * 4 + 3);
+    if (!out) return NULL;
+    char *p = out;
+    *p++ = '\'';
+    for (const char *c = s; *c; c++) {
+        if (*c == '\'') {
+            memcpy(p, "'\\''", 4);
+            p += 4;
+        } else {
+            *p++ = *c;
+        }
+    }
+    *p++ = '\'';
+    *p = '\0';
+    return out;
+}
+
+static char* build_perl_command(const char *script, uint32_t block_size, const char *path, const char *extra) {
+    char *quoted = shell_quote(path);
+    if (!quoted) return NULL;
+    size_t size = strlen(script) + strlen(quoted) + (extra ? strlen(extra) : 0) + 64;
+    char *command = malloc(size);
+    if (command) {
+        snprintf(command, size, "perl -e '%s' %u %s %s", script, block_size, quoted, extra ? extra : "");
+    }
+    free(quoted);
+    return command;
+}
+
+static uint32_t choose_block_size(uint64_t file_size) {
+    uint64_t bs = (uint64_t)sqrt((double)file_size);
+    bs = (bs + 63) & ~(uint64_t)63;
+    if (bs < SYNC_MIN_BLOCK) bs = SYNC_MIN_BLOCK;
+    if (bs > SYNC_MAX_BLOCK) bs = SYNC_MAX_BLOCK;
+    return (uint32_t)bs;
+}
+
+// ============================================================================
+// Signatures distantes
+// ============================================================================
+
+/**
+ * Récupérer les signatures du fichier distant
+ */
+static int fetch_signature(ssh_session_t *sess, const char *remote_path, uint32_t block_size,
+                           signature_t *sig, uint64_t *signature_bytes, char *err, size_t err_size) {
+    char *command = build_perl_command(SIG_SCRIPT, block_size, remote_path, NULL);
+    if (!command) {
+        snprintf(err, err_size, "Erreur d'allocation mémoire");
+        return -1;
+    }
+    ssh_channel channel = ssh_handler_open_exec(sess, command);
+    free(command);
+    if (!channel) {
+        snprintf(err, err_size, "Impossible de lancer le calcul des signatures");
+        return -1;
+    }
+
+    void *output = rust_buffer_new(64 * 1024);
+    if (!output) {
+        ssh_handler_close_channel(sess, channel);
+        snprintf(err, err_size, "Erreur d'allocation mémoire");
+        return -1;
+    }
+    int exit_status = ssh_handler_collect(sess, channel, output, NULL);
+    ssh_handler_close_channel(sess, channel);
+
+    *signature_bytes = rust_buffer_len(output);
+    rust_buffer_append(output, "", 1);
+    int rc = -1;
+    if (exit_status != 0) {
+        snprintf(err, err_size, "Échec du script de signatures (perl, Digest::MD5 requis) : code %d", exit_status);
+    } else if (signature_parse((const char*)rust_buffer_data(output), block_size, sig) < 0) {
+        snprintf(err, err_size, "Signatures distantes invalides");
+        signature_free(sig);
+    } else {
+        rc = 0;
+    }
+    rust_buffer_free(output);
+    return rc;
+}
+
+// ============================================================================
+// Flux de delta
+// ============================================================================
+
+// Canal du script d'application, ouvert au premier octet du delta
+typedef struct {
+    ssh_session_t *sess;
+    ssh_channel channel;
+    const char *apply_command;
+} apply_channel_t;
+
+static int apply_sink(void *ctx, const void *data, size_t len) {
+    apply_channel_t *out = ctx;
+    if (!out->channel) {
+        out->channel = ssh_handler_open_exec(out->sess, out->apply_command);
+        if (!out->channel) return -1;
+    }
+    return ssh_handler_channel_write(out->sess, out->channel, data, (uint32_t)len) < 0 ? -1 : 0;
+}
+
+/**
+ * Terminer le delta et attendre le résultat du script d'application
+ */
+static int delta_finish(delta_writer_t *w, apply_channel_t *out, char *err, size_t err_size) {
+    if (delta_end(w) < 0) {
+        snprintf(err, err_size, "Échec de l'envoi du delta");
+        return -1;
+    }
+
+    if (ssh_handler_lock(out->sess)) {
+        ssh_channel_send_eof(out->channel);
+        ssh_handler_unlock(out->sess);
+    }
+    void *output = rust_buffer_new(64);
+    int exit_status = output ? ssh_handler_collect(out->sess, out->channel, output, NULL) : -1;
+    bool ok = output && rust_buffer_len(output) >= 2 && memcmp(rust_buffer_data(output), "ok", 2) == 0;
+    if (output) rust_buffer_free(output);
+
+    if (exit_status != 0 || !ok) {
+        snprintf(err, err_size, "Échec de la reconstruction distante : code %d", exit_status);
+        return -1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Synchronisation d'un fichier
+// ============================================================================
+
+static int sync_one_file(ssh_session_t *sess, const char *local_path, const char *remote_path,
+                         uint32_t block_size_opt, sync_stats_t *stats, char *err, size_t err_size) {
+    memset(stats, 0, sizeof(*stats));
+
+    int fd = open(local_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(err, err_size, "Erreur fichier local: %s", strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    uint32_t block_size = block_size_opt ? block_size_opt : choose_block_size(size);
+    stats->file_size = size;
+    stats->block_size = block_size;
+
+    const uint8_t *data = NULL;
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            snprintf(err, err_size, "Erreur fichier local: %s", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        madvise((void*)data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    signature_t sig;
+    int rc = fetch_signature(sess, remote_path, block_size, &sig, &stats->signature_bytes, err, err_size);
+    if (rc < 0) {
+        if (data) munmap((void*)data, size);
+        return -1;
+    }
+    stats->blocks_total = sig.count;
+
+    char mode[16];
+    snprintf(mode, sizeof(mode), "%o", (unsigned int)(st.st_mode & 07777));
+    apply_channel_t out = {
+        .sess = sess,
+        .apply_command = build_perl_command(APPLY_SCRIPT, block_size, remote_path, mode),
+    };
+    delta_writer_t w;
+    if (delta_writer_init(&w, apply_sink, &out) < 0 || !out.apply_command) {
+        snprintf(err, err_size, "Erreur d'allocation mémoire");
+        rc = -1;
+    } else {
+        stats->unchanged = delta_scan(data, size, block_size, &sig, &w, &stats->blocks_matched);
+        if (!stats->unchanged) rc = delta_finish(&w, &out, err, err_size);
+    }
+    stats->bytes_sent = w.bytes_sent;
+
+    if (out.channel) ssh_handler_close_channel(sess, out.channel);
+    free((void*)out.apply_command);
+    delta_writer_free(&w);
+    signature_free(&sig);
+    if (data) munmap((void*)data, size);
+    return rc;
+}
+
+static uint32_t read_block_size(json_object *root) {
+    json_object *obj;
+    if (!json_object_object_get_ex(root, "block_size", &obj)) return 0;
+    int64_t v = json_object_get_int64(obj);
+    if (v < SYNC_MIN_BLOCK) v = SYNC_MIN_BLOCK;
+    if (v > SYNC_MAX_BLOCK) v = SYNC_MAX_BLOCK;
+    return (uint32_t)v;
+}
+
+/**
+ * Synchroniser un fichier (CMD_SYNC_FILE)
+ */
+response_code_t handle_sync_file(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id, *local_path, *remote_path;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    JSON_GET_STRING_OR_RETURN(root, "local_path", local_path, "local_path requis");
+    JSON_GET_STRING_OR_RETURN(root, "remote_path", remote_path, "remote_path requis");
+    uint32_t block_size = read_block_size(root);
+
+    ssh_session_t *sess = ssh_handler_find_native(session_id, response);
+    if (!sess) {
+        json_object_put(root);
+        return RESP_ERROR;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    sync_stats_t stats;
+    char err[256];
+    int rc = sync_one_file(sess, local_path, remote_path, block_size, &stats, err, sizeof(err));
+    json_object_put(root);
+
+    char response_json[512];
+    if (rc < 0) {
+        snprintf(response_json, sizeof(response_json), "{\"error\":\"%s\"}", err);
+        *response = strdup(response_json);
+        return RESP_SSH_ERROR;
+    }
+
+    int64_t saved = (int64_t)stats.file_size - (int64_t)(stats.bytes_sent + stats.signature_bytes);
+    snprintf(response_json, sizeof(response_json),
+            "{\"status\":\"%s\",\"bytes_total\":%llu,\"bytes_sent\":%llu,\"signature_bytes\":%llu,"
+            "\"bytes_saved\":%lld,\"blocks_matched\":%u,\"blocks_total\":%u,\"block_size\":%u,\"duration_ms\":%.1f}",
+            stats.unchanged ? "unchanged" : "synced",
+            (unsigned long long)stats.file_size, (unsigned long long)stats.bytes_sent,
+            (unsigned long long)stats.signature_bytes, (long long)saved,
+            stats.blocks_matched, stats.blocks_total, stats.block_size, elapsed_ms(&start));
+    *response = strdup(response_json);
+    return RESP_OK;
+}
+
+// Totaux d'une synchronisation de répertoire
+typedef struct {
+    ssh_session_t *sess;
+    uint32_t block_size;
+    uint32_t files;
+    uint32_t unchanged;
+    uint32_t failed;
+    uint32_t skipped_dirs;      // Sous-arbres au-delà de SYNC_MAX_DEPTH (comptés dans failed)
+    uint64_t bytes_total;
+    uint64_t bytes_sent;
+    uint64_t signature_bytes;
+    char first_error[256];
+} dir_sync_t;
+
+static int remote_mkdir(ssh_session_t *sess, const char *remote_dir) {
+    char *quoted = shell_quote(remote_dir);
+    if (!quoted) return -1;
+    size_t size = strlen(quoted) + 16;
+    char *command = malloc(size);
+    if (!command) {
+        free(quoted);
+        return -1;
+    }
+    snprintf(command, size, "mkdir -p %s", quoted);
+    free(quoted);
+
+    ssh_channel channel = ssh_handler_open_exec(sess, command);
+    free(command);
+    if (!channel) return -1;
+    void *output = rust_buffer_new(64);
+    int exit_status = output ? ssh_handler_collect(sess, channel, output, NULL) : -1;
+    if (output) rust_buffer_free(output);
+    ssh_handler_close_channel(sess, channel);
+    return exit_status == 0 ? 0 : -1;
+}
+
+/**
+ * Parcourir récursivement le répertoire local (fichiers réguliers uniquement)
+ */
+static void sync_dir_recursive(dir_sync_t *ctx, const char *local_dir, const char *remote_dir, int depth) {
+    if (depth > SYNC_MAX_DEPTH) {
+        ctx->failed++;
+        ctx->skipped_dirs++;
+        if (!ctx->first_error[0]) {
+            snprintf(ctx->first_error, sizeof(ctx->first_error), "Profondeur maximale (%d) dépassée",
+                     SYNC_MAX_DEPTH);
+        }
+        return;
+    }
+    if (remote_mkdir(ctx->sess, remote_dir) < 0) {
+        ctx->failed++;
+        if (!ctx->first_error[0]) snprintf(ctx->first_error, sizeof(ctx->first_error), "mkdir distant impossible");
+        return;
+    }
+
+    DIR *dir = opendir(local_dir);
+    if (!dir) {
+        ctx->failed++;
+        if (!ctx->first_error[0]) {
+            snprintf(ctx->first_error, sizeof(ctx->first_error), "Erreur répertoire local: %s", strerror(errno));
+        }
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char local_path[PATH_MAX], remote_path[PATH_MAX];
+        if (snprintf(local_path, sizeof(local_path), "%s/%s", local_dir, entry->d_name) >= (int)sizeof(local_path) ||
+            snprintf(remote_path, sizeof(remote_path), "%s/%s", remote_dir, entry->d_name) >= (int)sizeof(remote_path)) {
+            ctx->failed++;
+            continue;
+        }
+
+        struct stat st;
+        if (lstat(local_path, &st) < 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            sync_dir_recursive(ctx, local_path, remote_path, depth + 1);
+        } else if (S_ISREG(st.st_mode)) {
+            sync_stats_t stats;
+            char err[256];
+            ctx->files++;
+            if (sync_one_file(ctx->sess, local_path, remote_path, ctx->block_size, &stats, err, sizeof(err)) < 0) {
+                ctx->failed++;
+                if (!ctx->first_error[0]) snprintf(ctx->first_error, sizeof(ctx->first_error), "%s", err);
+                continue;
+            }
+            if (stats.unchanged) ctx->unchanged++;
+            ctx->bytes_total += stats.file_size;
+            ctx->bytes_sent += stats.bytes_sent;
+            ctx->signature_bytes += stats.signature_bytes;
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * Synchroniser un répertoire (CMD_SYNC_DIR)
+ */
+response_code_t handle_sync_dir(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id, *local_dir, *remote_dir;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    JSON_GET_STRING_OR_RETURN(root, "local_dir", local_dir, "local_dir requis");
+    JSON_GET_STRING_OR_RETURN(root, "remote_dir", remote_dir, "remote_dir requis");
+
+    dir_sync_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.block_size = read_block_size(root);
+    ctx.sess = ssh_handler_find_native(session_id, response);
+    if (!ctx.sess) {
+        json_object_put(root);
+        return RESP_ERROR;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sync_dir_recursive(&ctx, local_dir, remote_dir, 0);
+    json_object_put(root);
+
+    int64_t saved = (int64_t)ctx.bytes_total - (int64_t)(ctx.bytes_sent + ctx.signature_bytes);
+    char response_json[768];
+    snprintf(response_json, sizeof(response_json),
+            "{\"status\":\"%s\",\"files\":%u,\"unchanged\":%u,\"failed\":%u,\"skipped_dirs\":%u,"
+            "\"bytes_total\":%llu,\"bytes_sent\":%llu,\"signature_bytes\":%llu,\"bytes_saved\":%lld,"
+            "\"duration_ms\":%.1f%s%s%s}",
+            ctx.failed ? "partial" : "synced", ctx.files, ctx.unchanged, ctx.failed, ctx.skipped_dirs,
+            (unsigned long long)ctx.bytes_total, (unsigned long long)ctx.bytes_sent,
+            (unsigned long long)ctx.signature_bytes, (long long)saved, elapsed_ms(&start),
+            ctx.first_error[0] ? ",\"first_error\":\"" : "", ctx.first_error, ctx.first_error[0] ? "\"" : "");
+    *response = strdup(response_json);
+    return ctx.failed && ctx.files == ctx.failed ? RESP_SSH_ERROR : RESP_OK;
+}
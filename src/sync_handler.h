@@ -0,0 +1,9 @@
+#ifndef SYNC_HANDLER_H
+#define SYNC_HANDLER_H
+
+#include "agent.h"
+
+response_code_t handle_sync_file(const char *json_data, char **response);
+response_code_t handle_sync_dir(const char *json_data, char **response);
+
+#endif // SYNC_HANDLER_H
@@ -0,0 +1,168 @@
+/**
+ * Traces - Durée des phases d'une requête (connexion, exécution)
+ *
+ * Chaque requête note des instants monotones entre ses phases. Le résultat peut être
+ * renvoyé au client ("timing") et, si KROWN_TRACE_FILE est défini, écrit comme spans au
+ * format Chrome Trace Event (tableau JSON, lisible par chrome://tracing ou Perfetto).
+ * Un événement de requête = un seul write() en O_APPEND : pas de verrou entre threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "agent.h"
+
+#define TRACE_EVENT_BUFFER 4096
+
+static int trace_fd = -1;
+static size_t trace_max_bytes = TRACE_DEFAULT_MAX_BYTES;
+static atomic_size_t trace_bytes = 0;
+static atomic_bool trace_full = false;
+
+int64_t trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Ouvrir le fichier de traces (ajout en fin de fichier)
+ * @param max_bytes Taille au-delà de laquelle l'écriture s'arrête (0 = défaut)
+ */
+int trace_init(const char *path, size_t max_bytes) {
+    if (!path || !*path) return -1;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        LOG_ERROR("[Trace] Impossible d'ouvrir %s\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    size_t size = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    // Le tableau n'est jamais refermé : le format Chrome tolère l'absence du ']' final
+    if (size == 0 && write(fd, "[\n", 2) == 2) size = 2;
+
+    trace_max_bytes = max_bytes ? max_bytes : TRACE_DEFAULT_MAX_BYTES;
+    atomic_store(&trace_bytes, size);
+    atomic_store(&trace_full, false);
+    trace_fd = fd;
+    LOG_INFO("[Trace] Spans écrits dans %s\n", path);
+    return 0;
+}
+
+void trace_shutdown(void) {
+    if (trace_fd >= 0) close(trace_fd);
+    trace_fd = -1;
+}
+
+void trace_start(trace_t *t, const char *name) {
+    t->name = name;
+    t->start_us = trace_now_us();
+    t->last_us = t->start_us;
+    t->count = 0;
+}
+
+/**
+ * Clore la phase en cours : elle couvre l'intervalle depuis la marque précédente
+ */
+void trace_mark(trace_t *t, const char *phase) {
+    int64_t now = trace_now_us();
+    if (t->count < TRACE_MAX_PHASES) {
+        t->phases[t->count].name = phase;
+        t->phases[t->count].start_us = t->last_us;
+        t->phases[t->count].dur_us = now - t->last_us;
+        t->count++;
+    }
+    t->last_us = now;
+}
+
+/**
+ * Ajouter une durée cumulée (ex. temps passé dans les lectures pendant l'exécution)
+ * Exposée dans "timing" et en argument du span de la requête
+ */
+void trace_add(trace_t *t, const char *phase, int64_t dur_us) {
+    if (t->count >= TRACE_MAX_PHASES) return;
+    t->phases[t->count].name = phase;
+    t->phases[t->count].start_us = -1;
+    t->phases[t->count].dur_us = dur_us;
+    t->count++;
+}
+
+/**
+ * Ajouter "timing":{"total_ms":...,"<phase>_ms":...} à une réponse JSON
+ */
+char* trace_attach_timing(const trace_t *t, char *response) {
+    if (!response) return response;
+    size_t len = strlen(response);
+    if (len == 0 || response[len - 1] != '}') return response;
+
+    char timing[1024];
+    int n = snprintf(timing, sizeof(timing), ",\"timing\":{\"total_ms\":%.3f",
+                     (t->last_us - t->start_us) / 1000.0);
+    for (int i = 0; i < t->count && n < (int)sizeof(timing) - 64; i++) {
+        n += snprintf(timing + n, sizeof(timing) - n, ",\"%s_ms\":%.3f",
+                      t->phases[i].name, t->phases[i].dur_us / 1000.0);
+    }
+    n += snprintf(timing + n, sizeof(timing) - n, "}}");
+
+    char *extended = realloc(response, len + n);
+    if (!extended) return response;
+    memcpy(extended + len - 1, timing, n + 1);
+    return extended;
+}
+
+/**
+ * Écrire les spans de la requête (span parent + une phase par span) si le traçage est actif
+ */
+void trace_finish(trace_t *t, const char *target, int code) {
+    if (trace_fd < 0 || atomic_load_explicit(&trace_full, memory_order_relaxed)) return;
+
+    // Cible (session ou hôte) recopiée sans caractères à échapper
+    char label[128] = "";
+    size_t j = 0;
+    for (const char *p = target; p && *p && j < sizeof(label) - 1; p++) {
+        if (*p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) label[j++] = *p;
+    }
+    label[j] = '\0';
+
+    int pid = (int)getpid();
+    int tid = (int)syscall(SYS_gettid);
+    char buf[TRACE_EVENT_BUFFER];
+    int n = snprintf(buf, sizeof(buf),
+            "{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"target\":\"%s\",\"code\":%d",
+            t->name, (long long)t->start_us, (long long)(t->last_us - t->start_us), pid, tid, label, code);
+    for (int i = 0; i < t->count; i++) {
+        if (t->phases[i].start_us >= 0 || n >= (int)sizeof(buf) - 64) continue;
+        n += snprintf(buf + n, sizeof(buf) - n, ",\"%s_us\":%lld", t->phases[i].name, (long long)t->phases[i].dur_us);
+    }
+    n += snprintf(buf + n, sizeof(buf) - n, "}},\n");
+
+    for (int i = 0; i < t->count && n < (int)sizeof(buf) - 256; i++) {
+        if (t->phases[i].start_us < 0) continue;
+        n += snprintf(buf + n, sizeof(buf) - n,
+                "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d},\n",
+                t->phases[i].name, t->name, (long long)t->phases[i].start_us,
+                (long long)t->phases[i].dur_us, pid, tid);
+    }
+    if (n >= (int)sizeof(buf)) return;
+
+    size_t total = atomic_fetch_add(&trace_bytes, (size_t)n) + (size_t)n;
+    if (total > trace_max_bytes) {
+        if (!atomic_exchange(&trace_full, true)) {
+            LOG_WARN("[Trace] Taille maximale atteinte (%zu octets), traçage arrêté\n", trace_max_bytes);
+        }
+        return;
+    }
+    if (write(trace_fd, buf, (size_t)n) != n) {
+        atomic_store(&trace_full, true);
+    }
+}
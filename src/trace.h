@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_MAX_PHASES 16
+#define TRACE_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    const char *name;           // Littéral (jamais copié)
+    int64_t start_us;           // -1 : durée cumulée, sans intervalle propre (pas de span)
+    int64_t dur_us;
+} trace_phase_t;
+
+typedef struct {
+    const char *name;           // Requête tracée ("ssh_connect", "ssh_execute")
+    int64_t start_us;
+    int64_t last_us;            // Fin de la dernière phase
+    int count;
+    trace_phase_t phases[TRACE_MAX_PHASES];
+} trace_t;
+
+int trace_init(const char *path, size_t max_bytes);
+void trace_shutdown(void);
+int64_t trace_now_us(void);
+
+void trace_start(trace_t *t, const char *name);
+void trace_mark(trace_t *t, const char *phase);
+void trace_add(trace_t *t, const char *phase, int64_t dur_us);
+char* trace_attach_timing(const trace_t *t, char *response);
+void trace_finish(trace_t *t, const char *target, int code);
+
+#endif // TRACE_H
@@ -0,0 +1,927 @@
+/**
+ * Tunnels - Redirection de ports locale (équivalent de ssh -L) sur une session existante
+ *
+ * Chaque tunnel écoute sur un port TCP ou un socket Unix local ; chaque connexion acceptée
+ * est relayée sur un canal direct-tcpip de la session. Un seul thread de relais gère tous
+ * les tunnels : poll() sur les écoutes, les connexions locales et les sockets des sessions,
+ * lectures et écritures non bloquantes avec de grands tampons (un par sens), sans jamais
+ * attendre la fenêtre SSH d'un canal au détriment des autres. L'ouverture d'un canal
+ * (un aller-retour réseau) se fait hors du relais, sur un thread par connexion acceptée.
+ *
+ * Le même relais transporte les sessions ouvertes via un hôte de rebond : leur socket est
+ * une extrémité de socketpair, l'autre étant reliée à un canal de la session du bastion.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <json-c/json.h>
+#include <libssh/libssh.h>
+
+#include "tunnel.h"
+#include "ssh_handler.h"
+#include "agent.h"
+#include "json_macros.h"
+#include "memory.h"
+
+#define TUNNEL_ACCEPT_BATCH 16
+#define TUNNEL_RATE_INTERVAL_MS 1000
+
+typedef struct tunnel_conn {
+    int fd;
+    ssh_channel channel;
+    char *up;                   // Local -> distant
+    size_t up_len, up_off;
+    char *down;                 // Distant -> local
+    size_t down_len, down_off;
+    bool local_eof;             // Lecture locale terminée
+    bool eof_sent;              // EOF transmis au canal
+    bool remote_eof;            // EOF du canal, écriture locale fermée
+    int pfd;                    // Index dans le tableau poll (-1 : pas encore surveillée)
+    struct tunnel_conn *next;
+} tunnel_conn_t;
+
+typedef struct tunnel {
+    char id[32];
+    char session_id[64];
+    ssh_session_t *sess;
+    int listen_fd;
+    char listen[160];           // "adresse:port" ou chemin du socket Unix
+    int listen_port;
+    char unix_path[108];        // Supprimé à la fermeture
+    char remote_host[256];
+    int remote_port;
+    tunnel_conn_t *conns;
+    int active;
+    int opening;                // Canaux en cours d'ouverture (threads d'ouverture)
+    uint64_t connections;
+    uint64_t failed;            // Canaux direct-tcpip refusés
+    _Atomic uint64_t bytes_up;
+    _Atomic uint64_t bytes_down;
+    uint64_t rate_base_up, rate_base_down;
+    uint64_t rate_up, rate_down;            // Octets/s sur la dernière seconde
+    uint64_t peak_up, peak_down;
+    int64_t created_ms;
+    int64_t rate_ms;
+    bool jump;                  // Flux de rebond (sans écoute), un par session bastion
+    bool closing;               // Demandé par CMD_TUNNEL_CLOSE (le demandeur libère)
+    bool closed;
+    int listen_pfd;
+    int session_pfd;
+    struct tunnel *next;
+} tunnel_t;
+
+static tunnel_t *tunnels = NULL;
+static int tunnel_count = 0;
+static uint64_t tunnel_seq = 0;
+static pthread_mutex_t tunnels_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tunnels_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t relay_thread;
+static bool relay_running = false;
+static bool relay_stopping = false;
+static int wake_pipe[2] = { -1, -1 };
+static char listen_dir[80] = TUNNEL_DEFAULT_DIR;
+static bool remote_bind_allowed = false;   // Écoute TCP hors loopback (choix de l'opérateur)
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void wake_relay(void) {
+    char c = 1;
+    if (wake_pipe[1] >= 0 && write(wake_pipe[1], &c, 1) < 0) {
+        // Tube plein : le relais est déjà réveillé
+    }
+}
+
+static void conn_free(tunnel_t *t, tunnel_conn_t *c) {
+    if (c->channel) {
+        if (ssh_handler_lock(t->sess)) {
+            ssh_channel_close(c->channel);
+            ssh_channel_free(c->channel);
+            ssh_handler_unlock(t->sess);
+        }
+        // Session déconnectée : le canal a été libéré avec elle
+    }
+    close(c->fd);
+    free(c->up);
+    free(c->down);
+    free(c);
+}
+
+/**
+ * Fermer l'écoute et toutes les connexions d'un tunnel (avec tunnels_mutex, thread de relais)
+ */
+static void tunnel_teardown(tunnel_t *t) {
+    while (t->conns) {
+        tunnel_conn_t *c = t->conns;
+        t->conns = c->next;
+        conn_free(t, c);
+    }
+    t->active = 0;
+    if (t->listen_fd >= 0) close(t->listen_fd);
+    t->listen_fd = -1;
+    if (t->unix_path[0]) unlink(t->unix_path);
+}
+
+/**
+ * Créer une connexion relayée (tampons alloués) ; NULL en cas d'échec
+ */
+static tunnel_conn_t* conn_new(int fd, ssh_channel channel) {
+    tunnel_conn_t *c = calloc(1, sizeof(tunnel_conn_t));
+    if (!c) return NULL;
+    c->up = malloc(TUNNEL_BUFFER_SIZE);
+    c->down = malloc(TUNNEL_BUFFER_SIZE);
+    if (!c->up || !c->down) {
+        free(c->up);
+        free(c->down);
+        free(c);
+        return NULL;
+    }
+    c->fd = fd;
+    c->channel = channel;
+    c->pfd = -1;
+    return c;
+}
+
+static void conn_attach(tunnel_t *t, tunnel_conn_t *c) {
+    c->next = t->conns;
+    t->conns = c;
+    t->active++;
+    t->connections++;
+}
+
+/**
+ * Ouvrir un canal direct-tcpip vers host:port (un aller-retour, au plus TUNNEL_OPEN_TIMEOUT_MS)
+ * La requête est émise en mode non bloquant et le verrou de la session est relâché pendant
+ * l'attente de la confirmation : le relais continue de servir les canaux de la session
+ */
+static ssh_channel open_forward(ssh_session_t *sess, const char *host, int port, int source_port) {
+    if (!ssh_handler_lock(sess)) return NULL;
+    ssh_channel channel = ssh_channel_new(sess->session);
+    ssh_handler_unlock(sess);
+    if (!channel) return NULL;
+
+    int64_t deadline = now_ms() + TUNNEL_OPEN_TIMEOUT_MS;
+    int rc = SSH_AGAIN;
+    while (rc == SSH_AGAIN) {
+        if (!ssh_handler_lock(sess)) return NULL;  // Session déconnectée : canal libéré avec elle
+        ssh_set_blocking(sess->session, 0);
+        rc = ssh_channel_open_forward(channel, host, port, "127.0.0.1", source_port);
+        ssh_set_blocking(sess->session, 1);
+        if (rc != SSH_OK && (rc != SSH_AGAIN || now_ms() >= deadline)) {
+            DEBUG_PRINT("[Tunnel] Canal vers %s:%d refusé: %s\n", host, port,
+                        rc == SSH_AGAIN ? "délai dépassé" : ssh_get_error(sess->session));
+            ssh_channel_free(channel);
+            ssh_handler_unlock(sess);
+            return NULL;
+        }
+        ssh_handler_unlock(sess);
+        if (rc == SSH_AGAIN) ssh_handler_wait(sess, TUNNEL_POLL_MS);
+    }
+    return channel;
+}
+
+static void channel_discard(ssh_session_t *sess, ssh_channel channel) {
+    if (channel && ssh_handler_lock(sess)) {
+        ssh_channel_close(channel);
+        ssh_channel_free(channel);
+        ssh_handler_unlock(sess);
+    }
+}
+
+// Connexion acceptée en attente de son canal
+typedef struct {
+    tunnel_t *t;
+    int fd;
+} tunnel_open_t;
+
+/**
+ * Libérer un tunnel retiré du relais quand plus aucune ouverture n'est en cours
+ * (avec tunnels_mutex) ; un tunnel fermé par CMD_TUNNEL_CLOSE est libéré par le demandeur
+ */
+static void tunnel_release_locked(tunnel_t *t) {
+    if (t->closing) {
+        pthread_cond_broadcast(&tunnels_cond);
+    } else if (t->closed && t->opening == 0) {
+        free(t);
+    }
+}
+
+/**
+ * Thread d'ouverture : canal direct-tcpip ouvert sans tunnels_mutex (seul le verrou de la
+ * session est tenu), puis connexion confiée au relais
+ */
+static void* open_worker(void *arg) {
+    tunnel_open_t *op = arg;
+    tunnel_t *t = op->t;
+    int fd = op->fd;
+    free(op);
+
+    ssh_channel channel = open_forward(t->sess, t->remote_host, t->remote_port, t->listen_port);
+    tunnel_conn_t *c = channel ? conn_new(fd, channel) : NULL;
+
+    pthread_mutex_lock(&tunnels_mutex);
+    ssh_session_t *sess = t->sess;
+    t->opening--;
+    bool attached = c && !t->closing && !t->closed;
+    if (attached) {
+        conn_attach(t, c);
+    } else if (!c) {
+        t->failed++;
+    }
+    if (t->closing || t->closed) tunnel_release_locked(t);
+    pthread_mutex_unlock(&tunnels_mutex);
+
+    if (attached) {
+        wake_relay();
+        return NULL;
+    }
+    // Canal refusé, ou tunnel fermé pendant l'ouverture
+    channel_discard(sess, channel);
+    close(fd);
+    if (c) {
+        free(c->up);
+        free(c->down);
+        free(c);
+    }
+    return NULL;
+}
+
+/**
+ * Accepter les connexions en attente ; chaque canal est ouvert par un thread d'ouverture
+ * pour que le relais ne bloque jamais sur le réseau (avec tunnels_mutex)
+ */
+static void tunnel_accept(tunnel_t *t) {
+    for (int i = 0; i < TUNNEL_ACCEPT_BATCH && t->active + t->opening < TUNNEL_MAX_CONNECTIONS; i++) {
+        int fd = accept4(t->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        tunnel_open_t *op = malloc(sizeof(tunnel_open_t));
+        pthread_t thread;
+        if (op) {
+            op->t = t;
+            op->fd = fd;
+            t->opening++;
+        }
+        if (!op || pthread_create(&thread, NULL, open_worker, op) != 0) {
+            if (op) t->opening--;
+            free(op);
+            close(fd);
+            t->failed++;
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/**
+ * Faire avancer une connexion dans les deux sens sans bloquer
+ * @return 1 si des octets ont circulé, 0 sinon, -1 si la connexion est terminée
+ */
+static int relay_conn(tunnel_t *t, tunnel_conn_t *c, short revents) {
+    int progress = 0;
+    bool may_read = c->pfd < 0 || (revents & (POLLIN | POLLHUP | POLLERR));
+    bool may_write = c->pfd < 0 || (revents & (POLLOUT | POLLERR));
+
+    // Local -> distant
+    if (!c->local_eof && c->up_off == c->up_len && may_read) {
+        ssize_t n = recv(c->fd, c->up, TUNNEL_BUFFER_SIZE, 0);
+        if (n > 0) {
+            c->up_len = (size_t)n;
+            c->up_off = 0;
+        } else if (n == 0) {
+            c->local_eof = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+    }
+    if (c->up_off < c->up_len) {
+        if (!ssh_handler_lock(t->sess)) return -1;
+        uint32_t window = ssh_channel_window_size(c->channel);
+        if (window == 0) {
+            ssh_channel_poll(c->channel, 0);
+            window = ssh_channel_window_size(c->channel);
+        }
+        size_t pending = c->up_len - c->up_off;
+        int n = window > 0 ? ssh_channel_write(c->channel, c->up + c->up_off,
+                                               (uint32_t)(pending < window ? pending : window)) : 0;
+        ssh_handler_unlock(t->sess);
+        if (n == SSH_ERROR) return -1;
+        if (n > 0) {
+            c->up_off += (size_t)n;
+            atomic_fetch_add_explicit(&t->bytes_up, (uint64_t)n, memory_order_relaxed);
+            atomic_fetch_add_explicit(&t->sess->bytes_out, (uint64_t)n, memory_order_relaxed);
+            progress = 1;
+        }
+    }
+    if (c->local_eof && !c->eof_sent && c->up_off == c->up_len) {
+        if (!ssh_handler_lock(t->sess)) return -1;
+        ssh_channel_send_eof(c->channel);
+        ssh_handler_unlock(t->sess);
+        c->eof_sent = true;
+    }
+
+    // Distant -> local
+    if (!c->remote_eof && c->down_off == c->down_len) {
+        int n = ssh_handler_channel_read(t->sess, c->channel, c->down, TUNNEL_BUFFER_SIZE, 0, 0);
+        if (n > 0) {
+            c->down_len = (size_t)n;
+            c->down_off = 0;
+            may_write = true;
+            progress = 1;
+        } else if (n == 0) {
+            c->remote_eof = true;
+            shutdown(c->fd, SHUT_WR);
+        } else if (n == SSH_ERROR) {
+            return -1;
+        }
+    }
+    if (c->down_off < c->down_len && may_write) {
+        ssize_t n = send(c->fd, c->down + c->down_off, c->down_len - c->down_off, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->down_off += (size_t)n;
+            atomic_fetch_add_explicit(&t->bytes_down, (uint64_t)n, memory_order_relaxed);
+            progress = 1;
+        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+    }
+
+    if (c->eof_sent && c->remote_eof && c->down_off == c->down_len) return -1;
+    return progress;
+}
+
+/**
+ * Débit sur la dernière seconde et fermeture des tunnels dont la session a disparu
+ */
+static void tunnel_housekeeping(tunnel_t *t, int64_t now) {
+    if (now - t->rate_ms < TUNNEL_RATE_INTERVAL_MS) return;
+    uint64_t up = atomic_load(&t->bytes_up), down = atomic_load(&t->bytes_down);
+    int64_t elapsed = now - t->rate_ms;
+    t->rate_up = (up - t->rate_base_up) * 1000 / (uint64_t)elapsed;
+    t->rate_down = (down - t->rate_base_down) * 1000 / (uint64_t)elapsed;
+    if (t->rate_up > t->peak_up) t->peak_up = t->rate_up;
+    if (t->rate_down > t->peak_down) t->peak_down = t->rate_down;
+    t->rate_base_up = up;
+    t->rate_base_down = down;
+    t->rate_ms = now;
+
+    if (!ssh_handler_find(t->session_id)) {
+        DEBUG_PRINT("[Tunnel] %s: session %s fermée, tunnel supprimé\n", t->id, t->session_id);
+        t->closed = true;
+    }
+}
+
+static void* relay_loop(void *arg) {
+    (void)arg;
+    struct pollfd *pfds = NULL;
+    size_t pfds_cap = 0;
+    bool busy = false;
+
+    pthread_mutex_lock(&tunnels_mutex);
+    while (!relay_stopping) {
+        // Construire l'ensemble surveillé
+        size_t needed = 1;
+        for (tunnel_t *t = tunnels; t; t = t->next) needed += 2 + (size_t)t->active;
+        if (needed > pfds_cap) {
+            struct pollfd *grown = realloc(pfds, needed * sizeof(struct pollfd));
+            if (!grown) break;
+            pfds = grown;
+            pfds_cap = needed;
+        }
+        nfds_t n = 0;
+        pfds[n++] = (struct pollfd){ .fd = wake_pipe[0], .events = POLLIN };
+        for (tunnel_t *t = tunnels; t; t = t->next) {
+            t->listen_pfd = -1;
+            if (t->listen_fd >= 0 && t->active + t->opening < TUNNEL_MAX_CONNECTIONS) {
+                t->listen_pfd = (int)n;
+                pfds[n++] = (struct pollfd){ .fd = t->listen_fd, .events = POLLIN };
+            }
+            // Paquets SSH entrants : réveil sans attendre la fin du délai, seulement si une
+            // connexion peut les recevoir (sinon le socket resterait lisible en permanence)
+            bool can_receive = false;
+            for (tunnel_conn_t *c = t->conns; c; c = c->next) {
+                if (!c->remote_eof && c->down_off == c->down_len) can_receive = true;
+            }
+            t->session_pfd = -1;
+            if (can_receive && ssh_handler_lock(t->sess)) {
+                socket_t sfd = ssh_get_fd(t->sess->session);
+                ssh_handler_unlock(t->sess);
+                if (sfd != SSH_INVALID_SOCKET) {
+                    t->session_pfd = (int)n;
+                    pfds[n++] = (struct pollfd){ .fd = sfd, .events = POLLIN };
+                }
+            }
+            for (tunnel_conn_t *c = t->conns; c; c = c->next) {
+                short events = 0;
+                if (!c->local_eof && c->up_off == c->up_len) events |= POLLIN;
+                if (c->down_off < c->down_len) events |= POLLOUT;
+                c->pfd = (int)n;
+                pfds[n++] = (struct pollfd){ .fd = c->fd, .events = events };
+            }
+        }
+        pthread_mutex_unlock(&tunnels_mutex);
+
+        poll(pfds, n, busy ? 0 : TUNNEL_POLL_MS);
+        if (pfds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+        }
+
+        pthread_mutex_lock(&tunnels_mutex);
+        busy = false;
+        int64_t now = now_ms();
+        tunnel_t **pt = &tunnels;
+        while (*pt) {
+            tunnel_t *t = *pt;
+            if (!t->closing && !t->closed) {
+                if (t->listen_pfd >= 0 && (pfds[t->listen_pfd].revents & POLLIN)) tunnel_accept(t);
+
+                tunnel_conn_t **pc = &t->conns;
+                while (*pc) {
+                    tunnel_conn_t *c = *pc;
+                    int rc = relay_conn(t, c, c->pfd >= 0 ? pfds[c->pfd].revents : 0);
+                    if (rc < 0) {
+                        *pc = c->next;
+                        conn_free(t, c);
+                        t->active--;
+                        continue;
+                    }
+                    if (rc > 0) busy = true;
+                    pc = &c->next;
+                }
+                tunnel_housekeeping(t, now);
+            }
+
+            if (t->closing || t->closed) {
+                *pt = t->next;
+                tunnel_count--;
+                tunnel_teardown(t);
+                t->closed = true;
+                tunnel_release_locked(t);
+                continue;
+            }
+            pt = &t->next;
+        }
+    }
+    pthread_mutex_unlock(&tunnels_mutex);
+    free(pfds);
+    return NULL;
+}
+
+/**
+ * Démarrer le relais
+ * @param dir Répertoire des sockets listen_path (créé s'il manque)
+ * @param allow_remote_bind Autoriser bind_address hors loopback (0.0.0.0, adresse publique...)
+ */
+int tunnel_init(const char *dir, bool allow_remote_bind) {
+    snprintf(listen_dir, sizeof(listen_dir), "%s", dir ? dir : TUNNEL_DEFAULT_DIR);
+    size_t dir_len = strlen(listen_dir);
+    while (dir_len > 1 && listen_dir[dir_len - 1] == '/') listen_dir[--dir_len] = '\0';
+    if (mkdir(listen_dir, 0755) != 0 && errno != EEXIST) perror("mkdir tunnel dir");
+    remote_bind_allowed = allow_remote_bind;
+
+    if (pipe2(wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) return -1;
+    relay_stopping = false;
+    if (pthread_create(&relay_thread, NULL, relay_loop, NULL) != 0) {
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        wake_pipe[0] = wake_pipe[1] = -1;
+        return -1;
+    }
+    relay_running = true;
+    return 0;
+}
+
+void tunnel_shutdown(void) {
+    if (!relay_running) return;
+    pthread_mutex_lock(&tunnels_mutex);
+    relay_stopping = true;
+    pthread_mutex_unlock(&tunnels_mutex);
+    wake_relay();
+    pthread_join(relay_thread, NULL);
+    relay_running = false;
+
+    pthread_mutex_lock(&tunnels_mutex);
+    while (tunnels) {
+        tunnel_t *t = tunnels;
+        tunnels = t->next;
+        tunnel_teardown(t);
+        // CMD_TUNNEL_CLOSE en attente ou ouvertures en cours : le dernier libère le tunnel
+        t->closed = true;
+        tunnel_release_locked(t);
+    }
+    tunnel_count = 0;
+    pthread_mutex_unlock(&tunnels_mutex);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+/**
+ * Chemin du socket dans le répertoire des tunnels : nom simple, ou chemin absolu situé
+ * directement dans ce répertoire (ni sous-répertoire ni "..") ; un client ne peut ni
+ * écouter ni supprimer un socket ailleurs
+ */
+static bool resolve_listen_path(const char *requested, char *path, size_t size) {
+    const char *name = requested;
+    size_t dir_len = strlen(listen_dir);
+    if (requested[0] == '/') {
+        if (strncmp(requested, listen_dir, dir_len) != 0 || requested[dir_len] != '/') return false;
+        name = requested + dir_len + 1;
+    }
+    if (!*name || strchr(name, '/') || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return false;
+    return snprintf(path, size, "%s/%s", listen_dir, name) < (int)size;
+}
+
+/**
+ * Adresse de loopback (127.0.0.0/8, ::1, ::ffff:127.x.y.z)
+ */
+static bool is_loopback(const struct sockaddr_storage *addr) {
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *in4 = (const struct sockaddr_in *)addr;
+        return (ntohl(in4->sin_addr.s_addr) >> 24) == 127;
+    }
+    const struct in6_addr *a6 = &((const struct sockaddr_in6 *)addr)->sin6_addr;
+    return IN6_IS_ADDR_LOOPBACK(a6) || (IN6_IS_ADDR_V4MAPPED(a6) && a6->s6_addr[12] == 127);
+}
+
+/**
+ * Créer le socket d'écoute : listen_path (Unix, dans le répertoire des tunnels) ou
+ * bind_address:listen_port (TCP, 0 = port libre ; loopback sauf choix de l'opérateur)
+ */
+static int open_listener(json_object *root, tunnel_t *t, const char **error) {
+    json_object *obj;
+    int fd;
+
+    if (json_object_object_get_ex(root, "listen_path", &obj)) {
+        const char *requested = json_object_get_string(obj);
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        char path[sizeof(addr.sun_path)];
+        if (!requested || !resolve_listen_path(requested, path, sizeof(path))) {
+            *error = "listen_path invalide (nom de socket dans le répertoire des tunnels attendu)";
+            return -1;
+        }
+        // Un ancien socket est remplacé, jamais un autre type de fichier
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+        strcpy(addr.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            if (fd >= 0) close(fd);
+            *error = "Impossible d'écouter sur listen_path";
+            return -1;
+        }
+        chmod(path, 0660);
+        snprintf(t->unix_path, sizeof(t->unix_path), "%s", path);
+        snprintf(t->listen, sizeof(t->listen), "%s", path);
+    } else {
+        const char *bind_address = "127.0.0.1";
+        int port = 0;
+        if (json_object_object_get_ex(root, "bind_address", &obj)) bind_address = json_object_get_string(obj);
+        if (json_object_object_get_ex(root, "listen_port", &obj)) port = json_object_get_int(obj);
+        if (port < 0 || port > 65535) {
+            *error = "listen_port invalide";
+            return -1;
+        }
+
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        memset(&addr, 0, sizeof(addr));
+        struct sockaddr_in *in4 = (struct sockaddr_in *)&addr;
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+        if (inet_pton(AF_INET, bind_address, &in4->sin_addr) == 1) {
+            in4->sin_family = AF_INET;
+            in4->sin_port = htons((uint16_t)port);
+            addr_len = sizeof(*in4);
+        } else if (inet_pton(AF_INET6, bind_address, &in6->sin6_addr) == 1) {
+            in6->sin6_family = AF_INET6;
+            in6->sin6_port = htons((uint16_t)port);
+            addr_len = sizeof(*in6);
+        } else {
+            *error = "bind_address invalide (adresse IPv4 ou IPv6 attendue)";
+            return -1;
+        }
+        if (!remote_bind_allowed && !is_loopback(&addr)) {
+            *error = "bind_address hors loopback refusée (KROWN_TUNNEL_ALLOW_REMOTE_BIND)";
+            return -1;
+        }
+
+        fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, addr_len) < 0) {
+            if (fd >= 0) close(fd);
+            *error = "Impossible d'écouter sur le port demandé";
+            return -1;
+        }
+        getsockname(fd, (struct sockaddr *)&addr, &addr_len);
+        t->listen_port = ntohs(addr.ss_family == AF_INET ? in4->sin_port : in6->sin6_port);
+        snprintf(t->listen, sizeof(t->listen), addr.ss_family == AF_INET6 ? "[%s]:%d" : "%s:%d",
+                 bind_address, t->listen_port);
+    }
+
+    if (listen(fd, 128) < 0) {
+        close(fd);
+        if (t->unix_path[0]) unlink(t->unix_path);
+        *error = "Impossible d'écouter";
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Gérer CMD_TUNNEL_OPEN
+ * {"session_id":...,"remote_host":"db.internal","remote_port":5432,
+ *  "listen_port":15432,"bind_address":"127.0.0.1"} ou {...,"listen_path":"db.sock"}
+ */
+response_code_t handle_tunnel_open(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+    if (!relay_running) {
+        *response = strdup("{\"error\":\"Relais des tunnels indisponible\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+
+    const char *session_id;
+    JSON_GET_STRING_OR_RETURN(root, "session_id", session_id, "session_id requis");
+    const char *remote_host;
+    JSON_GET_STRING_OR_RETURN(root, "remote_host", remote_host, "remote_host requis");
+    json_object *port_obj;
+    int remote_port = json_object_object_get_ex(root, "remote_port", &port_obj) ? json_object_get_int(port_obj) : 0;
+    if (remote_port <= 0 || remote_port > 65535) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"remote_port invalide\"}");
+        return RESP_ERROR;
+    }
+
+    ssh_session_t *sess = ssh_handler_find_native(session_id, response);
+    if (!sess) {
+        json_object_put(root);
+        return RESP_ERROR;
+    }
+
+    tunnel_t *t = calloc(1, sizeof(tunnel_t));
+    if (!t) {
+        json_object_put(root);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    t->sess = sess;
+    snprintf(t->session_id, sizeof(t->session_id), "%s", session_id);
+    snprintf(t->remote_host, sizeof(t->remote_host), "%s", remote_host);
+    t->remote_port = remote_port;
+
+    const char *error = NULL;
+    t->listen_fd = open_listener(root, t, &error);
+    json_object_put(root);
+    if (t->listen_fd < 0) {
+        free(t);
+        char error_msg[160];
+        snprintf(error_msg, sizeof(error_msg), "{\"error\":\"%s\"}", error);
+        *response = strdup(error_msg);
+        return RESP_ERROR;
+    }
+
+    pthread_mutex_lock(&tunnels_mutex);
+    if (tunnel_count >= MAX_TUNNELS) {
+        pthread_mutex_unlock(&tunnels_mutex);
+        close(t->listen_fd);
+        if (t->unix_path[0]) unlink(t->unix_path);
+        free(t);
+        *response = strdup("{\"error\":\"Nombre maximum de tunnels atteint\"}");
+        return RESP_ERROR;
+    }
+    snprintf(t->id, sizeof(t->id), "tunnel_%llu", (unsigned long long)++tunnel_seq);
+    t->created_ms = now_ms();
+    t->rate_ms = t->created_ms;
+    t->listen_pfd = -1;
+    t->session_pfd = -1;
+    t->next = tunnels;
+    tunnels = t;
+    tunnel_count++;
+
+    char response_json[640];
+    snprintf(response_json, sizeof(response_json),
+            "{\"tunnel_id\":\"%s\",\"listen\":\"%s\",\"listen_port\":%d,\"remote\":\"%s:%d\"}",
+            t->id, t->listen, t->listen_port, t->remote_host, t->remote_port);
+    DEBUG_PRINT("[Tunnel] %s -> %s:%d via %s\n", t->listen, t->remote_host, t->remote_port, t->session_id);
+    pthread_mutex_unlock(&tunnels_mutex);
+    wake_relay();
+
+    *response = strdup(response_json);
+    return RESP_OK;
+}
+
+/**
+ * Ouvrir un flux vers host:port à travers une session existante (hôte de rebond)
+ * Le canal direct-tcpip est relayé vers une extrémité de socketpair ; l'autre extrémité
+ * est renvoyée et sert de socket à la nouvelle session (SSH_OPTIONS_FD). Tous les flux
+ * d'un même bastion partagent sa connexion TCP et sa poignée de main.
+ * @return Descripteur à confier à libssh, -1 en cas d'erreur (*error renseigné)
+ */
+int tunnel_open_stream(const char *via_session_id, const char *host, int port, const char **error) {
+    if (!relay_running) {
+        *error = "Relais des tunnels indisponible";
+        return -1;
+    }
+    ssh_session_t *via = ssh_handler_find(via_session_id);
+    if (!via) {
+        *error = "Session de rebond introuvable ou déconnectée";
+        return -1;
+    }
+    if (via->backend != &libssh_backend) {
+        *error = "Session de rebond sans transport SSH (backend fake)";
+        return -1;
+    }
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+        *error = "Impossible de créer le socket de rebond";
+        return -1;
+    }
+    fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+
+    ssh_channel channel = open_forward(via, host, port, 0);
+    tunnel_conn_t *c = channel ? conn_new(pair[0], channel) : NULL;
+    if (!c) {
+        channel_discard(via, channel);
+        close(pair[0]);
+        close(pair[1]);
+        *error = channel ? "Erreur d'allocation mémoire" : "Le bastion a refusé le canal vers l'hôte";
+        return -1;
+    }
+
+    pthread_mutex_lock(&tunnels_mutex);
+    tunnel_t *t = tunnels;
+    while (t && !(t->jump && t->sess == via && !t->closed)) t = t->next;
+    if (!t && (t = calloc(1, sizeof(tunnel_t))) != NULL) {
+        t->jump = true;
+        t->sess = via;
+        t->listen_fd = -1;
+        snprintf(t->id, sizeof(t->id), "jump_%llu", (unsigned long long)++tunnel_seq);
+        snprintf(t->session_id, sizeof(t->session_id), "%s", via_session_id);
+        snprintf(t->listen, sizeof(t->listen), "via:%s", via_session_id);
+        snprintf(t->remote_host, sizeof(t->remote_host), "*");
+        t->created_ms = now_ms();
+        t->rate_ms = t->created_ms;
+        t->listen_pfd = -1;
+        t->session_pfd = -1;
+        t->next = tunnels;
+        tunnels = t;
+        tunnel_count++;
+    }
+    if (!t) {
+        pthread_mutex_unlock(&tunnels_mutex);
+        conn_free(&(tunnel_t){ .sess = via }, c);
+        close(pair[1]);
+        *error = "Erreur d'allocation mémoire";
+        return -1;
+    }
+    conn_attach(t, c);
+    pthread_mutex_unlock(&tunnels_mutex);
+    wake_relay();
+    return pair[1];
+}
+
+/**
+ * Compteurs d'un tunnel en JSON (avec tunnels_mutex)
+ */
+static int format_tunnel(const tunnel_t *t, char *out, size_t size) {
+    return snprintf(out, size,
+            "{\"tunnel_id\":\"%s\",\"session_id\":\"%s\",\"listen\":\"%s\",\"remote\":\"%s:%d\","
+            "\"active\":%d,\"connections\":%llu,\"failed\":%llu,\"bytes_up\":%llu,\"bytes_down\":%llu,"
+            "\"up_bytes_per_sec\":%llu,\"down_bytes_per_sec\":%llu,"
+            "\"peak_up_bytes_per_sec\":%llu,\"peak_down_bytes_per_sec\":%llu,\"uptime_ms\":%lld}",
+            t->id, t->session_id, t->listen, t->remote_host, t->remote_port, t->active,
+            (unsigned long long)t->connections, (unsigned long long)t->failed,
+            (unsigned long long)atomic_load(&t->bytes_up), (unsigned long long)atomic_load(&t->bytes_down),
+            (unsigned long long)t->rate_up, (unsigned long long)t->rate_down,
+            (unsigned long long)t->peak_up, (unsigned long long)t->peak_down,
+            (long long)(now_ms() - t->created_ms));
+}
+
+/**
+ * Gérer CMD_TUNNEL_CLOSE : ferme l'écoute et les connexions, renvoie les compteurs finaux
+ */
+response_code_t handle_tunnel_close(const char *json_data, char **response) {
+    if (!json_data || !response) {
+        if (response) *response = strdup("{\"error\":\"Paramètres invalides\"}");
+        return RESP_ERROR;
+    }
+
+    json_object *root;
+    JSON_PARSE_OR_RETURN(json_data, root, "JSON invalide");
+    const char *tunnel_id;
+    JSON_GET_STRING_OR_RETURN(root, "tunnel_id", tunnel_id, "tunnel_id requis");
+
+    pthread_mutex_lock(&tunnels_mutex);
+    tunnel_t *t = tunnels;
+    while (t && (strcmp(t->id, tunnel_id) != 0 || t->jump || t->closing || t->closed)) t = t->next;
+    json_object_put(root);
+    if (!t) {
+        pthread_mutex_unlock(&tunnels_mutex);
+        *response = strdup("{\"error\":\"Tunnel introuvable\"}");
+        return RESP_ERROR;
+    }
+
+    // Le relais retire le tunnel puis nous le rend (closed) pour libération, une fois
+    // les ouvertures de canaux en cours terminées
+    t->closing = true;
+    wake_relay();
+    while (!t->closed || t->opening > 0) pthread_cond_wait(&tunnels_cond, &tunnels_mutex);
+
+    char stats[768];
+    format_tunnel(t, stats, sizeof(stats));
+    pthread_mutex_unlock(&tunnels_mutex);
+    free(t);
+
+    char response_json[800];
+    snprintf(response_json, sizeof(response_json), "{\"status\":\"closed\",\"tunnel\":%s}", stats);
+    *response = strdup(response_json);
+    return RESP_OK;
+}
+
+/**
+ * Gérer CMD_TUNNEL_LIST : compteurs et débit de chaque tunnel
+ */
+response_code_t handle_tunnel_list(char **response) {
+    void *json_buffer = rust_buffer_new(256);
+    if (!json_buffer) {
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+
+    rust_buffer_append(json_buffer, "{\"tunnels\":[", 12);
+    pthread_mutex_lock(&tunnels_mutex);
+    int count = 0;
+    for (tunnel_t *t = tunnels; t; t = t->next) {
+        char tunnel_json[768];
+        int n = format_tunnel(t, tunnel_json, sizeof(tunnel_json));
+        if (n <= 0 || n >= (int)sizeof(tunnel_json)) continue;
+        if (count > 0) rust_buffer_append(json_buffer, ",", 1);
+        rust_buffer_append(json_buffer, tunnel_json, n);
+        count++;
+    }
+    pthread_mutex_unlock(&tunnels_mutex);
+
+    char count_str[32];
+    int count_len = snprintf(count_str, sizeof(count_str), "],\"count\":%d}", count);
+    rust_buffer_append(json_buffer, count_str, count_len);
+
+    size_t json_len = rust_buffer_len(json_buffer);
+    char *json = malloc(json_len + 1);
+    if (!json) {
+        rust_buffer_free(json_buffer);
+        *response = strdup("{\"error\":\"Erreur d'allocation mémoire\"}");
+        return RESP_ERROR;
+    }
+    memcpy(json, rust_buffer_data(json_buffer), json_len);
+    json[json_len] = '\0';
+    rust_buffer_free(json_buffer);
+    *response = json;
+    return RESP_OK;
+}
+
+/**
+ * Totaux des tunnels pour CMD_STATS
+ */
+int tunnel_stats_json(char *buf, size_t size) {
+    pthread_mutex_lock(&tunnels_mutex);
+    int active = 0;
+    uint64_t up = 0, down = 0;
+    for (tunnel_t *t = tunnels; t; t = t->next) {
+        active += t->active;
+        up += atomic_load(&t->bytes_up);
+        down += atomic_load(&t->bytes_down);
+    }
+    int n = snprintf(buf, size, "{\"tunnels\":%d,\"active\":%d,\"bytes_up\":%llu,\"bytes_down\":%llu}",
+                     tunnel_count, active, (unsigned long long)up, (unsigned long long)down);
+    pthread_mutex_unlock(&tunnels_mutex);
+    return n;
+}
@@ -0,0 +1,24 @@
+#ifndef TUNNEL_H
+#define TUNNEL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "agent.h"
+
+#define MAX_TUNNELS 64
+#define TUNNEL_MAX_CONNECTIONS 256      // Connexions simultanées par tunnel
+#define TUNNEL_BUFFER_SIZE (256 * 1024) // Par sens et par connexion
+#define TUNNEL_POLL_MS 10               // Attente maximale du relais sans activité
+#define TUNNEL_OPEN_TIMEOUT_MS 15000    // Ouverture d'un canal direct-tcpip
+#define TUNNEL_DEFAULT_DIR "/run/krown/tunnels" // Seul répertoire des sockets listen_path
+
+int tunnel_init(const char *dir, bool allow_remote_bind);
+void tunnel_shutdown(void);
+int tunnel_stats_json(char *buf, size_t size);
+int tunnel_open_stream(const char *via_session_id, const char *host, int port, const char **error);
+
+response_code_t handle_tunnel_open(const char *json_data, char **response);
+response_code_t handle_tunnel_close(const char *json_data, char **response);
+response_code_t handle_tunnel_list(char **response);
+
+#endif // TUNNEL_H
@@ -0,0 +1,249 @@
+/**
+ * Tests du contrôle d'admission : poids, limites de requêtes en cours, expiration de la
+ * file et ordonnancement deficit round robin des opérations SSH. Une seule place SSH est
+ * ouverte : le test la garde le temps que tous les threads soient en file, puis la libère ;
+ * chaque thread servi note son rang et rend aussitôt sa place, ce qui sert le suivant.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "test_util.h"
+#include "admission.h"
+#include "logger.h"
+
+#define MAX_JOBS 64
+
+typedef struct {
+    admission_work_t work;
+    int id;
+    bool granted;
+} job_t;
+
+static pthread_mutex_t order_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int order[MAX_JOBS];
+static int order_len = 0;
+
+static void configure(int max_ssh_work, int max_per_host, int queue_timeout_ms) {
+    admission_config_t cfg = {
+        .max_inflight = 4,
+        .max_per_client = 2,
+        .max_ssh_work = max_ssh_work,
+        .queue_timeout_ms = queue_timeout_ms,
+        .max_per_host = max_per_host
+    };
+    admission_init(&cfg);
+    order_len = 0;
+}
+
+static int stat_int(const char *name) {
+    char buf[1024], pattern[64];
+    admission_stats_json(buf, sizeof(buf));
+    snprintf(pattern, sizeof(pattern), "\"%s\":", name);
+    const char *p = strstr(buf, pattern);
+    return p ? atoi(p + strlen(pattern)) : -1;
+}
+
+static void wait_queued(int count) {
+    for (int i = 0; i < 2000 && stat_int("ssh_queued") < count; i++) usleep(1000);
+    CHECK_EQ_INT(stat_int("ssh_queued"), count);
+}
+
+static void make_work(admission_work_t *work, pid_t client, int weight, const char *session,
+                      const char *host) {
+    memset(work, 0, sizeof(*work));
+    work->client = client;
+    work->weight = weight;
+    snprintf(work->session_key, sizeof(work->session_key), "%s", session);
+    snprintf(work->host, sizeof(work->host), "%s", host);
+}
+
+static void* job_main(void *arg) {
+    job_t *job = arg;
+    uint32_t retry_after;
+    job->granted = admission_acquire_ssh(&job->work, &retry_after);
+    if (job->granted) {
+        pthread_mutex_lock(&order_mutex);
+        order[order_len++] = job->id;
+        pthread_mutex_unlock(&order_mutex);
+        admission_release_ssh(&job->work, 1.0);
+    }
+    return NULL;
+}
+
+/**
+ * Lancer les jobs pendant que la place unique est occupée, puis la libérer et attendre
+ */
+static void run_queued(job_t *jobs, int count) {
+    admission_work_t holder;
+    uint32_t retry_after;
+    make_work(&holder, 1, ADMISSION_WEIGHT_NORMAL, "holder", "");
+    CHECK(admission_acquire_ssh(&holder, &retry_after));
+
+    pthread_t threads[MAX_JOBS];
+    for (int i = 0; i < count; i++) {
+        jobs[i].id = i;
+        pthread_create(&threads[i], NULL, job_main, &jobs[i]);
+        // Ordre d'arrivée fixe : chaque job est en file avant le suivant
+        wait_queued(i + 1);
+    }
+    admission_release_ssh(&holder, 1.0);
+    for (int i = 0; i < count; i++) pthread_join(threads[i], NULL);
+    CHECK_EQ_INT(order_len, count);
+}
+
+static void test_parse_weight(void) {
+    CHECK_EQ_INT(admission_parse_weight(NULL, 0), ADMISSION_WEIGHT_NORMAL);
+    CHECK_EQ_INT(admission_parse_weight("batch", 0), ADMISSION_WEIGHT_BATCH);
+    CHECK_EQ_INT(admission_parse_weight("interactive", 0), ADMISSION_WEIGHT_INTERACTIVE);
+    CHECK_EQ_INT(admission_parse_weight("unknown", 0), ADMISSION_WEIGHT_NORMAL);
+    CHECK_EQ_INT(admission_parse_weight("batch", 7), 7);
+    CHECK_EQ_INT(admission_parse_weight(NULL, 1000), ADMISSION_MAX_WEIGHT);
+}
+
+static void test_inflight_limits(void) {
+    configure(1, 8, 1000);
+    uint32_t retry_after = 0;
+    CHECK(admission_enter(10, &retry_after));
+    CHECK(admission_enter(10, &retry_after));
+    // Limite par client (2) puis limite globale (4)
+    CHECK(!admission_enter(10, &retry_after));
+    CHECK(retry_after >= 50);
+    CHECK(admission_enter(11, &retry_after));
+    CHECK(admission_enter(12, &retry_after));
+    CHECK(!admission_enter(13, &retry_after));
+    CHECK_EQ_INT(stat_int("inflight"), 4);
+
+    admission_leave(10);
+    CHECK(admission_enter(13, &retry_after));
+    admission_leave(10);
+    admission_leave(11);
+    admission_leave(12);
+    admission_leave(13);
+    CHECK_EQ_INT(stat_int("inflight"), 0);
+}
+
+static void test_queue_timeout(void) {
+    configure(1, 8, 50);
+    admission_work_t a, b;
+    uint32_t retry_after = 0;
+    make_work(&a, 1, ADMISSION_WEIGHT_NORMAL, "s1", "h");
+    make_work(&b, 2, ADMISSION_WEIGHT_NORMAL, "s2", "h");
+    int expired = stat_int("expired");
+    CHECK(admission_acquire_ssh(&a, &retry_after));
+    CHECK(!admission_acquire_ssh(&b, &retry_after));
+    CHECK_EQ_INT(stat_int("expired"), expired + 1);
+    CHECK_EQ_INT(stat_int("ssh_queued"), 0);
+    CHECK_EQ_INT(stat_int("flows"), 0);
+    admission_release_ssh(&a, 1.0);
+
+    // La place et le flux abandonnés sont réutilisables
+    CHECK(admission_acquire_ssh(&b, &retry_after));
+    admission_release_ssh(&b, 1.0);
+}
+
+static void test_drr_shares_by_weight(void) {
+    // Client 100 en batch (poids 1) arrivé en premier, client 200 en normal (poids 4)
+    configure(1, 64, 5000);
+    job_t jobs[20];
+    for (int i = 0; i < 20; i++) {
+        char session[16];
+        snprintf(session, sizeof(session), "s%d", i);
+        bool batch = i < 10;
+        make_work(&jobs[i].work, batch ? 100 : 200,
+                  batch ? ADMISSION_WEIGHT_BATCH : ADMISSION_WEIGHT_NORMAL, session, "");
+    }
+    run_queued(jobs, 20);
+
+    // Sur les 10 premières places : environ 4 pour 1 en faveur du poids normal
+    int normal = 0, batch = 0;
+    for (int i = 0; i < 10; i++) {
+        if (order[i] >= 10) normal++;
+        else batch++;
+    }
+    CHECK(normal >= 7);
+    CHECK(batch >= 1);
+    for (int i = 0; i < 20; i++) CHECK(jobs[i].granted);
+}
+
+static void test_interactive_passes_batch_backlog(void) {
+    configure(1, 64, 5000);
+    job_t jobs[13];
+    for (int i = 0; i < 12; i++) {
+        char session[16];
+        snprintf(session, sizeof(session), "fan%d", i);
+        make_work(&jobs[i].work, 100, ADMISSION_WEIGHT_BATCH, session, "");
+    }
+    make_work(&jobs[12].work, 300, ADMISSION_WEIGHT_INTERACTIVE, "shell", "");
+    run_queued(jobs, 13);
+
+    int rank = -1;
+    for (int i = 0; i < order_len; i++) {
+        if (order[i] == 12) rank = i;
+    }
+    CHECK(rank >= 0 && rank <= 1);
+}
+
+static void test_sessions_round_robin_within_flow(void) {
+    // Un client, deux sessions : la session chargée ne passe pas devant l'autre
+    configure(1, 64, 5000);
+    job_t jobs[6];
+    for (int i = 0; i < 5; i++) make_work(&jobs[i].work, 100, ADMISSION_WEIGHT_NORMAL, "busy", "");
+    make_work(&jobs[5].work, 100, ADMISSION_WEIGHT_NORMAL, "other", "");
+    run_queued(jobs, 6);
+
+    int rank = -1;
+    for (int i = 0; i < order_len; i++) {
+        if (order[i] == 5) rank = i;
+    }
+    CHECK(rank >= 0 && rank <= 1);
+    // Ordre FIFO à l'intérieur d'une session
+    int last = -1;
+    for (int i = 0; i < order_len; i++) {
+        if (order[i] == 5) continue;
+        CHECK(order[i] > last);
+        last = order[i];
+    }
+}
+
+static void test_per_host_limit(void) {
+    configure(4, 1, 5000);
+    admission_work_t h1;
+    uint32_t retry_after;
+    make_work(&h1, 1, ADMISSION_WEIGHT_NORMAL, "a", "h1");
+    CHECK(admission_acquire_ssh(&h1, &retry_after));
+
+    job_t same = { .id = 0 }, other = { .id = 1 };
+    make_work(&same.work, 2, ADMISSION_WEIGHT_NORMAL, "b", "h1");
+    make_work(&other.work, 3, ADMISSION_WEIGHT_NORMAL, "c", "h2");
+    pthread_t t_same, t_other;
+    pthread_create(&t_same, NULL, job_main, &same);
+    wait_queued(1);
+    // h1 saturé : l'opération reste en file sans bloquer celle de h2
+    pthread_create(&t_other, NULL, job_main, &other);
+    pthread_join(t_other, NULL);
+    CHECK(other.granted);
+    CHECK_EQ_INT(stat_int("ssh_queued"), 1);
+    CHECK(stat_int("host_deferred") > 0);
+
+    admission_release_ssh(&h1, 1.0);
+    pthread_join(t_same, NULL);
+    CHECK(same.granted);
+    CHECK_EQ_INT(stat_int("ssh_running"), 0);
+}
+
+int main(void) {
+    logger_init(LOG_LEVEL_ERROR);
+
+    RUN_TEST(test_parse_weight);
+    RUN_TEST(test_inflight_limits);
+    RUN_TEST(test_queue_timeout);
+    RUN_TEST(test_drr_shares_by_weight);
+    RUN_TEST(test_interactive_passes_batch_backlog);
+    RUN_TEST(test_sessions_round_robin_within_flow);
+    RUN_TEST(test_per_host_limit);
+
+    logger_shutdown();
+    return TEST_RESULT();
+}
@@ -0,0 +1,299 @@
+/**
+ * Tests du delta de synchronisation : Adler-32 (bloc et glissant), MD5, analyse des
+ * signatures et aller-retour complet. Les signatures sont produites ici au format du
+ * script distant, le delta est capturé en mémoire puis appliqué comme le ferait le
+ * script de reconstruction.
+ */
+
+#include <stdint.h>
+
+#include "test_util.h"
+#include "delta.h"
+#include "md5.h"
+
+#define BLOCK 64
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} bytes_t;
+
+static int memory_sink(void *ctx, const void *data, size_t len) {
+    bytes_t *out = ctx;
+    if (out->len + len > out->cap) {
+        size_t cap = out->cap ? out->cap * 2 : 4096;
+        while (cap < out->len + len) cap *= 2;
+        uint8_t *grown = realloc(out->data, cap);
+        if (!grown) return -1;
+        out->data = grown;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    return 0;
+}
+
+static uint32_t be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * Signatures de old au format du script distant ("size N" puis "adler32 md5" par bloc)
+ */
+static char* make_signature(const uint8_t *old, size_t len, uint32_t block_size) {
+    size_t blocks = (len + block_size - 1) / block_size;
+    char *text = malloc(32 + blocks * 48);
+    int n = sprintf(text, "size %zu\n", len);
+    for (size_t off = 0; off < len; off += block_size) {
+        size_t l = len - off < block_size ? len - off : block_size;
+        uint32_t a, b;
+        uint8_t digest[16];
+        uint32_t weak = adler_block(old + off, l, &a, &b);
+        md5_digest(old + off, l, digest);
+        n += sprintf(text + n, "%08x ", weak);
+        for (int i = 0; i < 16; i++) n += sprintf(text + n, "%02x", digest[i]);
+        text[n++] = '\n';
+    }
+    text[n] = '\0';
+    return text;
+}
+
+/**
+ * Reconstruire le fichier à partir de old et du delta (comme le script d'application)
+ * @return 0, ou -1 si le flux est mal formé
+ */
+static int apply_delta(const uint8_t *old, size_t old_len, const bytes_t *delta, uint32_t block_size,
+                       bytes_t *out) {
+    size_t p = 0;
+    while (p + 9 <= delta->len) {
+        char op = (char)delta->data[p];
+        uint32_t x = be32(delta->data + p + 1), y = be32(delta->data + p + 5);
+        p += 9;
+        if (op == 'C') {
+            size_t start = (size_t)x * block_size;
+            size_t n = (size_t)y * block_size;
+            if (start > old_len) return -1;
+            if (start + n > old_len) n = old_len - start;   // Dernier bloc partiel
+            memory_sink(out, old + start, n);
+        } else if (op == 'L') {
+            if (p + x > delta->len) return -1;
+            memory_sink(out, delta->data + p, x);
+            p += x;
+        } else if (op == 'E') {
+            return p == delta->len ? 0 : -1;
+        } else {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Synchroniser old -> new en mémoire et vérifier la reconstruction
+ * @return true si delta_scan a conclu que rien n'était à envoyer
+ */
+static bool roundtrip(const uint8_t *old, size_t old_len, const uint8_t *new_data, size_t new_len,
+                      uint32_t *blocks_matched, size_t *delta_len) {
+    char *text = old ? make_signature(old, old_len, BLOCK) : strdup("missing\n");
+    signature_t sig;
+    CHECK_EQ_INT(signature_parse(text, BLOCK, &sig), 0);
+    free(text);
+
+    bytes_t delta = { 0 };
+    delta_writer_t w;
+    CHECK_EQ_INT(delta_writer_init(&w, memory_sink, &delta), 0);
+    *blocks_matched = 0;
+    bool unchanged = delta_scan(new_data, new_len, BLOCK, &sig, &w, blocks_matched);
+    if (!unchanged) {
+        CHECK_EQ_INT(delta_end(&w), 0);
+        bytes_t rebuilt = { 0 };
+        CHECK_EQ_INT(apply_delta(old, old_len, &delta, BLOCK, &rebuilt), 0);
+        CHECK_EQ_INT(rebuilt.len, new_len);
+        CHECK(rebuilt.len == new_len && (new_len == 0 || memcmp(rebuilt.data, new_data, new_len) == 0));
+        free(rebuilt.data);
+    }
+    *delta_len = delta.len;
+    delta_writer_free(&w);
+    signature_free(&sig);
+    free(delta.data);
+    return unchanged;
+}
+
+static uint8_t* random_bytes(size_t len, uint32_t seed) {
+    uint8_t *data = malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+    return data;
+}
+
+static void test_adler_reference(void) {
+    uint32_t a, b;
+    CHECK_EQ_INT(adler_block((const uint8_t *)"Wikipedia", 9, &a, &b), 0x11E60398);
+    CHECK_EQ_INT(adler_block((const uint8_t *)"", 0, &a, &b), 1);
+}
+
+static void test_adler_roll_matches_block(void) {
+    size_t len = 4096;
+    uint8_t *data = random_bytes(len, 7);
+    uint32_t a, b, n_mod = BLOCK % ADLER_MOD;
+    uint32_t weak = adler_block(data, BLOCK, &a, &b);
+    for (size_t pos = 0; pos + BLOCK < len; pos++) {
+        weak = adler_roll(&a, &b, data[pos], data[pos + BLOCK], n_mod);
+        uint32_t ra, rb;
+        uint32_t expected = adler_block(data + pos + 1, BLOCK, &ra, &rb);
+        if (weak != expected) {
+            CHECK_EQ_INT(weak, expected);
+            break;
+        }
+    }
+    free(data);
+}
+
+static void check_md5(const char *input, const char *expected_hex) {
+    uint8_t digest[16];
+    char hex[33];
+    md5_digest(input, strlen(input), digest);
+    for (int i = 0; i < 16; i++) sprintf(hex + i * 2, "%02x", digest[i]);
+    CHECK_EQ_STR(hex, expected_hex);
+}
+
+static void test_md5_rfc1321(void) {
+    check_md5("", "d41d8cd98f00b204e9800998ecf8427e");
+    check_md5("abc", "900150983cd24fb0d6963f7d28e17f72");
+    check_md5("message digest", "f96b697d7cb7938d525a2f31aaf161d0");
+    check_md5("12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+              "57edf4a22be3c955ac49da2e2107b67a");
+
+    // Mise à jour par morceaux de tailles variées = calcul d'un bloc
+    uint8_t *data = random_bytes(1000, 3);
+    uint8_t one[16], parts[16];
+    md5_digest(data, 1000, one);
+    md5_ctx_t ctx;
+    md5_init(&ctx);
+    for (size_t off = 0, step = 1; off < 1000; off += step, step = step * 2 + 1) {
+        md5_update(&ctx, data + off, off + step > 1000 ? 1000 - off : step);
+    }
+    md5_final(&ctx, parts);
+    CHECK(memcmp(one, parts, 16) == 0);
+    free(data);
+}
+
+static void test_signature_parse(void) {
+    signature_t sig;
+    CHECK_EQ_INT(signature_parse("missing\n", BLOCK, &sig), 0);
+    CHECK(sig.missing);
+    signature_free(&sig);
+
+    uint8_t *old = random_bytes(BLOCK * 3 + 10, 1);
+    char *text = make_signature(old, BLOCK * 3 + 10, BLOCK);
+    CHECK_EQ_INT(signature_parse(text, BLOCK, &sig), 0);
+    CHECK_EQ_INT(sig.count, 4);
+    CHECK_EQ_INT(sig.full_count, 3);
+    CHECK_EQ_INT(sig.last_len, 10);
+    signature_free(&sig);
+
+    // Bloc manquant, empreinte invalide, en-tête absent
+    text[strlen(text) - 40] = '\0';
+    CHECK(signature_parse(text, BLOCK, &sig) < 0);
+    signature_free(&sig);
+    CHECK(signature_parse("size 64\n0000zz01 0123\n", BLOCK, &sig) < 0);
+    signature_free(&sig);
+    CHECK(signature_parse("garbage", BLOCK, &sig) < 0);
+    signature_free(&sig);
+    free(text);
+    free(old);
+}
+
+static void test_identical_sends_nothing(void) {
+    size_t len = BLOCK * 20 + 17;
+    uint8_t *data = random_bytes(len, 2);
+    uint32_t matched;
+    size_t delta_len;
+    CHECK(roundtrip(data, len, data, len, &matched, &delta_len));
+    CHECK_EQ_INT(matched, 21);
+    CHECK_EQ_INT(delta_len, 0);
+    free(data);
+}
+
+static void test_insertion_reuses_blocks(void) {
+    size_t len = BLOCK * 40;
+    uint8_t *old = random_bytes(len, 4);
+    uint8_t *new_data = malloc(len + 5);
+    memcpy(new_data, old, BLOCK * 10 + 3);
+    memcpy(new_data + BLOCK * 10 + 3, "HELLO", 5);
+    memcpy(new_data + BLOCK * 10 + 8, old + BLOCK * 10 + 3, len - BLOCK * 10 - 3);
+    uint32_t matched;
+    size_t delta_len;
+    CHECK(!roundtrip(old, len, new_data, len + 5, &matched, &delta_len));
+    // Seul le bloc touché par l'insertion est renvoyé
+    CHECK_EQ_INT(matched, 39);
+    CHECK(delta_len < 3 * BLOCK);
+    free(old);
+    free(new_data);
+}
+
+static void test_reordered_and_truncated(void) {
+    size_t len = BLOCK * 8;
+    uint8_t *old = random_bytes(len, 5);
+    uint8_t *new_data = malloc(len);
+    // Blocs 4..7 puis 0..2 : copies déplacées, fichier plus court
+    memcpy(new_data, old + BLOCK * 4, BLOCK * 4);
+    memcpy(new_data + BLOCK * 4, old, BLOCK * 3);
+    uint32_t matched;
+    size_t delta_len;
+    CHECK(!roundtrip(old, len, new_data, BLOCK * 7, &matched, &delta_len));
+    CHECK_EQ_INT(matched, 7);
+    free(old);
+    free(new_data);
+}
+
+static void test_partial_last_block(void) {
+    size_t len = BLOCK * 5 + 20;
+    uint8_t *old = random_bytes(len, 6);
+    uint8_t *new_data = malloc(len);
+    memcpy(new_data, old, len);
+    new_data[BLOCK + 1] ^= 0xff;
+    uint32_t matched;
+    size_t delta_len;
+    CHECK(!roundtrip(old, len, new_data, len, &matched, &delta_len));
+    // Bloc 1 modifié ; les autres, dont le dernier bloc partiel, sont copiés
+    CHECK_EQ_INT(matched, 5);
+    free(old);
+    free(new_data);
+}
+
+static void test_missing_remote_sends_literal(void) {
+    size_t len = BLOCK * 3 + 1;
+    uint8_t *data = random_bytes(len, 8);
+    uint32_t matched;
+    size_t delta_len;
+    CHECK(!roundtrip(NULL, 0, data, len, &matched, &delta_len));
+    CHECK_EQ_INT(matched, 0);
+    CHECK_EQ_INT(delta_len, len + 2 * 9);  // L + données + E
+    free(data);
+}
+
+static void test_empty_files(void) {
+    uint32_t matched;
+    size_t delta_len;
+    uint8_t empty = 0;
+    CHECK(roundtrip(&empty, 0, &empty, 0, &matched, &delta_len));
+    CHECK(!roundtrip(NULL, 0, &empty, 0, &matched, &delta_len));
+}
+
+int main(void) {
+    RUN_TEST(test_adler_reference);
+    RUN_TEST(test_adler_roll_matches_block);
+    RUN_TEST(test_md5_rfc1321);
+    RUN_TEST(test_signature_parse);
+    RUN_TEST(test_identical_sends_nothing);
+    RUN_TEST(test_insertion_reuses_blocks);
+    RUN_TEST(test_reordered_and_truncated);
+    RUN_TEST(test_partial_last_block);
+    RUN_TEST(test_missing_remote_sends_literal);
+    RUN_TEST(test_empty_files);
+    return TEST_RESULT();
+}
@@ -0,0 +1,251 @@
+/**
+ * Tests de bout en bout sur le backend fake : connexion, exécution, filtre, cache, jobs
+ * et stdin passent par les vrais handlers, sans réseau ni sshd. Le dernier test mesure le
+ * débit d'exécution de l'agent (référence pour repérer une régression de performance).
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include <json-c/json.h>
+
+#include "test_util.h"
+#include "agent.h"
+#include "logger.h"
+#include "mem_budget.h"
+#include "ssh_handler.h"
+#include "result_cache.h"
+#include "admission.h"
+#include "job_store.h"
+
+#define BENCH_OUTPUT_BYTES (4 * 1024 * 1024)
+#define BENCH_RUNS 16
+
+/**
+ * Exécuter un handler et décoder sa réponse JSON
+ * @return La réponse décodée (à libérer avec json_object_put), NULL si elle est invalide
+ */
+static json_object* call(response_code_t (*handler)(const char*, char**), const char *request,
+                         response_code_t *code) {
+    char *response = NULL;
+    *code = handler(request, &response);
+    json_object *root = response ? json_tokener_parse(response) : NULL;
+    if (!root) fprintf(stderr, "  réponse invalide: %s\n", response ? response : "(null)");
+    free(response);
+    return root;
+}
+
+static int64_t get_int(json_object *root, const char *key) {
+    json_object *obj;
+    return json_object_object_get_ex(root, key, &obj) ? json_object_get_int64(obj) : -1;
+}
+
+static bool get_bool(json_object *root, const char *key) {
+    json_object *obj;
+    return json_object_object_get_ex(root, key, &obj) && json_object_get_boolean(obj);
+}
+
+/**
+ * Ouvrir une session fake ; fake_json : objet "fake" de la spécification
+ */
+static bool connect_fake(const char *host, const char *fake_json, char *session_id, size_t size) {
+    char request[512];
+    snprintf(request, sizeof(request),
+             "{\"host\":\"%s\",\"username\":\"bench\",\"backend\":\"fake\",\"fake\":%s}", host, fake_json);
+    response_code_t code;
+    json_object *root = call(handle_ssh_connect, request, &code);
+    json_object *id;
+    bool ok = code == RESP_OK && root && json_object_object_get_ex(root, "session_id", &id);
+    if (ok) snprintf(session_id, size, "%s", json_object_get_string(id));
+    if (root) json_object_put(root);
+    return ok;
+}
+
+static void disconnect(const char *session_id) {
+    char request[128];
+    snprintf(request, sizeof(request), "{\"session_id\":\"%s\"}", session_id);
+    char *response = NULL;
+    handle_ssh_disconnect(request, &response);
+    free(response);
+}
+
+static void test_execute_output(void) {
+    char id[64];
+    CHECK(connect_fake("exec", "{\"output_bytes\":100000,\"stderr_bytes\":10,\"exit_code\":3}", id, sizeof(id)));
+
+    char request[256];
+    snprintf(request, sizeof(request), "{\"session_id\":\"%s\",\"command\":\"gen\"}", id);
+    response_code_t code;
+    json_object *root = call(handle_ssh_execute, request, &code);
+    CHECK_EQ_INT(code, RESP_OK);
+    if (root) {
+        json_object *output, *err;
+        CHECK(json_object_object_get_ex(root, "output", &output));
+        CHECK_EQ_INT(json_object_get_string_len(output), 100000);
+        CHECK(strncmp(json_object_get_string(output), "krown fake output", 17) == 0);
+        CHECK(json_object_object_get_ex(root, "stderr", &err));
+        CHECK_EQ_INT(json_object_get_string_len(err), 10);
+        CHECK_EQ_INT(get_int(root, "exit_code"), 3);
+        CHECK_EQ_INT(get_int(root, "bytes_read"), 100000);
+        json_object_put(root);
+    }
+    disconnect(id);
+}
+
+static void test_execute_filter(void) {
+    char id[64];
+    CHECK(connect_fake("filter", "{\"output_bytes\":65000}", id, sizeof(id)));
+
+    char request[256];
+    snprintf(request, sizeof(request), "{\"session_id\":\"%s\",\"command\":\"gen\",\"head\":2}", id);
+    response_code_t code;
+    json_object *root = call(handle_ssh_execute, request, &code);
+    CHECK_EQ_INT(code, RESP_OK);
+    if (root) {
+        json_object *output;
+        CHECK(json_object_object_get_ex(root, "output", &output));
+        CHECK_EQ_STR(json_object_get_string(output),
+                     "krown fake output 0123456789 abcdefghijklmnopqrstuvwxyz ABCDEFGH\n"
+                     "krown fake output 0123456789 abcdefghijklmnopqrstuvwxyz ABCDEFGH\n");
+        CHECK(get_bool(root, "truncated"));
+        json_object_put(root);
+    }
+    disconnect(id);
+}
+
+static void test_cache_hit(void) {
+    char id[64];
+    CHECK(connect_fake("cache", "{\"output_bytes\":1000}", id, sizeof(id)));
+
+    char request[256];
+    snprintf(request, sizeof(request),
+             "{\"session_id\":\"%s\",\"command\":\"uname -a\",\"cache_ttl_ms\":60000}", id);
+    response_code_t code;
+    json_object *first = call(handle_ssh_execute, request, &code);
+    CHECK_EQ_INT(code, RESP_OK);
+    json_object *second = call(handle_ssh_execute, request, &code);
+    CHECK_EQ_INT(code, RESP_OK);
+    if (first && second) {
+        CHECK(!get_bool(first, "cached"));
+        CHECK(get_bool(second, "cached"));
+        CHECK_EQ_INT(get_int(second, "bytes_read"), 1000);
+    }
+    if (first) json_object_put(first);
+    if (second) json_object_put(second);
+    disconnect(id);
+}
+
+static long long memory_used(void) {
+    char buf[256];
+    mem_budget_stats_json(buf, sizeof(buf));
+    const char *p = strstr(buf, "\"used\":");
+    return p ? atoll(p + 7) : -1;
+}
+
+static void test_job_result_charged_to_budget(void) {
+    char id[64];
+    CHECK(connect_fake("job", "{\"output_bytes\":200000}", id, sizeof(id)));
+    long long base = memory_used();
+
+    char request[256];
+    snprintf(request, sizeof(request), "{\"session_id\":\"%s\",\"command\":\"gen\"}", id);
+    char *response = NULL;
+    CHECK_EQ_INT(handle_ssh_execute_async(request, 0, &response), RESP_OK);
+    json_object *root = response ? json_tokener_parse(response) : NULL;
+    free(response);
+    json_object *job_id;
+    CHECK(root && json_object_object_get_ex(root, "job_id", &job_id));
+    if (root && json_object_object_get_ex(root, "job_id", &job_id)) {
+        char wait[128];
+        snprintf(wait, sizeof(wait), "{\"job_id\":\"%s\"}", json_object_get_string(job_id));
+        response_code_t code;
+        json_object *result = call(handle_job_wait, wait, &code);
+        CHECK_EQ_INT(code, RESP_OK);
+        if (result) json_object_put(result);
+        // Le résultat conservé reste imputé au budget jusqu'à son retrait
+        CHECK(memory_used() >= base + 200000);
+
+        snprintf(wait, sizeof(wait), "{\"job_id\":\"%s\",\"remove\":true}", json_object_get_string(job_id));
+        result = call(handle_job_result, wait, &code);
+        CHECK_EQ_INT(code, RESP_OK);
+        if (result) json_object_put(result);
+        CHECK_EQ_INT(memory_used(), base);
+    }
+    if (root) json_object_put(root);
+    disconnect(id);
+}
+
+static void test_job_rejects_stdin(void) {
+    char id[64];
+    CHECK(connect_fake("job_stdin", "{}", id, sizeof(id)));
+    char request[256];
+    snprintf(request, sizeof(request), "{\"session_id\":\"%s\",\"command\":\"cat\",\"stdin\":\"stream\"}", id);
+    char *response = NULL;
+    // Refusé à la soumission : aucun job créé
+    CHECK_EQ_INT(handle_ssh_execute_async(request, 0, &response), RESP_ERROR);
+    CHECK(response && strstr(response, "stdin en flux indisponible") != NULL);
+    free(response);
+    char stats[512];
+    job_store_stats_json(stats, sizeof(stats));
+    CHECK(strstr(stats, "\"jobs\":0,") != NULL);
+    disconnect(id);
+}
+
+static void test_connect_errors_are_deterministic(void) {
+    // error_rate 1 : toute connexion échoue, sans dépendre de la graine
+    char id[64];
+    CHECK(!connect_fake("fail", "{\"error_rate\":1.0}", id, sizeof(id)));
+}
+
+/**
+ * Débit d'exécution sur le backend fake : tout le temps mesuré est du surcoût de l'agent
+ * (lecture du canal, échappement JSON, formatage de la réponse)
+ */
+static void bench_execute_throughput(void) {
+    char id[64];
+    char fake[64];
+    snprintf(fake, sizeof(fake), "{\"output_bytes\":%d}", BENCH_OUTPUT_BYTES);
+    CHECK(connect_fake("bench", fake, id, sizeof(id)));
+
+    char request[256];
+    snprintf(request, sizeof(request), "{\"session_id\":\"%s\",\"command\":\"gen\"}", id);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        char *response = NULL;
+        CHECK_EQ_INT(handle_ssh_execute(request, &response), RESP_OK);
+        CHECK(response && strlen(response) > BENCH_OUTPUT_BYTES);
+        free(response);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("  débit d'exécution (fake): %.1f Mo/s (%d × %d octets en %.3f s)\n",
+           (double)BENCH_OUTPUT_BYTES * BENCH_RUNS / (1024.0 * 1024.0) / seconds,
+           BENCH_RUNS, BENCH_OUTPUT_BYTES, seconds);
+    disconnect(id);
+}
+
+int main(void) {
+    logger_init(LOG_LEVEL_ERROR);
+    mem_budget_init(0);
+    if (ssh_handler_init() != 0) return 1;
+    fake_backend_init(NULL);
+    result_cache_init(0);
+    admission_init(NULL);
+    job_store_config_t jobs = { .workers = 2, .max_jobs = 16, .max_bytes = JOB_DEFAULT_MAX_BYTES,
+                                .ttl_ms = JOB_DEFAULT_TTL_MS };
+    if (job_store_init(&jobs) != 0) return 1;
+
+    RUN_TEST(test_execute_output);
+    RUN_TEST(test_execute_filter);
+    RUN_TEST(test_cache_hit);
+    RUN_TEST(test_job_result_charged_to_budget);
+    RUN_TEST(test_job_rejects_stdin);
+    RUN_TEST(test_connect_errors_are_deterministic);
+    RUN_TEST(bench_execute_throughput);
+
+    job_store_shutdown();
+    result_cache_cleanup();
+    ssh_handler_cleanup();
+    logger_shutdown();
+    return TEST_RESULT();
+}
@@ -0,0 +1,181 @@
+/**
+ * Tests du filtre de sortie : head / tail / grep / max_bytes sur des morceaux coupés
+ * n'importe où, comme ils arrivent du canal. La sortie retenue est écrite sur un fichier
+ * temporaire (octets bruts) puis relue.
+ */
+
+#include <unistd.h>
+#include <json-c/json.h>
+
+#include "test_util.h"
+#include "output_filter.h"
+#include "mem_budget.h"
+
+/**
+ * Filtrer les morceaux avec les options JSON données
+ * @return Code du dernier output_filter_feed (ou -2 si le filtre est refusé) ; out reçoit
+ *         la sortie retenue, *truncated l'indicateur du filtre
+ */
+static int run_filter(const char *options, const char **chunks, size_t count, char *out, size_t size,
+                      bool *truncated) {
+    json_object *root = json_tokener_parse(options);
+    output_filter_t *f = NULL;
+    const char *error = NULL;
+    int rc = output_filter_create(root, &f, &error);
+    json_object_put(root);
+    out[0] = '\0';
+    if (rc != 0 || !f) return -2;
+
+    FILE *tmp = tmpfile();
+    output_filter_set_fd(f, fileno(tmp), 0, NULL);
+    rc = FILTER_CONTINUE;
+    for (size_t i = 0; i < count && rc == FILTER_CONTINUE; i++) {
+        rc = output_filter_feed(f, chunks[i], strlen(chunks[i]), NULL);
+    }
+    if (rc != FILTER_ERROR && output_filter_finish(f, NULL) != 0) rc = FILTER_ERROR;
+    if (truncated) *truncated = output_filter_truncated(f);
+
+    ssize_t n = pread(fileno(tmp), out, size - 1, 0);
+    out[n > 0 ? n : 0] = '\0';
+    if ((size_t)(n > 0 ? n : 0) != output_filter_bytes(f)) rc = FILTER_ERROR;
+    fclose(tmp);
+    output_filter_free(f);
+    return rc;
+}
+
+static void test_head_across_chunks(void) {
+    const char *chunks[] = { "a\nb", "b\nc\nd\n" };
+    char out[64];
+    bool truncated;
+    CHECK_EQ_INT(run_filter("{\"head\":2}", chunks, 2, out, sizeof(out), &truncated), FILTER_COMPLETE);
+    CHECK_EQ_STR(out, "a\nbb\n");
+    CHECK(truncated);
+}
+
+static void test_tail_keeps_last_lines(void) {
+    const char *chunks[] = { "1\n2", "\n3\n", "4" };
+    char out[64];
+    bool truncated;
+    CHECK_EQ_INT(run_filter("{\"tail\":2}", chunks, 3, out, sizeof(out), &truncated), FILTER_CONTINUE);
+    CHECK_EQ_STR(out, "3\n4");
+    CHECK(truncated);
+}
+
+static void test_tail_shorter_than_output(void) {
+    const char *chunks[] = { "x\ny\n" };
+    char out[64];
+    bool truncated;
+    run_filter("{\"tail\":5}", chunks, 1, out, sizeof(out), &truncated);
+    CHECK_EQ_STR(out, "x\ny\n");
+    CHECK(!truncated);
+}
+
+static void test_grep_substring(void) {
+    const char *chunks[] = { "foo\nba", "r\nfoobar\n" };
+    char out[64];
+    run_filter("{\"grep\":\"foo\"}", chunks, 2, out, sizeof(out), NULL);
+    CHECK_EQ_STR(out, "foo\nfoobar\n");
+}
+
+static void test_grep_regex(void) {
+    const char *chunks[] = { "foo\nbar\nbaar\n" };
+    char out[64];
+    run_filter("{\"grep\":\"^ba?r$\",\"grep_regex\":true}", chunks, 1, out, sizeof(out), NULL);
+    CHECK_EQ_STR(out, "bar\n");
+}
+
+static void test_grep_then_head(void) {
+    // Ordre `grep | head` : head compte les lignes sélectionnées
+    const char *chunks[] = { "e1\nx\ne2\ny\ne3\n" };
+    char out[64];
+    CHECK_EQ_INT(run_filter("{\"grep\":\"e\",\"head\":2}", chunks, 1, out, sizeof(out), NULL), FILTER_COMPLETE);
+    CHECK_EQ_STR(out, "e1\ne2\n");
+}
+
+static void test_max_bytes_utf8_boundary(void) {
+    // "é" = 2 octets : la coupe à 3 octets ne garde qu'un caractère entier
+    const char *chunks[] = { "\xc3\xa9\xc3\xa9" };
+    char out[64];
+    bool truncated;
+    CHECK_EQ_INT(run_filter("{\"max_bytes\":3}", chunks, 1, out, sizeof(out), &truncated), FILTER_COMPLETE);
+    CHECK_EQ_STR(out, "\xc3\xa9");
+    CHECK(truncated);
+}
+
+static void test_tail_with_max_bytes_keeps_end(void) {
+    const char *chunks[] = { "aaa\nbb\nc\n" };
+    char out[64];
+    bool truncated;
+    run_filter("{\"tail\":3,\"max_bytes\":4}", chunks, 1, out, sizeof(out), &truncated);
+    CHECK_EQ_STR(out, "b\nc\n");
+    CHECK(truncated);
+}
+
+static void test_long_line_is_cut(void) {
+    size_t len = OUTPUT_FILTER_MAX_LINE + 100;
+    char *line = malloc(len + 2);
+    memset(line, 'x', len);
+    line[len] = '\n';
+    line[len + 1] = '\0';
+    const char *chunks[] = { line };
+    char *out = malloc(len + 2);
+    bool truncated;
+    run_filter("{\"grep\":\"x\"}", chunks, 1, out, len + 2, &truncated);
+    CHECK_EQ_INT(strlen(out), OUTPUT_FILTER_MAX_LINE + 1);
+    CHECK(truncated);
+    free(out);
+    free(line);
+}
+
+static void test_invalid_options(void) {
+    char out[8];
+    const char *chunks[] = { "" };
+    CHECK_EQ_INT(run_filter("{\"head\":-1}", chunks, 1, out, sizeof(out), NULL), -2);
+    CHECK_EQ_INT(run_filter("{\"grep\":\"(\",\"grep_regex\":true}", chunks, 1, out, sizeof(out), NULL), -2);
+    CHECK_EQ_INT(run_filter("{\"tail\":1000000}", chunks, 1, out, sizeof(out), NULL), -2);
+
+    // Aucune option : pas de filtre
+    json_object *root = json_tokener_parse("{\"command\":\"ls\"}");
+    output_filter_t *f = (output_filter_t *)1;
+    const char *error = NULL;
+    CHECK_EQ_INT(output_filter_create(root, &f, &error), 0);
+    CHECK(f == NULL);
+    json_object_put(root);
+}
+
+static void test_cache_key_distinguishes_filters(void) {
+    const char *options[] = { "{\"head\":1}", "{\"tail\":1}", "{\"grep\":\"a\"}",
+                              "{\"grep\":\"a\",\"grep_regex\":true}" };
+    char keys[4][128];
+    for (int i = 0; i < 4; i++) {
+        json_object *root = json_tokener_parse(options[i]);
+        output_filter_t *f = NULL;
+        const char *error = NULL;
+        CHECK_EQ_INT(output_filter_create(root, &f, &error), 0);
+        json_object_put(root);
+        keys[i][0] = '\0';
+        if (f) output_filter_key(f, keys[i], sizeof(keys[i]));
+        output_filter_free(f);
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = i + 1; j < 4; j++) CHECK(strcmp(keys[i], keys[j]) != 0);
+    }
+}
+
+int main(void) {
+    mem_budget_init(0);
+
+    RUN_TEST(test_head_across_chunks);
+    RUN_TEST(test_tail_keeps_last_lines);
+    RUN_TEST(test_tail_shorter_than_output);
+    RUN_TEST(test_grep_substring);
+    RUN_TEST(test_grep_regex);
+    RUN_TEST(test_grep_then_head);
+    RUN_TEST(test_max_bytes_utf8_boundary);
+    RUN_TEST(test_tail_with_max_bytes_keeps_end);
+    RUN_TEST(test_long_line_is_cut);
+    RUN_TEST(test_invalid_options);
+    RUN_TEST(test_cache_key_distinguishes_filters);
+
+    return TEST_RESULT();
+}
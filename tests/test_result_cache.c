@@ -0,0 +1,294 @@
+/**
+ * Tests du cache de résultats : succès / échec, TTL, réponses non conservées, éviction LRU,
+ * imputation au budget mémoire global et regroupement des requêtes identiques (attente, échéance, annulation). Les attentes
+ * concurrentes passent par un thread qui appelle result_cache_begin pendant que le test
+ * garde le ticket.
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test_util.h"
+#include "result_cache.h"
+#include "exec_registry.h"
+#include "logger.h"
+#include "mem_budget.h"
+
+typedef struct {
+    uint64_t hits, misses, coalesced, evictions, expirations;
+    size_t entries;
+} cache_stats_t;
+
+static cache_stats_t stats(void) {
+    char buf[512];
+    cache_stats_t s = { 0 };
+    size_t bytes, max;
+    result_cache_stats_json(buf, sizeof(buf));
+    sscanf(buf, "{\"entries\":%zu,\"bytes\":%zu,\"max_bytes\":%zu,\"hits\":%" SCNu64 ",\"misses\":%" SCNu64
+                ",\"coalesced\":%" SCNu64 ",\"evictions\":%" SCNu64 ",\"expirations\":%" SCNu64 "}",
+           &s.entries, &bytes, &max, &s.hits, &s.misses, &s.coalesced, &s.evictions, &s.expirations);
+    return s;
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static long long memory_stat(const char *name) {
+    char buf[256], pattern[32];
+    mem_budget_stats_json(buf, sizeof(buf));
+    snprintf(pattern, sizeof(pattern), "\"%s\":", name);
+    const char *p = strstr(buf, pattern);
+    return p ? atoll(p + strlen(pattern)) : -1;
+}
+
+static void reset(size_t max_bytes) {
+    result_cache_cleanup();
+    result_cache_init(max_bytes);
+}
+
+/**
+ * Chercher key ; sur CACHE_MISS, publier value avec code et ttl_ms
+ * @return Résultat de la recherche ; *out reçoit la réponse d'un CACHE_HIT (à libérer)
+ */
+static cache_lookup_t lookup_or_store(const char *key, const char *value, response_code_t code,
+                                      uint32_t ttl_ms, char **out) {
+    cache_entry_t *ticket;
+    response_code_t got;
+    *out = NULL;
+    cache_lookup_t r = result_cache_begin(key, 0, NULL, out, &got, &ticket);
+    if (r == CACHE_MISS) result_cache_finish(ticket, value, code, ttl_ms);
+    return r;
+}
+
+static void test_miss_then_hit(void) {
+    reset(0);
+    cache_stats_t before = stats();
+    char *out;
+    CHECK_EQ_INT(lookup_or_store("h\nuname", "{\"output\":\"Linux\"}", RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("h\nuname", "autre", RESP_OK, 60000, &out), CACHE_HIT);
+    CHECK_EQ_STR(out, "{\"output\":\"Linux\"}");
+    free(out);
+
+    // Autre clé : pas de collision
+    CHECK_EQ_INT(lookup_or_store("h2\nuname", "x", RESP_OK, 60000, &out), CACHE_MISS);
+
+    cache_stats_t after = stats();
+    CHECK_EQ_INT(after.hits - before.hits, 1);
+    CHECK_EQ_INT(after.misses - before.misses, 2);
+    CHECK_EQ_INT(after.entries, 2);
+}
+
+static void test_ttl_expiry(void) {
+    reset(0);
+    cache_stats_t before = stats();
+    char *out;
+    CHECK_EQ_INT(lookup_or_store("ttl", "v1", RESP_OK, 30, &out), CACHE_MISS);
+    usleep(60 * 1000);
+    CHECK_EQ_INT(lookup_or_store("ttl", "v2", RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("ttl", NULL, RESP_OK, 0, &out), CACHE_HIT);
+    CHECK_EQ_STR(out, "v2");
+    free(out);
+    CHECK_EQ_INT(stats().expirations - before.expirations, 1);
+}
+
+static void test_errors_and_zero_ttl_not_kept(void) {
+    reset(0);
+    char *out;
+    CHECK_EQ_INT(lookup_or_store("err", "{\"error\":\"x\"}", RESP_ERROR, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("err", "ok", RESP_OK, 0, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("err", "ok", RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(stats().entries, 1);
+
+    // Échec d'allocation de l'appelant : finish(NULL) libère le ticket sans rien garder
+    CHECK_EQ_INT(lookup_or_store("null", NULL, RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("null", "v", RESP_OK, 60000, &out), CACHE_MISS);
+}
+
+static void test_lru_eviction(void) {
+    // Entrées d'environ 600 octets (sous le huitième du budget) : une douzaine tiennent en 8 Ko
+    reset(8 * 1024);
+    char value[512];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    char *out;
+    cache_stats_t before = stats();
+    lookup_or_store("a", value, RESP_OK, 60000, &out);
+    lookup_or_store("b", value, RESP_OK, 60000, &out);
+    lookup_or_store("c", value, RESP_OK, 60000, &out);
+    // "a" redevient la plus récente : "b" est évincée la première
+    CHECK_EQ_INT(lookup_or_store("a", NULL, RESP_OK, 0, &out), CACHE_HIT);
+    free(out);
+    for (int i = 0; i < 12; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%d", i);
+        lookup_or_store(key, value, RESP_OK, 60000, &out);
+        if (i == 8) {
+            CHECK_EQ_INT(lookup_or_store("a", NULL, RESP_OK, 0, &out), CACHE_HIT);
+            free(out);
+        }
+    }
+    CHECK(stats().evictions > before.evictions);
+    CHECK_EQ_INT(lookup_or_store("b", NULL, RESP_OK, 0, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("a", NULL, RESP_OK, 0, &out), CACHE_HIT);
+    free(out);
+
+    // Au-delà d'un huitième du budget : jamais conservée
+    char *big = malloc(2048);
+    memset(big, 'x', 2047);
+    big[2047] = '\0';
+    CHECK_EQ_INT(lookup_or_store("big", big, RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("big", NULL, RESP_OK, 0, &out), CACHE_MISS);
+    free(big);
+}
+
+typedef struct {
+    const char *key;
+    int64_t deadline_ms;
+    exec_handle_t *handle;
+    cache_lookup_t result;
+    char *response;
+    response_code_t code;
+    atomic_bool started;
+} waiter_t;
+
+static void* waiter_main(void *arg) {
+    waiter_t *w = arg;
+    cache_entry_t *ticket = NULL;
+    atomic_store(&w->started, true);
+    w->result = result_cache_begin(w->key, w->deadline_ms, w->handle, &w->response, &w->code, &ticket);
+    // Résultat non partagé : le thread devient propriétaire et publie une erreur
+    if (w->result == CACHE_MISS) result_cache_finish(ticket, "{\"error\":\"waiter\"}", RESP_ERROR, 0);
+    return NULL;
+}
+
+/**
+ * Prendre le ticket de key puis lancer un thread qui attend la même clé
+ */
+static cache_entry_t* start_waiter(waiter_t *w, pthread_t *thread) {
+    cache_entry_t *ticket;
+    char *out = NULL;
+    response_code_t code;
+    CHECK_EQ_INT(result_cache_begin(w->key, 0, NULL, &out, &code, &ticket), CACHE_MISS);
+    atomic_store(&w->started, false);
+    pthread_create(thread, NULL, waiter_main, w);
+    while (!atomic_load(&w->started)) usleep(1000);
+    usleep(30 * 1000);     // Laisser le thread entrer dans l'attente
+    return ticket;
+}
+
+static void test_coalesced_waiter_shares_result(void) {
+    reset(0);
+    cache_stats_t before = stats();
+    waiter_t w = { .key = "shared" };
+    pthread_t thread;
+    cache_entry_t *ticket = start_waiter(&w, &thread);
+    result_cache_finish(ticket, "{\"output\":\"once\"}", RESP_OK, 60000);
+    pthread_join(thread, NULL);
+    CHECK_EQ_INT(w.result, CACHE_HIT);
+    CHECK_EQ_INT(w.code, RESP_OK);
+    CHECK_EQ_STR(w.response, "{\"output\":\"once\"}");
+    CHECK_EQ_INT(stats().coalesced - before.coalesced, 1);
+    free(w.response);
+}
+
+static void test_waiter_reruns_after_error(void) {
+    reset(0);
+    waiter_t w = { .key = "failing" };
+    pthread_t thread;
+    cache_entry_t *ticket = start_waiter(&w, &thread);
+    // Erreur du propriétaire : jamais transmise, le thread exécute lui-même
+    result_cache_finish(ticket, "{\"error\":\"owner\"}", RESP_ERROR, 60000);
+    pthread_join(thread, NULL);
+    CHECK_EQ_INT(w.result, CACHE_MISS);
+    CHECK(w.response == NULL);
+}
+
+static void test_waiter_deadline(void) {
+    reset(0);
+    waiter_t w = { .key = "slow", .deadline_ms = monotonic_ms() + 80 };
+    pthread_t thread;
+    cache_entry_t *ticket = start_waiter(&w, &thread);
+    pthread_join(thread, NULL);
+    CHECK_EQ_INT(w.result, CACHE_TIMED_OUT);
+    CHECK(w.response == NULL);
+    result_cache_finish(ticket, "late", RESP_OK, 60000);
+
+    char *out;
+    CHECK_EQ_INT(lookup_or_store("slow", NULL, RESP_OK, 0, &out), CACHE_HIT);
+    CHECK_EQ_STR(out, "late");
+    free(out);
+}
+
+static void test_waiter_cancelled(void) {
+    reset(0);
+    exec_handle_t *handle = exec_registry_register("cache-test");
+    waiter_t w = { .key = "cancel", .handle = handle };
+    pthread_t thread;
+    cache_entry_t *ticket = start_waiter(&w, &thread);
+    CHECK_EQ_INT(exec_registry_cancel("cache-test"), 0);
+    pthread_join(thread, NULL);
+    CHECK_EQ_INT(w.result, CACHE_CANCELLED);
+    result_cache_finish(ticket, "done", RESP_OK, 60000);
+    exec_registry_unregister(handle);
+}
+
+static void test_entries_charged_to_budget(void) {
+    reset(0);
+    char value[1000];
+    memset(value, 'm', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    char *out;
+    long long base = memory_stat("used");
+    lookup_or_store("old", value, RESP_OK, 60000, &out);
+    CHECK(memory_stat("used") >= base + (long long)sizeof(value));
+
+    // Budget global presque plein : "old" cède sa place à "new"
+    mem_budget_init(1024 * 1024);
+    long long fill = (long long)mem_budget_limit() - memory_stat("used") - 500;
+    mem_budget_hold((ptrdiff_t)fill);
+    long long refused = memory_stat("refused");
+    CHECK_EQ_INT(lookup_or_store("new", value, RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("old", NULL, RESP_OK, 0, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("new", NULL, RESP_OK, 0, &out), CACHE_HIT);
+    free(out);
+
+    // Même en évinçant tout, l'entrée ne tient pas : non conservée, sans refus compté
+    char big[4000];
+    memset(big, 'b', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    CHECK_EQ_INT(lookup_or_store("big", big, RESP_OK, 60000, &out), CACHE_MISS);
+    CHECK_EQ_INT(lookup_or_store("big", NULL, RESP_OK, 0, &out), CACHE_MISS);
+    CHECK_EQ_INT(memory_stat("refused"), refused);
+    mem_budget_hold(-(ptrdiff_t)fill);
+    mem_budget_init(0);
+
+    reset(0);
+    CHECK_EQ_INT(memory_stat("used"), base);
+}
+
+int main(void) {
+    logger_init(LOG_LEVEL_ERROR);
+    mem_budget_init(0);
+    result_cache_init(0);
+
+    RUN_TEST(test_miss_then_hit);
+    RUN_TEST(test_ttl_expiry);
+    RUN_TEST(test_errors_and_zero_ttl_not_kept);
+    RUN_TEST(test_lru_eviction);
+    RUN_TEST(test_coalesced_waiter_shares_result);
+    RUN_TEST(test_waiter_reruns_after_error);
+    RUN_TEST(test_waiter_deadline);
+    RUN_TEST(test_waiter_cancelled);
+    RUN_TEST(test_entries_charged_to_budget);
+
+    result_cache_cleanup();
+    logger_shutdown();
+    return TEST_RESULT();
+}
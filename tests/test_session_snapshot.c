@@ -0,0 +1,182 @@
+/**
+ * Tests de la vue des sessions : versions par entrée, publication sans changement, délai
+ * de grâce (une vue tenue par un lecteur n'est pas libérée) et lectures concurrentes
+ * pendant des publications en rafale.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "test_util.h"
+#include "session_snapshot.h"
+#include "logger.h"
+
+#define SLOTS 8
+
+static ssh_session_t slots[SLOTS];
+
+static void make_entry(session_entry_t *e, int slot, bool connected) {
+    memset(e, 0, sizeof(*e));
+    e->sess = &slots[slot];
+    snprintf(e->session_id, sizeof(e->session_id), "session_%d", slot);
+    e->backend = "fake";
+    snprintf(e->host, sizeof(e->host), "host%d", slot);
+    e->port = 22;
+    e->connected = connected;
+}
+
+static uint64_t current_version(void) {
+    unsigned token;
+    const session_snapshot_t *snap = session_snapshot_acquire(&token);
+    uint64_t version = snap ? snap->version : 0;
+    session_snapshot_release(token);
+    return version;
+}
+
+static void test_initial_view_is_empty(void) {
+    unsigned token;
+    const session_snapshot_t *snap = session_snapshot_acquire(&token);
+    CHECK(snap != NULL);
+    if (snap) {
+        CHECK_EQ_INT(snap->count, 0);
+        CHECK_EQ_INT(snap->version, session_snapshot_base_version());
+    }
+    session_snapshot_release(token);
+}
+
+static void test_versions_per_entry(void) {
+    session_entry_t entries[3];
+    make_entry(&entries[0], 0, true);
+    make_entry(&entries[1], 1, true);
+    uint64_t v0 = current_version();
+    session_snapshot_publish(entries, 2);
+    uint64_t v1 = current_version();
+    CHECK_EQ_INT(v1, v0 + 1);
+
+    // Même état : vue conservée, version inchangée
+    unsigned token;
+    const session_snapshot_t *before = session_snapshot_acquire(&token);
+    session_snapshot_release(token);
+    session_snapshot_publish(entries, 2);
+    const session_snapshot_t *after = session_snapshot_acquire(&token);
+    CHECK(after == before);
+    CHECK_EQ_INT(after->version, v1);
+    session_snapshot_release(token);
+
+    // Déconnexion de l'entrée 1 et ajout de l'entrée 2 : l'entrée 0 garde sa version
+    entries[1].connected = false;
+    make_entry(&entries[2], 2, true);
+    session_snapshot_publish(entries, 3);
+    const session_snapshot_t *snap = session_snapshot_acquire(&token);
+    CHECK_EQ_INT(snap->version, v1 + 1);
+    CHECK_EQ_INT(snap->count, 3);
+    CHECK_EQ_INT(snap->entries[0].version, v1);
+    CHECK_EQ_INT(snap->entries[1].version, v1 + 1);
+    CHECK_EQ_INT(snap->entries[2].version, v1 + 1);
+    CHECK_EQ_STR(snap->entries[2].session_id, "session_2");
+    session_snapshot_release(token);
+
+    // Retrait d'une entrée : nouvelle version même si les restantes sont inchangées
+    session_snapshot_publish(entries, 2);
+    CHECK_EQ_INT(current_version(), v1 + 2);
+}
+
+typedef struct {
+    session_entry_t entries[SLOTS];
+    int count;
+    atomic_bool done;
+} publisher_t;
+
+static void* publish_main(void *arg) {
+    publisher_t *p = arg;
+    session_snapshot_publish(p->entries, p->count);
+    atomic_store(&p->done, true);
+    return NULL;
+}
+
+static void test_grace_period_waits_for_reader(void) {
+    session_entry_t one;
+    make_entry(&one, 0, true);
+    session_snapshot_publish(&one, 1);
+
+    unsigned token;
+    const session_snapshot_t *held = session_snapshot_acquire(&token);
+    uint64_t held_version = held->version;
+
+    publisher_t p = { .count = 2 };
+    make_entry(&p.entries[0], 3, true);
+    make_entry(&p.entries[1], 4, true);
+    atomic_init(&p.done, false);
+    pthread_t writer;
+    pthread_create(&writer, NULL, publish_main, &p);
+
+    // La nouvelle vue est publiée, mais l'ancienne reste intacte tant qu'elle est tenue
+    for (int i = 0; i < 1000 && current_version() == held_version; i++) usleep(1000);
+    CHECK_EQ_INT(current_version(), held_version + 1);
+    usleep(30 * 1000);
+    CHECK(!atomic_load(&p.done));
+    CHECK_EQ_INT(held->count, 1);
+    CHECK_EQ_STR(held->entries[0].session_id, "session_0");
+
+    session_snapshot_release(token);
+    pthread_join(writer, NULL);
+    CHECK(atomic_load(&p.done));
+}
+
+static atomic_bool stop_readers;
+static atomic_int torn_reads;
+
+// Chaque vue publiée par le test de charge a count entrées de port == count
+static void* reader_main(void *arg) {
+    (void)arg;
+    while (!atomic_load(&stop_readers)) {
+        unsigned token;
+        const session_snapshot_t *snap = session_snapshot_acquire(&token);
+        for (int i = 0; snap && i < snap->count; i++) {
+            if (snap->entries[i].port != snap->count || snap->entries[i].sess != &slots[i]) {
+                atomic_fetch_add(&torn_reads, 1);
+            }
+        }
+        session_snapshot_release(token);
+    }
+    return NULL;
+}
+
+static void test_concurrent_readers(void) {
+    pthread_t readers[4];
+    atomic_store(&stop_readers, false);
+    atomic_store(&torn_reads, 0);
+    for (int i = 0; i < 4; i++) pthread_create(&readers[i], NULL, reader_main, NULL);
+
+    session_entry_t entries[SLOTS];
+    uint64_t start = current_version();
+    for (int round = 0; round < 2000; round++) {
+        int count = 1 + round % SLOTS;
+        for (int i = 0; i < count; i++) {
+            make_entry(&entries[i], i, true);
+            entries[i].port = count;
+        }
+        session_snapshot_publish(entries, count);
+    }
+    atomic_store(&stop_readers, true);
+    for (int i = 0; i < 4; i++) pthread_join(readers[i], NULL);
+
+    CHECK_EQ_INT(atomic_load(&torn_reads), 0);
+    CHECK_EQ_INT(current_version(), start + 2000);
+}
+
+int main(void) {
+    logger_init(LOG_LEVEL_ERROR);
+    session_snapshot_init();
+
+    RUN_TEST(test_initial_view_is_empty);
+    RUN_TEST(test_versions_per_entry);
+    RUN_TEST(test_grace_period_waits_for_reader);
+    RUN_TEST(test_concurrent_readers);
+
+    session_snapshot_shutdown();
+    logger_shutdown();
+    return TEST_RESULT();
+}
@@ -0,0 +1,100 @@
+/**
+ * Tests de la reprise à chaud : reprise en arrière-plan, spécifications en échec gardées
+ * dans le fichier d'état avec leur nombre de reprises manquées, puis abandonnées au-delà
+ * de SESSION_STATE_MAX_RESTORE_FAILURES. Les hôtes sont injoignables (port 1 en local) :
+ * chaque reprise échoue.
+ */
+
+#include <unistd.h>
+#include <json-c/json.h>
+
+#include "test_util.h"
+#include "session_state.h"
+#include "ssh_handler.h"
+#include "logger.h"
+#include "mem_budget.h"
+
+static char state_path[64];
+
+static void write_state(const char *json) {
+    FILE *f = fopen(state_path, "w");
+    fputs(json, f);
+    fclose(f);
+}
+
+/**
+ * Lancer une reprise complète et relire le fichier d'état
+ * @return Tableau "sessions" (à libérer avec json_object_put), NULL si le fichier est invalide
+ */
+static json_object* restore_and_read(void) {
+    CHECK_EQ_INT(session_state_restore_start(4), 0);
+    session_state_shutdown();
+    CHECK(!session_state_restoring());
+
+    json_object *root = json_object_from_file(state_path);
+    json_object *specs = NULL;
+    if (root && json_object_object_get_ex(root, "sessions", &specs)) json_object_get(specs);
+    if (root) json_object_put(root);
+    return specs;
+}
+
+static int failures_of(json_object *specs, const char *session_id) {
+    for (size_t i = 0; specs && i < json_object_array_length(specs); i++) {
+        json_object *spec = json_object_array_get_idx(specs, i), *obj;
+        if (json_object_object_get_ex(spec, "session_id", &obj) &&
+            strcmp(json_object_get_string(obj), session_id) == 0) {
+            return json_object_object_get_ex(spec, "restore_failures", &obj) ? json_object_get_int(obj) : 0;
+        }
+    }
+    return -1;
+}
+
+static void test_failed_specs_are_retained(void) {
+    write_state("{\"version\":1,\"sessions\":["
+                "{\"session_id\":\"session_a\",\"host\":\"127.0.0.1\",\"port\":1,\"username\":\"u\",\"persist\":true},"
+                "{\"session_id\":\"session_b\",\"host\":\"127.0.0.1\",\"port\":1,\"username\":\"u\","
+                "\"via_session_id\":\"session_a\",\"persist\":true}]}");
+
+    for (int boot = 1; boot < SESSION_STATE_MAX_RESTORE_FAILURES; boot++) {
+        json_object *specs = restore_and_read();
+        CHECK(specs != NULL);
+        CHECK_EQ_INT(failures_of(specs, "session_a"), boot);
+        // Bastion absent : la session rebond est gardée elle aussi
+        CHECK_EQ_INT(failures_of(specs, "session_b"), boot);
+        CHECK(!session_state_restore_pending("session_a"));
+        if (specs) json_object_put(specs);
+    }
+
+    json_object *specs = restore_and_read();
+    CHECK(specs != NULL);
+    if (specs) {
+        CHECK_EQ_INT(json_object_array_length(specs), 0);
+        json_object_put(specs);
+    }
+}
+
+static void test_missing_or_empty_state(void) {
+    unlink(state_path);
+    CHECK_EQ_INT(session_state_restore_start(4), 0);
+    CHECK(!session_state_restoring());
+    write_state("{\"version\":1,\"sessions\":[]}");
+    CHECK_EQ_INT(session_state_restore_start(4), 0);
+    CHECK(!session_state_restoring());
+    session_state_shutdown();
+}
+
+int main(void) {
+    logger_init(LOG_LEVEL_ERROR);
+    mem_budget_init(0);
+    if (ssh_handler_init() != 0) return 1;
+    snprintf(state_path, sizeof(state_path), "/tmp/krown-test-state-%d.json", (int)getpid());
+    session_state_init(state_path);
+
+    RUN_TEST(test_failed_specs_are_retained);
+    RUN_TEST(test_missing_or_empty_state);
+
+    unlink(state_path);
+    ssh_handler_cleanup();
+    logger_shutdown();
+    return TEST_RESULT();
+}
@@ -0,0 +1,91 @@
+/**
+ * Tests de la lecture des commandes : descripteurs joints (SCM_RIGHTS) passés en
+ * O_NONBLOCK le temps de la requête puis rendus au client avec leurs drapeaux d'origine.
+ */
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "test_util.h"
+#include "socket_server.h"
+#include "logger.h"
+
+/**
+ * Envoyer une commande vide accompagnée de count descripteurs
+ */
+static void send_command(int sock, uint32_t version, const int *fds, int count) {
+    uint32_t header[3] = { version, CMD_PING, 0 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * COMMAND_MAX_FDS)];
+    } control;
+    struct iovec iov = { .iov_base = header, .iov_len = sizeof(header) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = CMSG_SPACE(sizeof(int) * count),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    CHECK_EQ_INT(sendmsg(sock, &msg, 0), sizeof(header));
+}
+
+static void test_received_fds_restored(void) {
+    int sv[2], in[2], out[2];
+    CHECK_EQ_INT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    CHECK_EQ_INT(pipe(in), 0);
+    CHECK_EQ_INT(pipe(out), 0);
+    // Le second descripteur est déjà non bloquant côté client : il doit le rester
+    fcntl(out[1], F_SETFL, fcntl(out[1], F_GETFL) | O_NONBLOCK);
+
+    int passed[2] = { in[0], out[1] };
+    send_command(sv[0], PROTOCOL_VERSION, passed, 2);
+    command_t *cmd = NULL;
+    CHECK_EQ_INT(socket_read_command(sv[1], &cmd), 0);
+    CHECK(cmd != NULL);
+    if (cmd) {
+        CHECK_EQ_INT(cmd->fd_count, 2);
+        // Description de fichier partagée : le drapeau est visible côté client
+        CHECK(fcntl(in[0], F_GETFL) & O_NONBLOCK);
+        socket_close_fds(cmd);
+        CHECK_EQ_INT(cmd->fd_count, 0);
+        free(cmd);
+    }
+    CHECK(!(fcntl(in[0], F_GETFL) & O_NONBLOCK));
+    CHECK(fcntl(out[1], F_GETFL) & O_NONBLOCK);
+
+    close(in[0]); close(in[1]);
+    close(out[0]); close(out[1]);
+    close(sv[0]); close(sv[1]);
+}
+
+static void test_bad_version_restores_fds(void) {
+    int sv[2], p[2];
+    CHECK_EQ_INT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    CHECK_EQ_INT(pipe(p), 0);
+
+    send_command(sv[0], PROTOCOL_VERSION + 1, &p[1], 1);
+
+    command_t *cmd = NULL;
+    CHECK_EQ_INT(socket_read_command(sv[1], &cmd), -1);
+    CHECK(!(fcntl(p[1], F_GETFL) & O_NONBLOCK));
+
+    close(p[0]); close(p[1]);
+    close(sv[0]); close(sv[1]);
+}
+
+int main(void) {
+    logger_init(LOG_LEVEL_ERROR);
+
+    RUN_TEST(test_received_fds_restored);
+    RUN_TEST(test_bad_version_restores_fds);
+
+    logger_shutdown();
+    return TEST_RESULT();
+}
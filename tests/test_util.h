@@ -0,0 +1,46 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+// Mini-harnais des tests : chaque binaire tests/test_*.c est lancé par `make test`
+// (NDEBUG est défini par CFLAGS : pas d'assert(), les vérifications passent par CHECK)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "  ✗ %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ_INT(actual, expected) do { \
+    long long a_ = (long long)(actual), e_ = (long long)(expected); \
+    if (a_ != e_) { \
+        fprintf(stderr, "  ✗ %s:%d: %s = %lld, attendu %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ_STR(actual, expected) do { \
+    const char *a_ = (actual), *e_ = (expected); \
+    if (!a_ || strcmp(a_, e_) != 0) { \
+        fprintf(stderr, "  ✗ %s:%d: %s = \"%s\", attendu \"%s\"\n", __FILE__, __LINE__, #actual, \
+                a_ ? a_ : "(null)", e_); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define RUN_TEST(fn) do { \
+    int before_ = test_failures; \
+    fn(); \
+    printf("%s %s\n", test_failures == before_ ? "✓" : "✗", #fn); \
+} while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : (fprintf(stderr, "%d vérification(s) en échec\n", \
+                                                         test_failures), 1))
+
+#endif // TEST_UTIL_H